@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+
+# Measures the cost of making a context with lg_create_context() and
+# with lg_clone_context(), as for a context per task, for programs with
+# increasing numbers of patterns.
+#
+# usage: LD_LIBRARY_PATH=src/lib/.libs benchmarks/clone.py [RUNS]
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'pylightgrep'))
+
+import lightgrep as lg
+
+RUNS = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+
+for n in (1000, 10000, 100000):
+    opts = lg.KeyOpts(fixedString=True)
+    keys = [(f'key{i}', ['ASCII'], opts) for i in range(n)]
+    # one regex, so the thread VM is used rather than the literal matcher
+    keys.append(('z+', ['ASCII'], lg.KeyOpts()))
+
+    with lg.make_program_from_patterns(keys, lg.ProgOpts()) as prog:
+        for name, engine in (('threads', lg.CtxOpts()), ('lazy dfa', lg.CtxOpts(lazyDfa=True))):
+            beg = time.perf_counter()
+            for i in range(RUNS):
+                lg.Context(prog, engine).close()
+            created = time.perf_counter() - beg
+
+            with lg.Context(prog, engine) as ctx:
+                beg = time.perf_counter()
+                for i in range(RUNS):
+                    ctx.clone().close()
+                cloned = time.perf_counter() - beg
+
+            print(f'{n:>7} patterns, {name:>8}: {1e6 * created / RUNS:10.2f} us to create, {1e6 * cloned / RUNS:10.2f} us to clone')
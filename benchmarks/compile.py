@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+
+# Measures adding a long pattern list with lg_add_pattern_list_parallel()
+# on increasing numbers of threads, and checks that the compiled program
+# is the same for each. The list is read from FILE, one pattern per line,
+# as from re_gen/randpat, or else is made up of N random keywords with
+# a sprinkling of regexes.
+#
+# usage: LD_LIBRARY_PATH=src/lib/.libs benchmarks/compile.py [FILE | N] [ENCODING]
+
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'pylightgrep'))
+
+import lightgrep as lg
+
+
+def synthetic(n):
+    rng = random.Random(7)
+    alpha = 'abcdefghijklmnopqrstuvwxyz'
+    word = lambda lo, hi: ''.join(rng.choice(alpha) for _ in range(rng.randint(lo, hi)))
+
+    pats = []
+    for i in range(n):
+        r = rng.random()
+        w = word(4, 12)
+        if r < 0.7:
+            pats.append(w)
+        elif r < 0.85:
+            k = rng.randint(1, len(w) - 1)
+            pats.append(w[:k] + rng.choice(['[0-9]+', '\\d{2,4}', '.', '[a-f]*', '\\s?']) + w[k:])
+        else:
+            pats.append(w + '|' + word(6, 6) + '(x|yz)+')
+    return '\n'.join(pats)
+
+
+arg = sys.argv[1] if len(sys.argv) > 1 else '100000'
+if os.path.exists(arg):
+    with open(arg, encoding='utf-8') as f:
+        patterns = f.read()
+else:
+    patterns = synthetic(int(arg))
+
+enc = sys.argv[2] if len(sys.argv) > 2 else 'ASCII'
+
+threads = sorted({1, 2, 4, os.cpu_count() or 1})
+expected = None
+
+for t in threads:
+    prog = lg.Program(0)
+    with lg.Fsm(0) as fsm:
+        beg = time.perf_counter()
+        try:
+            fsm.add_pattern_list(prog, patterns, arg, [enc], lg.KeyOpts(), t)
+        except RuntimeError:
+            # bad patterns are skipped, as in a real list
+            pass
+        added = time.perf_counter() - beg
+
+        prog.compile(fsm, lg.ProgOpts())
+        compiled = time.perf_counter() - beg - added
+
+    buf = prog.write()
+    prog.close()
+
+    if expected is None:
+        expected = buf
+    same = 'same' if buf == expected else 'DIFFERENT'
+
+    print(f'{t:>3} threads: {added:8.3f} s to add patterns, {compiled:8.3f} s to compile, program {same}')
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+
+# Measures collecting hits through a callback per hit, with lg_search(),
+# and a buffer at a time, with lg_search_hits(), for a pattern with a
+# hit in nearly every word of the input.
+#
+# usage: LD_LIBRARY_PATH=src/lib/.libs benchmarks/hitbuffer.py FILE [RUNS]
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'pylightgrep'))
+
+import lightgrep as lg
+
+with open(sys.argv[1], 'rb') as f:
+    data = f.read()
+
+RUNS = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+
+class TupleAccumulator(object):
+    # as little work per hit as a callback can do
+    def __init__(self):
+        self.Hits = []
+
+    def lgCallback(self, hitInfo, patInfo):
+        self.Hits.append((hitInfo.Start, hitInfo.End, hitInfo.KeywordIndex))
+
+
+keys = [('[a-z]+', ['ASCII'], lg.KeyOpts())]
+
+with lg.make_program_from_patterns(keys, lg.ProgOpts()) as prog:
+    with lg.Context(prog, lg.CtxOpts()) as ctx:
+        best = float('inf')
+        for i in range(RUNS):
+            acc = TupleAccumulator()
+            beg = time.perf_counter()
+            ctx.search(data, 0, acc)
+            ctx.closeout(acc)
+            best = min(best, time.perf_counter() - beg)
+            ctx.reset()
+        exp = acc.Hits
+        print(f'callback: {best:8.3f} s, {len(exp)} hits')
+
+        for bufSize in (64, 4096):
+            best = float('inf')
+            for i in range(RUNS):
+                beg = time.perf_counter()
+                hits = ctx.searchHits(data, 0, bufSize)
+                hits += ctx.closeoutHits(bufSize)
+                best = min(best, time.perf_counter() - beg)
+                ctx.reset()
+
+            if hits != exp:
+                raise RuntimeError('Buffered hits differ from the callback hits')
+            print(f'{bufSize:>8}: {best:8.3f} s, {len(hits)} hits')
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash -e
+
+# Compares the size of the program and the search throughput of two
+# lightgrep builds, e.g., one built before and one after a change to
+# DFA minimization. Extra arguments, such as encodings, are passed to both.
+#
+# usage: minimize.sh OLD_LIGHTGREP NEW_LIGHTGREP [KEYS] [CORPUS] [RUNS] [ARGS...]
+
+OLD=$1
+NEW=$2
+KEYS=${3:-pytest/keys/twain.txt}
+CORPUS=${4:-pytest/corpora/norvig1mb.txt}
+RUNS=${5:-10}
+shift $(( $# < 5 ? $# : 5 ))
+
+for bin in "$OLD" "$NEW" ; do
+  echo "$bin"
+  "$bin" -k "$KEYS" "$@" --no-output "$CORPUS" 2>&1 | grep -E "vertices|instructions"
+  for i in $(seq 1 $RUNS) ; do
+    "$bin" -k "$KEYS" "$@" --no-output "$CORPUS" 2>&1
+  done | python3 pytest/lightgrep_stats.py
+done
@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+
+# Measures the cost of searching a tiny buffer and resetting the context,
+# as for many small files, for programs with increasing numbers of
+# patterns. The cost should not grow with the number of patterns.
+#
+# usage: LD_LIBRARY_PATH=src/lib/.libs benchmarks/reset.py [RUNS]
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'pylightgrep'))
+
+import lightgrep as lg
+
+RUNS = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+
+data = b'xx key7 yy key42 zz'
+
+for n in (1000, 10000, 100000, 300000):
+    opts = lg.KeyOpts(fixedString=True)
+    keys = [(f'key{i}', ['ASCII'], opts) for i in range(n)]
+    # one regex, so the thread VM is used rather than the literal matcher
+    keys.append(('z+', ['ASCII'], lg.KeyOpts()))
+
+    with lg.make_program_from_patterns(keys, lg.ProgOpts()) as prog:
+        with lg.Context(prog, lg.CtxOpts()) as ctx:
+            hits = lg.HitAccumulator()
+            beg = time.perf_counter()
+            for i in range(RUNS):
+                ctx.search(data, 0, hits)
+                ctx.reset()
+            elapsed = time.perf_counter() - beg
+
+    print(f'{n:>7} patterns: {1e6 * elapsed / RUNS:8.2f} us per search and reset')
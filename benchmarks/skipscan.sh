@@ -0,0 +1,19 @@
+#!/usr/bin/env bash -e
+
+# Compares search throughput of two lightgrep builds, e.g., one built
+# before and one after a change to the idle loop in Vm::search.
+#
+# usage: skipscan.sh OLD_LIGHTGREP NEW_LIGHTGREP [KEYS] [CORPUS] [RUNS]
+
+OLD=$1
+NEW=$2
+KEYS=${3:-pytest/keys/twain.txt}
+CORPUS=${4:-pytest/corpora/norvig1mb.txt}
+RUNS=${5:-10}
+
+for bin in "$OLD" "$NEW" ; do
+  echo "$bin"
+  for i in $(seq 1 $RUNS) ; do
+    "$bin" -k "$KEYS" --no-output "$CORPUS" 2>&1
+  done | python3 pytest/lightgrep_stats.py
+done
@@ -1,5 +1,11 @@
 #!/usr/bin/env bash -e
 
+# usage: twaintime.sh [LIGHTGREP]
+#
+# e.g., compare builds configured with and without --enable-computed-goto
+
+LIGHTGREP=${1:-src/cmd/lightgrep}
+
 for i in $(seq 1 10) ; do
-  src/cmd/lightgrep -k pytest/keys/twain.txt --no-output pytest/corpora/marktwainworks.txt 2>&1
+  "$LIGHTGREP" -k pytest/keys/twain.txt --no-output pytest/corpora/marktwainworks.txt 2>&1
 done | python3 pytest/lightgrep_stats.py
@@ -117,6 +117,12 @@ int main() {
 
     // create a search context
     LG_ContextOptions ctxOpts;
+    ctxOpts.TraceBegin = 0xFFFFFFFFFFFFFFFF;
+    ctxOpts.TraceEnd = 0;
+    ctxOpts.Engine = LG_ENGINE_THREADS;
+    ctxOpts.DfaCacheSize = 0;
+    ctxOpts.HitMode = LG_HITS_ALL;
+    ctxOpts.MaxHitsPerPattern = 0;
     LG_HCONTEXT searcher = lg_create_context(prog, &ctxOpts);
 
     char filesigText[] = "lambs love mary.";
@@ -0,0 +1,68 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//
+// A read-only array which either owns its elements or refers to ones
+// held elsewhere, such as in a buffer a program was read from. Referred
+// elements must outlive the array and every copy of it.
+//
+template <class T>
+class ArrayRef {
+public:
+  ArrayRef(): Beg(nullptr), Len(0) {}
+
+  explicit ArrayRef(std::vector<T> v):
+    Own(std::move(v)), Beg(Own.data()), Len(Own.size()) {}
+
+  ArrayRef(const T* beg, size_t len): Beg(beg), Len(len) {}
+
+  ArrayRef(const ArrayRef& other):
+    Own(other.Own), Beg(other.owns() ? Own.data() : other.Beg), Len(other.Len) {}
+
+  // moving a vector leaves its elements where they were
+  ArrayRef(ArrayRef&& other) = default;
+
+  ArrayRef& operator=(ArrayRef other) {
+    std::swap(Own, other.Own);
+    std::swap(Beg, other.Beg);
+    std::swap(Len, other.Len);
+    return *this;
+  }
+
+  const T& operator[](size_t i) const { return Beg[i]; }
+
+  const T* data() const { return Beg; }
+  const T* begin() const { return Beg; }
+  const T* end() const { return Beg + Len; }
+
+  size_t size() const { return Len; }
+
+  bool owns() const { return !Own.empty(); }
+
+private:
+  std::vector<T> Own;
+  const T* Beg;
+  size_t Len;
+};
@@ -0,0 +1,63 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+
+#include "basic.h"
+#include "byteset.h"
+
+//
+// Classes of bytes which a program never tells apart. Jump tables and bit
+// vectors are indexed by class, rather than by byte, so they need only an
+// entry for each class. Classes are numbered in order of their least byte,
+// so that classes of nearby bytes stay near each other.
+//
+struct ByteClasses {
+  // each byte in a class of its own
+  ByteClasses(): Num(256) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      Map[i] = i;
+    }
+  }
+
+  byte operator[](byte b) const { return Map[b]; }
+
+  // the words in a bit vector with a bit for each class
+  uint32_t setWords() const { return (Num + 31) / 32; }
+
+  // the classes of the bytes in set
+  ByteSet classesOf(const ByteSet& set) const {
+    ByteSet ret;
+    for (uint32_t i = 0; i < 256; ++i) {
+      if (set[i]) {
+        ret.set(Map[i]);
+      }
+    }
+    return ret;
+  }
+
+  bool operator==(const ByteClasses& x) const {
+    return Num == x.Num && Map == x.Map;
+  }
+
+  std::array<byte,256> Map;
+  uint32_t Num;
+};
@@ -21,7 +21,9 @@
 #include "basic.h"
 
 #include "automata.h"
+#include "byteclasses.h"
 #include "instructions.h"
+#include "states.h"
 #include "utility.h"
 
 #include <vector>
@@ -70,6 +72,12 @@ struct CodeGenHelper {
     }
   }
 
+  // bit vectors have a bit for each class, rather than for each byte
+  uint32_t transitionSize(const Transition* t) const {
+    return t->type() == ByteSetStateType ?
+      1 + Classes.setWords() : t->numInstructions();
+  }
+
   void addSnippet(uint32_t state, uint32_t numEval, uint32_t numOther) {
     StateLayoutInfo& info(Snippets[state]);
     info.Start = Guard;
@@ -80,6 +88,7 @@ struct CodeGenHelper {
 
   std::vector<uint32_t> DiscoverRanks;
   std::vector<StateLayoutInfo> Snippets;
+  ByteClasses Classes;
   uint32_t Guard,
            NumDiscovered,
            MaxLabel,
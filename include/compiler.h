@@ -21,11 +21,21 @@
 #include "basic.h"
 
 #include "fwd_pointers.h"
+#include "literalmatcher.h"
+
+#include <bitset>
+#include <vector>
 
 class Compiler {
 public:
 
   static ProgramPtr createProgram(const NFA& graph);
 
+  static ProgramPtr createProgram(const NFA& graph, const std::vector<Literal>& lits);
+
+  // gives the program the required factors of its patterns, if they
+  // can narrow the search better than the prefilter alone
+  static void addFactors(Program& prog, const std::vector<Literal>& factors, const std::bitset<256>& lead, uint32_t maxLead);
+
 
 };
@@ -0,0 +1,94 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "basic.h"
+#include "fwd_pointers.h"
+#include "sparseset.h"
+
+//
+// Writes and reads the state an engine carries from one search() call to
+// the next, for VmInterface::save() and restore(). The state is in the
+// host's byte order and starts with a header naming the engine and the
+// program it came from, so that restoring it elsewhere fails instead of
+// sending threads off into the wrong program. Everything read is checked
+// against the program, and StateReader throws on anything amiss.
+//
+enum EngineStateTag : uint32_t {
+  THREAD_STATE = 1,
+  LITERAL_STATE = 2,
+  LAZY_DFA_STATE = 3
+};
+
+class StateWriter {
+public:
+  StateWriter(std::vector<char>& buf): Buf(buf) {}
+
+  template <class T>
+  void put(const T& v) {
+    const char* const p = reinterpret_cast<const char*>(&v);
+    Buf.insert(Buf.end(), p, p + sizeof(T));
+  }
+
+  void header(EngineStateTag tag, const Program& prog);
+
+  // writes the labels in matched and their ends
+  void matchEnds(const std::vector<uint64_t>& ends, const SparseSet& matched);
+
+private:
+  std::vector<char>& Buf;
+};
+
+class StateReader {
+public:
+  StateReader(const char* beg, const char* end): Cur(beg), End(end) {}
+
+  template <class T>
+  T get() {
+    if (static_cast<size_t>(End - Cur) < sizeof(T)) {
+      fail();
+    }
+
+    T v;
+    std::memcpy(&v, Cur, sizeof(T));
+    Cur += sizeof(T);
+    return v;
+  }
+
+  // reads a label, which must be no greater than maxLabel
+  uint32_t label(uint32_t maxLabel);
+
+  void header(EngineStateTag tag, const Program& prog);
+
+  // the counterpart of StateWriter::matchEnds; matched must be clear, as
+  // after a reset, and so must ends but for the labels the mask disables
+  void matchEnds(std::vector<uint64_t>& ends, SparseSet& matched);
+
+  // throws unless everything has been read
+  void finish() const;
+
+  [[noreturn]] static void fail();
+
+private:
+  const char* Cur;
+  const char* const End;
+};
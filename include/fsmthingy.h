@@ -1,11 +1,36 @@
 #pragma once
 
 #include "basic.h"
+#include "literalmatcher.h"
 #include "nfabuilder.h"
 #include "nfaoptimizer.h"
 #include "encoders/encoderfactory.h"
+#include "utility.h"
 
 #include <memory>
+#include <string>
+#include <vector>
+
+//
+// The NFA for one pattern, built apart from the FSM. Building touches
+// only the builder, encoder factory, and optimizer passed to it, so
+// patterns can be built concurrently, one set of those per thread, and
+// then merged into the FSM in order.
+//
+struct PatternNFA {
+  NFAPtr Nfa;
+
+  // the label the NFA was built with
+  uint32_t Label;
+
+  // the bytes of the pattern, if it is a plain byte string
+  bool Literal;
+  std::string Bytes;
+
+  // the pattern's required factor, if it was wanted and there is one
+  bool HasFactor;
+  RequiredFactor Factor;
+};
 
 class FSMThingy {
 public:
@@ -16,7 +41,29 @@ public:
   NFAOptimizer Comp;
   NFAPtr Fsm;
 
+  // the patterns added so far, while every one is a plain byte string
+  bool AllLiterals;
+  std::vector<Literal> Literals;
+
+  // the required factors of the patterns added so far, while every one
+  // has one, and the bytes and longest run which may precede them
+  bool AllFactors;
+  std::vector<Literal> Factors;
+  ByteSet FactorLead;
+  uint32_t FactorMaxLead;
+
   void addPattern(const ParseTree& tree, const char* chain, uint32_t label);
 
+  // builds the pruned NFA for a pattern, finding its required factor if
+  // factors is set; throws if the pattern matches the empty string
+  static void buildPattern(NFABuilder& nfab, EncoderFactory& encFac,
+                           NFAOptimizer& comp, const ParseTree& tree,
+                           const char* chain, uint32_t label, bool factors,
+                           PatternNFA& pat);
+
+  // merges a built pattern into the FSM, relabeling it if need be; its
+  // factor must have been found if AllFactors was set when it was built
+  void mergePattern(PatternNFA& pat, uint32_t label);
+
   void finalizeGraph(bool determinize);
 };
@@ -19,6 +19,8 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "lightgrep/api.h"
 #include "lightgrep/util.h"
@@ -52,6 +54,20 @@ struct ProgramHandle {
 
 struct ContextHandle {
   std::shared_ptr<VmInterface> Impl;
+
+  // for making more engines like Impl
+  ProgramPtr Prog;
+  uint32_t Engine;
+  uint64_t DfaCacheSize;
+  std::shared_ptr<const LabelMask> Mask;
+};
+
+struct ContextPoolHandle {
+  // cloned, never searched, so safe to clone from any thread
+  std::unique_ptr<ContextHandle> Prototype;
+
+  std::mutex Lock;
+  std::vector<std::unique_ptr<ContextHandle>> Idle;
 };
 
 struct DecoderHandle {
@@ -0,0 +1,235 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "basic.h"
+#include "enginestate.h"
+#include "searchhit.h"
+
+//
+// Holds the limits a context may put on its hits, and counts each
+// label's hits while there are any. Once a label has MaxPerLabel hits,
+// the engine retires it: its threads die and it reports no more. With
+// StopAtFirst, the engine stops searching after the first hit, and
+// without Report, hits are counted but not passed to the callback.
+//
+// For lg_search_hits(), hits can also go to a buffer instead of the
+// callback. Those which do not fit are held back, and the engine halts
+// at the end of the frame, noting where with pauseAt(), so the search
+// can be resumed from there once the buffer has been emptied.
+//
+// Engines go through count() and report() only when limited(), so that
+// reporting an unlimited hit costs nothing more than before.
+//
+class HitCounter {
+public:
+  HitCounter(uint32_t numLabels = 0):
+    Counts(numLabels, 0), MaxPerLabel(0),
+    Buf(nullptr), Cap(0), Len(0), PausedAt(0),
+    StopAtFirst(false), Report(true), Counting(false), Limited(false),
+    Stopped(false), Halted(false), Resume(false) {}
+
+  // maxPerLabel of zero is no limit
+  void limit(bool stopAtFirst, bool report, uint64_t maxPerLabel) {
+    StopAtFirst = stopAtFirst;
+    Report = report;
+    MaxPerLabel = maxPerLabel;
+    Counting = StopAtFirst || !Report || MaxPerLabel;
+    Limited = Counting || Buf;
+  }
+
+  // takes other's limits, but not its counts
+  void limit(const HitCounter& other) {
+    limit(other.StopAtFirst, other.Report, other.MaxPerLabel);
+  }
+
+  bool limited() const { return Limited; }
+
+  // Counts a hit for the label, if there are limits to count for.
+  // Returns true if the label is now to be retired.
+  bool count(uint32_t label) {
+    if (!Counting) {
+      return false;
+    }
+
+    if (!Counts[label]++) {
+      Counted.push_back(label);
+    }
+
+    if (StopAtFirst) {
+      Stopped = Halted = true;
+    }
+    return Counts[label] == MaxPerLabel;
+  }
+
+  // passes a hit on, to the buffer if there is one, else to fn
+  void report(const SearchHit& hit, HitCallback fn, void* userData) {
+    if (!Report) {
+      return;
+    }
+
+    if (Buf) {
+      if (Len < Cap) {
+        Buf[Len++] = hit;
+      }
+      else {
+        Held.push_back(hit);
+        Halted = true;
+      }
+    }
+    else if (fn) {
+      (*fn)(userData, &hit);
+    }
+  }
+
+  // true once a hit has been counted with StopAtFirst
+  bool stopped() const { return Stopped; }
+
+  // true when the engine is to stop searching: when stopped, or when
+  // holding hits back
+  bool halted() const { return Halted; }
+
+  // true when halted only to hold hits back
+  bool paused() const { return Halted && !Stopped; }
+
+  bool reports() const { return Report; }
+
+  // Sends hits to buf, after any held back from before.
+  void buffer(LG_SearchHit* buf, uint64_t cap) {
+    Buf = buf;
+    Cap = cap;
+    Len = std::min(cap, static_cast<uint64_t>(Held.size()));
+    std::copy(Held.begin(), Held.begin() + Len, Buf);
+    Held.erase(Held.begin(), Held.begin() + Len);
+    Halted = Stopped || !Held.empty();
+    Limited = true;
+  }
+
+  // Sends hits to the callback again. Held hits stay held.
+  void unbuffer() {
+    Buf = nullptr;
+    Cap = Len = 0;
+    Limited = Counting;
+  }
+
+  // the number of hits in the buffer
+  uint64_t buffered() const { return Len; }
+
+  bool holding() const { return !Held.empty(); }
+
+  // where an engine halted with hits held back, for the search to
+  // resume from; resuming() until resumed()
+  void pauseAt(uint64_t offset) {
+    PausedAt = offset;
+    Resume = true;
+  }
+
+  uint64_t pausedAt() const { return PausedAt; }
+
+  bool resuming() const { return Resume; }
+  void resumed() { Resume = false; }
+
+  uint64_t operator[](uint32_t label) const { return Counts[label]; }
+
+  uint32_t numLabels() const { return Counts.size(); }
+
+  // clears the counts and any held hits, but not the limits
+  void reset() {
+    for (const uint32_t label : Counted) {
+      Counts[label] = 0;
+    }
+    Counted.clear();
+    Held.clear();
+    Stopped = Halted = Resume = false;
+  }
+
+  // saves the counts, but not the limits
+  void save(StateWriter& out) const {
+    if (!Held.empty() || Resume) {
+      throw std::runtime_error("Cannot save a context with hits yet to collect");
+    }
+
+    out.put(static_cast<byte>(Stopped));
+    out.put(static_cast<uint32_t>(Counted.size()));
+    for (const uint32_t label : Counted) {
+      out.put(label);
+      out.put(Counts[label]);
+    }
+  }
+
+  // the counterpart of save(); the counts must be clear, as after reset()
+  void restore(StateReader& in) {
+    Stopped = Halted = in.get<byte>();
+
+    const uint32_t n = in.get<uint32_t>();
+    if (n > Counts.size()) {
+      StateReader::fail();
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+      const uint32_t label = in.label(Counts.size() - 1);
+      const uint64_t c = in.get<uint64_t>();
+      if (!c || Counts[label]) {
+        StateReader::fail();
+      }
+
+      Counts[label] = c;
+      Counted.push_back(label);
+    }
+  }
+
+  void swap(HitCounter& other) {
+    Counts.swap(other.Counts);
+    Counted.swap(other.Counted);
+    Held.swap(other.Held);
+    std::swap(MaxPerLabel, other.MaxPerLabel);
+    std::swap(Buf, other.Buf);
+    std::swap(Cap, other.Cap);
+    std::swap(Len, other.Len);
+    std::swap(PausedAt, other.PausedAt);
+    std::swap(StopAtFirst, other.StopAtFirst);
+    std::swap(Report, other.Report);
+    std::swap(Counting, other.Counting);
+    std::swap(Limited, other.Limited);
+    std::swap(Stopped, other.Stopped);
+    std::swap(Halted, other.Halted);
+    std::swap(Resume, other.Resume);
+  }
+
+private:
+  std::vector<uint64_t> Counts;
+
+  // the labels with nonzero counts, so reset() need not clear them all
+  std::vector<uint32_t> Counted;
+
+  // the hits which did not fit in the buffer
+  std::vector<SearchHit> Held;
+
+  uint64_t MaxPerLabel;
+
+  LG_SearchHit* Buf;
+  uint64_t Cap, Len, PausedAt;
+
+  bool StopAtFirst, Report, Counting, Limited, Stopped, Halted, Resume;
+};
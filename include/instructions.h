@@ -36,11 +36,16 @@ enum OpCodes {
   LABEL_OP,
   MATCH_OP,
   HALT_OP,
-  ADJUST_START_OP
+  ADJUST_START_OP,
+  JUMP_TABLE_SPARSE_OP,
+  JUMP_TABLE_BITMAP_OP,
+  LITERAL_OP
 };
 
 template<int OPCODE> struct InstructionSize { enum { VAL = 1 }; };
 
+// at most; a bit vector has one bit for each byte class, in as many
+// words as its operand says
 template<> struct InstructionSize<BIT_VECTOR_OP> { enum { VAL = 9 }; };
 template<> struct InstructionSize<FORK_OP> { enum { VAL = 2 }; };
 template<> struct InstructionSize<JUMP_OP> { enum { VAL = 2 }; };
@@ -56,11 +61,28 @@ struct InstructionType2 {
   byte First, Last;
 };
 
+struct InstructionType3 {
+  byte Count; // one less than the number of entries
+  byte First, Last;
+};
+
+// A literal is a byte instruction followed by Length-1 more in a row, so
+// the bytes of the whole run are at hand when the first is checked. Byte
+// is where it is in InstructionType1, so anything that only needs the
+// first byte can treat a literal as the byte instruction it replaced.
+struct InstructionType4 {
+  byte Flags;
+  byte Byte;
+  byte Length;
+};
+
 union Operand {
   unsigned  Offset : 24;
 
   InstructionType1 T1;
   InstructionType2 T2;
+  InstructionType3 T3;
+  InstructionType4 T4;
 };
 
 struct Instruction {
@@ -77,7 +99,7 @@ struct Instruction {
   byte wordSize() const {
     switch (OpCode) {
     case BIT_VECTOR_OP:
-      return InstructionSize<BIT_VECTOR_OP>::VAL;
+      return 1 + Op.T1.Byte;
     case FORK_OP:
     case JUMP_OP:
       return InstructionSize<FORK_OP>::VAL;
@@ -100,9 +122,12 @@ struct Instruction {
   static Instruction makeEither(byte one, byte two, bool negate = false);
   static Instruction makeRange(byte first, byte last, bool negate = false);
   static Instruction makeAny();
-  static Instruction makeBitVector();
+  static Instruction makeBitVector(byte words = 8);
   static Instruction makeJump(Instruction* ptr, uint32_t offset);
   static Instruction makeJumpTableRange(byte first, byte last);
+  static Instruction makeJumpTableSparse(byte first, byte last, uint32_t num);
+  static Instruction makeJumpTableBitmap(byte first, byte last);
+  static Instruction makeLiteral(byte b, byte length);
   static Instruction makeLabel(uint32_t label);
   static Instruction makeMatch();
   static Instruction makeFork(Instruction* ptr, uint32_t offset);
@@ -117,3 +142,93 @@ struct Instruction {
 
 std::ostream& operator<<(std::ostream& out, const Instruction& instr);
 std::istream& operator>>(std::istream& in, Instruction& instr);
+
+//
+// Jump tables are indexed by byte class and come in three layouts, each
+// followed by any indirect tables:
+//
+//   JUMP_TABLE_RANGE_OP  a target word for each class from First to
+//                        Last, zero where there is none
+//   JUMP_TABLE_SPARSE_OP the Count+1 classes having targets, in order,
+//                        four to a word, then their targets
+//   JUMP_TABLE_BITMAP_OP a bit for each class from First to Last, then
+//                        for each word of bits, the number of bits set
+//                        in the words before it, four to a word, then
+//                        the targets of the set bits
+//
+inline bool isJumpTable(byte op) {
+  return op == JUMP_TABLE_RANGE_OP || op == JUMP_TABLE_SPARSE_OP ||
+         op == JUMP_TABLE_BITMAP_OP;
+}
+
+inline uint32_t bytesToWords(uint32_t n) {
+  return (n + sizeof(Instruction) - 1) / sizeof(Instruction);
+}
+
+inline uint32_t bitmapWords(byte first, byte last) {
+  return (last - first) / 32 + 1;
+}
+
+// words after the instruction, not counting indirect tables, for a
+// table of num entries over the classes from first to last
+inline uint32_t jumpTableWords(byte op, byte first, byte last, uint32_t num) {
+  switch (op) {
+  case JUMP_TABLE_SPARSE_OP:
+    return bytesToWords(num) + num;
+  case JUMP_TABLE_BITMAP_OP:
+    return bitmapWords(first, last) + bytesToWords(bitmapWords(first, last)) + num;
+  default:
+    return last - first + 1;
+  }
+}
+
+// tables at least half full are dense, as they're quickest; otherwise
+// whichever is smaller, with the bitmap winning ties as it doesn't search
+inline OpCodes jumpTableLayout(byte first, byte last, uint32_t num) {
+  if (2*num >= uint32_t(last - first + 1)) {
+    return JUMP_TABLE_RANGE_OP;
+  }
+  return jumpTableWords(JUMP_TABLE_SPARSE_OP, first, last, num) <
+         jumpTableWords(JUMP_TABLE_BITMAP_OP, first, last, num) ?
+         JUMP_TABLE_SPARSE_OP : JUMP_TABLE_BITMAP_OP;
+}
+
+// the target for a class in a jump table of any layout, or 0 if none
+inline uint32_t jumpTableTarget(const Instruction& instr, byte cls) {
+  // all three layouts keep First and Last in the same place
+  if (cls < instr.Op.T2.First || instr.Op.T2.Last < cls) {
+    return 0;
+  }
+
+  const uint32_t* const words = reinterpret_cast<const uint32_t*>(&instr + 1);
+
+  switch (instr.OpCode) {
+  case JUMP_TABLE_SPARSE_OP:
+    {
+      // branchless binary search for the last key not above cls
+      const uint32_t num = instr.Op.T3.Count + 1;
+      const byte* const keys = reinterpret_cast<const byte*>(words);
+      const byte* k = keys;
+      for (uint32_t len = num; len > 1; ) {
+        const uint32_t half = len / 2;
+        k = k[half] <= cls ? k + half : k;
+        len -= half;
+      }
+      return *k == cls ? words[bytesToWords(num) + (k - keys)] : 0;
+    }
+  case JUMP_TABLE_BITMAP_OP:
+    {
+      const uint32_t i = cls - instr.Op.T2.First,
+                     w = words[i >> 5],
+                     bit = 1u << (i & 31);
+      if (!(w & bit)) {
+        return 0;
+      }
+      const uint32_t bw = bitmapWords(instr.Op.T2.First, instr.Op.T2.Last);
+      const byte rank = reinterpret_cast<const byte*>(words + bw)[i >> 5];
+      return words[bw + bytesToWords(bw) + rank + __builtin_popcount(w & (bit - 1))];
+    }
+  default:
+    return words[cls - instr.Op.T2.First];
+  }
+}
@@ -0,0 +1,60 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "basic.h"
+#include "vm.h"
+
+//
+// Vm with the program's consuming instructions compiled to x86-64 code.
+// Each instruction becomes a stub which tests the byte against operands
+// baked into the code and returns the next PC, following any JUMP_OP
+// chain there, so a thread skips the epsilon sequence entirely when it
+// lands on another consuming instruction. Everything else is left to
+// Vm, so the hits are exactly Vm's. Only search runs the compiled code;
+// startsWith and searchResolve, which see few bytes, are interpreted.
+//
+// Only x86-64 hosts are supported; elsewhere, VmInterface::create gives
+// a Vm instead.
+//
+class JitVm: public Vm {
+public:
+  JitVm(ProgramPtr prog);
+
+  JitVm& operator=(const JitVm&) = delete;
+
+  // shares the compiled code
+  virtual std::shared_ptr<VmInterface> clone() const;
+
+  static bool supported();
+
+  size_t codeSize() const;
+
+private:
+  JitVm(const JitVm& other);
+
+  // the executable memory and the stubs in it
+  struct Code;
+
+  std::shared_ptr<const Code> Compiled;
+};
@@ -0,0 +1,47 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "basic.h"
+#include "fwd_pointers.h"
+
+//
+// A set of labels to disable on a context, so that one program can serve
+// searches for different subsets of its patterns. Engines keep the match
+// end of a disabled label past any offset, so its threads die when they
+// take it, as if they overlapped a match. Vm also skips starting threads
+// which could only reach disabled labels; which those are depends only
+// on the program, so it is worked out here, once for every engine.
+//
+class LabelMask {
+public:
+  // disabled is indexed by label
+  LabelMask(const Program& prog, const std::vector<bool>& disabled);
+
+  const std::vector<uint32_t>& disabled() const { return Disabled; }
+
+  // whether a thread at pc can still reach an enabled label
+  bool live(uint32_t pc) const { return Live[pc]; }
+
+private:
+  std::vector<uint32_t> Disabled;
+  std::vector<bool> Live;
+};
@@ -0,0 +1,135 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "basic.h"
+#include "byteclasses.h"
+#include "skipscan.h"
+#include "sparseset.h"
+#include "vm.h"
+#include "vm_interface.h"
+
+//
+// Searches with a DFA built lazily from the program, backed by Vm. The
+// DFA tracks only which instructions the threads started so far could
+// be at, without their starts, labels, or priorities, so it can tell
+// where a match ends but not which hits Vm would report. When it sees
+// a match end, the search backs up to the last position where no
+// thread was alive and lets Vm run from there until its threads die
+// out. Labels, CHECK_HALT_OP locks, and hit reporting are thus left to
+// Vm, while the DFA runs through the stretches where nothing matches.
+//
+// DFA states are built on demand and kept in a cache of bounded size.
+// When the cache fills, it is flushed and rebuilt; if that happens so
+// often that few bytes are scanned per state built, the search gives
+// up on the DFA and uses Vm alone.
+//
+class LazyDfaVm: public VmInterface {
+public:
+  static const uint64_t DEFAULT_CACHE_SIZE;
+
+  LazyDfaVm(ProgramPtr prog, uint64_t cacheSize = DEFAULT_CACHE_SIZE);
+
+  virtual void startsWith(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual uint64_t search(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual uint64_t searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual void closeOut(HitCallback hitFn, void* userData);
+  virtual void reset();
+  virtual void restart();
+  virtual bool idle() const;
+  virtual HitCounter& hits() { return Threads.hits(); }
+  virtual void setMask(const std::shared_ptr<const LabelMask>& mask);
+
+  // the clone starts with an empty cache
+  virtual std::shared_ptr<VmInterface> clone() const;
+
+  virtual void save(std::vector<char>& buf) const;
+  virtual void restore(const char* beg, const char* end);
+
+  #ifdef LBT_TRACE_ENABLED
+  void setDebugRange(uint64_t beg, uint64_t end) {
+    Threads.setDebugRange(beg, end);
+  }
+  #endif
+
+  // true once the cache has thrashed and only Vm is used
+  bool fellBack() const { return FellBack; }
+
+  uint32_t numStates() const { return Sets.size(); }
+
+private:
+  LazyDfaVm(const LazyDfaVm& other);
+
+  typedef std::vector<uint32_t> PCSet;
+
+  struct PCSetHash {
+    size_t operator()(const PCSet& s) const;
+  };
+
+  static const uint32_t UNKNOWN;
+  static const uint32_t QUIET;
+
+  uint32_t _transition(uint32_t s, byte b);
+  uint32_t _step(uint32_t pc, byte b, byte cls) const;
+  void _closure(uint32_t pc, bool& match);
+  void _flush();
+
+  uint32_t _insert(const PCSet& pcs);
+  uint64_t _stateCost(size_t n) const;
+
+  const byte* _runThreads(const byte* cur, const byte* const end, uint64_t& offset, uint64_t& ret, HitCallback hitFn, void* userData);
+
+  const ProgramPtr Prog;
+  const Instruction* const Base;
+
+  // states have a transition for each byte class, with as many slots as
+  // the least power of two holding them, so a shift finds them
+  const ByteClasses& Classes;
+  const uint32_t ClassBits;
+
+  Vm Threads;
+
+  const SkipScanner Skip;
+
+  const uint64_t CacheSize;
+  uint64_t CacheUsed;
+
+  // the PCs of consuming instructions after the initial epsilon closure
+  PCSet StartPCs;
+
+  // each state's transitions, by class; a transition holds the next
+  // state shifted left one, with the low bit set if a match ends
+  std::vector<uint32_t> Trans;
+  std::unordered_map<PCSet,uint32_t,PCSetHash> Index;
+  std::vector<const PCSet*> Sets;
+
+  // scratch space for building states
+  PCSet Work;
+  std::vector<uint32_t> Stack;
+  SparseSet Seen;
+
+  uint64_t BytesSinceFlush;
+  bool FellBack;
+
+  // true while Vm has threads alive, so the DFA cannot run
+  bool InThreads;
+};
@@ -31,11 +31,13 @@ extern "C" {
   struct FSMHandle;
   struct ProgramHandle;
   struct ContextHandle;
+  struct ContextPoolHandle;
 
-  typedef struct PatternHandle*    LG_HPATTERN;
-  typedef struct FSMHandle*        LG_HFSM;
-  typedef struct ProgramHandle*    LG_HPROGRAM;
-  typedef struct ContextHandle*    LG_HCONTEXT;
+  typedef struct PatternHandle*     LG_HPATTERN;
+  typedef struct FSMHandle*         LG_HFSM;
+  typedef struct ProgramHandle*     LG_HPROGRAM;
+  typedef struct ContextHandle*     LG_HCONTEXT;
+  typedef struct ContextPoolHandle* LG_HCONTEXTPOOL;
 
   // Options for pattern parsing
   typedef struct {
@@ -88,10 +90,31 @@ extern "C" {
     char Determinize;     // 0 => build NFA, non-zero => build (pseudo)DFA
   } LG_ProgramOptions;
 
+  // Search engines
+  static const uint32_t LG_ENGINE_THREADS = 0;  // thread VM (default)
+  static const uint32_t LG_ENGINE_LAZY_DFA = 1; // lazily built DFA, backed
+                                                // by the thread VM
+  static const uint32_t LG_ENGINE_JIT = 2;      // thread VM compiled to
+                                                // native code on x86-64,
+                                                // else the thread VM
+
+  // Hit modes
+  static const uint32_t LG_HITS_ALL = 0;    // report every hit (default)
+  static const uint32_t LG_HITS_FIRST = 1;  // stop searching after the
+                                            // first hit reported
+  static const uint32_t LG_HITS_COUNT = 2;  // count hits, but do not
+                                            // call the callback
+
 // TODO: nix these, don't expose trace in the lib
   typedef struct {
     uint64_t TraceBegin,    // starting offset of trace output
              TraceEnd;      // ending offset of trace output
+    uint32_t Engine;        // one of LG_ENGINE_*
+    uint64_t DfaCacheSize;  // bytes for the lazy DFA state cache, 0 => default
+    uint32_t HitMode;       // one of LG_HITS_*
+    uint64_t MaxHitsPerPattern; // after this many hits, a keyword's partial
+                                // matches are dropped and it reports no
+                                // more, 0 => no limit
   } LG_ContextOptions;
 
   // Error handling
@@ -159,6 +182,21 @@ extern "C" {
                           const LG_KeyOptions* defaultOptions,
                           LG_Error** err);
 
+  // Add a pattern list, as lg_add_pattern_list() does, but parse the
+  // patterns and build their automata on up to numThreads - 1 threads, while
+  // the calling thread merges them into the FSM in order. The FSM, pattern
+  // indices, and errors are exactly those lg_add_pattern_list() gives, for
+  // any number of threads. It pays for long lists, of thousands of patterns.
+  int lg_add_pattern_list_parallel(LG_HFSM hFsm,
+                                   LG_HPROGRAM hProg,
+                                   const char* patterns,
+                                   const char* source,
+                                   const char** defaultEncodings,
+                                   unsigned int defaultEncodingsNum,
+                                   const LG_KeyOptions* defaultOptions,
+                                   unsigned int numThreads,
+                                   LG_Error** err);
+
   // The number of pattern-encoding pairs recognized by the Program. This
   // will be one greater than the maximum pattern index accepted by
   // lg_pattern_info().
@@ -180,15 +218,58 @@ extern "C" {
   unsigned int lg_program_size(const LG_HPROGRAM hProg);
 
   // Serialize the program, in binary format, to a buffer. The buffer must be
-  // at least as large as lg_program_size() in bytes.
+  // at least as large as lg_program_size() in bytes. The format is versioned
+  // and checksummed, and is the same on disk as in memory.
   void lg_write_program(const LG_HPROGRAM hProg, void* buffer);
 
   // Convert a buffer containing a serialized program to a program, given the
-  // binary buffer and size. No versioning check is done so don't keep these
-  // around too long. The caller is responsible for freeing the buffer after
-  // calling lg_destroy_program on the handle.
+  // binary buffer and size. Returns null if the buffer is not a program
+  // written by this version of lightgrep, or fails its checksum. The program
+  // refers to the buffer rather than copying it, if it is 8-byte aligned, so
+  // the caller is responsible for freeing the buffer after calling
+  // lg_destroy_program on the handle.
   LG_HPROGRAM lg_read_program(const void* buffer, int size);
 
+  // Map a file written from lg_write_program() read-only into memory and use
+  // the program in place, so that processes mapping the same file share its
+  // pages, and large programs load without being read. The program unmaps
+  // the file when it is destroyed. The header is always checked, but the
+  // checksum, which requires reading the whole file, only if verify is
+  // nonzero. Returns null on failure.
+  LG_HPROGRAM lg_map_program(const char* path, int verify);
+
+  // Programs compiled from pattern lists can be kept in a cache directory,
+  // sparing later runs, in this process or others, from adding and compiling
+  // the same patterns again. A program is cached under everything it was
+  // compiled from: the text of each pattern list added by
+  // lg_add_pattern_list(), in order, the default encodings and options they
+  // were added with, the program options, and the version of the library.
+  // Sources are not included, as they appear only in errors, and errors in
+  // the patterns are reported only when the program is first compiled.
+
+  // Read the program compiled from the given inputs from the cache directory.
+  // Returns null if it is not there.
+  LG_HPROGRAM lg_read_cached_program(const char* cacheDir,
+                                     const char** patternLists,
+                                     unsigned int numLists,
+                                     const char** defaultEncodings,
+                                     unsigned int defaultEncodingsNum,
+                                     const LG_KeyOptions* defaultOptions,
+                                     const LG_ProgramOptions* programOptions);
+
+  // Store a program compiled from the given inputs in the cache directory,
+  // which must exist. The file is written whole under a temporary name and
+  // then renamed, so processes may share a cache directory. Returns 0 on
+  // failure.
+  int lg_write_cached_program(const LG_HPROGRAM hProg,
+                              const char* cacheDir,
+                              const char** patternLists,
+                              unsigned int numLists,
+                              const char** defaultEncodings,
+                              unsigned int defaultEncodingsNum,
+                              const LG_KeyOptions* defaultOptions,
+                              const LG_ProgramOptions* programOptions);
+
   // A Program must live as long as any associated contexts,
   // so only call this at the end.
   void lg_destroy_program(LG_HPROGRAM hProg);
@@ -202,6 +283,35 @@ extern "C" {
 
   void lg_destroy_context(LG_HCONTEXT hCtx);
 
+  // Create a context for the same program as hCtx, with the same options
+  // and enabled keywords, in the reset state. Much cheaper than
+  // lg_create_context(), as the parts of a context which never change
+  // are copied or shared instead of being rebuilt; the lazy DFA's cache
+  // starts out empty, though. Only those parts of hCtx are read, so it
+  // may be cloned while another thread searches with it, but not while
+  // its keywords are being enabled or disabled. Returns NULL on failure.
+  LG_HCONTEXT lg_clone_context(LG_HCONTEXT hCtx);
+
+  // Create a pool of contexts like hCtx, for sharing among threads which
+  // each need a context for a while, such as one per task. The pool makes
+  // contexts with lg_clone_context() from its own clone of hCtx, so hCtx
+  // can be changed or destroyed afterwards. Returns NULL on failure.
+  LG_HCONTEXTPOOL lg_create_context_pool(LG_HCONTEXT hCtx);
+
+  // Destroys the pool and the contexts in it. Every context acquired from
+  // the pool must have been released to it first.
+  void lg_destroy_context_pool(LG_HCONTEXTPOOL hPool);
+
+  // Takes a reset context from the pool, cloning a new one if the pool is
+  // empty. The context belongs to the caller until released. Safe to call
+  // from many threads at once. Returns NULL on failure.
+  LG_HCONTEXT lg_acquire_context(LG_HCONTEXTPOOL hPool);
+
+  // Resets a context acquired from the pool, re-enabling the keywords the
+  // pool's contexts had if they were changed, and returns it to the pool.
+  // Safe to call from many threads at once.
+  void lg_release_context(LG_HCONTEXTPOOL hPool, LG_HCONTEXT hCtx);
+
   // Finds matches beginning at the first byte. It works like lg_search(), but
   // neither lg_closeout_search() nor lg_reset() need to be called (these are
   // done automatically). Consequently, this function cannot be called in
@@ -220,6 +330,38 @@ extern "C" {
   // Call this before searching a new file.
   void lg_reset_context(LG_HCONTEXT hCtx);
 
+  // Enables or disables the keywords with the given indices, or all of
+  // them if keywordIndices is NULL, so that one program can serve searches
+  // for different subsets of its keywords without being recompiled. Hits
+  // for disabled keywords are never reported, partial matches are dropped
+  // once they can only be for disabled keywords, and the thread VM does
+  // not start matches which can only be. Keywords start out enabled; the
+  // setting lasts until changed, across resets. Resets the context.
+  // Returns zero if an index is out of range, positive otherwise.
+  int lg_enable_keywords(LG_HCONTEXT hCtx,
+                         const uint64_t* keywordIndices,
+                         uint64_t numIndices,
+                         int enable);
+
+  // Save the state of the search in progress on the context: its partial
+  // matches, the ends of its hits, and its hit counts. Restored to a
+  // context for the same program and engine, now or in another process,
+  // the search carries on as if the buffers had all gone to one context,
+  // so a stream can be put aside, or a long search checkpointed. The
+  // offset to carry on from is not saved; it is the end of the last
+  // buffer searched. The state is in the host's byte order, and only good
+  // for the same version of the library. Returns the size of the state,
+  // which is written to buf if bufSize is large enough; pass NULL to get
+  // the size. Returns zero on failure, as when lg_search_hits() has hits
+  // yet to give.
+  uint64_t lg_save_context(LG_HCONTEXT hCtx, void* buf, uint64_t bufSize);
+
+  // Restore the state saved by lg_save_context(). The context keeps its own
+  // options and enabled keywords. Returns zero, leaving the context reset,
+  // if the state is malformed, or is from a context for another program or
+  // engine; positive otherwise.
+  int lg_restore_context(LG_HCONTEXT hCtx, const void* buf, uint64_t bufSize);
+
   // Search a buffer. It assumes it's picking up where it left off, so you can
   // call this in a loop. When a hit is identified, the callback function will
   // be called, on the same stackframe, giving you the starting byte offset of
@@ -255,6 +397,89 @@ extern "C" {
                          void* userData,
                          LG_HITCALLBACK_FN callbackFn);
 
+  // Search a buffer using up to numThreads threads. It finds the same hits as
+  // lg_search(), reports them in the same order, and leaves the context in
+  // the same state, so the two can be mixed when searching a stream. The
+  // callback is only called from the calling thread. Buffers under 2MB are
+  // searched on the calling thread alone, as are all buffers when the
+  // context's options limit its hits.
+  uint64_t lg_search_parallel(LG_HCONTEXT hCtx,
+                              const char* bufStart,
+                              const char* bufEnd,
+                              const uint64_t startOffset,
+                              unsigned int numThreads,
+                              void* userData,
+                              LG_HITCALLBACK_FN callbackFn);
+
+  // Search a buffer, as lg_search() does, but put the hits in an array
+  // instead of calling back for each. At most maxHits hits are written to
+  // hits, and their number to *numHits. If the array fills before the
+  // search is done, it returns a positive value, and the search stops at
+  // that point; empty the array and call it again, with the same
+  // arguments, to carry on. Returns zero when the buffer has been
+  // searched, and negative on failure. Call nothing else on the context
+  // in between, other than lg_reset_context(), which drops the hits yet
+  // to be collected.
+  int lg_search_hits(LG_HCONTEXT hCtx,
+                     const char* bufStart,
+                     const char* bufEnd,
+                     uint64_t startOffset,
+                     LG_SearchHit* hits,
+                     uint64_t maxHits,
+                     uint64_t* numHits);
+
+  // lg_closeout_search() for lg_search_hits(), with the same return values.
+  int lg_closeout_hits(LG_HCONTEXT hCtx,
+                       LG_SearchHit* hits,
+                       uint64_t maxHits,
+                       uint64_t* numHits);
+
+  // A buffer for lg_search_batch()
+  typedef struct {
+    const char* Buf;
+    uint64_t Len;
+    uint64_t Id;          // set by user, copied to the buffer's hits
+  } LG_BatchBuffer;
+
+  typedef struct {
+    LG_SearchHit Hit;     // offsets are relative to the start of the buffer
+    uint64_t Id;          // Id of the buffer the hit is in
+  } LG_BatchHit;
+
+  // Hits from lg_search_batch(). Hits may start out NULL, or be allocated
+  // by the user with malloc(); the array is grown with realloc() as needed.
+  typedef struct {
+    LG_BatchHit* Hits;
+    uint64_t Size;        // number of hits in the array
+    uint64_t Capacity;    // number of hits the array has room for
+  } LG_BatchHits;
+
+  void lg_free_batch_hits(LG_BatchHits* hits);
+
+  // The number of hits for the keyword with the given index since the
+  // context was last reset, including those not reported in LG_HITS_COUNT
+  // mode. Hits are counted only when the context's options limit them,
+  // so this is always zero with LG_HITS_ALL and no MaxHitsPerPattern.
+  // As lg_starts_with() resets the context, it clears the counts. Once a
+  // keyword reaches MaxHitsPerPattern, its count stays there.
+  // In LG_HITS_FIRST mode, the search stops after the first hit, and
+  // lg_search() returns the offset of the end of the buffer without
+  // looking at the rest of it; further searching finds nothing until the
+  // context is reset.
+  uint64_t lg_hit_count(LG_HCONTEXT hCtx, uint64_t keywordIndex);
+
+  // Search many small buffers at once. Each buffer is searched on its own,
+  // from offset zero, as if by lg_reset_context(), lg_search(), and
+  // lg_closeout_search(), and its hits are appended to hits in the order
+  // lg_search() would report them. This avoids a full context reset and a
+  // callback for each buffer. The context is reset when done, except for
+  // its hit counts, which cover the whole batch, as do any limits on hits.
+  // Return value is the number of hits appended.
+  uint64_t lg_search_batch(LG_HCONTEXT hCtx,
+                           const LG_BatchBuffer* bufs,
+                           uint64_t numBufs,
+                           LG_BatchHits* hits);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,366 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTGREP_CPP_API_H_
+#define LIGHTGREP_CPP_API_H_
+
+//
+// A header-only C++ layer over the C API. The handles free themselves,
+// failures throw lightgrep::Error, and hits go to any callable taking a
+// const LG_SearchHit&. Search collects the hits a buffer at a time with
+// lg_search_hits(), so the handler is called directly from an inlined
+// loop, rather than through a function pointer and void* for each hit,
+// and exceptions from it pass through to the caller. Nothing here is
+// compiled into the library, so the C ABI is unchanged.
+//
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "api.h"
+
+namespace lightgrep {
+
+  class Error: public std::runtime_error {
+  public:
+    explicit Error(const std::string& msg): std::runtime_error(msg) {}
+
+    // takes the first of the errors, and frees them all
+    explicit Error(LG_Error* err):
+      std::runtime_error(err && err->Message ? err->Message : "Unknown error")
+    {
+      lg_free_error(err);
+    }
+  };
+
+  namespace detail {
+    template <class T, void (*Destroy)(T*)>
+    struct Destroyer {
+      void operator()(T* h) const { Destroy(h); }
+    };
+
+    template <class T, void (*Destroy)(T*)>
+    using Handle = std::unique_ptr<T, Destroyer<T, Destroy>>;
+
+    template <class T>
+    T* check(T* h, const char* what) {
+      if (!h) {
+        throw Error(what);
+      }
+      return h;
+    }
+
+    // hits per call to lg_search_hits(); enough to make the calls cheap,
+    // few enough to stay in cache
+    constexpr uint64_t HIT_BATCH = 256;
+
+    // calls fn with a batch buffer until it returns zero, passing each
+    // hit to handler
+    template <class Fn, class Handler>
+    void drain(Fn&& fn, Handler& handler) {
+      LG_SearchHit hits[HIT_BATCH];
+      uint64_t n;
+      int status;
+      do {
+        status = fn(hits, HIT_BATCH, &n);
+        if (status < 0) {
+          throw Error("Search failed");
+        }
+
+        for (const LG_SearchHit* h = hits; h != hits + n; ++h) {
+          handler(*h);
+        }
+      } while (status);
+    }
+  }
+
+  class Pattern {
+  public:
+    Pattern(): H(detail::check(lg_create_pattern(), "Failed to create pattern")) {}
+
+    Pattern(const std::string& pattern, const LG_KeyOptions& opts = LG_KeyOptions{0, 0, 0}):
+      Pattern()
+    {
+      parse(pattern, opts);
+    }
+
+    // the handle may be reused for each pattern, saving allocations
+    void parse(const std::string& pattern, const LG_KeyOptions& opts = LG_KeyOptions{0, 0, 0}) {
+      LG_Error* err = nullptr;
+      if (!lg_parse_pattern(H.get(), pattern.c_str(), &opts, &err)) {
+        throw Error(err);
+      }
+    }
+
+    LG_HPATTERN get() const { return H.get(); }
+
+  private:
+    detail::Handle<PatternHandle, lg_destroy_pattern> H;
+  };
+
+  class Program;
+
+  class FSM {
+  public:
+    // see lg_create_fsm() for the hint
+    explicit FSM(unsigned int numFsmStateSizeHint = 0):
+      H(detail::check(lg_create_fsm(numFsmStateSizeHint), "Failed to create FSM")) {}
+
+    // returns the index of the pattern-encoding pair
+    int addPattern(Program& prog, const Pattern& pattern, const std::string& encoding, uint64_t userIndex);
+
+    // see lg_add_pattern_list() for the format
+    void addPatternList(Program& prog,
+                        const std::string& patterns,
+                        const std::string& source,
+                        const std::vector<std::string>& defaultEncodings = {"ASCII"},
+                        const LG_KeyOptions& defaultOptions = LG_KeyOptions{0, 0, 0});
+
+    LG_HFSM get() const { return H.get(); }
+
+  private:
+    detail::Handle<FSMHandle, lg_destroy_fsm> H;
+  };
+
+  //
+  // Contexts share ownership of their Program, so it lives as long as
+  // any of them do.
+  //
+  class Program {
+  public:
+    explicit Program(unsigned int numTotalPatternsSizeHint = 0):
+      H(detail::check(
+        lg_create_program(numTotalPatternsSizeHint), "Failed to create program"
+      ), lg_destroy_program) {}
+
+    // reads a program written by write(), keeping buf for as long as the
+    // program lives, as the program refers to it
+    static Program read(std::vector<char> buf) {
+      auto data = std::make_shared<std::vector<char>>(std::move(buf));
+      LG_HPROGRAM h = detail::check(
+        lg_read_program(data->data(), static_cast<int>(data->size())),
+        "Failed to read program"
+      );
+      return Program(std::shared_ptr<ProgramHandle>(
+        h, [data](ProgramHandle* p) { lg_destroy_program(p); }
+      ));
+    }
+
+    // maps a file holding a program written by write(); see lg_map_program()
+    static Program map(const std::string& path, bool verify = true) {
+      return Program(std::shared_ptr<ProgramHandle>(
+        detail::check(
+          lg_map_program(path.c_str(), verify), "Failed to map program"
+        ),
+        lg_destroy_program
+      ));
+    }
+
+    void compile(const FSM& fsm, const LG_ProgramOptions& opts = LG_ProgramOptions{1}) {
+      if (!lg_compile_program(fsm.get(), H.get(), &opts)) {
+        throw Error("Failed to compile program");
+      }
+    }
+
+    std::vector<char> write() const {
+      std::vector<char> buf(lg_program_size(H.get()));
+      lg_write_program(H.get(), buf.data());
+      return buf;
+    }
+
+    unsigned int size() const { return lg_program_size(H.get()); }
+
+    unsigned int patternCount() const { return lg_pattern_count(H.get()); }
+
+    const LG_PatternInfo& patternInfo(unsigned int patternIndex) const {
+      if (patternIndex >= patternCount()) {
+        throw Error("Pattern index out of range");
+      }
+      return *lg_pattern_info(H.get(), patternIndex);
+    }
+
+    LG_HPROGRAM get() const { return H.get(); }
+
+  private:
+    explicit Program(std::shared_ptr<ProgramHandle> h): H(std::move(h)) {}
+
+    friend class Context;
+
+    std::shared_ptr<ProgramHandle> H;
+  };
+
+  inline int FSM::addPattern(Program& prog, const Pattern& pattern, const std::string& encoding, uint64_t userIndex) {
+    LG_Error* err = nullptr;
+    const int idx = lg_add_pattern(
+      H.get(), prog.get(), pattern.get(), encoding.c_str(), userIndex, &err
+    );
+    if (err) {
+      throw Error(err);
+    }
+    return idx;
+  }
+
+  inline void FSM::addPatternList(Program& prog,
+                                  const std::string& patterns,
+                                  const std::string& source,
+                                  const std::vector<std::string>& defaultEncodings,
+                                  const LG_KeyOptions& defaultOptions)
+  {
+    std::vector<const char*> encs;
+    for (const std::string& enc : defaultEncodings) {
+      encs.push_back(enc.c_str());
+    }
+
+    LG_Error* err = nullptr;
+    lg_add_pattern_list(
+      H.get(), prog.get(), patterns.c_str(), source.c_str(),
+      encs.data(), static_cast<unsigned int>(encs.size()), &defaultOptions, &err
+    );
+    if (err) {
+      throw Error(err);
+    }
+  }
+
+  //
+  // The handlers passed to search() and closeOut() are called on the
+  // caller's thread, in the order lg_search() would report the hits. If a
+  // handler throws, the exception propagates, and the context must be
+  // reset before it is used again.
+  //
+  class Context {
+  public:
+    explicit Context(const Program& prog, const LG_ContextOptions& opts = LG_ContextOptions{0, 0, 0, 0, 0, 0}):
+      Prog(prog.H),
+      H(detail::check(
+        lg_create_context(prog.get(), &opts), "Failed to create context"
+      )) {}
+
+    // see lg_clone_context()
+    Context clone() const {
+      return Context(Prog, detail::check(
+        lg_clone_context(H.get()), "Failed to clone context"
+      ));
+    }
+
+    template <class Handler>
+    void search(const char* beg, const char* end, uint64_t startOffset, Handler&& handler) {
+      detail::drain(
+        [=](LG_SearchHit* hits, uint64_t maxHits, uint64_t* n) {
+          return lg_search_hits(H.get(), beg, end, startOffset, hits, maxHits, n);
+        },
+        handler
+      );
+    }
+
+    template <class Handler>
+    void search(std::string_view buf, uint64_t startOffset, Handler&& handler) {
+      search(buf.data(), buf.data() + buf.size(), startOffset, handler);
+    }
+
+    template <class Handler>
+    void closeOut(Handler&& handler) {
+      detail::drain(
+        [=](LG_SearchHit* hits, uint64_t maxHits, uint64_t* n) {
+          return lg_closeout_hits(H.get(), hits, maxHits, n);
+        },
+        handler
+      );
+    }
+
+    // searches the whole of buf as one stream, leaving the context reset
+    template <class Handler>
+    void searchBuffer(std::string_view buf, Handler&& handler) {
+      search(buf, 0, handler);
+      closeOut(handler);
+      reset();
+    }
+
+    // see lg_starts_with(); the context is reset afterwards
+    template <class Handler>
+    void startsWith(const char* beg, const char* end, uint64_t startOffset, Handler&& handler) {
+      using H_t = std::remove_reference_t<Handler>;
+      std::pair<H_t*, std::exception_ptr> data(&handler, nullptr);
+
+      // the library traps exceptions, so carry any out past it
+      lg_starts_with(
+        H.get(), beg, end, startOffset, &data,
+        [](void* userData, const LG_SearchHit* const hit) {
+          auto& d = *static_cast<std::pair<H_t*, std::exception_ptr>*>(userData);
+          if (!d.second) {
+            try {
+              (*d.first)(*hit);
+            }
+            catch (...) {
+              d.second = std::current_exception();
+            }
+          }
+        }
+      );
+
+      if (data.second) {
+        std::rethrow_exception(data.second);
+      }
+    }
+
+    void reset() { lg_reset_context(H.get()); }
+
+    // all keywords, if indices is empty
+    void enableKeywords(const std::vector<uint64_t>& indices, bool enable = true) {
+      if (!lg_enable_keywords(H.get(), indices.empty() ? nullptr : indices.data(), indices.size(), enable)) {
+        throw Error("Keyword index out of range");
+      }
+    }
+
+    uint64_t hitCount(uint64_t keywordIndex) const {
+      return lg_hit_count(H.get(), keywordIndex);
+    }
+
+    std::vector<char> save() const {
+      std::vector<char> state(lg_save_context(H.get(), nullptr, 0));
+      if (state.empty() || lg_save_context(H.get(), state.data(), state.size()) != state.size()) {
+        throw Error("Failed to save context");
+      }
+      return state;
+    }
+
+    void restore(const std::vector<char>& state) {
+      if (!lg_restore_context(H.get(), state.data(), state.size())) {
+        throw Error("Bad context state");
+      }
+    }
+
+    LG_HCONTEXT get() const { return H.get(); }
+
+  private:
+    Context(std::shared_ptr<ProgramHandle> prog, LG_HCONTEXT h):
+      Prog(std::move(prog)), H(h) {}
+
+    // declared first, so the context is destroyed before its program
+    std::shared_ptr<ProgramHandle> Prog;
+    detail::Handle<ContextHandle, lg_destroy_context> H;
+  };
+}
+
+#endif /* LIGHTGREP_CPP_API_H_ */
@@ -0,0 +1,112 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <bitset>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arrayref.h"
+#include "basic.h"
+
+// the encoded bytes of a pattern, and its label
+typedef std::pair<std::string,uint32_t> Literal;
+
+//
+// An Aho-Corasick automaton over a set of byte strings, stored as a
+// double-array trie. State 0 is the root. The goto function for state s
+// and byte c is t = Units[s].Base + c if Units[t].Check == s; otherwise
+// we follow failure links. The root's transitions are kept in a full
+// table, so the root never fails. The tables of an unmarshalled matcher
+// stay in the buffer it was read from.
+//
+class LiteralMatcher {
+public:
+  static const uint32_t NONE;
+
+  struct Unit {
+    int32_t Base;
+    uint32_t Check;
+  };
+
+  struct State {
+    uint32_t Fail,
+             Depth,
+             Dict,   // nearest state on the failure chain with labels
+             OutBeg, // [OutBeg, OutEnd) indexes Labels
+             OutEnd;
+  };
+
+  LiteralMatcher(const std::vector<Literal>& lits);
+
+  uint32_t next(uint32_t s, const byte c) const {
+    while (s) {
+      const uint32_t t = Units[s].Base + c;
+      if (Units[t].Check == s) {
+        return t;
+      }
+      s = States[s].Fail;
+    }
+    return RootNext[c];
+  }
+
+  // the goto function alone; NONE if there is no edge
+  uint32_t child(uint32_t s, const byte c) const {
+    if (!s) {
+      return RootNext[c] ? RootNext[c] : NONE;
+    }
+    const uint32_t t = Units[s].Base + c;
+    return Units[t].Check == s ? t : NONE;
+  }
+
+  const State& state(uint32_t s) const { return States[s]; }
+
+  const uint32_t* labelsBegin(uint32_t s) const {
+    return Labels.data() + States[s].OutBeg;
+  }
+
+  const uint32_t* labelsEnd(uint32_t s) const {
+    return Labels.data() + States[s].OutEnd;
+  }
+
+  uint32_t numStates() const { return States.size(); }
+
+  // the first two bytes of every literal, where one-byte literals pair
+  // with every second byte; usable as a prefilter at offset 0
+  std::bitset<256*256> pairs() const;
+
+  bool operator==(const LiteralMatcher& rhs) const;
+
+  // a multiple of 8 bytes
+  size_t bufSize() const;
+  void marshall(char* buf) const;
+
+  // buf must be 8-byte aligned, and outlive the matcher
+  static std::unique_ptr<LiteralMatcher> unmarshall(const char* buf, size_t len);
+
+private:
+  LiteralMatcher() {}
+
+  ArrayRef<uint32_t> RootNext;
+  ArrayRef<Unit> Units;
+  ArrayRef<State> States;
+  ArrayRef<uint32_t> Labels;
+};
@@ -0,0 +1,86 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "basic.h"
+#include "literalmatcher.h"
+#include "skipscan.h"
+#include "sparseset.h"
+#include "vm_interface.h"
+
+//
+// Searches with the program's literal set instead of running threads.
+// Used when every pattern is a plain byte string. Every label has a
+// single fixed length, so a hit is final as soon as its last byte is
+// seen; hits are reported in order of end offset, and for hits ending
+// at the same offset, longer before shorter. The hits are the same as
+// Vm's, but not always in the same order, as Vm holds back a hit while
+// a longer match with the same start is still live.
+//
+class LiteralVm: public VmInterface {
+public:
+  LiteralVm(ProgramPtr prog);
+
+  virtual void startsWith(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual uint64_t search(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual uint64_t searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
+  virtual void closeOut(HitCallback hitFn, void* userData);
+  virtual void reset();
+  virtual void restart();
+  virtual bool idle() const;
+  virtual HitCounter& hits() { return Hits; }
+  virtual void setMask(const std::shared_ptr<const LabelMask>& mask);
+  virtual std::shared_ptr<VmInterface> clone() const;
+  virtual void save(std::vector<char>& buf) const;
+  virtual void restore(const char* beg, const char* end);
+
+  #ifdef LBT_TRACE_ENABLED
+  void setDebugRange(uint64_t, uint64_t) {}
+  #endif
+
+private:
+  LiteralVm(const LiteralVm& other);
+
+  void _report(uint32_t s, const uint64_t end, const uint64_t startLimit);
+  void _setMatchEnd(const uint32_t label, const uint64_t end);
+  void _reportLimitedHit(const uint64_t start, const uint64_t end, const uint32_t label);
+
+  uint64_t _startOfLeftmostPartial(const uint64_t offset) const;
+
+  const ProgramPtr Prog;
+  const LiteralMatcher& Lits;
+
+  const SkipScanner Skip;
+
+  uint32_t State;
+
+  std::vector<uint64_t> MatchEnds;
+
+  // the labels with nonzero MatchEnds, so reset() need not clear them all
+  SparseSet Matched;
+
+  HitCallback CurHitFn;
+  void* UserData;
+
+  HitCounter Hits;
+
+  std::shared_ptr<const LabelMask> Mask;
+};
@@ -21,12 +21,13 @@
 #include "basic.h"
 #include "automata.h"
 
-#include <map>
-#include <set>
 #include <stack>
+#include <vector>
 
 class NFAOptimizer {
 public:
+  NFAOptimizer(): Stamp(0) {}
+
   typedef std::pair<NFA::VertexDescriptor, NFA::VertexDescriptor> StatePair;
   typedef std::pair<NFA::VertexDescriptor, uint32_t> EdgePair;
 
@@ -39,6 +40,13 @@ public:
 
   void subsetDFA(NFA& dst, const NFA& src);
 
+  // Merges equivalent vertices: those with the same transition and label,
+  // whose out edges lead, in order, to equivalent vertices. Edge order is
+  // kept, as it is the order of preference among threads, so this is
+  // minimization of the DFA whose letters are edge positions. dst must
+  // hold only the initial vertex.
+  void minimizeDFA(NFA& dst, const NFA& src);
+
   void pruneBranches(NFA& g);
 
   StatePair processChild(const NFA& src, NFA& dst, uint32_t si, NFA::VertexDescriptor srcHead, NFA::VertexDescriptor dstHead);
@@ -46,9 +54,25 @@ public:
   bool canMerge(const NFA& dst, NFA::VertexDescriptor dstTail, const Transition* dstTrans, ByteSet& dstBits, const NFA& src, NFA::VertexDescriptor srcTail, const ByteSet& srcBits) const;
 
 private:
-  std::map<NFA::VertexDescriptor, std::vector<NFA::VertexDescriptor>> Dst2Src;
+  // What the current merge knows of a destination vertex: the first
+  // source vertex mapped to it, and the position among its out edges
+  // from which to look for a match for the next source edge. Entries
+  // from earlier merges have older stamps, so nothing need be cleared.
+  struct DstInfo {
+    uint32_t SrcStamp, PosStamp;
+    NFA::VertexDescriptor FirstSrc;
+    uint32_t Pos;
+  };
+
+  void nextStamp();
+
+  std::vector<DstInfo> DstInfos;
+  uint32_t Stamp;
+
   std::vector<NFA::VertexDescriptor> Src2Dst;
   std::stack<EdgePair> Edges;
-  std::set<EdgePair> Visited;
-  std::map<NFA::VertexDescriptor, uint32_t> DstPos;
+
+  // the out edges of the source already merged, as indexed by EdgeBase
+  std::vector<uint32_t> EdgeBase;
+  std::vector<bool> Visited;
 };
@@ -31,6 +31,7 @@ public:
 
   std::string Output,
               ProgramFile,
+              ProgramCache,
               GroupSeparator;
 
   std::vector<std::string> Inputs,
@@ -39,7 +40,11 @@ public:
                            KeyFiles,
                            Encodings;
 
-  uint32_t BlockSize;
+  uint32_t BlockSize,
+           Threads;
+
+  uint64_t DfaCacheSize,
+           MaxCount;
 
   int32_t BeforeContext = -1,
           AfterContext = -1;
@@ -49,6 +54,8 @@ public:
        UnicodeMode,
        NoOutput,
        Determinize,
+       LazyDfa,
+       Jit,
        PrintPath,
        Recursive,
        Binary,
@@ -0,0 +1,59 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "fsmthingy.h"
+#include "pattern.h"
+
+//
+// A pattern to add in each of some encodings, and what became of it:
+// if it parsed, there is an entry in Nfas and in Errors for each
+// encoding, holding the built NFA or else the error from building it;
+// if it did not, Nfas is empty and Error holds the parse error. A job
+// with no encodings is neither parsed nor built.
+//
+struct PatternJob {
+  Pattern Pat;
+  std::vector<std::string> Encodings;
+
+  std::string Error;
+  std::vector<PatternNFA> Nfas;
+  std::vector<std::string> Errors;
+};
+
+//
+// Parses the patterns and builds their NFAs on up to numThreads - 1
+// threads, each with its own builder, while the calling thread passes
+// each job to merge, in order, as soon as the jobs before it have been.
+// merge is expected to add the job's NFAs to fsm with mergePattern(),
+// and so sees just what it would if the jobs were built serially: the
+// FSM is the same whatever the number of threads. The jobs are built a
+// window at a time, and their NFAs are freed once merged.
+//
+void buildPatterns(
+  FSMThingy& fsm,
+  std::vector<PatternJob>& jobs,
+  const uint32_t numThreads,
+  const std::function<void(PatternJob&)>& merge
+);
@@ -0,0 +1,47 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "basic.h"
+#include "searchhit.h"
+#include "vm_interface.h"
+
+//
+// Searches [beg, end) as vm->search() would, finding the same hits and
+// reporting them in the same order, but with the buffer split among up
+// to numThreads engines made by create. The first part is searched by
+// vm on the calling thread while fresh engines search the others. Then
+// vm runs on into each later part until both it and that part's engine
+// are idle at the same offset; after that the two must find the same
+// hits, so the part's remaining hits are reported and its engine takes
+// over from vm. Hits are only reported on the calling thread.
+//
+uint64_t parallelSearch(
+  std::shared_ptr<VmInterface>& vm,
+  const std::function<std::shared_ptr<VmInterface>()>& create,
+  const byte* const beg,
+  const byte* const end,
+  const uint64_t startOffset,
+  const uint32_t numThreads,
+  HitCallback hitFn,
+  void* userData
+);
@@ -27,8 +27,10 @@
 #include <vector>
 
 #include "basic.h"
+#include "byteclasses.h"
 #include "instructions.h"
 #include "fwd_pointers.h"
+#include "literalmatcher.h"
 
 class Program {
 public:
@@ -36,6 +38,7 @@ public:
 
   Program(size_t icount, const Instruction& val):
     MaxLabel(0), MaxCheck(0), FilterOff(0), Filter(),
+    FactorMaxLen(0), FactorMaxLead(0), FactorLead(),
     IBeg(new Instruction[icount], [](Instruction* i){ delete[] i; }),
     IEnd(IBeg.get() + icount)
   {
@@ -47,6 +50,17 @@ public:
   uint32_t FilterOff;
   std::bitset<256*256> Filter;
 
+  // the classes by which jump tables and bit vectors are indexed
+  ByteClasses Classes;
+
+  // set when every pattern is a byte string; see LiteralVm
+  std::unique_ptr<LiteralMatcher> Literals;
+
+  // set when every pattern has a required factor; see Vm::_nextStart
+  std::unique_ptr<LiteralMatcher> Factors;
+  uint32_t FactorMaxLen, FactorMaxLead;
+  std::bitset<256> FactorLead;
+
   // typedefs for container compatibility
   typedef Instruction value_type;
   typedef size_t size_type;
@@ -138,17 +152,28 @@ public:
 
   bool operator==(const Program& rhs) const;
 
+  // a multiple of 8 bytes
   size_t bufSize() const {
-    return sizeof(MaxLabel) +
-           sizeof(MaxCheck) +
-           sizeof(FilterOff) +
+    return 6*sizeof(uint32_t) +
+           3*sizeof(uint64_t) +
            Filter.size()/8 +
-           size()*sizeof(Instruction);
+           FactorLead.size()/8 +
+           sizeof(Classes.Map) +
+           (Literals ? Literals->bufSize() : 0) +
+           (Factors ? Factors->bufSize() : 0) +
+           ((size()*sizeof(Instruction) + 7) & ~size_t(7));
   }
 
   std::vector<char> marshall() const;
+
+  // The instructions and literal tables are used where they lie, so buf
+  // must be 8-byte aligned, and must outlive the program unless it is
+  // kept in Storage.
   static ProgramPtr unmarshall(const void* buf, size_t len);
 
+  // the memory the program was read from, when the program keeps it
+  std::shared_ptr<const void> Storage;
+
 private:
   std::unique_ptr<Instruction[], void(*)(Instruction*)> IBeg;
   Instruction* IEnd;
@@ -0,0 +1,61 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "lightgrep/api.h"
+
+//
+// A directory of serialized programs, each in a file named for a hash of
+// the inputs it was compiled from. The file holds the inputs in full, and
+// they are checked on reading, so a collision costs only a recompile.
+// Files are written under a temporary name and renamed into place, so
+// readers in other processes never see one partly written, and writers of
+// the same program just replace each other's identical file.
+//
+class ProgramCache {
+public:
+  ProgramCache(const std::string& dir): Dir(dir) {}
+
+  // the serialized program for the inputs, or empty if there isn't one
+  std::vector<char> read(const std::string& inputs) const;
+
+  // returns false if the program could not be stored
+  bool write(const std::string& inputs, const std::vector<char>& prog) const;
+
+  std::string path(const std::string& inputs) const;
+
+private:
+  std::string Dir;
+};
+
+// everything a program compiled from pattern lists depends on: the text of
+// each list, the encodings and options they are added with, the program
+// options, and the version of the library
+std::string programCacheInputs(
+  const char** patternLists,
+  unsigned int numLists,
+  const char** defaultEncodings,
+  unsigned int defaultEncodingsNum,
+  const LG_KeyOptions* defaultOptions,
+  const LG_ProgramOptions* programOptions
+);
@@ -0,0 +1,54 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "basic.h"
+#include "fwd_pointers.h"
+
+class PatternMap;
+
+//
+// A serialized program, as made by lg_write_program(). A header, with
+// a magic number, a format version, the size, and a checksum of the rest,
+// is followed by the pattern map and the program, each starting 8-byte
+// aligned. A program read from an aligned buffer or mapped from a file
+// uses its patterns, instructions, and literal tables where they lie, so
+// processes mapping the same file share one copy of it.
+//
+size_t programFileSize(const PatternMap& pmap, const Program& prog);
+
+// buf must hold programFileSize() bytes
+void writeProgramFile(const PatternMap& pmap, const Program& prog, char* buf);
+
+// Throws if buf is not a program of this version. The checksum is not
+// verified unless asked, so that mapping a large file need not read it.
+// buf must be 8-byte aligned and outlive the results.
+void readProgramFile(const char* buf, size_t len, bool verify,
+                     std::unique_ptr<PatternMap>& pmap, ProgramPtr& prog);
+
+// Maps the file read-only and reads it; the program keeps the mapping.
+void mapProgramFile(const std::string& path, bool verify,
+                    std::unique_ptr<PatternMap>& pmap, ProgramPtr& prog);
+
+// a fast 64-bit hash; not cryptographic
+uint64_t programChecksum(const char* buf, size_t len);
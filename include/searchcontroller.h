@@ -7,8 +7,9 @@
 
 class SearchController {
 public:
-  SearchController(uint32_t blkSize):
+  SearchController(uint32_t blkSize, uint32_t threads = 1):
     BlockSize(blkSize),
+    Threads(threads),
     BytesSearched(0),
     TotalTime(0.0) {}
 
@@ -19,7 +20,17 @@ public:
     LG_HITCALLBACK_FN callback
   );
 
+  uint64_t search(
+    ContextHandle* searcher,
+    HitCounterInfo* hinfo,
+    const char* buf,
+    uint64_t blkSize,
+    uint64_t offset,
+    LG_HITCALLBACK_FN callback
+  );
+
   size_t BlockSize;
+  uint32_t Threads;
   uint64_t BytesSearched;
   double TotalTime;
 };
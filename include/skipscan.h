@@ -0,0 +1,81 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <bitset>
+
+#include "basic.h"
+
+//
+// SkipScanner finds the next position which passes the two-byte
+// prefilter. When no threads are live, every position which fails the
+// prefilter is a no-op frame, so the VM can jump straight to the next
+// candidate. The scan tests the first and second filter bytes against
+// their projected byte sets with a vectorized (truffle-style) set test,
+// then confirms each candidate against the exact filter.
+//
+class SkipScanner {
+public:
+  enum Impl {
+    SCALAR,
+    SSE42,
+    AVX2
+  };
+
+  SkipScanner(const std::bitset<256*256>& filter);
+
+  SkipScanner(const std::bitset<256*256>& filter, Impl impl);
+
+  // A copy of other, but over filter, which must be a copy of other's
+  // filter; this skips rebuilding the tables.
+  SkipScanner(const SkipScanner& other, const std::bitset<256*256>& filter);
+
+  // Returns the first p in [beg, end) for which filter[p[0] | p[1] << 8]
+  // holds, or end if there is none. Reads up to and including *end.
+  const byte* next(const byte* beg, const byte* end) const {
+    return (this->*Scan)(beg, end);
+  }
+
+  Impl impl() const { return Which; }
+
+  // The best implementation supported by the running CPU
+  static Impl bestImpl();
+
+private:
+  typedef const byte* (SkipScanner::*ScanFn)(const byte*, const byte*) const;
+
+  void init(Impl impl);
+
+  bool test(const byte* p) const {
+    return Filter[p[0] | (static_cast<uint32_t>(p[1]) << 8)];
+  }
+
+  const byte* scanScalar(const byte* beg, const byte* end) const;
+  const byte* scanSSE42(const byte* beg, const byte* end) const;
+  const byte* scanAVX2(const byte* beg, const byte* end) const;
+
+  const std::bitset<256*256>& Filter;
+
+  // truffle tables for the first and second filter bytes: the low
+  // nibble selects a byte of the table, the high nibble a bit in it
+  byte Lo1[16], Hi1[16], Lo2[16], Hi2[16];
+
+  Impl Which;
+  ScanFn Scan;
+};
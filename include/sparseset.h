@@ -48,6 +48,10 @@ public:
     End = Max;
   }
 
+  // the elements, in order of insertion
+  const uint32_t* begin() const { return Data.get() + Max; }
+  const uint32_t* end() const { return Data.get() + End; }
+
   void resize(uint32_t maxSize) {
     Data.reset(new uint32_t[2 * maxSize]);
     End = Max = maxSize;
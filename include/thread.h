@@ -21,61 +21,63 @@
 #include "basic.h"
 #include "instructions.h"
 
+//
+// Threads are copied into Vm::Next on every byte they survive, so they
+// are kept small: the PC is an index into the program rather than a
+// pointer, and Lead shares a word with End, which leaves 24 bytes.
+//
 struct Thread {
   static const uint32_t NOLABEL;
+  static const uint32_t DEAD;   // the PC of a thread which has died
   static const uint64_t NONE;
 
-  Thread(): Thread(nullptr, NOLABEL, 0, NONE) {}
+  Thread(): Thread(DEAD, NOLABEL, 0, NONE) {}
 
-  Thread(const Instruction* pc): Thread(pc, NOLABEL, 0, NONE) {}
+  Thread(uint32_t pc): Thread(pc, NOLABEL, 0, NONE) {}
 
-  Thread(const Instruction* pc, uint32_t label, uint64_t start, uint64_t end):
+  Thread(uint32_t pc, uint32_t label, uint64_t start, uint64_t end):
     PC(pc),
+    Label(label),
     Start(start),
     End(end),
+    Lead(false)
     #ifdef LBT_TRACE_ENABLED
-    Id(0),
+    , Id(0)
     #endif
-    Label(label),
-    Lead(false) {}
+    {}
 
   #ifdef LBT_TRACE_ENABLED
-  Thread(const Instruction* pc, uint32_t label,
+  Thread(uint32_t pc, uint32_t label,
          uint64_t id, uint64_t start, uint64_t end):
     PC(pc),
+    Label(label),
     Start(start),
     End(end),
-    Id(id),
-    Label(label),
-    Lead(false) {}
+    Lead(false),
+    Id(id) {}
   #endif
 
-  void jump(const Instruction* base, uint32_t offset) {
-    PC = base + offset;
+  void jump(uint32_t pc) {
+    PC = pc;
   }
 
-  void fork(const Thread& parent, const Instruction* base, uint32_t offset) {
+  void fork(const Thread& parent, uint32_t pc) {
     *this = parent;
-    jump(base, offset);
+    jump(pc);
   }
 
   void advance(uint32_t size) {
     PC += size;
   }
 
-  void advance() {
-    PC += PC->wordSize();
-  }
-
-  const Instruction* PC;
-  uint64_t Start, End;
+  uint32_t PC;
+  uint32_t Label;
+  uint64_t Start;
+  uint64_t End : 63,
+           Lead : 1;
   #ifdef LBT_TRACE_ENABLED
   uint64_t Id;
   #endif
-  uint32_t Label;
-  bool Lead;
-
-//  uint32_t Dummy;
 
   #ifdef LBT_TRACE_ENABLED
   enum ThreadLife {
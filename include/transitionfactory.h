@@ -123,12 +123,14 @@ public:
     return getByteSet(bset);
   }
 
-private:
-  Transition* get(Transition* t) {
-    auto i = Exemplars.find(t);
+  // this factory's equivalent of t, which may be from another factory
+  Transition* get(const Transition* t) {
+    auto i = Exemplars.find(const_cast<Transition*>(t));
     return i == Exemplars.end() ? *Exemplars.insert(t->clone()).first : *i;
   }
 
+private:
+
   std::set<Transition*,TransitionComparator> Exemplars;
 
   // Local states so we don't have to create one on each lookup
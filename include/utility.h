@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "automata.h"
+#include "byteclasses.h"
 #include "pattern.h"
 
 struct SearchInfo {};
@@ -55,8 +56,30 @@ uint32_t estimateGraphSize(const std::vector<T>& keywords) {
 
 std::pair<uint32_t,std::bitset<256*256>> bestPair(const NFA& graph);
 
+struct RequiredFactor {
+  static const uint32_t UNBOUNDED;
+
+  // bytes which occur, contiguously, in every match
+  std::string Bytes;
+  // the most bytes a match can have before its first occurrence of the
+  // factor, or UNBOUNDED
+  uint32_t MaxLead;
+  // the bytes a match can have before its first occurrence of the factor
+  ByteSet Lead;
+};
+
+// finds the longest factor made of single-byte dominators of the match
+// states; returns false if there is none
+bool requiredFactor(const NFA& graph, RequiredFactor& factor);
+
 std::vector<std::vector<NFA::VertexDescriptor>> pivotStates(NFA::VertexDescriptor source, const NFA& graph);
 
+// as pivotStates, but indexed by the class of each byte
+std::vector<std::vector<NFA::VertexDescriptor>> pivotClasses(NFA::VertexDescriptor source, const NFA& graph, const ByteClasses& classes);
+
+// the classes of bytes which no transition in graph tells apart
+ByteClasses byteClasses(const NFA& graph);
+
 uint32_t maxOutbound(const std::vector<std::vector<NFA::VertexDescriptor>>& tranTable);
 
 void writeGraphviz(std::ostream& out, const NFA& graph);
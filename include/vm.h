@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "basic.h"
+#include "skipscan.h"
 #include "sparseset.h"
 #include "vm_interface.h"
 #include "thread.h"
@@ -39,6 +40,13 @@ public:
   virtual uint64_t searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData);
   virtual void closeOut(HitCallback hitFn, void* userData);
   virtual void reset();
+  virtual void restart();
+  virtual bool idle() const;
+  virtual HitCounter& hits() { return Hits; }
+  virtual void setMask(const std::shared_ptr<const LabelMask>& mask);
+  virtual std::shared_ptr<VmInterface> clone() const;
+  virtual void save(std::vector<char>& buf) const;
+  virtual void restore(const char* beg, const char* end);
 
   #ifdef LBT_TRACE_ENABLED
   void setDebugRange(uint64_t beg, uint64_t end) {
@@ -47,8 +55,9 @@ public:
   }
   #endif
 
-  bool execute(Thread* t, const byte* const cur);
-  bool execute(ThreadList::iterator t, const byte* const cur);
+  // end bounds how far literals look ahead of cur; by default, not at all
+  bool execute(Thread* t, const byte* const cur, const byte* const end = nullptr);
+  bool execute(ThreadList::iterator t, const byte* const cur, const byte* const end = nullptr);
 
   bool executeEpsilon(Thread* t, uint64_t offset);
   bool executeEpsilon(ThreadList::iterator t, uint64_t offset);
@@ -68,28 +77,54 @@ public:
   uint32_t numActive() const { return Active.size(); }
   uint32_t numNext() const { return Next.size(); }
 
+  // Consumes b for a thread at the instruction it was compiled from, in
+  // place of _execute. Returns the PC the thread goes to, with EPSILON
+  // set if an instruction consuming nothing is there, or Thread::DEAD.
+  typedef uint32_t (*NativeStep)(uint32_t b);
+
+  static const uint32_t EPSILON = 0x80000000;
+
 private:
   void _markLive(const uint32_t label);
+  void _setMatchEnd(const uint32_t label, const uint64_t end);
+  void _reportLimitedHit(const uint64_t start, const uint64_t end, const uint32_t label);
   bool _liveCheck(const uint64_t start, const uint32_t label) const;
 
-  bool _execute(const Instruction* const base, ThreadList::iterator t, const byte* const cur) const;
+  // cls is the class of *cur, which jump tables and bit vectors use
+  bool _execute(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls) const;
 
-  template <uint32_t X>
+  template <uint32_t X, bool Chain>
   bool _executeEpsilon(const Instruction* const base, ThreadList::iterator t, const uint64_t offset);
 
   template <uint32_t X>
   bool _executeEpSequence(const Instruction* const base, ThreadList::iterator t, const uint64_t offset);
 
-  void _executeThread(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const uint64_t offset);
+  // Jit selects Native over _execute; a template parameter, rather than
+  // a test of Native, so that the interpreter's loop is left as it was
+  template <bool Jit>
+  void _executeThread(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls, const uint64_t offset);
 
-  void _executeNewThreads(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const uint64_t offset);
+  template <bool Jit>
+  void _executeNewThreads(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls, const uint64_t offset);
 
+  template <bool Jit>
   void _executeFrame(const std::bitset<256*256>& filter, ThreadList::iterator t, const Instruction* const base, const byte* const cur, const uint64_t offset);
+  template <bool Jit>
   void _executeFrame(ThreadList::iterator t, const Instruction* const base, const byte* const cur, const uint64_t offset);
 
+  template <bool Jit>
+  uint64_t _search(const byte* const beg, const byte* const end, const uint64_t startOffset);
+
   void _cleanup();
 
+  // the state, without a header, for LazyDfaVm's too
+  void _save(StateWriter& out) const;
+  void _restore(StateReader& in);
+
   uint64_t _startOfLeftmostLiveThread(const uint64_t offset) const;
+  uint64_t _halt(const uint64_t end, const uint64_t next);
+
+  const byte* _nextStart(const byte* const cur, const byte* const end, const byte*& bound) const;
 
   #ifdef LBT_TRACE_ENABLED
   void open_init_epsilon_json(std::ostream& out);
@@ -113,7 +148,15 @@ private:
   std::vector<uint64_t> ThreadCountHist;
 
   const ProgramPtr Prog;
-  const Instruction* const ProgEnd;
+  const uint32_t ProgEnd;
+
+  // Prog's byte classes
+  const byte* const Classes;
+
+  const SkipScanner Skip;
+
+  const std::bitset<256*256> FactorFilter;
+  const SkipScanner FactorSkip;
 
   ThreadList First,
              Active,
@@ -127,6 +170,30 @@ private:
   std::vector<uint64_t> MatchEnds;
   uint64_t MatchEndsMax;
 
+  // the labels with nonzero MatchEnds, so reset() need not clear them all
+  SparseSet Matched;
+
   HitCallback CurHitFn;
   void* UserData;
+
+  // the end of the buffer being searched, for literals to look ahead to
+  const byte* BufEnd;
+
+protected:
+  // Not a copy: a reset engine like other, for clone()
+  Vm(const Vm& other);
+
+  friend class LazyDfaVm;
+
+  // the compiled instructions, indexed by PC; set by JitVm, else null
+  const NativeStep* Native;
+
+private:
+  // after Native, to leave the layout of the hot members as it was
+  HitCounter Hits;
+
+  std::shared_ptr<const LabelMask> Mask;
+
+  // First, before threads reaching only disabled labels were dropped
+  ThreadList Unmasked;
 };
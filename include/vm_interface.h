@@ -18,8 +18,12 @@
 
 #pragma once
 
+#include <vector>
+
 #include "basic.h"
 #include "fwd_pointers.h"
+#include "hitcounter.h"
+#include "labelmask.h"
 #include "searchhit.h"
 
 class VmInterface {
@@ -32,9 +36,43 @@ public:
   virtual void closeOut(HitCallback hitFn, void* userData) = 0;
   virtual void reset() = 0;
 
+  // Discards any match in progress, as reset() does, but keeps track of
+  // where earlier hits ended. Cheaper than reset(), but only good for
+  // starting a new search at or past the end of the last one.
+  virtual void restart() = 0;
+
+  // True when no match is in progress or waiting to be reported. What an
+  // idle engine finds next does not depend on what it has seen before.
+  virtual bool idle() const = 0;
+
+  // The limits on hits, and the counts of those found since the last
+  // reset. Once stopped, an engine reports nothing more until it is reset.
+  virtual HitCounter& hits() = 0;
+
+  // Disables the labels the mask disables, and enables all others; a
+  // null mask enables every label. Resets the engine.
+  virtual void setMask(const std::shared_ptr<const LabelMask>& mask) = 0;
+
+  // Appends to buf the state carried from one search() call to the next:
+  // the partial matches, the ends of earlier hits, and the hit counts,
+  // but not the mask or the limits, which are the engine's settings.
+  // restore() puts such a state back into an engine of the same kind for
+  // the same program; given a bad one, it throws, leaving the engine reset.
+  virtual void save(std::vector<char>& buf) const = 0;
+  virtual void restore(const char* beg, const char* end) = 0;
+
+  // Makes a new engine for the same program, with the same mask and hit
+  // limits, as if reset. The parts which never change are copied or
+  // shared rather than rebuilt, so this is cheaper than create(). Reads
+  // only those parts, so it is safe while this engine is searching.
+  virtual std::shared_ptr<VmInterface> clone() const = 0;
+
   #ifdef LBT_TRACE_ENABLED
   virtual void setDebugRange(uint64_t beg, uint64_t end) = 0;
   #endif
 
   static std::shared_ptr<VmInterface> create(ProgramPtr prog);
+
+  // creates the engine requested, one of the LG_ENGINE_* values
+  static std::shared_ptr<VmInterface> create(ProgramPtr prog, uint32_t engine, uint64_t dfaCacheSize);
 };
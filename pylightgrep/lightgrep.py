@@ -9,6 +9,7 @@
 
 import collections
 from ctypes import *
+import struct
 import sys
 
 #
@@ -198,13 +199,26 @@ class CtxOpts(Structure):
     # argh, this crap shouldn't even be exposed
     _fields_ = [
         ("TraceBegin", c_uint64),
-        ("TraceEnd", c_uint64)
+        ("TraceEnd", c_uint64),
+        ("Engine", c_uint32),
+        ("DfaCacheSize", c_uint64),
+        ("HitMode", c_uint32),
+        ("MaxHitsPerPattern", c_uint64)
     ]
 
-    def __init__(self):
+    # hit modes
+    HITS_ALL = 0
+    HITS_FIRST = 1
+    HITS_COUNT = 2
+
+    def __init__(self, lazyDfa = False, dfaCacheSize = 0, hitMode = HITS_ALL, maxHitsPerPattern = 0):
         super().__init__()
         self.TraceBegin = 0xFFFFFFFFFFFFFFFF
         self.TraceEnd = 0
+        self.Engine = 1 if lazyDfa else 0
+        self.DfaCacheSize = dfaCacheSize
+        self.HitMode = hitMode
+        self.MaxHitsPerPattern = maxHitsPerPattern
 
 
 class SearchHit(Structure):
@@ -215,6 +229,10 @@ class SearchHit(Structure):
     ]
 
 
+# SearchHit as (Start, End, KeywordIndex), padded the same
+_SEARCH_HIT_FORMAT = struct.Struct('QQI' + 'x' * (sizeof(SearchHit) - struct.calcsize('QQI')))
+
+
 class Window(Structure):
     _fields_ = [
         ("Start", c_uint64),
@@ -317,6 +335,14 @@ class Fsm(Handle):
             for enc in p[1]:
                 self.add_pattern(prog, pat, enc, i)
 
+    def add_pattern_list(self, prog, patterns, source, encodings, opts, numThreads=1):
+        # patterns is the text of a pattern list, as for lg_add_pattern_list
+        encs = (c_char_p * len(encodings))(*[e.encode("utf-8") for e in encodings])
+        with Error() as err:
+            _LG.lg_add_pattern_list_parallel(self.get(), prog.get(), patterns.encode("utf-8"), source.encode("utf-8"), encs, len(encodings), byref(opts), numThreads, byref(err.get()))
+            if err.get():
+                raise RuntimeError(f"Error adding patterns: {err}")
+
 
 class Program(Handle):
     def __init__(self, arg, shared=False):
@@ -366,6 +392,13 @@ class Context(Handle):
     def reset(self):
         _LG.lg_reset_context(self.get())
 
+    def clone(self):
+        # a new context like this one, without building it from scratch
+        ctx = Context.__new__(Context)
+        Handle.__init__(ctx, _LG.lg_clone_context(self.get()))
+        ctx.prog = self.prog
+        return ctx
+
     def search(self, data, startOffset, accumulator):
         self.prog.throwIfClosed()
         beg, end = buf_range(data, c_char)
@@ -380,6 +413,59 @@ class Context(Handle):
         self.prog.throwIfClosed()
         _LG.lg_closeout_search(self.get(), (self.prog, accumulator.lgCallback), _the_callback_shim)
 
+    def searchHits(self, data, startOffset, bufSize=4096):
+        # the hits as (start, end, keywordIndex) tuples, collected a
+        # buffer at a time instead of by a callback per hit
+        beg, end = buf_range(data, c_char)
+        return self._collectHits(
+            lambda buf, n: _LG.lg_search_hits(self.get(), beg, end, startOffset, buf, bufSize, n),
+            bufSize
+        )
+
+    def closeoutHits(self, bufSize=4096):
+        return self._collectHits(
+            lambda buf, n: _LG.lg_closeout_hits(self.get(), buf, bufSize, n),
+            bufSize
+        )
+
+    def _collectHits(self, fn, bufSize):
+        hits = []
+        buf = (SearchHit * bufSize)()
+        n = c_uint64()
+        while True:
+            status = fn(buf, byref(n))
+            if status < 0:
+                raise RuntimeError("Failed to search")
+            # unpacking the bytes is much faster than going through SearchHit
+            hits.extend(_SEARCH_HIT_FORMAT.iter_unpack(
+                memoryview(buf).cast('B')[:n.value * sizeof(SearchHit)]
+            ))
+            if not status:
+                return hits
+
+    def hitCount(self, keywordIndex):
+        return _LG.lg_hit_count(self.get(), keywordIndex)
+
+    def save(self):
+        size = _LG.lg_save_context(self.get(), None, 0)
+        buf = create_string_buffer(size)
+        if not size or _LG.lg_save_context(self.get(), buf, size) != size:
+            raise RuntimeError("Failed to save context")
+        return buf.raw
+
+    def restore(self, state):
+        if not _LG.lg_restore_context(self.get(), state, len(state)):
+            raise ValueError("Bad context state")
+
+    def enableKeywords(self, keywordIndices=None, enable=True):
+        if keywordIndices is None:
+            idxs, num = None, 0
+        else:
+            num = len(keywordIndices)
+            idxs = (c_uint64 * num)(*keywordIndices)
+        if not _LG.lg_enable_keywords(self.get(), idxs, num, enable):
+            raise IndexError(f"Keyword index out of range in {keywordIndices}")
+
     def searchBuffer(self, data, accumulator):
         self.search(data, 0, accumulator)
         self.closeout(accumulator)
@@ -503,6 +589,9 @@ _LG.lg_add_pattern.restype = c_int
 _LG.lg_add_pattern_list.argtypes = [c_void_p, c_void_p, c_char_p, c_char_p, POINTER(c_char_p), c_uint, POINTER(KeyOpts), POINTER(POINTER(Err))]
 _LG.lg_add_pattern_list.restype = c_int
 
+_LG.lg_add_pattern_list_parallel.argtypes = [c_void_p, c_void_p, c_char_p, c_char_p, POINTER(c_char_p), c_uint, POINTER(KeyOpts), c_uint, POINTER(POINTER(Err))]
+_LG.lg_add_pattern_list_parallel.restype = c_int
+
 _LG.lg_pattern_count.argtypes = [c_void_p]
 _LG.lg_pattern_count.restype = c_uint
 
@@ -533,6 +622,9 @@ _LG.lg_create_context.restype = c_void_p
 _LG.lg_destroy_context.argtypes = [c_void_p]
 _LG.lg_destroy_context.restype = None
 
+_LG.lg_clone_context.argtypes = [c_void_p]
+_LG.lg_clone_context.restype = c_void_p
+
 _LG.lg_starts_with.argtypes = [c_void_p, POINTER(c_char), POINTER(c_char), c_uint64, py_object, _CBType]
 _LG.lg_starts_with.restype = None
 
@@ -548,6 +640,24 @@ _LG.lg_closeout_search.restype = None
 _LG.lg_search_resolve.argtypes = [c_void_p, POINTER(c_char), POINTER(c_char), c_uint64, py_object, _CBType]
 _LG.lg_search_resolve.restype = c_uint64
 
+_LG.lg_search_hits.argtypes = [c_void_p, POINTER(c_char), POINTER(c_char), c_uint64, POINTER(SearchHit), c_uint64, POINTER(c_uint64)]
+_LG.lg_search_hits.restype = c_int
+
+_LG.lg_closeout_hits.argtypes = [c_void_p, POINTER(SearchHit), c_uint64, POINTER(c_uint64)]
+_LG.lg_closeout_hits.restype = c_int
+
+_LG.lg_hit_count.argtypes = [c_void_p, c_uint64]
+_LG.lg_hit_count.restype = c_uint64
+
+_LG.lg_save_context.argtypes = [c_void_p, c_void_p, c_uint64]
+_LG.lg_save_context.restype = c_uint64
+
+_LG.lg_restore_context.argtypes = [c_void_p, c_char_p, c_uint64]
+_LG.lg_restore_context.restype = c_int
+
+_LG.lg_enable_keywords.argtypes = [c_void_p, POINTER(c_uint64), c_uint64, c_int]
+_LG.lg_enable_keywords.restype = c_int
+
 #
 # util.h
 #
@@ -612,3 +722,4 @@ _LG.lg_create_pattern.errcheck = _checkHandleForErrors
 _LG.lg_create_fsm.errcheck = _checkHandleForErrors
 _LG.lg_create_program.errcheck = _checkHandleForErrors
 _LG.lg_create_context.errcheck = _checkHandleForErrors
+_LG.lg_clone_context.errcheck = _checkHandleForErrors
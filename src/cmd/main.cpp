@@ -187,7 +187,8 @@ std::tuple<
 >
 parsePatterns(const T& keyFiles,
               const std::vector<std::string>& defaultEncodings = { "ASCII" },
-              const LG_KeyOptions& defaultOpts = {0, 0, 1})
+              const LG_KeyOptions& defaultOpts = {0, 0, 1},
+              uint32_t numThreads = 1)
 {
   // read the patterns and parse them
 
@@ -221,10 +222,11 @@ parsePatterns(const T& keyFiles,
     // parse a complete pattern file
     LG_Error* local_err = nullptr;
 
-    lg_add_pattern_list(
+    lg_add_pattern_list_parallel(
       fsm.get(), prog.get(),
       pf.second.c_str(), pf.first.c_str(),
-      defEncs.get(), defaultEncodings.size(), &defaultOpts, &local_err
+      defEncs.get(), defaultEncodings.size(), &defaultOpts, numThreads,
+      &local_err
     );
 
     if (local_err) {
@@ -250,28 +252,61 @@ parsePatterns(const T& keyFiles,
 
 std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)>
 loadProgram(const std::string& pfile) {
-  std::ifstream pin(pfile, std::ios::in | std::ios::binary);
-  if (!pin) {
-    std::cerr << "Could not open program file " << pfile << std::endl;
-    return std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)>(
-      nullptr, nullptr
-    );
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    lg_map_program(pfile.c_str(), 1),
+    lg_destroy_program
+  );
+
+  if (!prog) {
+    std::cerr << "Could not read program file " << pfile << std::endl;
   }
+  return prog;
+}
 
-// FIXME: we need to handle the case where the read fails
-// FIXME: what to do for the pattern map?
+typedef std::vector<std::pair<std::string,std::string>> PatternLines;
 
-  const std::streampos end = stream_size(pin);
-  std::cerr << "program file is " << end << " bytes long" << std::endl;
+std::unique_ptr<const char*[]> patternLists(const PatternLines& lines) {
+  std::unique_ptr<const char*[]> arr(new const char*[lines.size()]);
+  for (uint32_t i = 0; i < lines.size(); ++i) {
+    arr[i] = lines[i].second.c_str();
+  }
+  return arr;
+}
 
-  std::vector<char> buf(end);
-  pin.read(&buf[0], end);
-  pin.close();
+std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)>
+readCachedProgram(const Options& opts, const PatternLines& lines, const LG_KeyOptions& keyOpts) {
+  const std::unique_ptr<const char*[]> lists(patternLists(lines));
+  const std::unique_ptr<const char*[]> encs(c_str_arr(opts.Encodings));
+  const LG_ProgramOptions progOpts{opts.Determinize};
 
-  return std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)>(
-    lg_read_program(&buf[0], end),
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    lg_read_cached_program(
+      opts.ProgramCache.c_str(), lists.get(), lines.size(),
+      encs.get(), opts.Encodings.size(), &keyOpts, &progOpts
+    ),
     lg_destroy_program
   );
+
+  if (prog) {
+    std::cerr << "read program from cache" << std::endl;
+  }
+  return prog;
+}
+
+void writeCachedProgram(const Options& opts, const PatternLines& lines, const LG_KeyOptions& keyOpts, ProgramHandle* prog) {
+  const std::unique_ptr<const char*[]> lists(patternLists(lines));
+  const std::unique_ptr<const char*[]> encs(c_str_arr(opts.Encodings));
+  const LG_ProgramOptions progOpts{opts.Determinize};
+
+  boost::system::error_code ec;
+  fs::create_directories(opts.ProgramCache, ec);
+
+  if (ec || !lg_write_cached_program(
+        prog, opts.ProgramCache.c_str(), lists.get(), lines.size(),
+        encs.get(), opts.Encodings.size(), &keyOpts, &progOpts))
+  {
+    std::cerr << "Could not write program to cache " << opts.ProgramCache << std::endl;
+  }
 }
 
 bool buildProgram(FSMHandle* fsm, ProgramHandle* prog, const Options& opts) {
@@ -380,24 +415,37 @@ void search(const Options& opts) {
     prog = loadProgram(opts.ProgramFile);
   }
   else {
-    // read the patterns and parse them
-    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(nullptr, nullptr);
-    std::unique_ptr<LG_Error,void(*)(LG_Error*)> err(nullptr, nullptr);
+    const PatternLines lines(opts.getPatternLines());
+    const LG_KeyOptions keyOpts{
+      opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode
+    };
 
-    std::tie(prog, fsm, err) = parsePatterns(
-      opts.getPatternLines(), opts.Encodings,
-      {opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode}
-    );
+    if (!opts.ProgramCache.empty()) {
+      prog = readCachedProgram(opts, lines, keyOpts);
+    }
+
+    if (!prog) {
+      // read the patterns and parse them
+      std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(nullptr, nullptr);
+      std::unique_ptr<LG_Error,void(*)(LG_Error*)> err(nullptr, nullptr);
+
+      std::tie(prog, fsm, err) = parsePatterns(
+        lines, opts.Encodings, keyOpts, opts.Threads
+      );
 
-    const bool printFilename =
-      opts.CmdLinePatterns.empty() && opts.KeyFiles.size() > 1;
+      const bool printFilename =
+        opts.CmdLinePatterns.empty() && opts.KeyFiles.size() > 1;
 
-    handleParseErrors(err.get(), printFilename);
+      handleParseErrors(err.get(), printFilename);
 
-    // build a program from parsed patterns
-    if (fsm) {
-      if (!buildProgram(fsm.get(), prog.get(), opts)) {
-        prog.reset();
+      // build a program from parsed patterns
+      if (fsm) {
+        if (!buildProgram(fsm.get(), prog.get(), opts)) {
+          prog.reset();
+        }
+        else if (!opts.ProgramCache.empty()) {
+          writeCachedProgram(opts, lines, keyOpts, prog.get());
+        }
       }
     }
   }
@@ -448,13 +496,18 @@ void search(const Options& opts) {
   LG_ContextOptions ctxOpts;
   ctxOpts.TraceBegin = opts.DebugBegin;
   ctxOpts.TraceEnd = opts.DebugEnd;
+  ctxOpts.Engine = opts.LazyDfa ? LG_ENGINE_LAZY_DFA :
+                   opts.Jit ? LG_ENGINE_JIT : LG_ENGINE_THREADS;
+  ctxOpts.DfaCacheSize = opts.DfaCacheSize;
+  ctxOpts.HitMode = LG_HITS_ALL;
+  ctxOpts.MaxHitsPerPattern = opts.MaxCount;
 
   std::unique_ptr<ContextHandle, void(*)(ContextHandle*)> searcher(
     lg_create_context(prog.get(), &ctxOpts),
     lg_destroy_context
   );
 
-  SearchController ctrl(opts.BlockSize);
+  SearchController ctrl(opts.BlockSize, opts.Threads);
 
   bool stdinUsed = false;
 
@@ -516,7 +569,8 @@ bool writeGraphviz(const Options& opts) {
 
   std::tie(prog, fsm, err) = parsePatterns(
     opts.getPatternLines(), opts.Encodings,
-    {opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode}
+    {opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode},
+    opts.Threads
   );
 
   const bool printFilename =
@@ -548,7 +602,8 @@ void writeProgram(const Options& opts) {
 
   std::tie(prog, fsm, err) = parsePatterns(
     opts.getPatternLines(), opts.Encodings,
-    {opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode}
+    {opts.LiteralMode, opts.CaseInsensitive, opts.UnicodeMode},
+    opts.Threads
   );
 
   const bool printFilename =
@@ -573,8 +628,10 @@ void writeProgram(const Options& opts) {
 
   std::ostream& out(opts.openOutput());
   if (opts.Binary) {
-    const std::vector<char> s = p->marshall();
-    out.write(s.data(), s.size());
+    // as --program-file reads it
+    std::vector<char> buf(lg_program_size(prog.get()));
+    lg_write_program(prog.get(), buf.data());
+    out.write(buf.data(), buf.size());
   }
   else {
     out << *p << std::endl;
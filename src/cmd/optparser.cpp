@@ -87,16 +87,22 @@ void parse_opts(int argc, char** argv,
     ("context,C", po::value<int32_t>(&opts.BeforeContext)->value_name("NUM"), "print NUM lines of context")
     ("group-separator", po::value<std::string>(&opts.GroupSeparator)->value_name("SEP")->default_value("--"), "use SEP as the group separator")
     ("no-output", "do not output hits (good for profiling)")
+    ("max-count,m", po::value<uint64_t>(&opts.MaxCount)->default_value(0)->value_name("NUM"), "stop reporting a pattern after NUM hits in each file (0 for no limit)")
     ("block-size", po::value<uint32_t>(&opts.BlockSize)->default_value(8 * 1024 * 1024)->value_name("BYTES"), "block size to use for buffering, in bytes")
     ("mmap", "memory-map input file(s)")
+    ("threads", po::value<uint32_t>(&opts.Threads)->default_value(1)->value_name("NUM"), "use NUM threads to search each block and to add patterns")
     ;
 
   // Other options
   po::options_description misc("Miscellaneous");
   misc.add_options()
     ("no-det", "do not determinize NFAs")
+    ("lazy-dfa", "search with a lazily built DFA")
+    ("jit", "search with the thread VM compiled to native code (x86-64 only)")
+    ("dfa-cache", po::value<uint64_t>(&opts.DfaCacheSize)->default_value(0)->value_name("BYTES"), "lazy DFA state cache size, in bytes (0 for default)")
     ("binary", "output program as binary")
     ("program-file", po::value<std::string>(&opts.ProgramFile)->value_name("FILE"), "read search program from file")
+    ("program-cache", po::value<std::string>(&opts.ProgramCache)->value_name("DIR"), "reuse programs compiled from the same patterns and options, kept in DIR")
     #ifdef LBT_TRACE_ENABLED
     ("begin-debug", po::value<uint64_t>(&opts.DebugBegin)->default_value(std::numeric_limits<uint64_t>::max()), "offset for beginning of debug logging")
     ("end-debug", po::value<uint64_t>(&opts.DebugEnd)->default_value(std::numeric_limits<uint64_t>::max()), "offset for end of debug logging")
@@ -197,6 +203,8 @@ void parse_opts(int argc, char** argv,
     opts.Binary = optsMap.count("binary") > 0;
     opts.NoOutput = optsMap.count("no-output") > 0;
     opts.Determinize = optsMap.count("no-det") == 0;
+    opts.LazyDfa = optsMap.count("lazy-dfa") > 0;
+    opts.Jit = optsMap.count("jit") > 0;
     opts.Recursive = optsMap.count("recursive") > 0;
     opts.MemoryMapped = optsMap.count("mmap") > 0;
 
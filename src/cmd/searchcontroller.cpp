@@ -16,6 +16,19 @@ void print_cumulative_stats(double seconds, uint64_t offset) {
             << bw << " MB/s avg" << std::endl;
 }
 
+uint64_t SearchController::search(
+  ContextHandle* searcher,
+  HitCounterInfo* hinfo,
+  const char* buf,
+  uint64_t blkSize,
+  uint64_t offset,
+  LG_HITCALLBACK_FN callback)
+{
+  return Threads > 1 ?
+    lg_search_parallel(searcher, buf, buf + blkSize, offset, Threads, hinfo, callback) :
+    lg_search(searcher, buf, buf + blkSize, offset, hinfo, callback);
+}
+
 bool SearchController::searchFile(
   ContextHandle* searcher,
   HitCounterInfo* hinfo,
@@ -38,7 +51,7 @@ bool SearchController::searchFile(
     // search cur block
     hinfo->setBuffer(buf, blkSize, offset);
 
-    lg_search(searcher, buf, buf + blkSize, offset, hinfo, callback);
+    search(searcher, hinfo, buf, blkSize, offset, callback);
 
     offset += blkSize;
 
@@ -55,7 +68,7 @@ bool SearchController::searchFile(
   // cur is last block
   hinfo->setBuffer(buf, blkSize, offset);
 
-  lg_search(searcher, buf, buf + blkSize, offset, hinfo, callback);
+  search(searcher, hinfo, buf, blkSize, offset, callback);
 
   lg_closeout_search(searcher, hinfo, callback);
   offset += blkSize;  // be sure to count the last block
@@ -27,27 +27,31 @@ void CodeGenVisitor::discover_vertex(NFA::VertexDescriptor v, const NFA& graph)
 
 uint32_t CodeGenVisitor::calcJumpTableSize(NFA::VertexDescriptor v, const NFA& graph, uint32_t outDegree) {
   if (outDegree > 3) {
-    TransitionTbl tbl(pivotStates(v, graph));
+    TransitionTbl tbl(pivotClasses(v, graph, Helper.Classes));
     if (maxOutbound(tbl) < outDegree) {
       uint32_t sizeIndirectTables = 0,
              num,
-             first = 256,
+             entries = 0,
+             first = tbl.size(),
              last  = 0;
 
-      for (uint32_t i = 0; i < 256; ++i) {
+      for (uint32_t i = 0; i < tbl.size(); ++i) {
         num = tbl[i].size();
         if (num > 1) {
           sizeIndirectTables += num;
         }
         if (num) {
+          ++entries;
           first = std::min(first, i);
           last  = i;
         }
       }
 
-      Helper.Snippets[v].Op = JUMP_TABLE_RANGE_OP;
-      // JumpTableRange instr + inclusive number
-      return 2 + (last - first) + 2*sizeIndirectTables;
+      // the layout depends on how many of the classes from the first to
+      // the last have entries
+      const OpCodes op = jumpTableLayout(first, last, entries);
+      Helper.Snippets[v].Op = op;
+      return 1 + jumpTableWords(op, first, last, entries) + 2*sizeIndirectTables;
     }
   }
   return 0;
@@ -58,7 +62,7 @@ void CodeGenVisitor::finish_vertex(NFA::VertexDescriptor v, const NFA& graph) {
 
   uint32_t label = 0,
          match = 0,
-         eval  = (v == 0 ? 0 : graph[v].Trans->numInstructions());
+         eval  = (v == 0 ? 0 : Helper.transitionSize(graph[v].Trans));
 
   const uint32_t outDegree = graph.outDegree(v);
 
@@ -22,6 +22,8 @@
 #include "program.h"
 #include "utility.h"
 
+#include <algorithm>
+#include <cstring>
 #include <tuple>
 
 uint32_t figureOutLanding(const CodeGenHelper& cg, NFA::VertexDescriptor v, const NFA& graph) {
@@ -39,15 +41,15 @@ uint32_t figureOutLanding(const CodeGenHelper& cg, NFA::VertexDescriptor v, cons
 
 std::tuple<uint32_t, uint32_t> minAndMaxValues(const std::vector<std::vector<NFA::VertexDescriptor>>& tbl) {
   uint32_t first = 0,
-           last  = 255;
+           last  = tbl.size() - 1;
 
-  for (uint32_t i = 0; i < 256; ++i) {
+  for (uint32_t i = 0; i < tbl.size(); ++i) {
     if (!tbl[i].empty()) {
       first = i;
       break;
     }
   }
-  for (uint32_t i = 255; i > first; --i) {
+  for (uint32_t i = tbl.size() - 1; i > first; --i) {
     if (!tbl[i].empty()) {
       last = i;
       break;
@@ -56,31 +58,69 @@ std::tuple<uint32_t, uint32_t> minAndMaxValues(const std::vector<std::vector<NFA
   return std::make_tuple(first, last);
 }
 
-// JumpTables are either ranged, or full-size, and can have indirect tables at the end when there are multiple transitions out on a single byte value
+// JumpTables are dense, sparse, or bitmapped, per jumpTableLayout(), and can have indirect tables at the end when there are multiple transitions out on a single byte class
 void createJumpTable(const CodeGenHelper& cg, Instruction const* const base, Instruction* const start, NFA::VertexDescriptor v, const NFA& graph) {
   const uint32_t startIndex = start - base;
-  Instruction* cur = start,
-             * indirectTbl;
+  Instruction* indirectTbl;
 
-  auto tbl(pivotStates(v, graph));
+  auto tbl(pivotClasses(v, graph, cg.Classes));
 
   uint32_t first, last;
   std::tie(first, last) = minAndMaxValues(tbl);
 
-  *cur++ = Instruction::makeJumpTableRange(first, last);
-  indirectTbl = start + 2 + (last - first);
-
+  std::vector<byte> keys;
   for (uint32_t i = first; i <= last; ++i) {
-    if (tbl[i].empty()) {
-      *cur++ = Instruction::makeRaw32(0);
+    if (!tbl[i].empty()) {
+      keys.push_back(i);
     }
-    else if (tbl[i].size() == 1) {
-      const uint32_t addr = figureOutLanding(cg, *tbl[i].begin(), graph);
-      *cur++ = Instruction::makeRaw32(addr);
+  }
+
+  const OpCodes op = cg.Snippets[v].Op;
+  const uint32_t num = keys.size();
+  uint32_t* targets = reinterpret_cast<uint32_t*>(start + 1);
+
+  switch (op) {
+  case JUMP_TABLE_SPARSE_OP:
+    *start = Instruction::makeJumpTableSparse(first, last, num);
+    std::fill(targets, targets + bytesToWords(num), 0);
+    std::copy(keys.begin(), keys.end(), reinterpret_cast<byte*>(targets));
+    targets += bytesToWords(num);
+    break;
+
+  case JUMP_TABLE_BITMAP_OP:
+    {
+      *start = Instruction::makeJumpTableBitmap(first, last);
+      const uint32_t bw = bitmapWords(first, last);
+      std::fill(targets, targets + bw + bytesToWords(bw), 0);
+      for (const byte k : keys) {
+        targets[(k - first) >> 5] |= 1u << ((k - first) & 31);
+      }
+
+      byte* ranks = reinterpret_cast<byte*>(targets + bw);
+      for (uint32_t w = 1; w < bw; ++w) {
+        ranks[w] = ranks[w-1] + __builtin_popcount(targets[w-1]);
+      }
+      targets += bw + bytesToWords(bw);
+    }
+    break;
+
+  default:
+    *start = Instruction::makeJumpTableRange(first, last);
+    std::fill(targets, targets + (last - first + 1), 0);
+    break;
+  }
+
+  indirectTbl = start + 1 + jumpTableWords(op, first, last, num);
+
+  for (const byte i : keys) {
+    // dense tables have a slot for every class, the others for each key
+    uint32_t* const slot = op == JUMP_TABLE_RANGE_OP ? targets + (i - first) : targets++;
+
+    if (tbl[i].size() == 1) {
+      *slot = figureOutLanding(cg, *tbl[i].begin(), graph);
     }
     else {
-      const uint32_t addr = startIndex + (indirectTbl - start);
-      *cur++ = Instruction::makeRaw32(addr);
+      *slot = startIndex + (indirectTbl - start);
 
       // write the indirect table in reverse edge order because
       // parent threads have priority over forked children
@@ -107,11 +147,83 @@ bool targetCodeFollowsSource(const CodeGenHelper& cg, const NFA::VertexDescripto
   return cg.DiscoverRanks[source] + 1 == cg.DiscoverRanks[target];
 }
 
-void encodeState(const NFA& graph, NFA::VertexDescriptor v, const CodeGenHelper& cg, Instruction const* const base, Instruction* curOp) {
+bool isLoneByte(const CodeGenHelper& cg, NFA::VertexDescriptor v, const NFA& graph) {
+  return graph[v].Trans && graph[v].Trans->type() == ByteStateType &&
+         !cg.Snippets[v].NumOther && 1 == graph.outDegree(v);
+}
+
+// The number of states in the run of byte instructions starting with v's,
+// which a thread passes through doing nothing but matching bytes: each
+// state before the last has only its byte instruction, falling through
+// to a successor which is also a byte.
+uint32_t literalLength(const CodeGenHelper& cg, NFA::VertexDescriptor v, const NFA& graph) {
+  uint32_t len = 1;
+  for ( ; len < 255 && isLoneByte(cg, v, graph); ++len) {
+    const NFA::VertexDescriptor next = graph.outVertex(v, 0);
+    if (!targetCodeFollowsSource(cg, v, next) ||
+        graph[next].Trans->type() != ByteStateType)
+    {
+      break;
+    }
+    v = next;
+  }
+  return len;
+}
+
+// The states whose code threads can get to other than by falling through
+// from a lone byte instruction, which would already have looked ahead
+// for them if it was a literal.
+std::vector<bool> enteredStates(const CodeGenHelper& cg, const NFA& graph) {
+  std::vector<bool> entered(graph.verticesSize(), false);
+
+  for (NFA::VertexDescriptor v = 0; v < graph.verticesSize(); ++v) {
+    if (isJumpTable(cg.Snippets[v].Op)) {
+      for (const NFA::VertexDescriptor t : graph.outVertices(v)) {
+        // as in figureOutLanding(), which otherwise lands past t's byte
+        if (1 == graph.outDegree(t) && NOLABEL == graph[t].Label && !graph[t].IsMatch) {
+          entered[graph.outVertex(t, 0)] = true;
+        }
+      }
+    }
+    else {
+      const uint32_t odeg = graph.outDegree(v);
+      for (uint32_t i = 0; i < odeg; ++i) {
+        const NFA::VertexDescriptor t = graph.outVertex(v, i);
+        if (i || !targetCodeFollowsSource(cg, v, t) || !isLoneByte(cg, v, graph)) {
+          entered[t] = true;
+        }
+      }
+    }
+  }
+
+  return entered;
+}
+
+void encodeState(const NFA& graph, NFA::VertexDescriptor v, const CodeGenHelper& cg, const std::vector<bool>& entered, Instruction const* const base, Instruction* curOp) {
   const NFA::Vertex& state(graph[v]);
   if (state.Trans) {
-    state.Trans->toInstruction(curOp);
-    curOp += state.Trans->numInstructions();
+    if (state.Trans->type() == ByteSetStateType) {
+      // only as many words as the classes need
+      const uint32_t words = cg.Classes.setWords();
+      ByteSet bytes;
+      state.Trans->getBytes(bytes);
+      const ByteSet set(cg.Classes.classesOf(bytes));
+
+      *curOp = Instruction::makeBitVector(words);
+      std::memcpy(curOp + 1, &set, words*sizeof(Instruction));
+    }
+    else {
+      state.Trans->toInstruction(curOp);
+
+      if (state.Trans->type() == ByteStateType && entered[v]) {
+        // shorter runs aren't worth looking ahead for
+        const uint32_t len = literalLength(cg, v, graph);
+        if (len >= 4) {
+          *curOp = Instruction::makeLiteral(curOp->Op.T1.Byte, len);
+        }
+      }
+    }
+    curOp += cg.transitionSize(state.Trans);
     // std::cerr << "wrote " << i << std::endl;
 
     if (state.Label != NOLABEL) {
@@ -135,7 +247,7 @@ void encodeState(const NFA& graph, NFA::VertexDescriptor v, const CodeGenHelper&
     }
   }
 
-  if (JUMP_TABLE_RANGE_OP == cg.Snippets[v].Op) {
+  if (isJumpTable(cg.Snippets[v].Op)) {
     createJumpTable(cg, base, curOp, v, graph);
   }
   else {
@@ -167,6 +279,7 @@ ProgramPtr Compiler::createProgram(const NFA& graph) {
   // std::cerr << "Compiling to byte code" << std::endl;
   const uint32_t numVs = graph.verticesSize();
   CodeGenHelper cg(numVs);
+  cg.Classes = byteClasses(graph);
   CodeGenVisitor vis(cg);
   specialVisit(graph, 0ul, vis);
   // std::cerr << "Determined order in first pass" << std::endl;
@@ -174,13 +287,16 @@ ProgramPtr Compiler::createProgram(const NFA& graph) {
   ProgramPtr ret(new Program(cg.Guard+2));
   ret->MaxLabel= cg.MaxLabel;
   ret->MaxCheck = cg.MaxCheck;
+  ret->Classes = cg.Classes;
   std::tie(ret->FilterOff, ret->Filter) = bestPair(graph);
 
+  const std::vector<bool> entered(enteredStates(cg, graph));
+
   for (NFA::VertexDescriptor v = 0; v < numVs; ++v) {
     // if (++i % 10000 == 0) {
     //   std::cerr << "have compiled " << i << " states so far" << std::endl;
     // }
-    encodeState(graph, v, cg, &(*ret)[0], &(*ret)[cg.Snippets[v].Start]);
+    encodeState(graph, v, cg, entered, &(*ret)[0], &(*ret)[cg.Snippets[v].Start]);
   }
   // penultimate instruction will always be Halt, so Vm can jump there
   (*ret)[cg.Guard] = Instruction::makeHalt();
@@ -189,3 +305,33 @@ ProgramPtr Compiler::createProgram(const NFA& graph) {
 
   return ret;
 }
+
+ProgramPtr Compiler::createProgram(const NFA& graph, const std::vector<Literal>& lits) {
+  ProgramPtr ret(createProgram(graph));
+  if (!lits.empty()) {
+    // every pattern is a byte string, so LiteralVm can search instead
+    ret->Literals.reset(new LiteralMatcher(lits));
+  }
+  return ret;
+}
+
+void Compiler::addFactors(Program& prog, const std::vector<Literal>& factors, const std::bitset<256>& lead, uint32_t maxLead) {
+  if (factors.empty() || prog.Literals) {
+    return;
+  }
+
+  // Every factor at the start of its pattern is what the prefilter
+  // already checks, and a factor which may be preceded by anything at
+  // all never lets us skip.
+  if (maxLead == 0 || (maxLead == RequiredFactor::UNBOUNDED && lead.all())) {
+    return;
+  }
+
+  prog.Factors.reset(new LiteralMatcher(factors));
+  prog.FactorMaxLead = maxLead;
+  prog.FactorLead = lead;
+  prog.FactorMaxLen = 0;
+  for (const Literal& f : factors) {
+    prog.FactorMaxLen = std::max(prog.FactorMaxLen, static_cast<uint32_t>(f.first.size()));
+  }
+}
@@ -0,0 +1,100 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "enginestate.h"
+#include "program.h"
+
+#include <stdexcept>
+
+namespace {
+  // "LGST", and the version of the layout
+  const uint32_t MAGIC = 0x5453474C;
+  const uint32_t VERSION = 1;
+}
+
+void StateWriter::header(EngineStateTag tag, const Program& prog) {
+  put(MAGIC);
+  put(VERSION);
+  put(static_cast<uint32_t>(tag));
+  put(static_cast<uint64_t>(prog.size()));
+  put(prog.MaxLabel);
+  put(prog.MaxCheck);
+}
+
+void StateWriter::matchEnds(const std::vector<uint64_t>& ends, const SparseSet& matched) {
+  put(matched.size());
+  for (const uint32_t label : matched) {
+    put(label);
+    put(ends[label]);
+  }
+}
+
+uint32_t StateReader::label(uint32_t maxLabel) {
+  const uint32_t l = get<uint32_t>();
+  if (l > maxLabel) {
+    fail();
+  }
+  return l;
+}
+
+void StateReader::header(EngineStateTag tag, const Program& prog) {
+  if (get<uint32_t>() != MAGIC || get<uint32_t>() != VERSION) {
+    throw std::runtime_error("Not a context state, or from another version");
+  }
+
+  if (get<uint32_t>() != static_cast<uint32_t>(tag) ||
+      get<uint64_t>() != prog.size() ||
+      get<uint32_t>() != prog.MaxLabel ||
+      get<uint32_t>() != prog.MaxCheck)
+  {
+    throw std::runtime_error("Context state is for a different program or engine");
+  }
+}
+
+void StateReader::matchEnds(std::vector<uint64_t>& ends, SparseSet& matched) {
+  const uint32_t maxLabel = ends.size() - 1;
+  const uint32_t n = get<uint32_t>();
+  if (n > ends.size()) {
+    fail();
+  }
+
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint32_t l = label(maxLabel);
+    const uint64_t end = get<uint64_t>();
+    // match ends are never zero
+    if (!end || matched.find(l)) {
+      fail();
+    }
+
+    // a label disabled here stays so
+    if (!ends[l]) {
+      matched.insert(l);
+      ends[l] = end;
+    }
+  }
+}
+
+void StateReader::finish() const {
+  if (Cur != End) {
+    fail();
+  }
+}
+
+void StateReader::fail() {
+  throw std::runtime_error("Malformed context state");
+}
@@ -18,32 +18,134 @@
 
 #include "fsmthingy.h"
 #include "encoders/encoder.h"
+#include "utility.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
 
-FSMThingy::FSMThingy(uint32_t sizeHint): Fsm(new NFA(1, sizeHint)) {
+FSMThingy::FSMThingy(uint32_t sizeHint):
+  Fsm(new NFA(1, sizeHint)), AllLiterals(true),
+  AllFactors(true), FactorMaxLead(0)
+{
   Fsm->TransFac = Nfab.getTransFac();
 }
 
+namespace {
+  bool literalChain(const NFA& g, std::string& bytes) {
+    // a literal is a chain from the initial state, one byte per state,
+    // with only the last state matching
+    ByteSet bs;
+    NFA::VertexDescriptor v = 0;
+    for (uint32_t n = 1; n < g.verticesSize(); ++n) {
+      if (g.outDegree(v) != 1 || g[v].IsMatch) {
+        return false;
+      }
+
+      const NFA::VertexDescriptor w = g.outVertex(v, 0);
+      if (w != n || g.inDegree(w) != 1) {
+        // a back edge or a skipped state
+        return false;
+      }
+
+      g[w].Trans->getBytes(bs);
+      if (bs.count() != 1) {
+        return false;
+      }
+
+      for (uint32_t b = 0; b < 256; ++b) {
+        if (bs[b]) {
+          bytes.push_back(static_cast<char>(b));
+          break;
+        }
+      }
+
+      v = w;
+    }
+
+    return g.outDegree(v) == 0 && g[v].IsMatch && !bytes.empty();
+  }
+}
+
 void FSMThingy::addPattern(const ParseTree& tree, const char* chain, uint32_t label) {
+  PatternNFA pat;
+  buildPattern(Nfab, EncFac, Comp, tree, chain, label, AllFactors, pat);
+  mergePattern(pat, label);
+}
+
+void FSMThingy::buildPattern(NFABuilder& nfab, EncoderFactory& encFac,
+                             NFAOptimizer& comp, const ParseTree& tree,
+                             const char* chain, uint32_t label, bool factors,
+                             PatternNFA& pat)
+{
   // prepare the NFA builder
-  Nfab.reset();
-  Nfab.setCurLabel(label);
+  nfab.reset();
+  nfab.setCurLabel(label);
 
   // set the character encoding
-  Nfab.setEncoder(EncFac.get(chain));
+  nfab.setEncoder(encFac.get(chain));
 
   // build the NFA for this pattern
-  if (Nfab.build(tree)) {
-    // and merge it into the greater NFA
-    Comp.pruneBranches(*Nfab.getFsm());
-    Comp.mergeIntoFSM(*Fsm, *Nfab.getFsm());
-  }
-  else {
+  if (!nfab.build(tree)) {
     THROW_RUNTIME_ERROR_WITH_CLEAN_OUTPUT("Empty matches");
   }
+
+  // take the NFA, so the builder starts a fresh one next time
+  pat.Nfa = nfab.getFsm();
+  nfab.resetFsm();
+  pat.Label = label;
+
+  NFA& g = *pat.Nfa;
+
+  pat.Bytes.clear();
+  pat.Literal = literalChain(g, pat.Bytes);
+
+  comp.pruneBranches(g);
+
+  // a literal is its own factor
+  pat.HasFactor = factors && !pat.Literal && requiredFactor(g, pat.Factor);
+}
+
+void FSMThingy::mergePattern(PatternNFA& pat, uint32_t label) {
+  NFA& g = *pat.Nfa;
+
+  if (pat.Label != label) {
+    for (NFA::VertexDescriptor v = 0; v < g.verticesSize(); ++v) {
+      if (g[v].Label != NFA::Vertex::NOLABEL) {
+        g[v].Label = label;
+      }
+    }
+    pat.Label = label;
+  }
+
+  if (AllLiterals) {
+    if (pat.Literal) {
+      Literals.emplace_back(pat.Bytes, label);
+    }
+    else {
+      AllLiterals = false;
+      std::vector<Literal>().swap(Literals);
+    }
+  }
+
+  if (AllFactors) {
+    if (pat.Literal) {
+      Factors.emplace_back(pat.Bytes, label);
+    }
+    else if (pat.HasFactor) {
+      Factors.emplace_back(pat.Factor.Bytes, label);
+      FactorLead |= pat.Factor.Lead;
+      FactorMaxLead = std::max(FactorMaxLead, pat.Factor.MaxLead);
+    }
+    else {
+      AllFactors = false;
+      std::vector<Literal>().swap(Factors);
+    }
+  }
+
+  // and merge it into the greater NFA
+  Comp.mergeIntoFSM(*Fsm, g);
 }
 
 void FSMThingy::finalizeGraph(bool determinize) {
@@ -51,11 +153,19 @@ void FSMThingy::finalizeGraph(bool determinize) {
     throw std::runtime_error("No valid patterns were parsed");
   }
 
-  if (determinize && !Fsm->Deterministic) {
-    NFAPtr dfa(new NFA(1, 2 * Fsm->verticesSize(), Fsm->edgesSize()));
-    dfa->TransFac = Fsm->TransFac;
-    Comp.subsetDFA(*dfa, *Fsm);
-    Fsm = dfa;
+  if (determinize) {
+    if (!Fsm->Deterministic) {
+      NFAPtr dfa(new NFA(1, 2 * Fsm->verticesSize(), Fsm->edgesSize()));
+      dfa->TransFac = Fsm->TransFac;
+      Comp.subsetDFA(*dfa, *Fsm);
+      Fsm = dfa;
+    }
+
+    // before labeling guard states, so they are found on the final graph
+    NFAPtr min(new NFA(1, Fsm->verticesSize(), Fsm->edgesSize()));
+    min->TransFac = Fsm->TransFac;
+    Comp.minimizeDFA(*min, *Fsm);
+    Fsm = min;
   }
 
   Comp.labelGuardStates(*Fsm);
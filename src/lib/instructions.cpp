@@ -62,6 +62,9 @@ std::string Instruction::toString() const {
   case ANY_OP:
     buf << "Any";
     break;
+  case LITERAL_OP:
+    buf << "Literal 0x" << HexCode<byte>(Op.T4.Byte) << "/'" << Op.T4.Byte << "' " << std::dec << (uint32_t) Op.T4.Length;
+    break;
   case BIT_VECTOR_OP:
     buf << "BitVector";
     break;
@@ -71,6 +74,12 @@ std::string Instruction::toString() const {
   case JUMP_TABLE_RANGE_OP:
     buf << "JmpTblRange 0x" << HexCode<byte>(Op.T2.First) << "/'" << Op.T2.First << "'-0x" << HexCode<byte>(Op.T2.Last) << "/'" << Op.T2.Last << '\'';
     break;
+  case JUMP_TABLE_SPARSE_OP:
+    buf << "JmpTblSparse 0x" << HexCode<byte>(Op.T3.First) << "-0x" << HexCode<byte>(Op.T3.Last) << ' ' << std::dec << (Op.T3.Count + 1);
+    break;
+  case JUMP_TABLE_BITMAP_OP:
+    buf << "JmpTblBitmap 0x" << HexCode<byte>(Op.T2.First) << "-0x" << HexCode<byte>(Op.T2.Last);
+    break;
   case FORK_OP:
     buf << "Fork 0x" << HexCode<uint32_t>(*reinterpret_cast<const uint32_t*>(this+1)) << '/' << std::dec << (*reinterpret_cast<const uint32_t*>(this+1));
     break;
@@ -135,9 +144,13 @@ Instruction Instruction::makeAny() {
   return i;
 }
 
-Instruction Instruction::makeBitVector() {
+Instruction Instruction::makeBitVector(byte words) {
+  if (words < 1 || words > 8) {
+    THROW_WITH_OUTPUT(std::range_error, "bit vectors have 1 to 8 words; specified value was " << (uint32_t) words);
+  }
   Instruction i;
   i.OpCode = BIT_VECTOR_OP;
+  i.Op.T1.Byte = words;
   return i;
 }
 
@@ -157,6 +170,22 @@ Instruction Instruction::makeJumpTableRange(byte first, byte last) {
   return i;
 }
 
+Instruction Instruction::makeJumpTableSparse(byte first, byte last, uint32_t num) {
+  if (num < 1 || num > 256u || num > uint32_t(last - first + 1)) {
+    THROW_WITH_OUTPUT(std::range_error, "sparse jump tables have 1 to 256 entries in their range; specified value was " << num);
+  }
+  Instruction i = makeRange(first, last);
+  i.OpCode = JUMP_TABLE_SPARSE_OP;
+  i.Op.T3.Count = num - 1;
+  return i;
+}
+
+Instruction Instruction::makeJumpTableBitmap(byte first, byte last) {
+  Instruction i = makeRange(first, last);
+  i.OpCode = JUMP_TABLE_BITMAP_OP;
+  return i;
+}
+
 Instruction Instruction::makeRaw24(uint32_t val) {
   if (val >= (1 << 24)) {
     THROW_WITH_OUTPUT(
@@ -170,6 +199,16 @@ Instruction Instruction::makeRaw24(uint32_t val) {
   return i;
 }
 
+Instruction Instruction::makeLiteral(byte b, byte length) {
+  if (length < 1) {
+    THROW_WITH_OUTPUT(std::range_error, "literals have 1 to 255 bytes; specified value was " << (uint32_t) length);
+  }
+  Instruction i = makeByte(b);
+  i.OpCode = LITERAL_OP;
+  i.Op.T4.Length = length;
+  return i;
+}
+
 Instruction Instruction::makeLabel(uint32_t label) {
   Instruction i = makeRaw24(label);
   i.OpCode = LABEL_OP;
@@ -259,6 +298,16 @@ std::istream& operator>>(std::istream& in, Instruction& instr) {
     instr = Instruction::makeRange(first, last);
     instr.OpCode = JUMP_TABLE_RANGE_OP;
   }
+  else if (opname == "JumpTblSparse") {
+    uint32_t first, last, num;
+    in >> std::hex >> first >> last >> std::dec >> num;
+    instr = Instruction::makeJumpTableSparse(first, last, num);
+  }
+  else if (opname == "JumpTblBitmap") {
+    uint32_t first, last;
+    in >> std::hex >> first >> last;
+    instr = Instruction::makeJumpTableBitmap(first, last);
+  }
   else if (opname == "Fork") {
     instr.OpCode = FORK_OP;
     instr.Op.Offset = 0;
@@ -268,6 +317,11 @@ std::istream& operator>>(std::istream& in, Instruction& instr) {
     in >> label;
     instr = Instruction::makeCheckHalt(label);
   }
+  else if (opname == "Literal") {
+    uint32_t b, length;
+    in >> std::hex >> b >> std::dec >> length;
+    instr = Instruction::makeLiteral(b, length);
+  }
   else if (opname == "Label") {
     uint32_t label;
     in >> label;
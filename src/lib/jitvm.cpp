@@ -0,0 +1,403 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "jitvm.h"
+#include "program.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define LBT_JIT_X86_64
+#endif
+
+namespace {
+  // condition codes for Jcc rel32, the second byte after 0x0F
+  enum Cond : byte {
+    JAE = 0x83,
+    JE  = 0x84,
+    JNE = 0x85,
+    JBE = 0x86,
+    JA  = 0x87
+  };
+
+  class Assembler {
+  public:
+    size_t size() const { return Code.size(); }
+
+    std::vector<byte>& code() { return Code; }
+
+    void bytes(std::initializer_list<byte> b) {
+      Code.insert(Code.end(), b);
+    }
+
+    void imm32(uint32_t v) {
+      for (int i = 0; i < 4; ++i) {
+        Code.push_back(v >> (8*i));
+      }
+    }
+
+    // jumps to target if cond holds
+    void jcc(Cond cond, size_t target) {
+      bytes({0x0F, cond});
+      imm32(static_cast<uint32_t>(target - (Code.size() + 4)));
+    }
+
+    // returns r
+    void ret(uint32_t r) {
+      bytes({0xB8});        // mov eax, r
+      imm32(r);
+      bytes({0xC3});        // ret
+    }
+
+    // leaves the byte less first in eax, and compares it to last less first
+    void range(byte first, byte last) {
+      bytes({0x8D, 0x82});  // lea eax, [rdx - first]
+      imm32(-static_cast<uint32_t>(first));
+      bytes({0x3D});        // cmp eax, last - first
+      imm32(last - first);
+    }
+
+    void cmp(byte b) {
+      bytes({0x81, 0xFA});  // cmp edx, b
+      imm32(b);
+    }
+
+  private:
+    std::vector<byte> Code;
+  };
+
+  bool isConsuming(byte op) {
+    return op <= ANY_OP || isJumpTable(op) || op == LITERAL_OP;
+  }
+
+  uint32_t target(const Instruction* const base, uint32_t pc) {
+    return *reinterpret_cast<const uint32_t*>(base + pc + 1);
+  }
+
+  // the PC a thread arriving at pc ends up at, after any jumps
+  uint32_t resolve(const Instruction* const base, uint32_t n, uint32_t pc) {
+    for (uint32_t i = 0; i < n && base[pc].OpCode == JUMP_OP; ++i) {
+      pc = target(base, pc);
+    }
+    return isConsuming(base[pc].OpCode) ? pc : pc | Vm::EPSILON;
+  }
+
+  // the instructions threads can reach, so the words of jump tables and
+  // bit vectors aren't mistaken for instructions
+  std::vector<bool> reachable(const Instruction* const base, uint32_t n) {
+    std::vector<bool> seen(n, false);
+    std::vector<uint32_t> stack(1, 0);
+
+    while (!stack.empty()) {
+      const uint32_t pc = stack.back();
+      stack.pop_back();
+
+      if (pc >= n || seen[pc]) {
+        continue;
+      }
+      seen[pc] = true;
+
+      const Instruction& instr = base[pc];
+      switch (instr.OpCode) {
+      case JUMP_TABLE_RANGE_OP:
+      case JUMP_TABLE_SPARSE_OP:
+      case JUMP_TABLE_BITMAP_OP:
+        for (uint32_t c = instr.Op.T2.First; c <= instr.Op.T2.Last; ++c) {
+          const uint32_t addr = jumpTableTarget(instr, c);
+          if (addr) {
+            stack.push_back(addr);
+          }
+        }
+        break;
+
+      case FORK_OP:
+        stack.push_back(target(base, pc));
+        stack.push_back(pc + InstructionSize<FORK_OP>::VAL);
+        break;
+
+      case JUMP_OP:
+        stack.push_back(target(base, pc));
+        break;
+
+      case FINISH_OP:
+      case HALT_OP:
+        break;
+
+      default:
+        stack.push_back(pc + instr.wordSize());
+        break;
+      }
+    }
+
+    return seen;
+  }
+
+  //
+  // Compiles each instruction threads can wait at to a function, and
+  // returns the code and the offset of each PC's function in it. Each
+  // function moves the byte into edx and leaves the next PC in eax. Jump
+  // tables and bit vectors are indexed by byte class in the program, but
+  // are expanded to bytes here, so the code needs no class lookup. They
+  // use only registers which are volatile under both the System V and
+  // Windows calling conventions, and address their operands relative to
+  // rip, so the code can be moved anywhere.
+  //
+  std::vector<byte> compile(const Program& prog, std::vector<size_t>& stubs) {
+    const Instruction* const base = &prog[0];
+    const uint32_t n = prog.size();
+    const ByteClasses& classes = prog.Classes;
+
+    Assembler a;
+
+    // every other instruction kills the thread, as in Vm::_execute
+    const size_t die = a.size();
+    a.ret(Thread::DEAD);
+
+    stubs.assign(n, die);
+
+    const std::vector<bool> seen(reachable(base, n));
+
+    for (uint32_t pc = 0; pc < n; ++pc) {
+      const Instruction& instr = base[pc];
+
+      if (seen[pc] && (isConsuming(instr.OpCode) || instr.OpCode == FINISH_OP)) {
+        while (a.size() % 16) {
+          a.bytes({0xCC});                // int3
+        }
+        stubs[pc] = a.size();
+
+        #ifdef _WIN32
+        a.bytes({0x0F, 0xB6, 0xD1});      // movzx edx, cl
+        #else
+        a.bytes({0x40, 0x0F, 0xB6, 0xD7}); // movzx edx, dil
+        #endif
+
+        const bool negate = instr.Op.T1.Flags & Instruction::NEGATE;
+
+        switch (instr.OpCode) {
+        case JUMP_TABLE_RANGE_OP:
+        case JUMP_TABLE_SPARSE_OP:
+        case JUMP_TABLE_BITMAP_OP:
+          {
+            // whatever the layout, native code gets a dense table over
+            // the bytes with targets, so it does no class lookup
+            uint32_t lo = 255, hi = 0;
+            for (uint32_t b = 0; b < 256; ++b) {
+              if (jumpTableTarget(instr, classes[b])) {
+                lo = std::min(lo, b);
+                hi = b;
+              }
+            }
+
+            a.range(lo, hi);
+            a.jcc(JA, die);
+            a.bytes({
+              0x4C, 0x8D, 0x05, 0x05, 0x00, 0x00, 0x00, // lea r8, [rip + 5]
+              0x41, 0x8B, 0x04, 0x80,                   // mov eax, [r8 + rax*4]
+              0xC3                                      // ret
+            });
+
+            // the table follows, by byte, with its targets resolved
+            for (uint32_t b = lo; b <= hi; ++b) {
+              const uint32_t addr = jumpTableTarget(instr, classes[b]);
+              a.imm32(addr ? resolve(base, n, addr) : Thread::DEAD);
+            }
+          }
+          break;
+
+        case BYTE_OP:
+          a.cmp(instr.Op.T1.Byte);
+          a.jcc(negate ? JE : JNE, die);
+          a.ret(resolve(base, n, pc + InstructionSize<BYTE_OP>::VAL));
+          break;
+
+        case LITERAL_OP:
+          // only the first byte; native code doesn't look ahead
+          a.cmp(instr.Op.T4.Byte);
+          a.jcc(JNE, die);
+          a.ret(resolve(base, n, pc + InstructionSize<LITERAL_OP>::VAL));
+          break;
+
+        case BIT_VECTOR_OP:
+          {
+            a.bytes({0x0F, 0xA3, 0x15});  // bt [rip + 12], edx
+            a.imm32(12);
+            a.jcc(JAE, die);
+            a.ret(resolve(base, n, pc + instr.wordSize()));
+
+            // the set follows, by byte
+            const uint32_t* const words = reinterpret_cast<const uint32_t*>(base + pc + 1);
+            byte bits[32] = {0};
+            for (uint32_t b = 0; b < 256; ++b) {
+              const byte c = classes[b];
+              if ((words[c >> 5] >> (c & 31)) & 1) {
+                bits[b >> 3] |= 1 << (b & 7);
+              }
+            }
+            a.code().insert(a.code().end(), bits, bits + 32);
+          }
+          break;
+
+        case EITHER_OP:
+          a.cmp(instr.Op.T2.First);
+          if (negate) {
+            a.jcc(JE, die);
+            a.cmp(instr.Op.T2.Last);
+            a.jcc(JE, die);
+          }
+          else {
+            a.bytes({0x74, 0x0C});        // je past the second test
+            a.cmp(instr.Op.T2.Last);
+            a.jcc(JNE, die);
+          }
+          a.ret(resolve(base, n, pc + InstructionSize<EITHER_OP>::VAL));
+          break;
+
+        case RANGE_OP:
+          a.range(instr.Op.T2.First, instr.Op.T2.Last);
+          a.jcc(negate ? JBE : JA, die);
+          a.ret(resolve(base, n, pc + InstructionSize<RANGE_OP>::VAL));
+          break;
+
+        case ANY_OP:
+          a.ret(resolve(base, n, pc + InstructionSize<ANY_OP>::VAL));
+          break;
+
+        case FINISH_OP:
+          // the thread waits here for its match to be emitted
+          a.ret(pc | Vm::EPSILON);
+          break;
+        }
+      }
+    }
+
+    return a.code();
+  }
+}
+
+bool JitVm::supported() {
+  #ifdef LBT_JIT_X86_64
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+struct JitVm::Code {
+  Code(): Mem(nullptr), Size(0) {}
+
+  ~Code() {
+    if (Mem) {
+      #ifdef _WIN32
+      VirtualFree(Mem, 0, MEM_RELEASE);
+      #else
+      munmap(Mem, Size);
+      #endif
+    }
+  }
+
+  Code(const Code&) = delete;
+  Code& operator=(const Code&) = delete;
+
+  void* Mem;
+  size_t Size;
+
+  std::vector<NativeStep> Stubs;
+};
+
+JitVm::JitVm(ProgramPtr prog):
+  Vm(prog)
+{
+  if (!supported()) {
+    throw std::runtime_error("Native code is not supported on this host");
+  }
+
+  if (prog->size() >= EPSILON) {
+    throw std::runtime_error("Program too large to compile to native code");
+  }
+
+  std::vector<size_t> stubs;
+  const std::vector<byte> code(compile(*prog, stubs));
+  if (code.size() > 0x7FFFFFFF) {
+    throw std::runtime_error("Program too large to compile to native code");
+  }
+
+  std::shared_ptr<Code> c(new Code);
+
+  // write the code, then make it executable but no longer writable
+  #ifdef _WIN32
+  c->Mem = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (!c->Mem) {
+    throw std::runtime_error("Could not allocate memory for native code");
+  }
+  c->Size = code.size();
+
+  std::memcpy(c->Mem, code.data(), code.size());
+
+  DWORD old;
+  if (!VirtualProtect(c->Mem, c->Size, PAGE_EXECUTE_READ, &old)) {
+    throw std::runtime_error("Could not make native code executable");
+  }
+  FlushInstructionCache(GetCurrentProcess(), c->Mem, c->Size);
+  #else
+  void* const mem = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error("Could not allocate memory for native code");
+  }
+  c->Mem = mem;
+  c->Size = code.size();
+
+  std::memcpy(c->Mem, code.data(), code.size());
+
+  if (mprotect(c->Mem, c->Size, PROT_READ | PROT_EXEC)) {
+    throw std::runtime_error("Could not make native code executable");
+  }
+  #endif
+
+  c->Stubs.reserve(stubs.size());
+  for (const size_t off : stubs) {
+    c->Stubs.push_back(reinterpret_cast<NativeStep>(static_cast<byte*>(c->Mem) + off));
+  }
+
+  Compiled = c;
+  Native = Compiled->Stubs.data();
+}
+
+JitVm::JitVm(const JitVm& other):
+  Vm(other),
+  Compiled(other.Compiled)
+{}
+
+std::shared_ptr<VmInterface> JitVm::clone() const {
+  return std::shared_ptr<VmInterface>(new JitVm(*this));
+}
+
+size_t JitVm::codeSize() const {
+  return Compiled->Size;
+}
@@ -0,0 +1,125 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "labelmask.h"
+#include "program.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+  uint32_t target(const Instruction* const base, uint32_t pc) {
+    return *reinterpret_cast<const uint32_t*>(base + pc + 1);
+  }
+
+  // calls f with each PC a thread at pc can go to next
+  template <class F>
+  void successors(const Instruction* const base, uint32_t pc, F f) {
+    const Instruction& instr = base[pc];
+    switch (instr.OpCode) {
+    case JUMP_TABLE_RANGE_OP:
+    case JUMP_TABLE_SPARSE_OP:
+    case JUMP_TABLE_BITMAP_OP:
+      for (uint32_t c = instr.Op.T2.First; c <= instr.Op.T2.Last; ++c) {
+        const uint32_t addr = jumpTableTarget(instr, c);
+        if (addr) {
+          f(addr);
+        }
+      }
+      break;
+
+    case FORK_OP:
+      f(target(base, pc));
+      f(pc + InstructionSize<FORK_OP>::VAL);
+      break;
+
+    case JUMP_OP:
+      f(target(base, pc));
+      break;
+
+    case FINISH_OP:
+    case HALT_OP:
+      break;
+
+    default:
+      f(pc + instr.wordSize());
+      break;
+    }
+  }
+}
+
+LabelMask::LabelMask(const Program& prog, const std::vector<bool>& disabled):
+  Live(prog.size(), false)
+{
+  for (uint32_t label = 0; label < disabled.size(); ++label) {
+    if (disabled[label]) {
+      Disabled.push_back(label);
+    }
+  }
+
+  const Instruction* const base = &prog[0];
+  const uint32_t n = prog.size();
+
+  // find the instructions threads can reach, and the edges between them,
+  // as (to, from), so that the edges into an instruction are adjacent
+  std::vector<bool> seen(n, false);
+  std::vector<std::pair<uint32_t,uint32_t>> edges;
+  std::vector<uint32_t> stack(1, 0);
+
+  while (!stack.empty()) {
+    const uint32_t pc = stack.back();
+    stack.pop_back();
+
+    if (pc >= n || seen[pc]) {
+      continue;
+    }
+    seen[pc] = true;
+
+    successors(base, pc, [&](uint32_t next) {
+      edges.emplace_back(next, pc);
+      stack.push_back(next);
+    });
+  }
+
+  std::sort(edges.begin(), edges.end());
+
+  // walk back from the labels left enabled
+  for (uint32_t pc = 0; pc < n; ++pc) {
+    if (seen[pc] && base[pc].OpCode == LABEL_OP) {
+      const uint32_t label = base[pc].Op.Offset;
+      if (label >= disabled.size() || !disabled[label]) {
+        Live[pc] = true;
+        stack.push_back(pc);
+      }
+    }
+  }
+
+  while (!stack.empty()) {
+    const uint32_t pc = stack.back();
+    stack.pop_back();
+
+    for (auto e = std::lower_bound(edges.begin(), edges.end(), std::make_pair(pc, uint32_t(0)));
+         e != edges.end() && e->first == pc; ++e)
+    {
+      if (!Live[e->second]) {
+        Live[e->second] = true;
+        stack.push_back(e->second);
+      }
+    }
+  }
+}
@@ -0,0 +1,458 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lazydfavm.h"
+#include "byteset.h"
+#include "program.h"
+
+#include <algorithm>
+#include <limits>
+
+const uint64_t LazyDfaVm::DEFAULT_CACHE_SIZE = 8 << 20;
+
+const uint32_t LazyDfaVm::UNKNOWN = std::numeric_limits<uint32_t>::max();
+const uint32_t LazyDfaVm::QUIET = 0;
+
+namespace {
+  // how many bytes Vm runs before checking whether its threads died out
+  const uint32_t THREAD_CHUNK = 64;
+
+  // fewer bytes scanned per state than this between flushes is thrashing
+  const uint64_t MIN_BYTES_PER_STATE = 10;
+
+  // the bits of the least power of two not less than n
+  uint32_t log2Ceil(uint32_t n) {
+    uint32_t bits = 0;
+    while ((1u << bits) < n) {
+      ++bits;
+    }
+    return bits;
+  }
+}
+
+uint64_t LazyDfaVm::_stateCost(size_t n) const {
+  // the transitions, the set in the index, and the index overhead
+  return (sizeof(uint32_t) << ClassBits) + n*sizeof(uint32_t) + 64;
+}
+
+size_t LazyDfaVm::PCSetHash::operator()(const PCSet& s) const {
+  size_t h = s.size();
+  for (const uint32_t pc : s) {
+    h = (h ^ pc) * 0x100000001B3ull;
+  }
+  return h;
+}
+
+LazyDfaVm::LazyDfaVm(ProgramPtr prog, uint64_t cacheSize):
+  Prog(prog),
+  Base(&(*prog)[0]),
+  Classes(prog->Classes),
+  ClassBits(log2Ceil(prog->Classes.Num)),
+  Threads(prog),
+  Skip(prog->Filter),
+  CacheSize(cacheSize),
+  CacheUsed(0),
+  Seen(prog->size()),
+  BytesSinceFlush(0),
+  FellBack(false),
+  InThreads(false)
+{
+  bool match = false;
+  _closure(0, match);
+  std::sort(Work.begin(), Work.end());
+  StartPCs.swap(Work);
+
+  _flush();
+}
+
+LazyDfaVm::LazyDfaVm(const LazyDfaVm& other):
+  Prog(other.Prog),
+  Base(other.Base),
+  Classes(other.Classes),
+  ClassBits(other.ClassBits),
+  Threads(other.Threads),
+  Skip(other.Skip),
+  CacheSize(other.CacheSize),
+  CacheUsed(0),
+  StartPCs(other.StartPCs),
+  Seen(Prog->size()),
+  BytesSinceFlush(0),
+  FellBack(false),
+  InThreads(false)
+{
+  _flush();
+}
+
+std::shared_ptr<VmInterface> LazyDfaVm::clone() const {
+  return std::shared_ptr<VmInterface>(new LazyDfaVm(*this));
+}
+
+void LazyDfaVm::save(std::vector<char>& buf) const {
+  // the DFA has no state between calls; a partial match at the end of a
+  // buffer is always handed to Vm
+  StateWriter out(buf);
+  out.header(LAZY_DFA_STATE, *Prog);
+  out.put(static_cast<byte>(FellBack));
+  Threads._save(out);
+}
+
+void LazyDfaVm::restore(const char* beg, const char* end) {
+  reset();
+
+  try {
+    StateReader in(beg, end);
+    in.header(LAZY_DFA_STATE, *Prog);
+    FellBack = in.get<byte>();
+    Threads._restore(in);
+    in.finish();
+
+    InThreads = Threads.numActive();
+  }
+  catch (...) {
+    reset();
+    throw;
+  }
+}
+
+void LazyDfaVm::reset() {
+  Threads.reset();
+  InThreads = false;
+}
+
+void LazyDfaVm::setMask(const std::shared_ptr<const LabelMask>& mask) {
+  // the DFA is left as it is; matches for disabled labels still go to
+  // Vm, where they die
+  Threads.setMask(mask);
+  InThreads = false;
+}
+
+void LazyDfaVm::restart() {
+  Threads.restart();
+  InThreads = false;
+}
+
+bool LazyDfaVm::idle() const {
+  return !InThreads;
+}
+
+uint32_t LazyDfaVm::_insert(const PCSet& pcs) {
+  const uint32_t id = Sets.size();
+  const auto i = Index.emplace(pcs, id).first;
+  Sets.push_back(&i->first);
+  Trans.resize(Trans.size() + (1 << ClassBits), UNKNOWN);
+  CacheUsed += _stateCost(pcs.size());
+  return id;
+}
+
+void LazyDfaVm::_flush() {
+  Index.clear();
+  Sets.clear();
+  Trans.clear();
+  CacheUsed = 0;
+  BytesSinceFlush = 0;
+
+  // the state with no threads alive is always state 0
+  _insert(PCSet());
+}
+
+uint32_t LazyDfaVm::_step(uint32_t pc, byte b, byte cls) const {
+  const Instruction& instr = Base[pc];
+
+  switch (instr.OpCode) {
+  case JUMP_TABLE_RANGE_OP:
+  case JUMP_TABLE_SPARSE_OP:
+  case JUMP_TABLE_BITMAP_OP:
+    {
+      const uint32_t addr = jumpTableTarget(instr, cls);
+      if (addr) {
+        return addr;
+      }
+    }
+    break;
+
+  case BYTE_OP:
+    if ((b == instr.Op.T1.Byte) ^ (instr.Op.T1.Flags & Instruction::NEGATE)) {
+      return pc + InstructionSize<BYTE_OP>::VAL;
+    }
+    break;
+
+  case LITERAL_OP:
+    // states are built a byte at a time, so there's nothing to look ahead for
+    if (b == instr.Op.T4.Byte) {
+      return pc + InstructionSize<LITERAL_OP>::VAL;
+    }
+    break;
+
+  case BIT_VECTOR_OP:
+    if ((reinterpret_cast<const uint32_t*>(&instr + 1)[cls >> 5] >> (cls & 31)) & 1) {
+      return pc + instr.wordSize();
+    }
+    break;
+
+  case EITHER_OP:
+    if ((b == instr.Op.T2.First || b == instr.Op.T2.Last) ^ (instr.Op.T2.Flags & Instruction::NEGATE)) {
+      return pc + InstructionSize<EITHER_OP>::VAL;
+    }
+    break;
+
+  case RANGE_OP:
+    if ((instr.Op.T2.First <= b && b <= instr.Op.T2.Last) ^ (instr.Op.T2.Flags & Instruction::NEGATE)) {
+      return pc + InstructionSize<RANGE_OP>::VAL;
+    }
+    break;
+
+  case ANY_OP:
+    return pc + InstructionSize<ANY_OP>::VAL;
+  }
+
+  return UNKNOWN;
+}
+
+void LazyDfaVm::_closure(uint32_t pc, bool& match) {
+  // follows the epsilon instructions from pc, collecting the consuming
+  // instructions reached; labels and checks don't stop threads here
+  Stack.push_back(pc);
+  while (!Stack.empty()) {
+    pc = Stack.back();
+    Stack.pop_back();
+
+    if (Seen.find(pc)) {
+      continue;
+    }
+    Seen.insert(pc);
+
+    const Instruction& instr = Base[pc];
+    switch (instr.OpCode) {
+    case JUMP_TABLE_RANGE_OP:
+    case JUMP_TABLE_SPARSE_OP:
+    case JUMP_TABLE_BITMAP_OP:
+    case LITERAL_OP:
+    case BYTE_OP:
+    case BIT_VECTOR_OP:
+    case EITHER_OP:
+    case RANGE_OP:
+    case ANY_OP:
+      Work.push_back(pc);
+      break;
+
+    case FORK_OP:
+      Stack.push_back(*reinterpret_cast<const uint32_t*>(&instr + 1));
+      Stack.push_back(pc + InstructionSize<FORK_OP>::VAL);
+      break;
+
+    case JUMP_OP:
+      Stack.push_back(*reinterpret_cast<const uint32_t*>(&instr + 1));
+      break;
+
+    case MATCH_OP:
+      match = true;
+      Stack.push_back(pc + InstructionSize<MATCH_OP>::VAL);
+      break;
+
+    case LABEL_OP:
+    case CHECK_HALT_OP:
+      Stack.push_back(pc + 1);
+      break;
+
+    default:
+      // FINISH_OP and HALT_OP consume nothing more
+      break;
+    }
+  }
+}
+
+uint32_t LazyDfaVm::_transition(uint32_t s, byte b) {
+  Work.clear();
+  Seen.clear();
+  bool match = false;
+
+  // every byte in the class goes the same way, so the transition is kept
+  // for the class
+  const byte cls = Classes[b];
+  const uint32_t i = (s << ClassBits) | cls;
+
+  // step the threads alive in s, and the one starting here
+  for (const PCSet* set : {Sets[s], static_cast<const PCSet*>(&StartPCs)}) {
+    for (const uint32_t pc : *set) {
+      const uint32_t next = _step(pc, b, cls);
+      if (next != UNKNOWN) {
+        _closure(next, match);
+      }
+    }
+  }
+
+  std::sort(Work.begin(), Work.end());
+
+  const auto j = Index.find(Work);
+  if (j != Index.end()) {
+    return Trans[i] = (j->second << 1) | match;
+  }
+
+  if (CacheUsed + _stateCost(Work.size()) > CacheSize) {
+    if (BytesSinceFlush < MIN_BYTES_PER_STATE * Sets.size()) {
+      // the cache is thrashing; Vm will do better alone
+      FellBack = true;
+      return UNKNOWN;
+    }
+
+    // s is gone after the flush, so this transition isn't cached
+    _flush();
+    const uint32_t t = Work.empty() ? QUIET : _insert(Work);
+    return (t << 1) | match;
+  }
+
+  const uint32_t t = _insert(Work);
+  return Trans[i] = (t << 1) | match;
+}
+
+const byte* LazyDfaVm::_runThreads(const byte* cur, const byte* const end, uint64_t& offset, uint64_t& ret, HitCallback hitFn, void* userData) {
+  // run Vm a little at a time until its threads die out
+  while (cur < end) {
+    const byte* const stop = end - cur > THREAD_CHUNK ? cur + THREAD_CHUNK : end;
+    ret = Threads.search(cur, stop, offset, hitFn, userData);
+
+    if (Threads.hits().halted()) {
+      if (Threads.hits().paused()) {
+        // Vm stopped short of stop
+        cur += Threads.hits().pausedAt() - offset;
+        offset = Threads.hits().pausedAt();
+      }
+      InThreads = Threads.numActive();
+      break;
+    }
+
+    offset += stop - cur;
+    cur = stop;
+
+    if (!Threads.numActive()) {
+      InThreads = false;
+      break;
+    }
+  }
+  return cur;
+}
+
+uint64_t LazyDfaVm::search(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  if (FellBack || beg == end) {
+    const uint64_t ret = Threads.search(beg, end, startOffset, hitFn, userData);
+    InThreads = Threads.numActive();
+    return ret;
+  }
+
+  const uint32_t filterOff = Prog->FilterOff;
+  const byte* const filterEnd = end - filterOff - 1;
+
+  uint64_t offset = startOffset, ret = startOffset;
+
+  const byte* cur = beg;
+  while (cur < end) {
+    if (Threads.hits().halted()) {
+      if (Threads.hits().stopped()) {
+        // Vm has dropped its threads
+        InThreads = false;
+        return startOffset + (end - beg);
+      }
+
+      // Vm paused, with hits held back
+      break;
+    }
+
+    if (FellBack) {
+      ret = Threads.search(cur, end, offset, hitFn, userData);
+      offset = Threads.hits().paused() ? Threads.hits().pausedAt() : offset + (end - cur);
+      cur = end;
+      InThreads = Threads.numActive();
+      break;
+    }
+
+    if (InThreads) {
+      cur = _runThreads(cur, end, offset, ret, hitFn, userData);
+      continue;
+    }
+
+    // Run the DFA from a position where no threads are alive. Every
+    // match ending before the next quiet position starts after the
+    // last one, so Vm need only run from there.
+    const byte* const dfaBeg = cur;
+    const byte* quiet = cur;
+    uint32_t s = QUIET;
+    bool handOff = false;
+
+    for ( ; cur < end; ++cur) {
+      if (s == QUIET && cur < filterEnd) {
+        // as in Vm, no match starts where the prefilter fails
+        cur = Skip.next(cur + filterOff, filterEnd + filterOff) - filterOff;
+        quiet = cur;
+        if (cur == filterEnd) {
+          break;
+        }
+      }
+
+      uint32_t t = Trans[(s << ClassBits) | Classes[*cur]];
+      if (t == UNKNOWN) {
+        t = _transition(s, *cur);
+        if (FellBack) {
+          handOff = true;
+          break;
+        }
+      }
+
+      if (t & 1) {
+        // a match ends here
+        handOff = true;
+        break;
+      }
+
+      s = t >> 1;
+      if (s == QUIET) {
+        quiet = cur + 1;
+      }
+    }
+
+    BytesSinceFlush += cur - dfaBeg;
+
+    if (handOff || s != QUIET) {
+      // partial matches at the end must go to Vm too, to carry them
+      // into the next buffer
+      offset += quiet - dfaBeg;
+      cur = quiet;
+      InThreads = true;
+    }
+    else {
+      offset += cur - dfaBeg;
+    }
+  }
+
+  return InThreads ? ret : offset;
+}
+
+uint64_t LazyDfaVm::searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  const uint64_t ret = Threads.searchResolve(beg, end, startOffset, hitFn, userData);
+  InThreads = Threads.numActive();
+  return ret;
+}
+
+void LazyDfaVm::closeOut(HitCallback hitFn, void* userData) {
+  Threads.closeOut(hitFn, userData);
+  InThreads = Threads.numActive();
+}
+
+void LazyDfaVm::startsWith(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  Threads.startsWith(beg, end, startOffset, hitFn, userData);
+  InThreads = Threads.numActive();
+}
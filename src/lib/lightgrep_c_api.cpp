@@ -26,14 +26,23 @@
 #include "handles.h"
 #include "nfabuilder.h"
 #include "nfaoptimizer.h"
+#include "parallelcompile.h"
+#include "parallelsearch.h"
 #include "parser.h"
 #include "parsetree.h"
 #include "program.h"
+#include "programcache.h"
+#include "programfile.h"
 #include "utility.h"
 #include "vm_interface.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -170,24 +179,18 @@ namespace {
     }
   }
 
-  int addPatternList(LG_HFSM hFsm,
-                     LG_HPROGRAM hProg,
-                     const char* patterns,
-                     const char* source,
-                     const char** defaultEncodings,
-                     size_t defaultEncodingsNum,
-                     const LG_KeyOptions* defaultOptions,
-                     LG_Error** err)
+  typedef std::unique_ptr<LG_Error,void(*)(LG_Error*)> ErrorPtr;
+
+  // reads each line of a pattern list into a job; a line with no
+  // pattern or no encodings gets a job with no encodings, and its error
+  // goes at the same index in errs
+  void readPatternList(const char* patterns,
+                       const char* source,
+                       const std::vector<std::string>& defEncs,
+                       const LG_KeyOptions* defaultOptions,
+                       std::vector<PatternJob>& jobs,
+                       std::vector<ErrorPtr>& errs)
   {
-    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> ph(
-      lg_create_pattern(),
-      lg_destroy_pattern
-    );
-
-    const std::vector<std::string> defEncs(
-      defaultEncodings, defaultEncodings + defaultEncodingsNum
-    );
-
     typedef boost::char_separator<char> char_separator;
     typedef boost::tokenizer<char_separator, const char*> cstr_tokenizer;
     typedef boost::tokenizer<char_separator> tokenizer;
@@ -200,16 +203,20 @@ namespace {
     cstr_tokenizer::const_iterator lcur(ltok.begin());
     const cstr_tokenizer::const_iterator lend(ltok.end());
     for (int lnum = 0; lcur != lend; ++lcur, ++lnum) {
+      jobs.emplace_back();
+      errs.emplace_back(nullptr, lg_free_error);
+
+      PatternJob& job(jobs.back());
+
       // split each pattern line into columns
       const tokenizer ctok(*lcur, char_separator("\t"));
       tokenizer::const_iterator ccur(ctok.begin());
       const tokenizer::const_iterator cend(ctok.end());
 
       if (ccur == cend) { // FIXME: is this possible?
-        if (err) {
-          *err = makeError("no pattern", nullptr, nullptr, source, lnum);
-          err = &((*err)->Next);
-        }
+        errs.back().reset(
+          makeError("no pattern", nullptr, nullptr, source, lnum)
+        );
         continue;
       }
 
@@ -224,13 +231,10 @@ namespace {
         const tokenizer etok(el, char_separator(","));
 
         if (etok.begin() == etok.end()) {
-          if (err) {
-            *err = makeError(
-              "no encoding list",
-              pat.c_str(), nullptr, source, lnum
-            );
-            err = &((*err)->Next);
-          }
+          errs.back().reset(makeError(
+            "no encoding list",
+            pat.c_str(), nullptr, source, lnum
+          ));
           continue;
         }
 
@@ -245,12 +249,133 @@ namespace {
           }
         }
 
-        addPattern(hFsm, hProg, ph.get(), pat, &opts, etok, lnum, err);
+        job.Encodings.assign(etok.begin(), etok.end());
       }
       else {
         // use default encodings and options
-        addPattern(hFsm, hProg, ph.get(), pat, &opts, defEncs, lnum, err);
+        job.Encodings = defEncs;
       }
+
+      job.Pat = {
+        pat,
+        static_cast<bool>(opts.FixedString),
+        static_cast<bool>(opts.CaseInsensitive),
+        static_cast<bool>(opts.UnicodeMode)
+      };
+    }
+  }
+
+  void chainError(LG_Error**& err, LG_Error* e, int lnum) {
+    *err = e;
+    (*err)->Index = lnum;
+    err = &((*err)->Next);
+  }
+
+  int addBuiltPattern(LG_HFSM hFsm, LG_HPROGRAM hProg, const PatternJob& job, PatternNFA& nfa, const std::string& encoding, uint64_t userIndex) {
+    const uint32_t label = hProg->PMap->Patterns.size();
+    hFsm->Impl->mergePattern(nfa, label);
+    hProg->PMap->addPattern(job.Pat.Expression.c_str(), encoding.c_str(), userIndex);
+    return (int) label;
+  }
+
+  // adds a job built by buildPatterns(), just as addPattern() would
+  void mergeJob(LG_HFSM hFsm,
+                LG_HPROGRAM hProg,
+                PatternJob& job,
+                int lnum,
+                LG_Error**& err)
+  {
+    if (job.Nfas.empty()) {
+      chainError(err, makeError(job.Error.c_str()), lnum);
+      return;
+    }
+
+    for (size_t i = 0; i < job.Encodings.size(); ++i) {
+      if (!job.Nfas[i].Nfa) {
+        chainError(err, makeError(job.Errors[i].c_str()), lnum);
+        continue;
+      }
+
+      trapWithRetval(
+        [&]() {
+          return addBuiltPattern(hFsm, hProg, job, job.Nfas[i], job.Encodings[i], lnum);
+        },
+        -1,
+        err
+      );
+      if (*err) {
+        (*err)->Index = lnum;
+        err = &((*err)->Next);
+      }
+    }
+  }
+
+  int addPatternList(LG_HFSM hFsm,
+                     LG_HPROGRAM hProg,
+                     const char* patterns,
+                     const char* source,
+                     const char** defaultEncodings,
+                     size_t defaultEncodingsNum,
+                     const LG_KeyOptions* defaultOptions,
+                     unsigned int numThreads,
+                     LG_Error** err)
+  {
+    const std::vector<std::string> defEncs(
+      defaultEncodings, defaultEncodings + defaultEncodingsNum
+    );
+
+    std::vector<PatternJob> jobs;
+    std::vector<ErrorPtr> errs;
+
+    // a bad line stops the reading, but the lines before it are still
+    // added, and then the error is thrown
+    std::exception_ptr bad;
+    try {
+      readPatternList(patterns, source, defEncs, defaultOptions, jobs, errs);
+    }
+    catch (...) {
+      bad = std::current_exception();
+      if (jobs.size() == errs.size()) {
+        errs.pop_back();
+      }
+      jobs.resize(errs.size());
+    }
+
+    if (numThreads < 2) {
+      std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> ph(
+        lg_create_pattern(),
+        lg_destroy_pattern
+      );
+
+      for (size_t lnum = 0; lnum < jobs.size(); ++lnum) {
+        const PatternJob& job(jobs[lnum]);
+        if (errs[lnum]) {
+          chainError(err, errs[lnum].release(), lnum);
+        }
+        else {
+          LG_KeyOptions opts{
+            job.Pat.FixedString, job.Pat.CaseInsensitive, job.Pat.UnicodeMode
+          };
+          addPattern(hFsm, hProg, ph.get(), job.Pat.Expression, &opts, job.Encodings, lnum, err);
+        }
+      }
+    }
+    else {
+      buildPatterns(*hFsm->Impl, jobs, numThreads,
+        [&](PatternJob& job) {
+          const int lnum = &job - jobs.data();
+          if (errs[lnum]) {
+            chainError(err, errs[lnum].release(), lnum);
+          }
+          else {
+            mergeJob(hFsm, hProg, job, lnum, err);
+          }
+        }
+      );
+    }
+
+    if (bad) {
+      std::rethrow_exception(bad);
     }
 
     return 0;
@@ -265,12 +390,28 @@ int lg_add_pattern_list(LG_HFSM hFsm,
                         unsigned int defaultEncodingsNum,
                         const LG_KeyOptions* defaultOptions,
                         LG_Error** err)
+{
+  return lg_add_pattern_list_parallel(
+    hFsm, hProg, patterns, source, defaultEncodings, defaultEncodingsNum,
+    defaultOptions, 1, err
+  );
+}
+
+int lg_add_pattern_list_parallel(LG_HFSM hFsm,
+                                 LG_HPROGRAM hProg,
+                                 const char* patterns,
+                                 const char* source,
+                                 const char** defaultEncodings,
+                                 unsigned int defaultEncodingsNum,
+                                 const LG_KeyOptions* defaultOptions,
+                                 unsigned int numThreads,
+                                 LG_Error** err)
 {
   LG_Error* in_err = nullptr;
 
   int ret = trapWithRetval(
-    [hFsm, hProg, patterns, source, defaultEncodings, defaultEncodingsNum, defaultOptions, &in_err]() {
-      return addPatternList(hFsm, hProg, patterns, source, defaultEncodings, defaultEncodingsNum, defaultOptions, &in_err);
+    [hFsm, hProg, patterns, source, defaultEncodings, defaultEncodingsNum, defaultOptions, numThreads, &in_err]() {
+      return addPatternList(hFsm, hProg, patterns, source, defaultEncodings, defaultEncodingsNum, defaultOptions, numThreads, &in_err);
     },
     -1,
     err
@@ -285,6 +426,9 @@ int lg_add_pattern_list(LG_HFSM hFsm,
       *err = in_err;
     }
   }
+  else {
+    lg_free_error(in_err);
+  }
 
   return ret;
 }
@@ -323,7 +467,17 @@ LG_HPROGRAM lg_create_program(unsigned int numTotalPatternsSizeHint) {
 namespace {
   int compile_program(LG_HFSM hFsm, LG_HPROGRAM hProg, const LG_ProgramOptions* opts) {
     hFsm->Impl->finalizeGraph(opts->Determinize);
-    hProg->Prog = Compiler::createProgram(*hFsm->Impl->Fsm);
+    hProg->Prog = Compiler::createProgram(
+      *hFsm->Impl->Fsm,
+      hFsm->Impl->AllLiterals ? hFsm->Impl->Literals : std::vector<Literal>()
+    );
+
+    if (hFsm->Impl->AllFactors) {
+      Compiler::addFactors(
+        *hProg->Prog, hFsm->Impl->Factors,
+        hFsm->Impl->FactorLead, hFsm->Impl->FactorMaxLead
+      );
+    }
     return hProg->Prog != nullptr;
   }
 }
@@ -338,27 +492,12 @@ int lg_compile_program(LG_HFSM hFsm, LG_HPROGRAM hProg,
 }
 
 unsigned int lg_program_size(const LG_HPROGRAM hProg) {
-  return sizeof(uint64_t) + hProg->PMap->bufSize() +
-         sizeof(uint64_t) + hProg->Prog->bufSize();
+  return programFileSize(*hProg->PMap, *hProg->Prog);
 }
 
 namespace {
   void write_program(const LG_HPROGRAM hProg, void* buffer) {
-    char* dst = reinterpret_cast<char*>(buffer);
-
-    const std::vector<char> pmap_buf = hProg->PMap->marshall();
-    const uint64_t pmap_size = pmap_buf.size();
-    *reinterpret_cast<uint64_t*>(dst) = pmap_size;
-    dst += sizeof(pmap_size);
-    std::memcpy(dst, pmap_buf.data(), pmap_size);
-    dst += pmap_size;
-
-    const std::vector<char> prog_buf = hProg->Prog->marshall();
-    const uint64_t prog_size = prog_buf.size();
-    *reinterpret_cast<uint64_t*>(dst) = prog_size;
-    dst += sizeof(prog_size);
-    std::memcpy(dst, prog_buf.data(), prog_size);
-    dst += prog_size;
+    writeProgramFile(*hProg->PMap, *hProg->Prog, static_cast<char*>(buffer));
   }
 
   LG_HPROGRAM read_program(const void* buffer, size_t size) {
@@ -367,20 +506,32 @@ namespace {
       lg_destroy_program
     );
 
-    const char* src = reinterpret_cast<const char*>(buffer);
-
-    const uint64_t pmap_size = *reinterpret_cast<const uint64_t*>(src);
-    src += sizeof(pmap_size);
-    hProg->PMap = PatternMap::unmarshall(src, pmap_size);
-    src += pmap_size;
+    const char* src = static_cast<const char*>(buffer);
+
+    if (reinterpret_cast<uintptr_t>(src) % 8) {
+      // the program is used in place, so it must be aligned; copy it
+      auto copy = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+      std::memcpy(copy->data(), src, size);
+      readProgramFile(
+        reinterpret_cast<const char*>(copy->data()), size, true,
+        hProg->PMap, hProg->Prog
+      );
+      hProg->Prog->Storage = copy;
+    }
+    else {
+      readProgramFile(src, size, true, hProg->PMap, hProg->Prog);
+    }
 
-    const uint64_t prog_size = *reinterpret_cast<const uint64_t*>(src);
-    src += sizeof(prog_size);
-    hProg->Prog = Program::unmarshall(src, prog_size);
-    src += prog_size;
+    return hProg.release();
+  }
 
-// TODO: don't go beyond size?
+  LG_HPROGRAM map_program(const char* path, bool verify) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> hProg(
+      new ProgramHandle,
+      lg_destroy_program
+    );
 
+    mapProgramFile(path, verify, hProg->PMap, hProg->Prog);
     return hProg.release();
   }
 }
@@ -392,6 +543,13 @@ LG_HPROGRAM lg_read_program(const void* buffer, int size) {
   );
 }
 
+LG_HPROGRAM lg_map_program(const char* path, int verify) {
+  return trapWithRetval(
+    [path, verify](){ return map_program(path, verify); },
+    nullptr
+  );
+}
+
 void lg_write_program(const LG_HPROGRAM hProg, void* buffer) {
   exceptionTrap(std::bind(write_program, hProg, buffer));
 }
@@ -400,13 +558,83 @@ void lg_destroy_program(LG_HPROGRAM hProg) {
   delete hProg;
 }
 
+namespace {
+  LG_HPROGRAM read_cached_program(const char* cacheDir, const std::string& inputs) {
+    auto buf = std::make_shared<std::vector<char>>(
+      ProgramCache(cacheDir).read(inputs)
+    );
+    if (buf->empty()) {
+      return nullptr;
+    }
+
+    LG_HPROGRAM hProg = read_program(buf->data(), buf->size());
+    if (!hProg->Prog->Storage) {
+      // the program refers to buf, rather than to a copy of it
+      hProg->Prog->Storage = buf;
+    }
+    return hProg;
+  }
+
+  int write_cached_program(const LG_HPROGRAM hProg, const char* cacheDir, const std::string& inputs) {
+    if (!hProg->Prog) {
+      // not compiled
+      return 0;
+    }
+
+    std::vector<char> buf(lg_program_size(hProg));
+    write_program(hProg, buf.data());
+    return ProgramCache(cacheDir).write(inputs, buf);
+  }
+}
+
+LG_HPROGRAM lg_read_cached_program(const char* cacheDir,
+                                   const char** patternLists,
+                                   unsigned int numLists,
+                                   const char** defaultEncodings,
+                                   unsigned int defaultEncodingsNum,
+                                   const LG_KeyOptions* defaultOptions,
+                                   const LG_ProgramOptions* programOptions)
+{
+  return trapWithRetval(
+    [=]() {
+      return read_cached_program(cacheDir, programCacheInputs(
+        patternLists, numLists, defaultEncodings, defaultEncodingsNum,
+        defaultOptions, programOptions
+      ));
+    },
+    nullptr
+  );
+}
+
+int lg_write_cached_program(const LG_HPROGRAM hProg,
+                            const char* cacheDir,
+                            const char** patternLists,
+                            unsigned int numLists,
+                            const char** defaultEncodings,
+                            unsigned int defaultEncodingsNum,
+                            const LG_KeyOptions* defaultOptions,
+                            const LG_ProgramOptions* programOptions)
+{
+  return trapWithRetval(
+    [=]() {
+      return write_cached_program(hProg, cacheDir, programCacheInputs(
+        patternLists, numLists, defaultEncodings, defaultEncodingsNum,
+        defaultOptions, programOptions
+      ));
+    },
+    0
+  );
+}
+
 namespace {
   LG_HCONTEXT create_context(LG_HPROGRAM hProg,
 #ifdef LBT_TRACE_ENABLED
-                             uint64_t beginTrace, uint64_t endTrace
+                             uint64_t beginTrace, uint64_t endTrace,
 #else
-                             uint64_t, uint64_t
+                             uint64_t, uint64_t,
 #endif
+                             uint32_t engine, uint64_t dfaCacheSize,
+                             uint32_t hitMode, uint64_t maxHits
     )
   {
     std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> hCtx(
@@ -414,7 +642,14 @@ namespace {
       lg_destroy_context
     );
 
-    hCtx->Impl = VmInterface::create(hProg->Prog);
+    hCtx->Impl = VmInterface::create(hProg->Prog, engine, dfaCacheSize);
+    hCtx->Prog = hProg->Prog;
+    hCtx->Engine = engine;
+    hCtx->DfaCacheSize = dfaCacheSize;
+
+    hCtx->Impl->hits().limit(
+      hitMode == LG_HITS_FIRST, hitMode != LG_HITS_COUNT, maxHits
+    );
 #ifdef LBT_TRACE_ENABLED
     hCtx->Impl->setDebugRange(beginTrace, endTrace);
 #endif
@@ -428,10 +663,18 @@ LG_HCONTEXT lg_create_context(LG_HPROGRAM hProg,
 {
   const uint64_t
     begin = options ? options->TraceBegin : std::numeric_limits<uint64_t>::max(),
-    end = options ? options->TraceEnd : std::numeric_limits<uint64_t>::max();
+    end = options ? options->TraceEnd : std::numeric_limits<uint64_t>::max(),
+    cacheSize = options ? options->DfaCacheSize : 0;
+
+  const uint32_t engine = options ? options->Engine : LG_ENGINE_THREADS,
+                 hitMode = options ? options->HitMode : LG_HITS_ALL;
+
+  const uint64_t maxHits = options ? options->MaxHitsPerPattern : 0;
 
   return trapWithRetval(
-    [hProg,begin,end](){ return create_context(hProg, begin, end); },
+    [hProg,begin,end,engine,cacheSize,hitMode,maxHits](){
+      return create_context(hProg, begin, end, engine, cacheSize, hitMode, maxHits);
+    },
     nullptr
   );
 }
@@ -440,10 +683,276 @@ void lg_destroy_context(LG_HCONTEXT hCtx) {
   delete hCtx;
 }
 
+namespace {
+  LG_HCONTEXT clone_context(LG_HCONTEXT hCtx) {
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> hClone(
+      new ContextHandle,
+      lg_destroy_context
+    );
+
+    hClone->Impl = hCtx->Impl->clone();
+    hClone->Prog = hCtx->Prog;
+    hClone->Engine = hCtx->Engine;
+    hClone->DfaCacheSize = hCtx->DfaCacheSize;
+    hClone->Mask = hCtx->Mask;
+
+    return hClone.release();
+  }
+
+  LG_HCONTEXTPOOL create_context_pool(LG_HCONTEXT hCtx) {
+    std::unique_ptr<ContextPoolHandle> hPool(new ContextPoolHandle);
+    hPool->Prototype.reset(clone_context(hCtx));
+    return hPool.release();
+  }
+
+  LG_HCONTEXT acquire_context(LG_HCONTEXTPOOL hPool) {
+    {
+      std::lock_guard<std::mutex> lock(hPool->Lock);
+      if (!hPool->Idle.empty()) {
+        LG_HCONTEXT hCtx = hPool->Idle.back().release();
+        hPool->Idle.pop_back();
+        return hCtx;
+      }
+    }
+
+    // clone outside the lock, so others need not wait for it
+    return clone_context(hPool->Prototype.get());
+  }
+
+  void release_context(LG_HCONTEXTPOOL hPool, LG_HCONTEXT hCtx) {
+    std::unique_ptr<ContextHandle> ctx(hCtx);
+
+    const std::shared_ptr<const LabelMask>& mask = hPool->Prototype->Mask;
+    if (ctx->Mask != mask) {
+      ctx->Impl->setMask(mask);
+      ctx->Mask = mask;
+    }
+    else {
+      ctx->Impl->reset();
+    }
+
+    std::lock_guard<std::mutex> lock(hPool->Lock);
+    hPool->Idle.push_back(std::move(ctx));
+  }
+}
+
+LG_HCONTEXT lg_clone_context(LG_HCONTEXT hCtx) {
+  return trapWithRetval(
+    [hCtx](){ return clone_context(hCtx); },
+    nullptr
+  );
+}
+
+LG_HCONTEXTPOOL lg_create_context_pool(LG_HCONTEXT hCtx) {
+  return trapWithRetval(
+    [hCtx](){ return create_context_pool(hCtx); },
+    nullptr
+  );
+}
+
+void lg_destroy_context_pool(LG_HCONTEXTPOOL hPool) {
+  delete hPool;
+}
+
+LG_HCONTEXT lg_acquire_context(LG_HCONTEXTPOOL hPool) {
+  return trapWithRetval(
+    [hPool](){ return acquire_context(hPool); },
+    nullptr
+  );
+}
+
+void lg_release_context(LG_HCONTEXTPOOL hPool, LG_HCONTEXT hCtx) {
+  exceptionTrap(std::bind(release_context, hPool, hCtx));
+}
+
 void lg_reset_context(LG_HCONTEXT hCtx) {
   exceptionTrap(std::bind(&VmInterface::reset, hCtx->Impl));
 }
 
+namespace {
+  void enable_keywords(LG_HCONTEXT hCtx,
+                       const uint64_t* keywordIndices,
+                       uint64_t numIndices,
+                       bool enable)
+  {
+    const uint32_t numLabels = hCtx->Prog->MaxLabel + 1;
+
+    std::vector<bool> disabled(numLabels, false);
+    if (hCtx->Mask) {
+      for (const uint32_t label : hCtx->Mask->disabled()) {
+        disabled[label] = true;
+      }
+    }
+
+    if (keywordIndices) {
+      for (uint64_t i = 0; i < numIndices; ++i) {
+        if (keywordIndices[i] >= numLabels) {
+          THROW_RUNTIME_ERROR_WITH_OUTPUT(
+            "Keyword index " << keywordIndices[i] << " is out of range"
+          );
+        }
+      }
+
+      for (uint64_t i = 0; i < numIndices; ++i) {
+        disabled[keywordIndices[i]] = !enable;
+      }
+    }
+    else {
+      disabled.assign(numLabels, !enable);
+    }
+
+    std::shared_ptr<const LabelMask> mask;
+    if (std::find(disabled.begin(), disabled.end(), true) != disabled.end()) {
+      mask = std::make_shared<const LabelMask>(*hCtx->Prog, disabled);
+    }
+
+    hCtx->Impl->setMask(mask);
+    hCtx->Mask = mask;
+  }
+}
+
+int lg_enable_keywords(LG_HCONTEXT hCtx,
+                       const uint64_t* keywordIndices,
+                       uint64_t numIndices,
+                       int enable)
+{
+  return trapWithRetval(
+    [=](){
+      enable_keywords(hCtx, keywordIndices, numIndices, enable);
+      return 1;
+    },
+    0
+  );
+}
+
+namespace {
+  uint64_t save_context(LG_HCONTEXT hCtx, void* buf, uint64_t bufSize) {
+    std::vector<char> state;
+    hCtx->Impl->save(state);
+    if (buf && state.size() <= bufSize) {
+      std::memcpy(buf, state.data(), state.size());
+    }
+    return state.size();
+  }
+}
+
+uint64_t lg_save_context(LG_HCONTEXT hCtx, void* buf, uint64_t bufSize) {
+  return trapWithRetval(
+    [=](){ return save_context(hCtx, buf, bufSize); },
+    uint64_t(0)
+  );
+}
+
+int lg_restore_context(LG_HCONTEXT hCtx, const void* buf, uint64_t bufSize) {
+  const char* const beg = static_cast<const char*>(buf);
+  return trapWithRetval(
+    [=](){
+      hCtx->Impl->restore(beg, beg + bufSize);
+      return 1;
+    },
+    0
+  );
+}
+
+namespace {
+  // goes back to reporting hits by callback, however the search ends
+  class HitBufferGuard {
+  public:
+    HitBufferGuard(HitCounter& counter, LG_SearchHit* hits, uint64_t maxHits):
+      Counter(counter)
+    {
+      if (!maxHits) {
+        // nothing could ever be collected
+        throw std::runtime_error("The hit buffer must have room for a hit");
+      }
+      Counter.buffer(hits, maxHits);
+    }
+
+    ~HitBufferGuard() { Counter.unbuffer(); }
+
+  private:
+    HitCounter& Counter;
+  };
+
+  int search_hits(LG_HCONTEXT hCtx,
+                  const char* bufStart,
+                  const char* bufEnd,
+                  uint64_t startOffset,
+                  LG_SearchHit* hits,
+                  uint64_t maxHits,
+                  uint64_t* numHits)
+  {
+    HitCounter& counter = hCtx->Impl->hits();
+    HitBufferGuard guard(counter, hits, maxHits);
+
+    if (!counter.holding()) {
+      uint64_t offset = startOffset;
+      if (counter.resuming()) {
+        offset = counter.pausedAt();
+        if (offset < startOffset || offset - startOffset > uint64_t(bufEnd - bufStart)) {
+          THROW_RUNTIME_ERROR_WITH_OUTPUT(
+            "Resumed at " << offset << ", outside the buffer"
+          );
+        }
+        counter.resumed();
+      }
+
+      hCtx->Impl->search(
+        (const byte*) bufStart + (offset - startOffset), (const byte*) bufEnd,
+        offset, nullptr, nullptr
+      );
+    }
+
+    *numHits = counter.buffered();
+    return counter.holding() || counter.resuming();
+  }
+
+  int closeout_hits(LG_HCONTEXT hCtx,
+                    LG_SearchHit* hits,
+                    uint64_t maxHits,
+                    uint64_t* numHits)
+  {
+    HitCounter& counter = hCtx->Impl->hits();
+    HitBufferGuard guard(counter, hits, maxHits);
+
+    if (!counter.holding()) {
+      hCtx->Impl->closeOut(nullptr, nullptr);
+    }
+
+    *numHits = counter.buffered();
+    return counter.holding();
+  }
+}
+
+int lg_search_hits(LG_HCONTEXT hCtx,
+                   const char* bufStart,
+                   const char* bufEnd,
+                   uint64_t startOffset,
+                   LG_SearchHit* hits,
+                   uint64_t maxHits,
+                   uint64_t* numHits)
+{
+  *numHits = 0;
+  return trapWithRetval(
+    [=](){
+      return search_hits(hCtx, bufStart, bufEnd, startOffset, hits, maxHits, numHits);
+    },
+    -1
+  );
+}
+
+int lg_closeout_hits(LG_HCONTEXT hCtx,
+                     LG_SearchHit* hits,
+                     uint64_t maxHits,
+                     uint64_t* numHits)
+{
+  *numHits = 0;
+  return trapWithRetval(
+    [=](){ return closeout_hits(hCtx, hits, maxHits, numHits); },
+    -1
+  );
+}
+
 void lg_starts_with(LG_HCONTEXT hCtx,
                    const char* bufStart,
                    const char* bufEnd,
@@ -464,6 +973,151 @@ uint64_t lg_search(LG_HCONTEXT hCtx,
   return trapWithRetval(std::bind(&VmInterface::search, hCtx->Impl, (const byte*) bufStart, (const byte*) bufEnd, startOffset, callbackFn, userData), std::numeric_limits<uint64_t>::max());
 }
 
+namespace {
+  uint64_t search_parallel(LG_HCONTEXT hCtx,
+                           const char* bufStart,
+                           const char* bufEnd,
+                           const uint64_t startOffset,
+                           unsigned int numThreads,
+                           void* userData,
+                           LG_HITCALLBACK_FN callbackFn)
+  {
+    if (hCtx->Impl->hits().limited()) {
+      // the limits depend on the order of the hits, so the parts cannot
+      // be searched independently
+      return hCtx->Impl->search(
+        (const byte*) bufStart, (const byte*) bufEnd, startOffset,
+        callbackFn, userData
+      );
+    }
+
+    return parallelSearch(
+      hCtx->Impl,
+      [hCtx](){
+        std::shared_ptr<VmInterface> vm(
+          VmInterface::create(hCtx->Prog, hCtx->Engine, hCtx->DfaCacheSize)
+        );
+        if (hCtx->Mask) {
+          vm->setMask(hCtx->Mask);
+        }
+        return vm;
+      },
+      (const byte*) bufStart, (const byte*) bufEnd, startOffset,
+      numThreads, callbackFn, userData
+    );
+  }
+}
+
+uint64_t lg_search_parallel(LG_HCONTEXT hCtx,
+                            const char* bufStart,
+                            const char* bufEnd,
+                            const uint64_t startOffset,
+                            unsigned int numThreads,
+                            void* userData,
+                            LG_HITCALLBACK_FN callbackFn)
+{
+  return trapWithRetval(
+    [=](){
+      return search_parallel(hCtx, bufStart, bufEnd, startOffset,
+                             numThreads, userData, callbackFn);
+    },
+    std::numeric_limits<uint64_t>::max()
+  );
+}
+
+uint64_t lg_hit_count(LG_HCONTEXT hCtx, uint64_t keywordIndex) {
+  const HitCounter& hits = hCtx->Impl->hits();
+  return keywordIndex < hits.numLabels() ? hits[keywordIndex] : 0;
+}
+
+void lg_free_batch_hits(LG_BatchHits* hits) {
+  std::free(hits->Hits);
+  hits->Hits = nullptr;
+  hits->Size = hits->Capacity = 0;
+}
+
+namespace {
+  struct BatchCollector {
+    LG_BatchHits* Hits;
+    uint64_t Base;
+    uint64_t Id;
+  };
+
+  void collectBatchHit(void* userData, const LG_SearchHit* const hit) {
+    BatchCollector& c = *static_cast<BatchCollector*>(userData);
+    LG_BatchHits& hits = *c.Hits;
+
+    if (hits.Size == hits.Capacity) {
+      const uint64_t cap = std::max(2*hits.Capacity, uint64_t(64));
+      LG_BatchHit* h = static_cast<LG_BatchHit*>(
+        std::realloc(hits.Hits, cap*sizeof(LG_BatchHit))
+      );
+
+      if (!h) {
+        throw std::bad_alloc();
+      }
+
+      hits.Hits = h;
+      hits.Capacity = cap;
+    }
+
+    LG_BatchHit& bh = hits.Hits[hits.Size++];
+    bh.Hit.Start = hit->Start - c.Base;
+    bh.Hit.End = hit->End - c.Base;
+    bh.Hit.KeywordIndex = hit->KeywordIndex;
+    bh.Id = c.Id;
+  }
+
+  uint64_t search_batch(LG_HCONTEXT hCtx,
+                        const LG_BatchBuffer* bufs,
+                        uint64_t numBufs,
+                        LG_BatchHits* hits)
+  {
+    VmInterface& vm = *hCtx->Impl;
+    const uint64_t size = hits->Size;
+
+    // Each buffer is searched at an offset past the end of the one before,
+    // so hits in earlier buffers cannot block hits in later ones. Thus the
+    // engine need only be restarted between buffers, not reset.
+    vm.reset();
+
+    BatchCollector c{hits, 0, 0};
+    for (const LG_BatchBuffer* b = bufs; b != bufs + numBufs; ++b) {
+      const byte* const beg = reinterpret_cast<const byte*>(b->Buf);
+      c.Id = b->Id;
+
+      vm.search(beg, beg + b->Len, c.Base, collectBatchHit, &c);
+      vm.closeOut(collectBatchHit, &c);
+      vm.restart();
+
+      c.Base += b->Len;
+
+      if (vm.hits().stopped()) {
+        break;
+      }
+    }
+
+    // keep the batch's hit counts through the reset
+    HitCounter counts;
+    counts.swap(vm.hits());
+    vm.reset();
+    vm.hits().swap(counts);
+
+    return hits->Size - size;
+  }
+}
+
+uint64_t lg_search_batch(LG_HCONTEXT hCtx,
+                         const LG_BatchBuffer* bufs,
+                         uint64_t numBufs,
+                         LG_BatchHits* hits)
+{
+  return trapWithRetval(
+    [=](){ return search_batch(hCtx, bufs, numBufs, hits); },
+    std::numeric_limits<uint64_t>::max()
+  );
+}
+
 void lg_closeout_search(LG_HCONTEXT hCtx,
                         void* userData,
                         LG_HITCALLBACK_FN callbackFn)
@@ -0,0 +1,365 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "literalmatcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+const uint32_t LiteralMatcher::NONE = std::numeric_limits<uint32_t>::max();
+
+namespace {
+  struct TrieNode {
+    std::vector<std::pair<byte,uint32_t>> Kids;
+    std::vector<uint32_t> Labels;
+    uint32_t Depth, Fail, Dict, Slot;
+  };
+
+  uint32_t findKid(const TrieNode& n, byte c) {
+    const auto i = std::lower_bound(
+      n.Kids.begin(), n.Kids.end(), std::make_pair(c, uint32_t(0))
+    );
+    return i != n.Kids.end() && i->first == c ? i->second : LiteralMatcher::NONE;
+  }
+
+  //
+  // Finds bases for the double array. The free slots are kept in an
+  // ordered linked list, and the search for a base starts from Cursor,
+  // which moves past regions that have filled up, so that placement
+  // stays roughly linear in the number of states.
+  //
+  class SlotAllocator {
+  public:
+    SlotAllocator(): Used(1, true), Next(1, 0), Prev(1, 0), Cursor(0) {}
+
+    size_t size() const { return Used.size(); }
+
+    // finds a base for the given (sorted) children and claims their slots
+    uint32_t place(const std::vector<std::pair<byte,uint32_t>>& kids) {
+      const uint32_t first = kids.front().first;
+
+      // bases are nonnegative so that Base + c is in bounds for every c
+      uint32_t p = firstFree();
+      while (p < first) {
+        p = nextFree(p);
+      }
+
+      uint32_t skipped = 0;
+      for ( ; ; p = nextFree(p), ++skipped) {
+        const uint32_t base = p - first;
+        bool fits = true;
+        for (const auto& kid : kids) {
+          const uint32_t t = base + kid.first;
+          if (t < Used.size() && Used[t]) {
+            fits = false;
+            break;
+          }
+        }
+
+        if (fits) {
+          // give up on a crowded region rather than rescanning it
+          if (skipped > 16) {
+            Cursor = p;
+          }
+
+          for (const auto& kid : kids) {
+            claim(base + kid.first);
+          }
+          return base;
+        }
+      }
+    }
+
+  private:
+    void grow(uint32_t n) {
+      // free slots are appended to the end of the list
+      for (uint32_t i = Used.size(); i < n; ++i) {
+        const uint32_t last = Prev[0];
+        Used.push_back(false);
+        Next.push_back(0);
+        Prev.push_back(last);
+        Next[last] = i;
+        Prev[0] = i;
+      }
+    }
+
+    uint32_t firstFree() {
+      if (Cursor == 0) {
+        if (Next[0] == 0) {
+          grow(Used.size() + 256);
+        }
+        Cursor = Next[0];
+      }
+      return Cursor;
+    }
+
+    uint32_t nextFree(uint32_t p) {
+      if (Next[p] == 0) {
+        grow(Used.size() + 256);
+      }
+      return Next[p];
+    }
+
+    void claim(uint32_t t) {
+      if (t >= Used.size()) {
+        grow(t + 1);
+      }
+
+      // keep a free slot after t, so Cursor never falls off the end
+      if (Next[t] == 0) {
+        grow(Used.size() + 256);
+      }
+
+      if (t == Cursor) {
+        Cursor = Next[t];
+      }
+
+      Used[t] = true;
+      Next[Prev[t]] = Next[t];
+      Prev[Next[t]] = Prev[t];
+    }
+
+    std::vector<bool> Used;
+    std::vector<uint32_t> Next, Prev; // slot 0 is the list head
+    uint32_t Cursor;
+  };
+
+  size_t padded(size_t n) {
+    return (n + 7) & ~size_t(7);
+  }
+
+  template <class T>
+  size_t arraySize(const ArrayRef<T>& a) {
+    return sizeof(uint64_t) + padded(a.size()*sizeof(T));
+  }
+
+  // the count, then the elements, padded so the next array is aligned
+  template <class T>
+  void appendArray(char*& i, const ArrayRef<T>& a) {
+    const uint64_t n = a.size();
+    std::memcpy(i, &n, sizeof(n));
+    i += sizeof(n);
+    std::memcpy(i, a.data(), n*sizeof(T));
+    std::memset(i + n*sizeof(T), 0, padded(n*sizeof(T)) - n*sizeof(T));
+    i += padded(n*sizeof(T));
+  }
+
+  template <class T>
+  void readArray(const char*& i, const char* end, ArrayRef<T>& a) {
+    if (end - i < static_cast<std::ptrdiff_t>(sizeof(uint64_t))) {
+      throw std::runtime_error("Truncated literal table");
+    }
+
+    uint64_t n;
+    std::memcpy(&n, i, sizeof(n));
+    i += sizeof(n);
+
+    if (static_cast<uint64_t>(end - i) / sizeof(T) < n ||
+        static_cast<uint64_t>(end - i) < padded(n*sizeof(T)))
+    {
+      throw std::runtime_error("Truncated literal table");
+    }
+
+    a = ArrayRef<T>(reinterpret_cast<const T*>(i), n);
+    i += padded(n*sizeof(T));
+  }
+}
+
+LiteralMatcher::LiteralMatcher(const std::vector<Literal>& lits) {
+  // build the trie
+  std::vector<TrieNode> trie(1);
+  trie[0].Depth = 0;
+
+  for (const Literal& lit : lits) {
+    uint32_t n = 0;
+    for (const char ch : lit.first) {
+      const byte c = ch;
+      uint32_t k = findKid(trie[n], c);
+      if (k == NONE) {
+        k = trie.size();
+        trie.emplace_back();
+        trie.back().Depth = trie[n].Depth + 1;
+        auto& kids = trie[n].Kids;
+        kids.insert(
+          std::lower_bound(kids.begin(), kids.end(), std::make_pair(c, uint32_t(0))),
+          std::make_pair(c, k)
+        );
+      }
+      n = k;
+    }
+    trie[n].Labels.push_back(lit.second);
+  }
+
+  // breadth-first order, so failure targets precede their sources
+  std::vector<uint32_t> order(1, 0);
+  for (size_t i = 0; i < order.size(); ++i) {
+    for (const auto& kid : trie[order[i]].Kids) {
+      order.push_back(kid.second);
+    }
+  }
+
+  trie[0].Fail = 0;
+  trie[0].Dict = NONE;
+  for (const uint32_t u : order) {
+    for (const auto& kid : trie[u].Kids) {
+      TrieNode& v = trie[kid.second];
+      if (u == 0) {
+        v.Fail = 0;
+      }
+      else {
+        uint32_t f = trie[u].Fail;
+        uint32_t k;
+        while ((k = findKid(trie[f], kid.first)) == NONE && f != 0) {
+          f = trie[f].Fail;
+        }
+        v.Fail = k == NONE ? 0 : k;
+      }
+      v.Dict = v.Labels.empty() ? trie[v.Fail].Dict : kid.second;
+    }
+  }
+
+  // place the nodes in the double array; slot 0 is the root
+  SlotAllocator slots;
+  trie[0].Slot = 0;
+
+  std::vector<int32_t> bases(trie.size(), 0);
+
+  for (const uint32_t u : order) {
+    const auto& kids = trie[u].Kids;
+    if (!kids.empty()) {
+      const uint32_t base = slots.place(kids);
+      if (base + 255 >= static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
+        throw std::runtime_error("Too many literal states");
+      }
+
+      bases[u] = base;
+      for (const auto& kid : kids) {
+        trie[kid.second].Slot = base + kid.first;
+      }
+    }
+  }
+
+  // pad so that Base + c is always in bounds
+  const size_t num = slots.size() + 256;
+  std::vector<Unit> units(num, Unit{0, NONE});
+  std::vector<State> states(num, State{0, 0, NONE, 0, 0});
+  std::vector<uint32_t> labels, rootNext(256, 0);
+
+  for (const uint32_t u : order) {
+    const TrieNode& n = trie[u];
+    Unit& unit = units[n.Slot];
+    unit.Base = bases[u];
+    if (u != 0) {
+      // the root's children hang off RootNext, but are placed normally
+      unit.Check = 0;
+    }
+
+    State& st = states[n.Slot];
+    st.Fail = trie[n.Fail].Slot;
+    st.Depth = n.Depth;
+    st.Dict = n.Dict == NONE ? NONE : trie[n.Dict].Slot;
+    st.OutBeg = labels.size();
+    // Vm reports duplicate patterns last label first
+    labels.insert(labels.end(), n.Labels.rbegin(), n.Labels.rend());
+    st.OutEnd = labels.size();
+  }
+
+  for (const uint32_t u : order) {
+    for (const auto& kid : trie[u].Kids) {
+      units[trie[kid.second].Slot].Check = trie[u].Slot;
+    }
+  }
+
+  for (const auto& kid : trie[0].Kids) {
+    rootNext[kid.first] = trie[kid.second].Slot;
+  }
+
+  RootNext = ArrayRef<uint32_t>(std::move(rootNext));
+  Units = ArrayRef<Unit>(std::move(units));
+  States = ArrayRef<State>(std::move(states));
+  Labels = ArrayRef<uint32_t>(std::move(labels));
+}
+
+std::bitset<256*256> LiteralMatcher::pairs() const {
+  std::bitset<256*256> p;
+  for (uint32_t a = 0; a < 256; ++a) {
+    const uint32_t s = RootNext[a];
+    if (!s) {
+      continue;
+    }
+
+    for (uint32_t b = 0; b < 256; ++b) {
+      if (States[s].OutBeg != States[s].OutEnd || child(s, b) != NONE) {
+        p.set(a | (b << 8));
+      }
+    }
+  }
+  return p;
+}
+
+namespace {
+  template <class T>
+  bool sameArray(const ArrayRef<T>& a, const ArrayRef<T>& b) {
+    return a.size() == b.size() &&
+           !std::memcmp(a.data(), b.data(), a.size()*sizeof(T));
+  }
+}
+
+bool LiteralMatcher::operator==(const LiteralMatcher& rhs) const {
+  return sameArray(RootNext, rhs.RootNext) &&
+         sameArray(Units, rhs.Units) &&
+         sameArray(States, rhs.States) &&
+         sameArray(Labels, rhs.Labels);
+}
+
+size_t LiteralMatcher::bufSize() const {
+  return arraySize(RootNext) +
+         arraySize(Units) +
+         arraySize(States) +
+         arraySize(Labels);
+}
+
+void LiteralMatcher::marshall(char* buf) const {
+  appendArray(buf, RootNext);
+  appendArray(buf, Units);
+  appendArray(buf, States);
+  appendArray(buf, Labels);
+}
+
+std::unique_ptr<LiteralMatcher> LiteralMatcher::unmarshall(const char* buf, size_t len) {
+  if (reinterpret_cast<uintptr_t>(buf) % 8) {
+    throw std::runtime_error("Misaligned literal table");
+  }
+
+  std::unique_ptr<LiteralMatcher> m(new LiteralMatcher);
+  const char* const end = buf + len;
+  readArray(buf, end, m->RootNext);
+  readArray(buf, end, m->Units);
+  readArray(buf, end, m->States);
+  readArray(buf, end, m->Labels);
+
+  if (buf != end || m->RootNext.size() != 256 ||
+      m->Units.size() != m->States.size() || m->Units.size() < 256)
+  {
+    throw std::runtime_error("Malformed literal table");
+  }
+
+  return m;
+}
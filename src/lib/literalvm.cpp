@@ -0,0 +1,294 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "literalvm.h"
+#include "program.h"
+
+#include <limits>
+
+LiteralVm::LiteralVm(ProgramPtr prog):
+  Prog(prog),
+  Lits(*prog->Literals),
+  Skip(prog->Filter),
+  State(0),
+  MatchEnds(prog->MaxLabel+1),
+  Matched(prog->MaxLabel+1),
+  CurHitFn(nullptr), UserData(nullptr),
+  Hits(prog->MaxLabel+1)
+{
+  reset();
+}
+
+LiteralVm::LiteralVm(const LiteralVm& other):
+  Prog(other.Prog),
+  Lits(other.Lits),
+  Skip(other.Skip),
+  State(0),
+  MatchEnds(Prog->MaxLabel+1),
+  Matched(Prog->MaxLabel+1),
+  CurHitFn(nullptr), UserData(nullptr),
+  Hits(Prog->MaxLabel+1),
+  Mask(other.Mask)
+{
+  Hits.limit(other.Hits);
+
+  if (Mask) {
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+    }
+  }
+}
+
+std::shared_ptr<VmInterface> LiteralVm::clone() const {
+  return std::shared_ptr<VmInterface>(new LiteralVm(*this));
+}
+
+void LiteralVm::save(std::vector<char>& buf) const {
+  StateWriter out(buf);
+  out.header(LITERAL_STATE, *Prog);
+  out.put(State);
+  out.matchEnds(MatchEnds, Matched);
+  Hits.save(out);
+}
+
+void LiteralVm::restore(const char* beg, const char* end) {
+  reset();
+
+  try {
+    StateReader in(beg, end);
+    in.header(LITERAL_STATE, *Prog);
+
+    State = in.get<uint32_t>();
+    if (State >= Lits.numStates()) {
+      StateReader::fail();
+    }
+
+    in.matchEnds(MatchEnds, Matched);
+    Hits.restore(in);
+    in.finish();
+  }
+  catch (...) {
+    reset();
+    throw;
+  }
+}
+
+void LiteralVm::reset() {
+  restart();
+
+  for (const uint32_t label : Matched) {
+    MatchEnds[label] = 0;
+  }
+  Matched.clear();
+
+  Hits.reset();
+}
+
+void LiteralVm::restart() {
+  State = 0;
+  CurHitFn = nullptr;
+}
+
+bool LiteralVm::idle() const {
+  return !State;
+}
+
+void LiteralVm::setMask(const std::shared_ptr<const LabelMask>& mask) {
+  reset();
+
+  if (Mask) {
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = 0;
+    }
+  }
+
+  Mask = mask;
+
+  if (Mask) {
+    // as in Vm; the automaton still finds these, but never reports them
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+    }
+  }
+}
+
+inline void LiteralVm::_setMatchEnd(const uint32_t label, const uint64_t end) {
+  // match ends are never zero, so the label is new if its end is
+  if (!MatchEnds[label]) {
+    Matched.insert(label);
+  }
+  MatchEnds[label] = end;
+}
+
+void LiteralVm::_reportLimitedHit(const uint64_t start, const uint64_t end, const uint32_t label) {
+  if (Hits.stopped()) {
+    return;
+  }
+
+  if (Hits.count(label)) {
+    // as in Vm, nothing starts past the end of time
+    MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+  }
+
+  Hits.report(SearchHit(start, end, label), CurHitFn, UserData);
+}
+
+inline void LiteralVm::_report(uint32_t s, const uint64_t end, const uint64_t startLimit) {
+  // walk the dictionary links from the longest match to the shortest
+  for (s = Lits.state(s).Dict; s != LiteralMatcher::NONE;
+       s = Lits.state(Lits.state(s).Fail).Dict)
+  {
+    const uint64_t start = end - Lits.state(s).Depth;
+    if (start >= startLimit) {
+      // shorter matches start even later
+      return;
+    }
+
+    for (const uint32_t* l = Lits.labelsBegin(s); l != Lits.labelsEnd(s); ++l) {
+      if (start >= MatchEnds[*l]) {
+        _setMatchEnd(*l, end);
+
+        if (Hits.limited()) {
+          _reportLimitedHit(start, end, *l);
+        }
+        else if (CurHitFn) {
+          const SearchHit hit(start, end, *l);
+          (*CurHitFn)(UserData, &hit);
+        }
+      }
+    }
+  }
+}
+
+uint64_t LiteralVm::_startOfLeftmostPartial(const uint64_t offset) const {
+  return offset - Lits.state(State).Depth;
+}
+
+void LiteralVm::startsWith(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  CurHitFn = hitFn;
+  UserData = userData;
+
+  // same early rejection as Vm::startsWith
+  const byte* const filterOff = beg+Prog->FilterOff;
+
+  if (end - beg == 1 || (filterOff < end - 1 &&
+      Prog->Filter[*(reinterpret_cast<const uint16_t*>(filterOff))]))
+  {
+    uint32_t s = 0;
+    uint64_t offset = startOffset;
+    for (const byte* cur = beg; cur < end; ++cur, ++offset) {
+      s = Lits.child(s, *cur);
+      if (s == LiteralMatcher::NONE) {
+        break;
+      }
+
+      for (const uint32_t* l = Lits.labelsBegin(s); l != Lits.labelsEnd(s); ++l) {
+        if (startOffset >= MatchEnds[*l]) {
+          _setMatchEnd(*l, offset + 1);
+
+          if (Hits.limited()) {
+            _reportLimitedHit(startOffset, offset + 1, *l);
+          }
+          else if (CurHitFn) {
+            const SearchHit hit(startOffset, offset + 1, *l);
+            (*CurHitFn)(UserData, &hit);
+          }
+        }
+      }
+
+      if (Hits.stopped()) {
+        break;
+      }
+    }
+
+    reset();
+  }
+}
+
+uint64_t LiteralVm::search(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  CurHitFn = hitFn;
+  UserData = userData;
+
+  if (Hits.stopped()) {
+    return startOffset + (end - beg);
+  }
+
+  const uint32_t filterOff = Prog->FilterOff;
+  const byte* const filterEnd = end - filterOff - 1;
+
+  uint64_t offset = startOffset;
+  uint32_t s = State;
+
+  for (const byte* cur = beg; cur < end; ++cur, ++offset) {
+    if (!s && cur < filterEnd) {
+      // no partial match is live, so skip to the next position where
+      // a match could start
+      const byte* const next = Skip.next(cur + filterOff, filterEnd + filterOff) - filterOff;
+      offset += next - cur;
+      cur = next;
+    }
+
+    s = Lits.next(s, *cur);
+    if (Lits.state(s).Dict != LiteralMatcher::NONE) {
+      _report(s, offset + 1, std::numeric_limits<uint64_t>::max());
+
+      if (Hits.halted()) {
+        if (Hits.stopped()) {
+          State = 0;
+          return startOffset + (end - beg);
+        }
+
+        // hits are held back, so pause after this byte
+        State = s;
+        Hits.pauseAt(offset + 1);
+        return _startOfLeftmostPartial(offset + 1);
+      }
+    }
+  }
+
+  State = s;
+  return _startOfLeftmostPartial(offset);
+}
+
+uint64_t LiteralVm::searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
+  CurHitFn = hitFn;
+  UserData = userData;
+
+  uint64_t offset = startOffset;
+  uint32_t s = State;
+
+  // run only while some partial match began before this buffer
+  for (const byte* cur = beg;
+       cur < end && s && offset - Lits.state(s).Depth < startOffset;
+       ++cur, ++offset)
+  {
+    s = Lits.next(s, *cur);
+    if (Lits.state(s).Dict != LiteralMatcher::NONE) {
+      _report(s, offset + 1, startOffset);
+    }
+  }
+
+  State = s;
+  return _startOfLeftmostPartial(offset);
+}
+
+void LiteralVm::closeOut(HitCallback hitFn, void* userData) {
+  // every hit is reported as soon as it ends, so nothing is pending
+  CurHitFn = hitFn;
+  UserData = userData;
+}
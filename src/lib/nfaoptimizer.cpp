@@ -25,8 +25,10 @@
 #include <array>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <set>
 #include <stack>
+#include <tuple>
 #include <vector>
 
 static const NFA::VertexDescriptor NONE = 0xFFFFFFFF;
@@ -58,8 +60,8 @@ bool NFAOptimizer::canMerge(const NFA& dst, NFA::VertexDescriptor dstTail, const
     && 1 == dst.inDegree(dstTail) && 1 == src.inDegree(srcTail)
   )
   {
-    const std::map<NFA::VertexDescriptor, std::vector<NFA::VertexDescriptor>>::const_iterator i(Dst2Src.find(dstTail));
-    if (i == Dst2Src.end() || 1 == src.inDegree(i->second.front())) {
+    const DstInfo& info = DstInfos[dstTail];
+    if (info.SrcStamp != Stamp || 1 == src.inDegree(info.FirstSrc)) {
       dstTrans->getBytes(dstBits);
       return dstBits == srcBits;
     }
@@ -97,8 +99,8 @@ NFAOptimizer::StatePair NFAOptimizer::processChild(const NFA& src, NFA& dst, uin
     bool found = false;
     ByteSet dstBits;
 
-    std::map<NFA::VertexDescriptor, uint32_t>::const_iterator i(DstPos.find(dstHead));
-    di = i == DstPos.end() ? 0 : i->second;
+    const bool hasPos = DstInfos[dstHead].PosStamp == Stamp;
+    di = hasPos ? DstInfos[dstHead].Pos : 0;
 
     for ( ; di < dstHeadOutDegree; ++di) {
       dstTail = dst.outVertex(dstHead, di);
@@ -121,7 +123,13 @@ NFAOptimizer::StatePair NFAOptimizer::processChild(const NFA& src, NFA& dst, uin
       dstTail = dst.addVertex();
       dst[dstTail] = src[srcTail];
 
-      if (i == DstPos.end()) {
+      if (src.TransFac != dst.TransFac) {
+        // src was built apart from dst, so its transitions belong to
+        // another factory, which may not outlive dst
+        dst[dstTail].Trans = dst.TransFac->get(srcTrans);
+      }
+
+      if (!hasPos) {
         di = 0;
       }
 
@@ -152,25 +160,46 @@ NFAOptimizer::StatePair NFAOptimizer::processChild(const NFA& src, NFA& dst, uin
   }
 */
 
-  DstPos[dstHead] = di;
+  DstInfos[dstHead].PosStamp = Stamp;
+  DstInfos[dstHead].Pos = di;
   return StatePair(dstTail, srcTail);
 }
 
+void NFAOptimizer::nextStamp() {
+  if (++Stamp == 0) {
+    // wrapped, so old entries could pass for new ones
+    for (DstInfo& info : DstInfos) {
+      info.SrcStamp = info.PosStamp = 0;
+    }
+    Stamp = 1;
+  }
+}
+
 void NFAOptimizer::mergeIntoFSM(NFA& dst, const NFA& src) {
-  Src2Dst.assign(src.verticesSize(), NONE);
-  Dst2Src.clear();
-  DstPos.clear();
-  Visited.clear();
+  nextStamp();
+
+  // each source vertex adds at most one vertex to the destination
+  if (DstInfos.size() < dst.verticesSize() + src.verticesSize()) {
+    DstInfos.resize(dst.verticesSize() + src.verticesSize(), DstInfo{0, 0, 0, 0});
+  }
 
+  Src2Dst.assign(src.verticesSize(), NONE);
   Src2Dst[0] = 0;
 
+  EdgeBase.resize(src.verticesSize() + 1);
+  EdgeBase[0] = 0;
+  for (NFA::VertexDescriptor v = 0; v < src.verticesSize(); ++v) {
+    EdgeBase[v + 1] = EdgeBase[v] + src.outDegree(v);
+  }
+  Visited.assign(EdgeBase.back(), false);
+
   // push all outedges of the initial state in the source
   for (int32_t i = src.outDegree(0) - 1; i >= 0; --i) {
     Edges.push(StatePair(0, i));
   }
 
   while (!Edges.empty()) {
-    const StatePair& p(Edges.top());
+    const StatePair p(Edges.top());
     Edges.pop();
 
     const uint32_t si = p.second;
@@ -178,18 +207,21 @@ void NFAOptimizer::mergeIntoFSM(NFA& dst, const NFA& src) {
     const NFA::VertexDescriptor dstHead = Src2Dst[srcHead];
 
     // skip if we've seen this edge already
-    if (Visited.find(p) != Visited.end()) {
+    if (Visited[EdgeBase[srcHead] + si]) {
       continue;
     }
 
-    Visited.insert(p);
+    Visited[EdgeBase[srcHead] + si] = true;
 
     const StatePair s(processChild(src, dst, si, srcHead, dstHead));
     const NFA::VertexDescriptor srcTail = s.second;
     const NFA::VertexDescriptor dstTail = s.first;
 
     Src2Dst[srcTail] = dstTail;
-    Dst2Src[dstTail].push_back(srcTail);
+    if (DstInfos[dstTail].SrcStamp != Stamp) {
+      DstInfos[dstTail].SrcStamp = Stamp;
+      DstInfos[dstTail].FirstSrc = srcTail;
+    }
 
     for (int32_t i = src.outDegree(srcTail) - 1; i >= 0; --i) {
       Edges.push(StatePair(srcTail, i));
@@ -540,3 +572,235 @@ void NFAOptimizer::subsetDFA(NFA& dst, const NFA& src) {
   }
   // std::cerr << "done with subsetDFA" << std::endl;
 }
+
+namespace {
+  //
+  // A partition of [0, n) which can be refined by marking elements and
+  // splitting the marked ones from each set, after Valmari and Lehtinen,
+  // "Efficient Minimization of DFAs with Partial Transition Functions".
+  // The members of set s are Elems[First[s], Past[s]), with the marked
+  // ones first.
+  //
+  class Partition {
+  public:
+    // initially the sets are the nonempty keys, in order of key
+    Partition(const std::vector<uint32_t>& keys, uint32_t numKeys):
+      Elems(keys.size()), Loc(keys.size()), SetOf(keys.size()),
+      First(), Past(), Marked(keys.size()), Touched(), NumSets(0)
+    {
+      std::vector<uint32_t> count(numKeys + 1, 0);
+      for (const uint32_t k : keys) {
+        ++count[k + 1];
+      }
+
+      for (uint32_t k = 0; k < numKeys; ++k) {
+        if (count[k + 1]) {
+          First.push_back(count[k]);
+          Past.push_back(count[k] + count[k + 1]);
+          ++NumSets;
+        }
+        count[k + 1] += count[k];
+      }
+
+      // count[k] is now where key k starts
+      for (uint32_t e = 0; e < keys.size(); ++e) {
+        const uint32_t i = count[keys[e]]++;
+        Elems[i] = e;
+        Loc[e] = i;
+      }
+
+      for (uint32_t s = 0; s < NumSets; ++s) {
+        for (uint32_t i = First[s]; i < Past[s]; ++i) {
+          SetOf[Elems[i]] = s;
+        }
+      }
+
+      First.resize(keys.size());
+      Past.resize(keys.size());
+    }
+
+    uint32_t size() const { return NumSets; }
+
+    uint32_t setOf(uint32_t e) const { return SetOf[e]; }
+
+    const uint32_t* begin(uint32_t s) const { return Elems.data() + First[s]; }
+    const uint32_t* end(uint32_t s) const { return Elems.data() + Past[s]; }
+
+    // each element may be marked at most once between splits
+    void mark(uint32_t e) {
+      const uint32_t s = SetOf[e], i = Loc[e], j = First[s] + Marked[s];
+      Elems[i] = Elems[j];
+      Loc[Elems[i]] = i;
+      Elems[j] = e;
+      Loc[e] = j;
+
+      if (!Marked[s]++) {
+        Touched.push_back(s);
+      }
+    }
+
+    // separates the marked elements of each set from the unmarked,
+    // giving the smaller part a new set number
+    void split() {
+      while (!Touched.empty()) {
+        const uint32_t s = Touched.back(), j = First[s] + Marked[s];
+        Touched.pop_back();
+
+        if (j < Past[s]) {
+          if (Marked[s] <= Past[s] - j) {
+            First[NumSets] = First[s];
+            Past[NumSets] = First[s] = j;
+          }
+          else {
+            Past[NumSets] = Past[s];
+            First[NumSets] = Past[s] = j;
+          }
+
+          for (uint32_t i = First[NumSets]; i < Past[NumSets]; ++i) {
+            SetOf[Elems[i]] = NumSets;
+          }
+
+          Marked[NumSets++] = 0;
+        }
+
+        Marked[s] = 0;
+      }
+    }
+
+  private:
+    std::vector<uint32_t> Elems, Loc, SetOf, First, Past, Marked, Touched;
+    uint32_t NumSets;
+  };
+
+  // numbers vertices by transition bytes, match, and label
+  uint32_t vertexKeys(const NFA& g, std::vector<uint32_t>& keys) {
+    std::map<ByteSet, uint32_t> byteIds;
+    std::map<const Transition*, uint32_t> transIds;
+    std::map<std::tuple<uint32_t, bool, uint32_t>, uint32_t> ids;
+
+    ByteSet bytes;
+    for (NFA::VertexDescriptor v = 0; v < g.verticesSize(); ++v) {
+      const Transition* t = g[v].Trans;
+
+      auto ti = transIds.find(t);
+      if (ti == transIds.end()) {
+        // the initial vertex has no transition
+        bytes.reset();
+        if (t) {
+          t->getBytes(bytes);
+        }
+
+        const uint32_t bid = byteIds.insert(
+          std::make_pair(bytes, byteIds.size() + (t ? 1 : 0))
+        ).first->second;
+        ti = transIds.insert(std::make_pair(t, t ? bid : 0)).first;
+      }
+
+      keys[v] = ids.insert(std::make_pair(
+        std::make_tuple(ti->second, g[v].IsMatch, g[v].Label), ids.size()
+      )).first->second;
+    }
+
+    return ids.size();
+  }
+}
+
+void NFAOptimizer::minimizeDFA(NFA& dst, const NFA& src) {
+  const uint32_t n = src.verticesSize();
+
+  // one transition per edge, lettered by its position among the head's
+  // out edges
+  std::vector<uint32_t> heads, tails, letters;
+  uint32_t numLetters = 0;
+
+  for (NFA::VertexDescriptor h = 0; h < n; ++h) {
+    const uint32_t odeg = src.outDegree(h);
+    for (uint32_t i = 0; i < odeg; ++i) {
+      heads.push_back(h);
+      tails.push_back(src.outVertex(h, i));
+      letters.push_back(i);
+    }
+    numLetters = std::max(numLetters, odeg);
+  }
+
+  const uint32_t m = heads.size();
+
+  // the transitions into each vertex are inTrans[inBeg[v], inBeg[v+1])
+  std::vector<uint32_t> inBeg(n + 1, 0), inTrans(m);
+  for (uint32_t t = 0; t < m; ++t) {
+    ++inBeg[tails[t] + 1];
+  }
+
+  for (uint32_t v = 0; v < n; ++v) {
+    inBeg[v + 1] += inBeg[v];
+  }
+
+  for (uint32_t t = 0; t < m; ++t) {
+    inTrans[inBeg[tails[t]]++] = t;
+  }
+
+  // each inBeg[v] has advanced to the start of v+1
+  for (uint32_t v = n; v > 0; --v) {
+    inBeg[v] = inBeg[v - 1];
+  }
+  inBeg[0] = 0;
+
+  std::vector<uint32_t> keys(n);
+  const uint32_t numKeys = vertexKeys(src, keys);
+
+  Partition blocks(keys, numKeys), cords(letters, numLetters);
+
+  // Hopcroft's refinement: split the blocks by the cords, the transitions
+  // sharing a letter and the block of their tails, and the cords by the
+  // blocks, until neither splits the other. The first block need not be
+  // used as a splitter.
+  for (uint32_t b = 1, c = 0; c < cords.size(); ++c) {
+    for (const uint32_t* t = cords.begin(c); t != cords.end(c); ++t) {
+      blocks.mark(heads[*t]);
+    }
+    blocks.split();
+
+    for ( ; b < blocks.size(); ++b) {
+      for (const uint32_t* v = blocks.begin(b); v != blocks.end(b); ++v) {
+        for (uint32_t i = inBeg[*v]; i < inBeg[*v + 1]; ++i) {
+          cords.mark(inTrans[i]);
+        }
+      }
+      cords.split();
+    }
+  }
+
+  // each block becomes the vertex of its first member, so the initial
+  // vertex stays first and the order of the rest is kept
+  std::vector<NFA::VertexDescriptor> blockVertex(blocks.size(), NONE), reps;
+  reps.reserve(blocks.size());
+
+  for (NFA::VertexDescriptor v = 0; v < n; ++v) {
+    NFA::VertexDescriptor& bv = blockVertex[blocks.setOf(v)];
+    if (bv == NONE) {
+      bv = reps.size();
+      reps.push_back(v);
+    }
+  }
+
+  dst[0] = src[0];
+  for (uint32_t i = 1; i < reps.size(); ++i) {
+    dst.addVertex(src[reps[i]]);
+  }
+
+  // merging can send two edges of a vertex to the same block; the later
+  // one is dead, as a thread taking the earlier one reaches the same state
+  // first, and the code generator expects distinct successors
+  for (uint32_t i = 0; i < reps.size(); ++i) {
+    const NFA::VertexDescriptor v = reps[i];
+    for (const NFA::VertexDescriptor t : src.outVertices(v)) {
+      const NFA::VertexDescriptor bt = blockVertex[blocks.setOf(t)];
+      const NFA::NeighborList out(dst.outVertices(i));
+      if (std::find(out.begin(), out.end(), bt) == out.end()) {
+        dst.addEdge(i, bt);
+      }
+    }
+  }
+
+  dst.Deterministic = src.Deterministic;
+}
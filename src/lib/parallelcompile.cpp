@@ -0,0 +1,134 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "parallelcompile.h"
+#include "parser.h"
+#include "parsetree.h"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+
+namespace {
+  // jobs built between merges; enough to keep the threads busy, few
+  // enough that their NFAs don't pile up
+  const size_t WINDOW = 1024;
+
+  // encoders and transition factories aren't thread-safe, so each thread
+  // has its own
+  struct Builder {
+    EncoderFactory EncFac;
+    NFABuilder Nfab;
+    NFAOptimizer Comp;
+    ParseTree Tree;
+  };
+
+  void buildJob(Builder& b, PatternJob& job, bool factors) {
+    if (job.Encodings.empty()) {
+      return;
+    }
+
+    try {
+      parseAndReduce(job.Pat, b.Tree);
+    }
+    catch (const std::exception& e) {
+      job.Error = e.what();
+      return;
+    }
+    catch (...) {
+      job.Error = "Unspecified exception";
+      return;
+    }
+
+    const size_t n = job.Encodings.size();
+    job.Nfas.resize(n);
+    job.Errors.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+      try {
+        // the label is set when the NFA is merged
+        FSMThingy::buildPattern(
+          b.Nfab, b.EncFac, b.Comp, b.Tree,
+          job.Encodings[i].c_str(), 0, factors, job.Nfas[i]
+        );
+      }
+      catch (const std::exception& e) {
+        job.Nfas[i].Nfa.reset();
+        job.Errors[i] = e.what();
+      }
+      catch (...) {
+        job.Nfas[i].Nfa.reset();
+        job.Errors[i] = "Unspecified exception";
+      }
+    }
+  }
+
+  // builds every stride-th job in [first, end)
+  void buildStride(Builder& b, std::vector<PatternJob>& jobs, size_t first, size_t end, size_t stride, bool factors) {
+    for (size_t i = first; i < end; i += stride) {
+      buildJob(b, jobs[i], factors);
+    }
+  }
+}
+
+void buildPatterns(
+  FSMThingy& fsm,
+  std::vector<PatternJob>& jobs,
+  const uint32_t numThreads,
+  const std::function<void(PatternJob&)>& merge)
+{
+  // the calling thread merges, so one fewer builds
+  const size_t num = std::max(numThreads, 2u) - 1;
+  std::vector<Builder> builders(num);
+
+  std::vector<std::future<void>> futs;
+
+  const auto launch = [&](size_t beg) {
+    // once a pattern lacks a factor, the FSM never needs another, and
+    // the flag can only have been cleared by the merges done so far
+    const bool factors = fsm.AllFactors;
+    const size_t end = std::min(beg + WINDOW, jobs.size());
+    for (size_t t = 0; t < num; ++t) {
+      futs.push_back(std::async(
+        std::launch::async, buildStride, std::ref(builders[t]),
+        std::ref(jobs), beg + t, end, num, factors
+      ));
+    }
+  };
+
+  launch(0);
+
+  for (size_t beg = 0; beg < jobs.size(); beg += WINDOW) {
+    for (std::future<void>& f : futs) {
+      f.get();
+    }
+    futs.clear();
+
+    // build the next window while this one is merged
+    const size_t end = std::min(beg + WINDOW, jobs.size());
+    if (end < jobs.size()) {
+      launch(end);
+    }
+
+    for (size_t i = beg; i < end; ++i) {
+      merge(jobs[i]);
+      std::vector<PatternNFA>().swap(jobs[i].Nfas);
+    }
+  }
+}
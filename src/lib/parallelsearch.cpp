@@ -0,0 +1,133 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parallelsearch.h"
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+namespace {
+  // parts smaller than this aren't worth a thread
+  const uint64_t MIN_PART = 1 << 20;
+
+  // engines are compared for idleness at this interval
+  const uint64_t STRIDE = 1 << 16;
+
+  struct Part {
+    const byte* Beg;
+    const byte* End;
+    uint64_t Offset;
+
+    std::shared_ptr<VmInterface> Vm;
+    std::vector<SearchHit> Hits;
+
+    // at each stride, whether the engine was idle and how many hits it
+    // had found before it
+    std::vector<std::pair<bool,size_t>> Marks;
+
+    uint64_t Ret;
+  };
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  const byte* strideEnd(const byte* cur, const byte* end) {
+    return static_cast<uint64_t>(end - cur) > STRIDE ? cur + STRIDE : end;
+  }
+
+  void searchPart(Part& p) {
+    uint64_t offset = p.Offset;
+    for (const byte* cur = p.Beg; cur < p.End; ) {
+      p.Marks.emplace_back(p.Vm->idle(), p.Hits.size());
+
+      const byte* const stop = strideEnd(cur, p.End);
+      p.Ret = p.Vm->search(cur, stop, offset, collect, &p.Hits);
+      offset += stop - cur;
+      cur = stop;
+    }
+  }
+}
+
+uint64_t parallelSearch(
+  std::shared_ptr<VmInterface>& vm,
+  const std::function<std::shared_ptr<VmInterface>()>& create,
+  const byte* const beg,
+  const byte* const end,
+  const uint64_t startOffset,
+  const uint32_t numThreads,
+  HitCallback hitFn,
+  void* userData)
+{
+  const uint64_t len = end - beg;
+  const uint64_t num = std::min(static_cast<uint64_t>(numThreads), len / MIN_PART);
+
+  if (num < 2) {
+    return vm->search(beg, end, startOffset, hitFn, userData);
+  }
+
+  std::vector<Part> parts(num);
+  for (uint64_t i = 0; i < num; ++i) {
+    Part& p = parts[i];
+    p.Beg = beg + i*(len/num);
+    p.End = i + 1 < num ? p.Beg + len/num : end;
+    p.Offset = startOffset + (p.Beg - beg);
+  }
+
+  // search all but the first part in the background
+  std::vector<std::future<void>> futs;
+  for (uint64_t i = 1; i < num; ++i) {
+    Part& p = parts[i];
+    p.Vm = create();
+    futs.push_back(std::async(std::launch::async, searchPart, std::ref(p)));
+  }
+
+  uint64_t ret = vm->search(parts[0].Beg, parts[0].End, parts[0].Offset, hitFn, userData);
+
+  for (uint64_t i = 1; i < num; ++i) {
+    Part& p = parts[i];
+    futs[i-1].get();
+
+    uint64_t offset = p.Offset;
+    const byte* cur = p.Beg;
+    for (size_t m = 0; cur < p.End; ++m) {
+      if (vm->idle() && p.Marks[m].first) {
+        // from here on, vm would find just what the part's engine did
+        if (hitFn) {
+          for (auto h = p.Hits.begin() + p.Marks[m].second; h != p.Hits.end(); ++h) {
+            (*hitFn)(userData, &*h);
+          }
+        }
+
+        vm = p.Vm;
+        ret = p.Ret;
+        break;
+      }
+
+      const byte* const stop = strideEnd(cur, p.End);
+      ret = vm->search(cur, stop, offset, hitFn, userData);
+      offset += stop - cur;
+      cur = stop;
+    }
+  }
+
+  return ret;
+}
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <memory>
 #include <numeric>
+#include <stdexcept>
 
 void PatternMap::addPattern(const char* pattern, const char* chain, uint64_t idx) {
   std::unique_ptr<char[]> patcopy(new char[std::strlen(pattern)+1]);
@@ -61,20 +62,31 @@ std::unique_ptr<PatternMap> PatternMap::unmarshall(const void* buf, size_t len)
   p->Shared = true;
 
   const char* i = static_cast<const char*>(buf);
-  const char* pat;
-  const char* chain;
-  const char* idx;
-  
   const char* const end = i + len;
-  
+
+  // the strings are used in place, so they need only be found
+  auto nextString = [&end](const char* s) {
+    const void* nul = std::memchr(s, '\0', end - s);
+    if (!nul) {
+      throw std::runtime_error("Malformed pattern map");
+    }
+    return static_cast<const char*>(nul) + 1;
+  };
+
   while (i < end) {
-    pat = i;
-    chain = pat + std::strlen(pat) + 1;
-    idx = chain + std::strlen(chain) + 1;
+    const char* const pat = i;
+    const char* const chain = nextString(pat);
+    const char* const idx = nextString(chain);
+
+    if (end - idx < static_cast<std::ptrdiff_t>(sizeof(LG_PatternInfo::UserIndex))) {
+      throw std::runtime_error("Malformed pattern map");
+    }
 
-    p->usePattern(pat, chain, *reinterpret_cast<const uint64_t*>(idx));
+    uint64_t userIndex;
+    std::memcpy(&userIndex, idx, sizeof(userIndex));
+    p->usePattern(pat, chain, userIndex);
 
-    i = idx + sizeof(LG_PatternInfo::UserIndex); 
+    i = idx + sizeof(LG_PatternInfo::UserIndex);
   }
 
   return p;
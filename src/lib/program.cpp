@@ -20,77 +20,155 @@
 
 #include <cstring>
 #include <iomanip>
+#include <stdexcept>
 
 bool Program::operator==(const Program& rhs) const {
   return MaxLabel == rhs.MaxLabel &&
          MaxCheck == rhs.MaxCheck &&
          FilterOff == rhs.FilterOff &&
          Filter == rhs.Filter &&
+         Classes == rhs.Classes &&
+         (Literals ? rhs.Literals && *Literals == *rhs.Literals : !rhs.Literals) &&
+         (Factors ? rhs.Factors && *Factors == *rhs.Factors : !rhs.Factors) &&
+         FactorMaxLen == rhs.FactorMaxLen &&
+         FactorMaxLead == rhs.FactorMaxLead &&
+         FactorLead == rhs.FactorLead &&
          std::equal(begin(), end(), rhs.begin());
 }
 
+//
+// The layout is the fixed fields, the filter and factor lead bitsets, the
+// byte classes, then the literal tables and the instructions, each starting 8-byte aligned,
+// so that unmarshall() can use them in place.
+//
+namespace {
+  template <class T>
+  void putVal(char*& i, const T& v) {
+    std::memcpy(i, &v, sizeof(v));
+    i += sizeof(v);
+  }
+
+  template <class T>
+  T getVal(const char*& i) {
+    T v;
+    std::memcpy(&v, i, sizeof(v));
+    i += sizeof(v);
+    return v;
+  }
+
+  template <size_t N>
+  void putBits(char*& i, const std::bitset<N>& bits) {
+    for (size_t b = 0; b < N; b += 8, ++i) {
+      *i = 0;
+      for (size_t j = 0; j < 8; ++j) {
+        *i |= bits[b+j] << j;
+      }
+    }
+  }
+
+  template <size_t N>
+  void getBits(const char*& i, std::bitset<N>& bits) {
+    // filters are mostly empty, so skip the zero bytes
+    for (size_t b = 0; b < N; b += 8, ++i) {
+      if (*i) {
+        for (size_t j = 0; j < 8; ++j) {
+          if (*i & (1 << j)) {
+            bits.set(b+j);
+          }
+        }
+      }
+    }
+  }
+}
+
 std::vector<char> Program::marshall() const {
-  const size_t plen = bufSize();
-  std::vector<char> buf(plen);
+  std::vector<char> buf(bufSize(), 0);
   char* i = buf.data();
 
-  // MaxLabel
-  std::memcpy(i, &MaxLabel, sizeof(MaxLabel));
-  i += sizeof(MaxLabel);
-
-  // MaxCheck
-  std::memcpy(i, &MaxCheck, sizeof(MaxCheck));
-  i += sizeof(MaxCheck);
-
-  // FilterOff
-  std::memcpy(i, &FilterOff, sizeof(FilterOff));
-  i += sizeof(FilterOff);
-
-  // Filter
-  for (size_t b = 0; b < Filter.size(); b += 8) {
-    *i = Filter[b] |
-         (Filter[b+1] << 1) |
-         (Filter[b+2] << 2) |
-         (Filter[b+3] << 3) |
-         (Filter[b+4] << 4) |
-         (Filter[b+5] << 5) |
-         (Filter[b+6] << 6) |
-         (Filter[b+7] << 7);
-    ++i;
-  }
+  putVal(i, MaxLabel);
+  putVal(i, MaxCheck);
+  putVal(i, FilterOff);
+  putVal(i, FactorMaxLen);
+  putVal(i, FactorMaxLead);
+  putVal(i, Classes.Num);
+
+  const uint64_t llen = Literals ? Literals->bufSize() : 0,
+                 flen = Factors ? Factors->bufSize() : 0,
+                 icount = size();
+
+  putVal(i, llen);
+  putVal(i, flen);
+  putVal(i, icount);
+
+  putBits(i, Filter);
+  putBits(i, FactorLead);
+  putVal(i, Classes.Map);
 
-  // Instructions
-  std::memcpy(i, IBeg.get(), size()*sizeof(Instruction));
+  if (Literals) {
+    Literals->marshall(i);
+    i += llen;
+  }
 
-  // XXX: i should be at the end now
+  if (Factors) {
+    Factors->marshall(i);
+    i += flen;
+  }
 
+  std::memcpy(i, IBeg.get(), icount*sizeof(Instruction));
   return buf;
 }
 
 ProgramPtr Program::unmarshall(const void* buf, size_t len) {
   const char* i = static_cast<const char*>(buf);
-  const size_t icount = (len - (sizeof(Program::MaxLabel) + sizeof(Program::MaxCheck) + sizeof(Program::FilterOff) + 256*256/8)) / sizeof(Instruction);
+
+  if (reinterpret_cast<uintptr_t>(i) % 8) {
+    throw std::runtime_error("Misaligned program buffer");
+  }
 
   ProgramPtr p(new Program(0));
 
-  p->MaxLabel = *reinterpret_cast<const decltype(p->MaxLabel)*>(i);
-  i += sizeof(p->MaxLabel);
+  const size_t fixed = p->bufSize();
+  if (len < fixed) {
+    throw std::runtime_error("Truncated program");
+  }
 
-  p->MaxCheck = *reinterpret_cast<const decltype(p->MaxCheck)*>(i);
-  i += sizeof(p->MaxCheck);
+  p->MaxLabel = getVal<uint32_t>(i);
+  p->MaxCheck = getVal<uint32_t>(i);
+  p->FilterOff = getVal<uint32_t>(i);
+  p->FactorMaxLen = getVal<uint32_t>(i);
+  p->FactorMaxLead = getVal<uint32_t>(i);
+  p->Classes.Num = getVal<uint32_t>(i);
+
+  const uint64_t llen = getVal<uint64_t>(i),
+                 flen = getVal<uint64_t>(i),
+                 icount = getVal<uint64_t>(i);
+
+  const uint64_t rest = len - fixed;
+  if (llen > rest || flen > rest - llen ||
+      icount > (rest - llen - flen) / sizeof(Instruction) ||
+      fixed + llen + flen + ((icount*sizeof(Instruction) + 7) & ~uint64_t(7)) != len)
+  {
+    throw std::runtime_error("Malformed program");
+  }
+
+  getBits(i, p->Filter);
+  getBits(i, p->FactorLead);
+  p->Classes.Map = getVal<std::array<byte,256>>(i);
 
-  p->FilterOff = *reinterpret_cast<const decltype(p->FilterOff)*>(i);
-  i += sizeof(p->FilterOff);
+  if (p->Classes.Num < 1 || p->Classes.Num > 256 ||
+      *std::max_element(p->Classes.Map.begin(), p->Classes.Map.end()) >= p->Classes.Num)
+  {
+    throw std::runtime_error("Malformed program");
+  }
 
-  for (size_t b = 0; b < p->Filter.size() / 8; ++b, ++i) {
-    p->Filter[8*b]   = *i & 0x01;
-    p->Filter[8*b+1] = *i & 0x02;
-    p->Filter[8*b+2] = *i & 0x04;
-    p->Filter[8*b+3] = *i & 0x08;
-    p->Filter[8*b+4] = *i & 0x10;
-    p->Filter[8*b+5] = *i & 0x20;
-    p->Filter[8*b+6] = *i & 0x40;
-    p->Filter[8*b+7] = *i & 0x80;
+  if (llen) {
+    p->Literals = LiteralMatcher::unmarshall(i, llen);
+    i += llen;
+  }
+
+  if (flen) {
+    p->Factors = LiteralMatcher::unmarshall(i, flen);
+    i += flen;
   }
 
   // The caller is responsible for freeing buf. We subvert std::unique_ptr
@@ -114,13 +192,14 @@ std::ostream& operator<<(std::ostream& out, const Program& prog) {
     printIndex(out, i) << prog[i] << '\n';
 
     if (prog[i].OpCode == BIT_VECTOR_OP) {
-      for (uint32_t j = 1; j < 9; ++j) {
+      const uint32_t words = prog[i].wordSize() - 1;
+      for (uint32_t j = 1; j <= words; ++j) {
         out << std::hex << std::setfill('0') << std::setw(8)
             << i + j << '\t' << *(uint32_t*)(&prog[i]+j) << '\n';
       }
 
       out << std::dec;
-      i += 8;
+      i += words;
     }
     else if (prog[i].OpCode == JUMP_TABLE_RANGE_OP) {
       const uint32_t start = prog[i].Op.T2.First, end = prog[i].Op.T2.Last;
@@ -129,6 +208,26 @@ std::ostream& operator<<(std::ostream& out, const Program& prog) {
         printIndex(out, i) << std::setfill(' ') << std::setw(3) << j << ": " << reinterpret_cast<const uint32_t&>(prog[i]) << '\n';
       }
     }
+    else if (prog[i].OpCode == JUMP_TABLE_SPARSE_OP || prog[i].OpCode == JUMP_TABLE_BITMAP_OP) {
+      const Instruction& instr = prog[i];
+      const uint32_t num = instr.OpCode == JUMP_TABLE_SPARSE_OP ? instr.Op.T3.Count + 1 : 0,
+                     words = jumpTableWords(instr.OpCode, instr.Op.T2.First, instr.Op.T2.Last, num) - num;
+
+      // the keys or bitmap and ranks, then the targets in class order
+      for (uint32_t j = 1; j <= words; ++j) {
+        out << std::hex << std::setfill('0') << std::setw(8)
+            << i + j << '\t' << *(uint32_t*)(&instr+j) << '\n';
+      }
+      out << std::dec;
+      i += words;
+
+      for (uint32_t j = instr.Op.T2.First; j <= instr.Op.T2.Last; ++j) {
+        if (jumpTableTarget(instr, j)) {
+          ++i;
+          printIndex(out, i) << std::setfill(' ') << std::setw(3) << j << ": " << reinterpret_cast<const uint32_t&>(prog[i]) << '\n';
+        }
+      }
+    }
     else if (prog[i].OpCode == JUMP_OP || prog[i].OpCode == FORK_OP) {
       ++i;
       printIndex(out, i) << reinterpret_cast<const uint32_t&>(prog[i]) << '\n';
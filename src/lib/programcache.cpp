@@ -0,0 +1,177 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "programcache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "unknown"
+#endif
+
+namespace {
+  // "LGPC", and the version of the layout
+  const uint32_t MAGIC = 0x4350474C;
+  const uint32_t FORMAT = 4;
+
+  struct FileCloser {
+    void operator()(std::FILE* f) const { std::fclose(f); }
+  };
+
+  typedef std::unique_ptr<std::FILE, FileCloser> FilePtr;
+
+  template <class T>
+  void put(std::string& out, const T& val) {
+    out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+
+  void putString(std::string& out, const char* s) {
+    const uint64_t len = std::strlen(s);
+    put(out, len);
+    out.append(s, len);
+  }
+
+  template <class T>
+  bool readVal(std::FILE* f, T& val) {
+    return std::fread(&val, sizeof(val), 1, f) == 1;
+  }
+
+  template <class T>
+  bool writeVal(std::FILE* f, const T& val) {
+    return std::fwrite(&val, sizeof(val), 1, f) == 1;
+  }
+
+  // FNV-1a; only for naming files, as the inputs themselves are compared
+  uint64_t hash(const std::string& s) {
+    uint64_t h = 0xCBF29CE484222325;
+    for (const char c : s) {
+      h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3;
+    }
+    return h;
+  }
+
+  std::string hex(uint64_t v) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+  }
+}
+
+std::string ProgramCache::path(const std::string& inputs) const {
+  return Dir + '/' + hex(hash(inputs)) + ".lgprog";
+}
+
+std::vector<char> ProgramCache::read(const std::string& inputs) const {
+  FilePtr f(std::fopen(path(inputs).c_str(), "rb"));
+  if (!f) {
+    return {};
+  }
+
+  uint32_t magic, version;
+  uint64_t ilen, plen;
+  if (!readVal(f.get(), magic) || magic != MAGIC ||
+      !readVal(f.get(), version) || version != FORMAT ||
+      !readVal(f.get(), ilen) || ilen != inputs.size())
+  {
+    return {};
+  }
+
+  std::string in(ilen, '\0');
+  if (std::fread(&in[0], 1, ilen, f.get()) != ilen || in != inputs ||
+      !readVal(f.get(), plen))
+  {
+    return {};
+  }
+
+  std::vector<char> prog(plen);
+  if (std::fread(prog.data(), 1, plen, f.get()) != plen ||
+      std::fgetc(f.get()) != EOF)
+  {
+    // truncated, or trailing junk
+    return {};
+  }
+
+  return prog;
+}
+
+bool ProgramCache::write(const std::string& inputs, const std::vector<char>& prog) const {
+  const std::string dst = path(inputs);
+
+  // unique to this writer, so concurrent writers don't collide
+  std::random_device rd;
+  const std::string tmp = dst + ".tmp" +
+    hex((static_cast<uint64_t>(rd()) << 32) | rd());
+
+  std::FILE* f = std::fopen(tmp.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+
+  const uint64_t ilen = inputs.size(), plen = prog.size();
+  bool ok = writeVal(f, MAGIC) && writeVal(f, FORMAT) &&
+            writeVal(f, ilen) &&
+            std::fwrite(inputs.data(), 1, ilen, f) == ilen &&
+            writeVal(f, plen) &&
+            std::fwrite(prog.data(), 1, plen, f) == plen;
+  ok = (std::fclose(f) == 0) && ok;
+
+  // a reader sees the old file or the new one, never a partial one
+  if (!ok || std::rename(tmp.c_str(), dst.c_str())) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string programCacheInputs(
+  const char** patternLists,
+  unsigned int numLists,
+  const char** defaultEncodings,
+  unsigned int defaultEncodingsNum,
+  const LG_KeyOptions* defaultOptions,
+  const LG_ProgramOptions* programOptions)
+{
+  std::string in;
+  putString(in, PACKAGE_VERSION);
+
+  // the lists are kept apart, as each numbers its patterns from zero
+  put(in, numLists);
+  for (unsigned int i = 0; i < numLists; ++i) {
+    putString(in, patternLists[i]);
+  }
+
+  put(in, defaultEncodingsNum);
+  for (unsigned int i = 0; i < defaultEncodingsNum; ++i) {
+    putString(in, defaultEncodings[i]);
+  }
+
+  put(in, static_cast<bool>(defaultOptions->FixedString));
+  put(in, static_cast<bool>(defaultOptions->CaseInsensitive));
+  put(in, static_cast<bool>(defaultOptions->UnicodeMode));
+  put(in, static_cast<bool>(programOptions->Determinize));
+  return in;
+}
@@ -0,0 +1,179 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "programfile.h"
+
+#include "pattern_map.h"
+#include "program.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace {
+  const uint32_t MAGIC = 0x5250474C; // "LGPR"
+
+  // bump whenever the layout of any part changes
+  const uint32_t FORMAT = 4;
+
+  struct Header {
+    uint32_t Magic,
+             Format;
+    uint64_t Size,
+             Checksum,     // of everything after the header
+             PatternsOff,
+             PatternsLen,
+             ProgramOff,
+             ProgramLen;
+  };
+
+  size_t padded(size_t n) {
+    return (n + 7) & ~size_t(7);
+  }
+
+  uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  uint64_t word(const char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+  }
+
+  const uint64_t P1 = 0x9E3779B185EBCA87ull,
+                 P2 = 0xC2B2AE3D27D4EB4Full,
+                 P3 = 0x165667B19E3779F9ull;
+
+  uint64_t mixLane(uint64_t h, uint64_t w) {
+    return rotl(h + w * P2, 31) * P1;
+  }
+}
+
+uint64_t programChecksum(const char* buf, size_t len) {
+  // four independent lanes, as in xxHash, so the multiplies overlap
+  uint64_t h0 = P1 + P2, h1 = P2, h2 = 0, h3 = -P1;
+
+  const char* i = buf;
+  const char* const end = buf + len;
+  for ( ; end - i >= 32; i += 32) {
+    h0 = mixLane(h0, word(i));
+    h1 = mixLane(h1, word(i + 8));
+    h2 = mixLane(h2, word(i + 16));
+    h3 = mixLane(h3, word(i + 24));
+  }
+
+  uint64_t h = rotl(h0, 1) + rotl(h1, 7) + rotl(h2, 12) + rotl(h3, 18) + len;
+
+  for ( ; end - i >= 8; i += 8) {
+    h = rotl(h ^ mixLane(0, word(i)), 27) * P1 + P3;
+  }
+
+  for ( ; i < end; ++i) {
+    h = rotl(h ^ (static_cast<byte>(*i) * P3), 11) * P1;
+  }
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+size_t programFileSize(const PatternMap& pmap, const Program& prog) {
+  return sizeof(Header) + padded(pmap.bufSize()) + prog.bufSize();
+}
+
+void writeProgramFile(const PatternMap& pmap, const Program& prog, char* buf) {
+  const std::vector<char> pbuf = pmap.marshall(), gbuf = prog.marshall();
+
+  Header h;
+  h.Magic = MAGIC;
+  h.Format = FORMAT;
+  h.PatternsOff = sizeof(Header);
+  h.PatternsLen = pbuf.size();
+  h.ProgramOff = h.PatternsOff + padded(pbuf.size());
+  h.ProgramLen = gbuf.size();
+  h.Size = h.ProgramOff + h.ProgramLen;
+
+  char* const payload = buf + sizeof(Header);
+  std::memcpy(buf + h.PatternsOff, pbuf.data(), pbuf.size());
+  std::memset(buf + h.PatternsOff + pbuf.size(), 0, h.ProgramOff - h.PatternsOff - pbuf.size());
+  std::memcpy(buf + h.ProgramOff, gbuf.data(), gbuf.size());
+
+  h.Checksum = programChecksum(payload, h.Size - sizeof(Header));
+  std::memcpy(buf, &h, sizeof(h));
+}
+
+void readProgramFile(const char* buf, size_t len, bool verify,
+                     std::unique_ptr<PatternMap>& pmap, ProgramPtr& prog)
+{
+  Header h;
+  if (len < sizeof(h)) {
+    throw std::runtime_error("Truncated program file");
+  }
+  std::memcpy(&h, buf, sizeof(h));
+
+  if (h.Magic != MAGIC) {
+    throw std::runtime_error("Not a lightgrep program");
+  }
+
+  if (h.Format != FORMAT) {
+    throw std::runtime_error("Program is from another version of lightgrep");
+  }
+
+  if (h.Size != len) {
+    throw std::runtime_error("Truncated program file");
+  }
+
+  if (h.PatternsOff != sizeof(Header) ||
+      h.PatternsLen > len - h.PatternsOff ||
+      h.ProgramOff != h.PatternsOff + padded(h.PatternsLen) ||
+      h.ProgramOff > len || h.ProgramLen != len - h.ProgramOff)
+  {
+    throw std::runtime_error("Malformed program file");
+  }
+
+  if (verify && h.Checksum != programChecksum(buf + sizeof(Header), len - sizeof(Header))) {
+    throw std::runtime_error("Program file checksum mismatch");
+  }
+
+  pmap = PatternMap::unmarshall(buf + h.PatternsOff, h.PatternsLen);
+  prog = Program::unmarshall(buf + h.ProgramOff, h.ProgramLen);
+}
+
+void mapProgramFile(const std::string& path, bool verify,
+                    std::unique_ptr<PatternMap>& pmap, ProgramPtr& prog)
+{
+  namespace bip = boost::interprocess;
+
+  // the region stays mapped after the file mapping is gone
+  const bip::file_mapping file(path.c_str(), bip::read_only);
+  auto region = std::make_shared<bip::mapped_region>(file, bip::read_only);
+
+  readProgramFile(
+    static_cast<const char*>(region->get_address()), region->get_size(),
+    verify, pmap, prog
+  );
+  prog->Storage = region;
+}
@@ -0,0 +1,221 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "skipscan.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LG_SKIPSCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+  void makeTruffle(const std::bitset<256>& set, byte* lo, byte* hi) {
+    std::memset(lo, 0, 16);
+    std::memset(hi, 0, 16);
+
+    for (uint32_t b = 0; b < 256; ++b) {
+      if (set[b]) {
+        byte* t = b < 0x80 ? lo : hi;
+        t[b & 0x0F] |= 1 << ((b >> 4) & 0x07);
+      }
+    }
+  }
+}
+
+SkipScanner::SkipScanner(const std::bitset<256*256>& filter):
+  Filter(filter)
+{
+  init(bestImpl());
+}
+
+SkipScanner::SkipScanner(const std::bitset<256*256>& filter, Impl impl):
+  Filter(filter)
+{
+  init(impl);
+}
+
+SkipScanner::SkipScanner(const SkipScanner& other, const std::bitset<256*256>& filter):
+  Filter(filter),
+  Which(other.Which),
+  Scan(other.Scan)
+{
+  std::memcpy(Lo1, other.Lo1, sizeof(Lo1));
+  std::memcpy(Hi1, other.Hi1, sizeof(Hi1));
+  std::memcpy(Lo2, other.Lo2, sizeof(Lo2));
+  std::memcpy(Hi2, other.Hi2, sizeof(Hi2));
+}
+
+void SkipScanner::init(Impl impl) {
+  // never select an implementation the CPU cannot run
+  const Impl best = bestImpl();
+  if (impl > best) {
+    impl = best;
+  }
+
+  // project the filter onto its first and second bytes
+  std::bitset<256> first, second;
+  for (uint32_t i = 0; i < 256*256; ++i) {
+    if (Filter[i]) {
+      first.set(i & 0xFF);
+      second.set(i >> 8);
+    }
+  }
+
+  makeTruffle(first, Lo1, Hi1);
+  makeTruffle(second, Lo2, Hi2);
+
+  if (first.all() && second.all()) {
+    // the byte sets reject nothing, so vectorizing cannot help
+    impl = SCALAR;
+  }
+
+  Which = impl;
+  switch (impl) {
+  case AVX2:
+    Scan = &SkipScanner::scanAVX2;
+    break;
+  case SSE42:
+    Scan = &SkipScanner::scanSSE42;
+    break;
+  default:
+    Which = SCALAR;
+    Scan = &SkipScanner::scanScalar;
+    break;
+  }
+}
+
+SkipScanner::Impl SkipScanner::bestImpl() {
+#ifdef LG_SKIPSCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return AVX2;
+  }
+  else if (__builtin_cpu_supports("sse4.2")) {
+    return SSE42;
+  }
+#endif
+  return SCALAR;
+}
+
+const byte* SkipScanner::scanScalar(const byte* beg, const byte* end) const {
+  for ( ; beg < end && !test(beg); ++beg) ;
+  return beg;
+}
+
+#ifdef LG_SKIPSCAN_X86
+
+namespace {
+  __attribute__((target("sse4.2")))
+  inline __m128i notInSet128(__m128i v, __m128i lo, __m128i hi, __m128i bits) {
+    const __m128i nib = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+    const __m128i t = _mm_or_si128(
+      _mm_shuffle_epi8(lo, v),
+      _mm_shuffle_epi8(hi, _mm_xor_si128(v, _mm_set1_epi8(static_cast<char>(0x80))))
+    );
+    return _mm_cmpeq_epi8(
+      _mm_and_si128(t, _mm_shuffle_epi8(bits, nib)), _mm_setzero_si128()
+    );
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i notInSet256(__m256i v, __m256i lo, __m256i hi, __m256i bits) {
+    const __m256i nib = _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+    const __m256i t = _mm256_or_si256(
+      _mm256_shuffle_epi8(lo, v),
+      _mm256_shuffle_epi8(hi, _mm256_xor_si256(v, _mm256_set1_epi8(static_cast<char>(0x80))))
+    );
+    return _mm256_cmpeq_epi8(
+      _mm256_and_si256(t, _mm256_shuffle_epi8(bits, nib)), _mm256_setzero_si256()
+    );
+  }
+
+  const byte BitTable[16] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+  };
+}
+
+__attribute__((target("sse4.2")))
+const byte* SkipScanner::scanSSE42(const byte* beg, const byte* end) const {
+  const __m128i lo1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Lo1)),
+                hi1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Hi1)),
+                lo2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Lo2)),
+                hi2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Hi2)),
+                bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BitTable));
+
+  // each step reads [beg, beg + 16], so stop while *end is the last byte
+  for ( ; end - beg >= 16; beg += 16) {
+    const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg)),
+                  v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg + 1));
+
+    uint32_t mask = ~_mm_movemask_epi8(_mm_or_si128(
+      notInSet128(v1, lo1, hi1, bits), notInSet128(v2, lo2, hi2, bits)
+    )) & 0xFFFF;
+
+    for ( ; mask; mask &= mask - 1) {
+      const byte* p = beg + __builtin_ctz(mask);
+      if (test(p)) {
+        return p;
+      }
+    }
+  }
+
+  return scanScalar(beg, end);
+}
+
+__attribute__((target("avx2")))
+const byte* SkipScanner::scanAVX2(const byte* beg, const byte* end) const {
+  const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Lo1))),
+                hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Hi1))),
+                lo2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Lo2))),
+                hi2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Hi2))),
+                bits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(BitTable)));
+
+  // each step reads [beg, beg + 32], so stop while *end is the last byte
+  for ( ; end - beg >= 32; beg += 32) {
+    const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(beg)),
+                  v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(beg + 1));
+
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(
+      notInSet256(v1, lo1, hi1, bits), notInSet256(v2, lo2, hi2, bits)
+    )));
+
+    for ( ; mask; mask &= mask - 1) {
+      const byte* p = beg + __builtin_ctz(mask);
+      if (test(p)) {
+        return p;
+      }
+    }
+  }
+
+  return scanSSE42(beg, end);
+}
+
+#else
+
+const byte* SkipScanner::scanSSE42(const byte* beg, const byte* end) const {
+  return scanScalar(beg, end);
+}
+
+const byte* SkipScanner::scanAVX2(const byte* beg, const byte* end) const {
+  return scanScalar(beg, end);
+}
+
+#endif
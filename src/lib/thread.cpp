@@ -21,5 +21,6 @@
 #include <limits>
 
 const uint32_t Thread::NOLABEL = std::numeric_limits<uint32_t>::max();
-const uint64_t Thread::NONE = std::numeric_limits<uint64_t>::max();
+const uint32_t Thread::DEAD = std::numeric_limits<uint32_t>::max();
+const uint64_t Thread::NONE = std::numeric_limits<uint64_t>::max() >> 1;
 
@@ -19,7 +19,10 @@
 #include "utility.h"
 
 #include <algorithm>
+#include <array>
+#include <limits>
 #include <set>
+#include <unordered_set>
 
 std::pair<uint32_t,std::bitset<256*256>> bestPair(const NFA& graph) {
   std::set<std::pair<uint32_t,NFA::VertexDescriptor>> next;
@@ -108,6 +111,251 @@ std::pair<uint32_t,std::bitset<256*256>> bestPair(const NFA& graph) {
   return {i-b.begin(), *i};
 }
 
+const uint32_t RequiredFactor::UNBOUNDED = std::numeric_limits<uint32_t>::max();
+
+namespace {
+  bool singleByte(const NFA& graph, NFA::VertexDescriptor v, byte& b) {
+    ByteSet bs;
+    graph[v].Trans->getBytes(bs);
+    if (bs.count() != 1) {
+      return false;
+    }
+
+    for (uint32_t i = 0; i < 256; ++i) {
+      if (bs[i]) {
+        b = i;
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Computes the immediate dominators of the vertices reachable from the
+  // initial state, plus a virtual sink, numbered verticesSize(), which
+  // follows every match state (Cooper, Harvey & Kennedy). Unreachable
+  // vertices get NONE.
+  std::vector<uint32_t> dominators(const NFA& graph) {
+    const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    const uint32_t n = graph.verticesSize(), sink = n;
+
+    // reverse postorder numbering
+    std::vector<uint32_t> rpo(n + 1, NONE), post;
+    std::vector<std::pair<uint32_t,uint32_t>> stack{{0, 0}};
+    rpo[0] = 0;
+    while (!stack.empty()) {
+      const uint32_t v = stack.back().first;
+      const uint32_t i = stack.back().second++;
+      const uint32_t deg = v == sink ? 0 : graph.outDegree(v);
+      if (i < deg || (i == deg && v != sink && graph[v].IsMatch)) {
+        const uint32_t w = i < deg ? graph.outVertex(v, i) : sink;
+        if (rpo[w] == NONE) {
+          rpo[w] = 0;
+          stack.emplace_back(w, 0);
+        }
+      }
+      else {
+        post.push_back(v);
+        stack.pop_back();
+      }
+    }
+
+    std::vector<uint32_t> order(post.rbegin(), post.rend());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+      rpo[order[i]] = i;
+    }
+
+    std::vector<uint32_t> idom(n + 1, NONE);
+    idom[0] = 0;
+
+    auto intersect = [&](uint32_t a, uint32_t b) {
+      while (a != b) {
+        while (rpo[a] > rpo[b]) {
+          a = idom[a];
+        }
+        while (rpo[b] > rpo[a]) {
+          b = idom[b];
+        }
+      }
+      return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (uint32_t i = 1; i < order.size(); ++i) {
+        const uint32_t v = order[i];
+        uint32_t nd = NONE;
+
+        auto visit = [&](uint32_t p) {
+          if (idom[p] != NONE) {
+            nd = nd == NONE ? p : intersect(p, nd);
+          }
+        };
+
+        if (v == sink) {
+          for (uint32_t p = 0; p < n; ++p) {
+            if (graph[p].IsMatch) {
+              visit(p);
+            }
+          }
+        }
+        else {
+          for (const NFA::VertexDescriptor p : graph.inVertices(v)) {
+            visit(p);
+          }
+        }
+
+        if (idom[v] != nd) {
+          idom[v] = nd;
+          changed = true;
+        }
+      }
+    }
+
+    return idom;
+  }
+
+  // Finds the bytes which can precede the first entry to d, and the
+  // length of the longest such prefix
+  void leadOf(const NFA& graph, NFA::VertexDescriptor d, RequiredFactor& factor) {
+    const uint32_t n = graph.verticesSize();
+
+    // vertices reachable without passing through d...
+    std::vector<bool> reach(n, false);
+    std::vector<NFA::VertexDescriptor> stack{0};
+    reach[0] = true;
+    while (!stack.empty()) {
+      const NFA::VertexDescriptor v = stack.back();
+      stack.pop_back();
+      for (const NFA::VertexDescriptor w : graph.outVertices(v)) {
+        if (w != d && !reach[w]) {
+          reach[w] = true;
+          stack.push_back(w);
+        }
+      }
+    }
+
+    // ...which can also reach d
+    std::vector<bool> lead(n, false);
+    for (const NFA::VertexDescriptor p : graph.inVertices(d)) {
+      if (reach[p] && !lead[p]) {
+        lead[p] = true;
+        stack.push_back(p);
+      }
+    }
+
+    while (!stack.empty()) {
+      const NFA::VertexDescriptor v = stack.back();
+      stack.pop_back();
+      for (const NFA::VertexDescriptor u : graph.inVertices(v)) {
+        if (reach[u] && !lead[u]) {
+          lead[u] = true;
+          stack.push_back(u);
+        }
+      }
+    }
+
+    factor.Lead.reset();
+    std::vector<uint32_t> indeg(n, 0);
+    uint32_t num = 0;
+    for (uint32_t v = 0; v < n; ++v) {
+      if (lead[v]) {
+        ++num;
+        if (v) {
+          graph[v].Trans->orBytes(factor.Lead);
+        }
+        for (const NFA::VertexDescriptor w : graph.outVertices(v)) {
+          if (lead[w]) {
+            ++indeg[w];
+          }
+        }
+      }
+    }
+
+    // longest path by topological order; a cycle makes it unbounded
+    std::vector<uint32_t> dist(n, 0);
+    uint32_t sorted = 0;
+    for (uint32_t v = 0; v < n; ++v) {
+      if (lead[v] && !indeg[v]) {
+        stack.push_back(v);
+      }
+    }
+
+    factor.MaxLead = 0;
+    while (!stack.empty()) {
+      const NFA::VertexDescriptor v = stack.back();
+      stack.pop_back();
+      ++sorted;
+      for (const NFA::VertexDescriptor w : graph.outVertices(v)) {
+        if (lead[w]) {
+          dist[w] = std::max(dist[w], dist[v] + 1);
+          if (!--indeg[w]) {
+            stack.push_back(w);
+          }
+        }
+        else if (w == d) {
+          factor.MaxLead = std::max(factor.MaxLead, dist[v]);
+        }
+      }
+    }
+
+    if (sorted < num) {
+      factor.MaxLead = RequiredFactor::UNBOUNDED;
+    }
+  }
+}
+
+bool requiredFactor(const NFA& graph, RequiredFactor& factor) {
+  const std::vector<uint32_t> idom = dominators(graph);
+  const uint32_t sink = graph.verticesSize();
+
+  if (idom[sink] == std::numeric_limits<uint32_t>::max()) {
+    // no match states
+    return false;
+  }
+
+  bool found = false;
+  RequiredFactor cand;
+
+  // every dominator of the sink lies on every path to a match
+  for (uint32_t d = idom[sink]; d != 0; d = idom[d]) {
+    byte b;
+    if (!singleByte(graph, d, b)) {
+      continue;
+    }
+
+    // extend along the chain of single-byte states which must follow d
+    cand.Bytes.assign(1, b);
+    std::vector<bool> seen(graph.verticesSize(), false);
+    seen[d] = true;
+    for (NFA::VertexDescriptor v = d;
+         !graph[v].IsMatch && graph.outDegree(v) == 1; )
+    {
+      v = graph.outVertex(v, 0);
+      if (seen[v] || !singleByte(graph, v, b)) {
+        break;
+      }
+      seen[v] = true;
+      cand.Bytes.push_back(b);
+    }
+
+    if (found && cand.Bytes.size() < factor.Bytes.size()) {
+      continue;
+    }
+
+    leadOf(graph, d, cand);
+
+    if (!found || cand.Bytes.size() > factor.Bytes.size() ||
+        cand.MaxLead < factor.MaxLead)
+    {
+      factor = cand;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
 std::vector<std::vector<NFA::VertexDescriptor>> pivotStates(NFA::VertexDescriptor source, const NFA& graph) {
   std::vector<std::vector<NFA::VertexDescriptor>> ret(256);
   ByteSet permitted;
@@ -123,6 +371,56 @@ std::vector<std::vector<NFA::VertexDescriptor>> pivotStates(NFA::VertexDescripto
   return ret;
 }
 
+std::vector<std::vector<NFA::VertexDescriptor>> pivotClasses(NFA::VertexDescriptor source, const NFA& graph, const ByteClasses& classes) {
+  std::vector<std::vector<NFA::VertexDescriptor>> tbl(pivotStates(source, graph)),
+                                                  ret(classes.Num);
+
+  // every byte in a class has the same targets
+  for (uint32_t i = 0; i < 256; ++i) {
+    std::vector<NFA::VertexDescriptor>& c = ret[classes[i]];
+    if (c.empty()) {
+      c.swap(tbl[i]);
+    }
+  }
+  return ret;
+}
+
+ByteClasses byteClasses(const NFA& graph) {
+  ByteClasses ret;
+  ret.Map.fill(0);
+  ret.Num = 1;
+
+  std::unordered_set<const Transition*> seen;
+  ByteSet bytes;
+  std::array<uint32_t, 512> ids;
+
+  // split each class by each distinct transition in turn, into the bytes
+  // it allows and those it doesn't; numbering the new classes as they are
+  // met keeps them in order of their least byte
+  for (NFA::VertexDescriptor v = 1; v < graph.verticesSize() && ret.Num < 256; ++v) {
+    const Transition* t = graph[v].Trans;
+    if (!seen.insert(t).second) {
+      continue;
+    }
+
+    bytes.reset();
+    t->getBytes(bytes);
+
+    ids.fill(256);
+    uint32_t num = 0;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t& id = ids[2*ret.Map[i] + bytes[i]];
+      if (id == 256) {
+        id = num++;
+      }
+      ret.Map[i] = id;
+    }
+    ret.Num = num;
+  }
+
+  return ret;
+}
+
 uint32_t maxOutbound(const std::vector<std::vector<NFA::VertexDescriptor>>& tranTable) {
   return std::max_element(tranTable.begin(), tranTable.end(),
     [](const std::vector<NFA::VertexDescriptor>& l,
@@ -16,8 +16,13 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "lightgrep/api.h"
+
 #include "byteset.h"
 #include "container_out.h"
+#include "jitvm.h"
+#include "lazydfavm.h"
+#include "literalvm.h"
 #include "vm.h"
 #include "program.h"
 
@@ -25,9 +30,26 @@
 #include <cctype>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+
+//
+// With LBT_COMPUTED_GOTO, _execute and _executeEpsilon dispatch through
+// tables of label addresses (a GNU extension) instead of a switch, and
+// each epsilon handler jumps straight to the handler for the thread's
+// next instruction. The switch is still used with other compilers, and
+// when tracing, since the trace output is per instruction.
+//
+#if defined(LBT_COMPUTED_GOTO) && defined(__GNUC__) && !defined(LBT_TRACE_ENABLED)
+  #define LBT_VM_GOTO
+  #pragma GCC diagnostic ignored "-Wpedantic"
+
+  #define VM_TARGET(op) op##_L:
+#else
+  #define VM_TARGET(op)
+#endif
 
 std::ostream& operator<<(std::ostream& out, const Thread& t) {
-  out << "{ \"PC\":" << std::hex << t.PC
+  out << "{ \"PC\":" << t.PC
       << ", \"Label\":" << std::dec << t.Label
       #ifdef LBT_TRACE_ENABLED
       << ", \"Id\":" << t.Id
@@ -81,7 +103,7 @@ void Vm::post_run_thread_json(std::ostream& out, uint64_t offset,
                               const Thread& t, const Instruction* const base) {
   if (BeginDebug <= offset && offset < EndDebug) {
     byte state = Thread::POSTRUN;
-    if (!t.PC)  {
+    if (t.PC == Thread::DEAD)  {
       state |= Thread::DIED;
     }
 
@@ -104,31 +126,58 @@ void Vm::thread_json(std::ostream& out, const Thread& t,
 
 void Thread::output_json(std::ostream& out, const Instruction* const base, byte state) const {
   out << "{ \"Id\":" << Id
-      << ", \"PC\":" << (PC ? PC - base : -1)
+      << ", \"PC\":" << (PC != DEAD ? int64_t(PC) : -1)
       << ", \"Label\":" << Label
       << ", \"Start\":" << Start
       << ", \"End\":" << End
       << ", \"state\":" << (uint32_t) state
-      << ", \"op\":" << (PC ? PC->OpCode : 0)
+      << ", \"op\":" << (PC != DEAD ? base[PC].OpCode : 0)
       << " }";
 }
 #endif
 
 std::shared_ptr<VmInterface> VmInterface::create(ProgramPtr prog) {
+  #ifndef LBT_TRACE_ENABLED
+  if (prog->Literals) {
+    return std::shared_ptr<VmInterface>(new LiteralVm(prog));
+  }
+  #endif
   return std::shared_ptr<VmInterface>(new Vm(prog));
 }
 
+std::shared_ptr<VmInterface> VmInterface::create(ProgramPtr prog, uint32_t engine, uint64_t dfaCacheSize) {
+  #ifndef LBT_TRACE_ENABLED
+  if (engine == LG_ENGINE_LAZY_DFA) {
+    return std::shared_ptr<VmInterface>(new LazyDfaVm(
+      prog, dfaCacheSize ? dfaCacheSize : LazyDfaVm::DEFAULT_CACHE_SIZE
+    ));
+  }
+  else if (engine == LG_ENGINE_JIT && JitVm::supported()) {
+    return std::shared_ptr<VmInterface>(new JitVm(prog));
+  }
+  #endif
+  return create(prog);
+}
+
 Vm::Vm(ProgramPtr prog):
   #ifdef LBT_TRACE_ENABLED
   BeginDebug(Thread::NONE), EndDebug(Thread::NONE), NextId(0),
   #endif
   Prog(prog),
-  ProgEnd(&(*prog)[prog->size() - 2]), // not end, but penultimate, guaranteed to be a halt; threads die just short of the finish
-  First(), Active(1, &(*prog)[0]), Next(),
+  ProgEnd(prog->size() - 2), // not end, but penultimate, guaranteed to be a halt; threads die just short of the finish
+  Classes(prog->Classes.Map.data()),
+  Skip(prog->Filter),
+  FactorFilter(prog->Factors ? prog->Factors->pairs() : std::bitset<256*256>()),
+  FactorSkip(FactorFilter),
+  First(), Active(1, Thread(0)), Next(),
   CheckLabels(prog->MaxCheck+1),
   LiveNoLabel(false), Live(prog->MaxLabel+1),
   MatchEnds(prog->MaxLabel+1), MatchEndsMax(0),
-  CurHitFn(nullptr), UserData(nullptr)
+  Matched(prog->MaxLabel+1),
+  CurHitFn(nullptr), UserData(nullptr),
+  BufEnd(nullptr),
+  Native(nullptr),
+  Hits(prog->MaxLabel+1)
 {
 // FIXME: should do these checks inside SparseSet::resize()?
   if (Live.size() > Live.max_size()) {
@@ -161,7 +210,61 @@ Vm::Vm(ProgramPtr prog):
   reset();
 }
 
+Vm::Vm(const Vm& other):
+  #ifdef LBT_TRACE_ENABLED
+  BeginDebug(other.BeginDebug), EndDebug(other.EndDebug), NextId(0),
+  #endif
+  Prog(other.Prog),
+  ProgEnd(other.ProgEnd),
+  Classes(other.Classes),
+  Skip(other.Skip),
+  FactorFilter(other.FactorFilter),
+  FactorSkip(other.FactorSkip, FactorFilter),
+  First(other.First), Active(), Next(),
+  CheckLabels(Prog->MaxCheck+1),
+  LiveNoLabel(false), Live(Prog->MaxLabel+1),
+  MatchEnds(Prog->MaxLabel+1), MatchEndsMax(0),
+  Matched(Prog->MaxLabel+1),
+  CurHitFn(nullptr), UserData(nullptr),
+  BufEnd(nullptr),
+  Native(other.Native),
+  Hits(Prog->MaxLabel+1),
+  Mask(other.Mask),
+  Unmasked(other.Unmasked)
+{
+  // First already has the epsilon closure, and the mask applied
+  Hits.limit(other.Hits);
+
+  if (Mask) {
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+    }
+  }
+
+  reset();
+}
+
+std::shared_ptr<VmInterface> Vm::clone() const {
+  return std::shared_ptr<VmInterface>(new Vm(*this));
+}
+
 void Vm::reset() {
+  restart();
+
+  for (const uint32_t label : Matched) {
+    MatchEnds[label] = 0;
+  }
+  Matched.clear();
+  MatchEndsMax = 0;
+
+  Hits.reset();
+
+  #ifdef LBT_TRACE_ENABLED
+  NextId = 1;
+  #endif
+}
+
+void Vm::restart() {
   Active.clear();
   Next.clear();
 
@@ -170,14 +273,103 @@ void Vm::reset() {
   LiveNoLabel = false;
   Live.clear();
 
-  MatchEnds.assign(MatchEnds.size(), 0);
-  MatchEndsMax = 0;
-
   CurHitFn = nullptr;
+}
 
-  #ifdef LBT_TRACE_ENABLED
-  NextId = 1;
-  #endif
+bool Vm::idle() const {
+  return Active.empty();
+}
+
+void Vm::setMask(const std::shared_ptr<const LabelMask>& mask) {
+  reset();
+
+  if (Mask) {
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = 0;
+    }
+  }
+  else {
+    Unmasked = First;
+  }
+
+  Mask = mask;
+
+  First.clear();
+  for (const Thread& t : Unmasked) {
+    if (!Mask || Mask->live(t.PC)) {
+      First.push_back(t);
+    }
+  }
+
+  if (Mask) {
+    // as for a label with all its hits, but these are not in Matched,
+    // so reset() leaves them be
+    for (const uint32_t label : Mask->disabled()) {
+      MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+    }
+  }
+}
+
+void Vm::save(std::vector<char>& buf) const {
+  StateWriter out(buf);
+  out.header(THREAD_STATE, *Prog);
+  _save(out);
+}
+
+void Vm::restore(const char* beg, const char* end) {
+  reset();
+
+  try {
+    StateReader in(beg, end);
+    in.header(THREAD_STATE, *Prog);
+    _restore(in);
+    in.finish();
+  }
+  catch (...) {
+    reset();
+    throw;
+  }
+}
+
+void Vm::_save(StateWriter& out) const {
+  // between calls, the threads carried forward are all in Active
+  out.put(static_cast<uint32_t>(Active.size()));
+  for (const Thread& t : Active) {
+    out.put(t.PC);
+    out.put(t.Label);
+    out.put(t.Start);
+    out.put(static_cast<uint64_t>(t.End) | (static_cast<uint64_t>(t.Lead) << 63));
+  }
+
+  out.put(MatchEndsMax);
+  out.matchEnds(MatchEnds, Matched);
+  Hits.save(out);
+}
+
+void Vm::_restore(StateReader& in) {
+  const uint32_t n = in.get<uint32_t>();
+  for (uint32_t i = 0; i < n; ++i) {
+    Thread t;
+    t.PC = in.get<uint32_t>();
+    t.Label = in.get<uint32_t>();
+    t.Start = in.get<uint64_t>();
+
+    const uint64_t end = in.get<uint64_t>();
+    t.End = end & 0x7FFFFFFFFFFFFFFF;
+    t.Lead = end >> 63;
+
+    if (t.PC >= Prog->size() ||
+        (t.Label != Thread::NOLABEL && t.Label > Prog->MaxLabel))
+    {
+      StateReader::fail();
+    }
+
+    Active.push_back(t);
+  }
+
+  MatchEndsMax = in.get<uint64_t>();
+  in.matchEnds(MatchEnds, Matched);
+  Hits.restore(in);
 }
 
 inline void Vm::_markLive(const uint32_t label) {
@@ -189,35 +381,109 @@ inline void Vm::_markLive(const uint32_t label) {
   }
 }
 
-inline bool Vm::_execute(const Instruction* const base, ThreadList::iterator t, const byte* const cur) const {
-  const Instruction& instr = *t->PC;
+inline void Vm::_setMatchEnd(const uint32_t label, const uint64_t end) {
+  // match ends are never zero, so the label is new if its end is
+  if (!MatchEnds[label]) {
+    Matched.insert(label);
+  }
+  MatchEnds[label] = end;
+}
+
+// not inline, as inlining this into the FINISH_OP handler slows down
+// searches with no limits by several percent
+void Vm::_reportLimitedHit(const uint64_t start, const uint64_t end, const uint32_t label) {
+  if (Hits.stopped()) {
+    return;
+  }
+
+  if (Hits.count(label)) {
+    // no match can start past the end of time, so the overlap checks
+    // kill the label's threads; MatchEndsMax is left alone, as it bounds
+    // only where unlabeled threads may start
+    MatchEnds[label] = std::numeric_limits<uint64_t>::max();
+  }
+
+  Hits.report(SearchHit(start, end, label), CurHitFn, UserData);
+}
+
+inline bool Vm::_execute(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls) const {
+  const Instruction& instr = base[t->PC];
+
+  #ifdef LBT_VM_GOTO
+  // indexed by OpCode; epsilon instructions die, as in the switch
+  static const void* const targets[] = {
+    &&JUMP_TABLE_RANGE_OP_L, &&BYTE_OP_L, &&BIT_VECTOR_OP_L, &&EITHER_OP_L,
+    &&RANGE_OP_L, &&ANY_OP_L, &&FINISH_OP_L, &&DIE_L, &&DIE_L, &&DIE_L,
+    &&DIE_L, &&DIE_L, &&DIE_L, &&DIE_L, &&JUMP_TABLE_SPARSE_OP_L,
+    &&JUMP_TABLE_BITMAP_OP_L, &&LITERAL_OP_L
+  };
+  static_assert(sizeof(targets)/sizeof(targets[0]) == LITERAL_OP + 1, "one target per opcode");
+
+  goto *targets[instr.OpCode];
+  #endif
 
   switch (instr.OpCode) {
   case JUMP_TABLE_RANGE_OP:
-    if (instr.Op.T2.First <= *cur && *cur <= instr.Op.T2.Last) {
-      const uint32_t addr = *reinterpret_cast<const uint32_t* const>(t->PC + 1 + (*cur - instr.Op.T2.First));
+  VM_TARGET(JUMP_TABLE_RANGE_OP)
+    if (instr.Op.T2.First <= cls && cls <= instr.Op.T2.Last) {
+      const uint32_t addr = *reinterpret_cast<const uint32_t* const>(&instr + 1 + (cls - instr.Op.T2.First));
+      if (addr) {
+        t->jump(addr);
+        return true;
+      }
+    }
+    break;
+
+  case JUMP_TABLE_SPARSE_OP:
+  VM_TARGET(JUMP_TABLE_SPARSE_OP)
+  case JUMP_TABLE_BITMAP_OP:
+  VM_TARGET(JUMP_TABLE_BITMAP_OP)
+    {
+      const uint32_t addr = jumpTableTarget(instr, cls);
       if (addr) {
-        t->jump(base, addr);
+        t->jump(addr);
         return true;
       }
     }
     break;
 
   case BYTE_OP:
+  VM_TARGET(BYTE_OP)
     if ((*cur == instr.Op.T1.Byte) ^ (instr.Op.T1.Flags & Instruction::NEGATE)) {
       t->advance(InstructionSize<BYTE_OP>::VAL);
       return true;
     }
     break;
 
+  case LITERAL_OP:
+  VM_TARGET(LITERAL_OP)
+    if (*cur == instr.Op.T4.Byte) {
+      // the rest of the literal is in the byte instructions after this
+      // one, with nothing between them for a thread to do but match, so
+      // a thread which won't match as much as the buffer holds dies now
+      // rather than being carried along until it fails
+      const uint32_t len = std::min<uint64_t>(instr.Op.T4.Length, BufEnd ? BufEnd - cur : 1);
+      for (uint32_t i = 1; i < len; ++i) {
+        if (cur[i] != (&instr)[i].Op.T1.Byte) {
+          return false;
+        }
+      }
+
+      t->advance(InstructionSize<LITERAL_OP>::VAL);
+      return true;
+    }
+    break;
+
   case BIT_VECTOR_OP:
-    if ((*reinterpret_cast<const ByteSet* const>(t->PC + 1))[*cur]) {
-      t->advance(InstructionSize<BIT_VECTOR_OP>::VAL);
+  VM_TARGET(BIT_VECTOR_OP)
+    if ((reinterpret_cast<const uint32_t* const>(&instr + 1)[cls >> 5] >> (cls & 31)) & 1) {
+      t->advance(instr.wordSize());
       return true;
     }
     break;
 
   case EITHER_OP:
+  VM_TARGET(EITHER_OP)
     if ((*cur == instr.Op.T2.First || *cur == instr.Op.T2.Last) ^ (instr.Op.T2.Flags & Instruction::NEGATE)) {
       t->advance(InstructionSize<EITHER_OP>::VAL);
       return true;
@@ -225,6 +491,7 @@ inline bool Vm::_execute(const Instruction* const base, ThreadList::iterator t,
     break;
 
   case RANGE_OP:
+  VM_TARGET(RANGE_OP)
     if ((instr.Op.T2.First <= *cur && *cur <= instr.Op.T2.Last) ^ (instr.Op.T2.Flags & Instruction::NEGATE)) {
       t->advance(InstructionSize<RANGE_OP>::VAL);
       return true;
@@ -232,14 +499,17 @@ inline bool Vm::_execute(const Instruction* const base, ThreadList::iterator t,
     break;
 
   case ANY_OP:
+  VM_TARGET(ANY_OP)
     t->advance(InstructionSize<ANY_OP>::VAL);
     return true;
 
   case FINISH_OP:
+  VM_TARGET(FINISH_OP)
     return true;
   }
 
   // Die.
+  VM_TARGET(DIE)
   return false;
 }
 
@@ -257,12 +527,36 @@ inline bool Vm::_liveCheck(const uint64_t start, const uint32_t label) const {
 }
 
 // while base is always == &Program[0], we pass it in because it then should get inlined away
-template <uint32_t X>
+// with Chain, the handlers go on to the next instruction themselves
+template <uint32_t X, bool Chain>
 inline bool Vm::_executeEpsilon(const Instruction* const base, ThreadList::iterator t, const uint64_t offset) {
-  const Instruction& instr = *t->PC;
+  const Instruction* instr = base + t->PC;
+
+  #ifdef LBT_VM_GOTO
+  // indexed by OpCode; consuming instructions wait for the next byte
+  static const void* const targets[] = {
+    &&WAIT_L, &&WAIT_L, &&WAIT_L, &&WAIT_L, &&WAIT_L, &&WAIT_L,
+    &&FINISH_OP_L, &&FORK_OP_L, &&JUMP_OP_L, &&CHECK_HALT_OP_L,
+    &&LABEL_OP_L, &&MATCH_OP_L, &&HALT_OP_L, &&WAIT_L, &&WAIT_L, &&WAIT_L,
+    &&WAIT_L
+  };
+  static_assert(sizeof(targets)/sizeof(targets[0]) == LITERAL_OP + 1, "one target per opcode");
+
+  #define EP_NEXT() \
+    if (Chain) { \
+      instr = base + t->PC; \
+      goto *targets[instr->OpCode]; \
+    } \
+    return true
+
+  goto *targets[instr->OpCode];
+  #else
+  #define EP_NEXT() return true
+  #endif
 
-  switch (instr.OpCode) {
+  switch (instr->OpCode) {
   case FINISH_OP:
+  VM_TARGET(FINISH_OP)
     {
       const uint32_t tLabel = t->Label;
       const uint64_t tStart = t->Start;
@@ -294,25 +588,29 @@ inline bool Vm::_executeEpsilon(const Instruction* const base, ThreadList::itera
 
       if (!LiveNoLabel && !Live.find(tLabel)) {
         if (tStart >= MatchEnds[tLabel]) {
-          MatchEnds[tLabel] = tEnd + 1;
+          _setMatchEnd(tLabel, tEnd + 1);
 
           if (tEnd + 1 > MatchEndsMax) {
             MatchEndsMax = tEnd + 1;
           }
 
-          if (CurHitFn) {
+          if (Hits.limited()) {
+            _reportLimitedHit(tStart, tEnd + 1, tLabel);
+          }
+          else if (CurHitFn) {
             const SearchHit hit(tStart, tEnd + 1, tLabel);
             (*CurHitFn)(UserData, &hit);
           }
         }
 
-        t->PC = 0;
+        t->PC = Thread::DEAD;
       }
 
       return false;
     }
 
   case FORK_OP:
+  VM_TARGET(FORK_OP)
     {
       Thread f = *t;
       t->advance(InstructionSize<FORK_OP>::VAL);
@@ -334,58 +632,67 @@ inline bool Vm::_executeEpsilon(const Instruction* const base, ThreadList::itera
     }
 
   case JUMP_OP:
-    t->jump(base, *reinterpret_cast<const uint32_t* const>(t->PC+1));
-    return true;
+  VM_TARGET(JUMP_OP)
+    t->jump(*reinterpret_cast<const uint32_t* const>(instr + 1));
+    EP_NEXT();
 
   case CHECK_HALT_OP:
+  VM_TARGET(CHECK_HALT_OP)
     {
-      if (CheckLabels.find(instr.Op.Offset)) {
+      if (CheckLabels.find(instr->Op.Offset)) {
         // another thread has the lock, we die
-        t->PC = 0;
+        t->PC = Thread::DEAD;
         return false;
       }
       else if (!_liveCheck(t->Start, t->Label)) {
         // nothing blocks us, we take the lock
-        CheckLabels.insert(instr.Op.Offset);
+        CheckLabels.insert(instr->Op.Offset);
       }
 
       t->advance(InstructionSize<CHECK_HALT_OP>::VAL);
-      return true;
+      EP_NEXT();
     }
 
   case LABEL_OP:
+  VM_TARGET(LABEL_OP)
     {
-      const uint32_t label = instr.Op.Offset;
+      const uint32_t label = instr->Op.Offset;
       if (t->Start >= MatchEnds[label]) {
         t->Label = label;
         t->advance(InstructionSize<LABEL_OP>::VAL);
-        return true;
+        EP_NEXT();
       }
       else {
-        t->PC = 0;
+        t->PC = Thread::DEAD;
         return false;
       }
     }
 
   case MATCH_OP:
+  VM_TARGET(MATCH_OP)
     t->End = offset;
     t->advance(InstructionSize<MATCH_OP>::VAL);
     t->Lead = !LiveNoLabel && !Live.find(t->Label);
-    return true;
+    EP_NEXT();
 
   case HALT_OP:
+  VM_TARGET(HALT_OP)
     // die, motherfucker, die
-    t->PC = 0;
+    t->PC = Thread::DEAD;
     return false;
   }
 
+  VM_TARGET(WAIT)
   return false;
+
+  #undef EP_NEXT
 }
 
-inline void Vm::_executeThread(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const uint64_t offset) {
+template <bool Jit>
+inline void Vm::_executeThread(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls, const uint64_t offset) {
   #ifdef LBT_TRACE_ENABLED
   pre_run_thread_json(std::clog, offset, *t, base);
-  const bool alive = _execute(base, t, cur);
+  const bool alive = _execute(base, t, cur, cls);
   post_run_thread_json(std::clog, offset, *t, base);
 
   if (alive && _executeEpSequence<10>(base, t, offset)) {
@@ -393,7 +700,24 @@ inline void Vm::_executeThread(const Instruction* const base, ThreadList::iterat
     Next.push_back(*t);
   }
   #else
-  if (_execute(base, t, cur) && _executeEpSequence<10>(base, t, offset)) {
+  if (Jit) {
+    const uint32_t pc = Native[t->PC](*cur);
+    if (pc == Thread::DEAD) {
+      return;
+    }
+
+    t->PC = pc & ~EPSILON;
+
+    // at a consuming instruction, the epsilon sequence would only check
+    // whether the thread overlaps an emitted match
+    if (pc & EPSILON ? _executeEpSequence<10>(base, t, offset) :
+        t->Label == Thread::NOLABEL || t->Start >= MatchEnds[t->Label])
+    {
+      _markLive(t->Label);
+      Next.push_back(*t);
+    }
+  }
+  else if (_execute(base, t, cur, cls) && _executeEpSequence<10>(base, t, offset)) {
     _markLive(t->Label);
     Next.push_back(*t);
   }
@@ -413,7 +737,7 @@ inline bool Vm::_executeEpSequence(const Instruction* const base, ThreadList::it
   do {
     const uint64_t id = t->Id; // t can change on a fork, we want the original
     pre_run_thread_json(std::clog, offset, *t, base);
-    ex = _executeEpsilon<X>(base, t, offset);
+    ex = _executeEpsilon<X, false>(base, t, offset);
 //std::cerr << "\nNext.size() == " << Next.size() << std::endl;
 
     if (t->Id == id) {
@@ -428,13 +752,14 @@ inline bool Vm::_executeEpSequence(const Instruction* const base, ThreadList::it
 */
   } while (ex);
   #else
-  while (_executeEpsilon<X>(base, t, offset)) ;
+  while (_executeEpsilon<X, true>(base, t, offset)) ;
   #endif
 
-  return t->PC;
+  return t->PC != Thread::DEAD;
 }
 
-inline void Vm::_executeNewThreads(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const uint64_t offset) {
+template <bool Jit>
+inline void Vm::_executeNewThreads(const Instruction* const base, ThreadList::iterator t, const byte* const cur, const byte cls, const uint64_t offset) {
   const size_t oldsize = Active.size();
 
   for (t = First.begin(); t != First.end(); ++t) {
@@ -452,39 +777,46 @@ inline void Vm::_executeNewThreads(const Instruction* const base, ThreadList::it
   }
 
   for (t = Active.begin() + oldsize; t != Active.end(); ++t) {
-    _executeThread(base, t, cur, offset);
+    _executeThread<Jit>(base, t, cur, cls, offset);
     // ++count;
   }
 }
 
+template <bool Jit>
 inline void Vm::_executeFrame(const std::bitset<256*256>& filter, ThreadList::iterator t, const Instruction* const base, const byte* const cur, const uint64_t offset) {
+  // the class of the byte, for every jump table and bit vector
+  const byte cls = Classes[*cur];
+
   // run old threads at this offset
   // uint32_t count = 0;
 
   for ( ; t != Active.end(); ++t) {
-    _executeThread(base, t, cur, offset);
+    _executeThread<Jit>(base, t, cur, cls, offset);
     // ++count;
   }
 
   // create new threads at this offset
   if (filter[*reinterpret_cast<const uint16_t* const>(cur+Prog->FilterOff)]) {
-    _executeNewThreads(base, t, cur, offset);
+    _executeNewThreads<Jit>(base, t, cur, cls, offset);
   }
   // ThreadCountHist.resize(count + 1, 0);
   // ++ThreadCountHist[count];
 }
 
+template <bool Jit>
 inline void Vm::_executeFrame(ThreadList::iterator t, const Instruction* const base, const byte* const cur, const uint64_t offset) {
+  const byte cls = Classes[*cur];
+
   // run old threads at this offset
   // uint32_t count = 0;
 
   for ( ; t != Active.end(); ++t) {
-    _executeThread(base, t, cur, offset);
+    _executeThread<Jit>(base, t, cur, cls, offset);
     // ++count;
   }
 
   // create new threads at this offset
-  _executeNewThreads(base, t, cur, offset);
+  _executeNewThreads<Jit>(base, t, cur, cls, offset);
 
   // ThreadCountHist.resize(count + 1, 0);
   // ++ThreadCountHist[count];
@@ -502,13 +834,14 @@ inline void Vm::_cleanup() {
 
 void Vm::cleanup() { _cleanup(); }
 
-bool Vm::execute(Thread* t, const byte* const cur) {
+bool Vm::execute(Thread* t, const byte* const cur, const byte* const end) {
   Active.push_back(*t);
-  return execute(Active.end()-1, cur);
+  return execute(Active.end()-1, cur, end);
 }
 
-bool Vm::execute(ThreadList::iterator t, const byte* const cur) {
-  return _execute(&(*Prog)[0], t, cur);
+bool Vm::execute(ThreadList::iterator t, const byte* const cur, const byte* const end) {
+  BufEnd = end;
+  return _execute(&(*Prog)[0], t, cur, Classes[*cur]);
 }
 
 bool Vm::executeEpsilon(Thread* t, uint64_t offset) {
@@ -517,19 +850,21 @@ bool Vm::executeEpsilon(Thread* t, uint64_t offset) {
 }
 
 bool Vm::executeEpsilon(ThreadList::iterator t, uint64_t offset) {
-  return _executeEpsilon<0>(&(*Prog)[0], t, offset);
+  return _executeEpsilon<0, false>(&(*Prog)[0], t, offset);
 }
 
 void Vm::executeFrame(const byte* const cur, uint64_t offset, HitCallback hitFn, void* userData) {
   CurHitFn = hitFn;
   UserData = userData;
+  BufEnd = nullptr;
   ThreadList::iterator t = Active.begin();
-  _executeFrame(t, &(*Prog)[0], cur, offset);
+  _executeFrame<false>(t, &(*Prog)[0], cur, offset);
 }
 
 void Vm::startsWith(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
   CurHitFn = hitFn;
   UserData = userData;
+  BufEnd = end;
   const Instruction* const base = &(*Prog)[0];
   uint64_t offset = startOffset;
 
@@ -543,13 +878,14 @@ void Vm::startsWith(const byte* const beg, const byte* const end, const uint64_t
     }
 
     for (const byte* cur = beg; cur < end; ++cur, ++offset) {
+      const byte cls = Classes[*cur];
       for (ThreadList::iterator t(Active.begin()); t != Active.end(); ++t) {
-        _executeThread(base, t, cur, offset);
+        _executeThread<false>(base, t, cur, cls, offset);
       }
 
       _cleanup();
 
-      if (Active.empty()) {
+      if (Active.empty() || Hits.stopped()) {
         // early exit if threads die out
         break;
       }
@@ -560,10 +896,22 @@ void Vm::startsWith(const byte* const beg, const byte* const end, const uint64_t
   }
 }
 
+uint64_t Vm::_halt(const uint64_t end, const uint64_t next) {
+  if (Hits.stopped()) {
+    // nothing more will be reported, so drop the threads
+    restart();
+    return end;
+  }
+
+  // hits are held back, so pause, to carry on from next
+  Hits.pauseAt(next);
+  return _startOfLeftmostLiveThread(next);
+}
+
 uint64_t Vm::_startOfLeftmostLiveThread(const uint64_t offset) const {
   const ThreadList::const_iterator e(Active.end());
   for (ThreadList::const_iterator t(Active.begin()); t != e; ++t) {
-    const unsigned char op = t->PC->OpCode;
+    const unsigned char op = (*Prog)[t->PC].OpCode;
     if (op == HALT_OP || op == FINISH_OP) {
       continue;
     }
@@ -574,9 +922,69 @@ uint64_t Vm::_startOfLeftmostLiveThread(const uint64_t offset) const {
   return offset;
 }
 
+//
+// Every match contains one of the required factors, preceded by at most
+// FactorMaxLead bytes, all from FactorLead. So a match starting at or
+// after cur starts no earlier than the run of lead bytes before the
+// first factor occurrence which starts at or after cur. We can't tell
+// which factor that is from where the automaton finds it, only that it
+// started within FactorMaxLen bytes of its end, which gives bound.
+// Occurrences starting later end no earlier, so bound holds until the
+// search passes it.
+//
+const byte* Vm::_nextStart(const byte* const cur, const byte* const end, const byte*& bound) const {
+  if (!bound || cur > bound) {
+    const LiteralMatcher& factors = *Prog->Factors;
+    const uint32_t maxLen = Prog->FactorMaxLen;
+
+    // a factor cut off at the end could start this far back
+    bound = end - cur > maxLen ? end + 1 - maxLen : cur;
+
+    uint32_t s = 0;
+    for (const byte* i = cur; i < end; ++i) {
+      if (!s) {
+        i = FactorSkip.next(i, end - 1);
+      }
+
+      s = factors.next(s, *i);
+      if (factors.state(s).Dict != LiteralMatcher::NONE) {
+        bound = i + 1 - cur > maxLen ? i + 1 - maxLen : cur;
+        break;
+      }
+    }
+  }
+
+  const uint32_t maxLead = Prog->FactorMaxLead;
+  const byte* const lo = static_cast<uint64_t>(bound - cur) > maxLead ?
+                         bound - maxLead : cur;
+
+  const std::bitset<256>& lead = Prog->FactorLead;
+  const byte* p = bound;
+  while (p > lo && lead[p[-1]]) {
+    --p;
+  }
+  return p;
+}
+
 uint64_t Vm::search(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
   CurHitFn = hitFn;
   UserData = userData;
+  BufEnd = end;
+
+  if (Hits.stopped()) {
+    return startOffset + (end - beg);
+  }
+
+  #ifdef LBT_TRACE_ENABLED
+  return _search<false>(beg, end, startOffset);
+  #else
+  return Native ? _search<true>(beg, end, startOffset) :
+                  _search<false>(beg, end, startOffset);
+  #endif
+}
+
+template <bool Jit>
+uint64_t Vm::_search(const byte* const beg, const byte* const end, const uint64_t startOffset) {
   const Instruction* const base = &(*Prog)[0];
 
   const std::bitset<256*256>& filter = Prog->Filter;
@@ -585,18 +993,50 @@ uint64_t Vm::search(const byte* const beg, const byte* const end, const uint64_t
   uint64_t offset = startOffset;
 
   const byte* cur = beg;
+  const byte* factorBound = nullptr;
+
   for ( ; cur < filterEnd; ++cur, ++offset) {
+    #ifndef LBT_TRACE_ENABLED
+    if (Active.empty()) {
+      if (Prog->Factors) {
+        // no match can start before the run of lead bytes preceding
+        // the next required factor
+        const byte* const next = _nextStart(cur, end, factorBound);
+        offset += next - cur;
+        cur = next;
+
+        if (cur >= filterEnd) {
+          break;
+        }
+      }
+
+      // nothing is live, so every frame failing the filter is a no-op;
+      // jump straight to the next one which passes
+      const byte* const next = Skip.next(cur + Prog->FilterOff, filterEnd + Prog->FilterOff) - Prog->FilterOff;
+      offset += next - cur;
+      cur = next;
+
+      if (cur == filterEnd) {
+        break;
+      }
+    }
+    #endif
+
     #ifdef LBT_TRACE_ENABLED
     open_frame_json(std::clog, offset, cur);
     #endif
 
-    _executeFrame(filter, Active.begin(), base, cur, offset);
+    _executeFrame<Jit>(filter, Active.begin(), base, cur, offset);
 
     #ifdef LBT_TRACE_ENABLED
     close_frame_json(std::clog, offset);
     #endif
 
     _cleanup();
+
+    if (Hits.halted()) {
+      return _halt(startOffset + (end - beg), offset + 1);
+    }
   }
 
   for ( ; cur < end; ++cur, ++offset) {
@@ -604,13 +1044,17 @@ uint64_t Vm::search(const byte* const beg, const byte* const end, const uint64_t
     open_frame_json(std::clog, offset, cur);
     #endif
 
-    _executeFrame(Active.begin(), base, cur, offset);
+    _executeFrame<Jit>(Active.begin(), base, cur, offset);
 
     #ifdef LBT_TRACE_ENABLED
     close_frame_json(std::clog, offset);
     #endif
 
     _cleanup();
+
+    if (Hits.halted()) {
+      return _halt(startOffset + (end - beg), offset + 1);
+    }
   }
 
   // std::cerr << "Max number of active threads was " << maxActive << ", average was " << total/(end - beg) << std::endl;
@@ -622,6 +1066,7 @@ uint64_t Vm::search(const byte* const beg, const byte* const end, const uint64_t
 uint64_t Vm::searchResolve(const byte* const beg, const byte* const end, const uint64_t startOffset, HitCallback hitFn, void* userData) {
   CurHitFn = hitFn;
   UserData = userData;
+  BufEnd = end;
   const Instruction* const base = &(*Prog)[0];
   uint64_t offset = startOffset;
 
@@ -632,10 +1077,12 @@ uint64_t Vm::searchResolve(const byte* const beg, const byte* const end, const u
     open_frame_json(std::clog, offset, cur);
     #endif
 
+    const byte cls = Classes[*cur];
     hadRealOps = false;
     for (ThreadList::iterator t(Active.begin()); t != Active.end(); ++t) {
-      hadRealOps |= !(t->PC->OpCode == HALT_OP || t->PC->OpCode == FINISH_OP);
-      _executeThread(base, t, cur, offset);
+      const unsigned char op = base[t->PC].OpCode;
+      hadRealOps |= !(op == HALT_OP || op == FINISH_OP);
+      _executeThread<false>(base, t, cur, cls, offset);
     }
 
     #ifdef LBT_TRACE_ENABLED
@@ -655,22 +1102,27 @@ void Vm::closeOut(HitCallback hitFn, void* userData) {
   CurHitFn = hitFn;
   UserData = userData;
 
-  if (!CurHitFn) {
+  if (!CurHitFn && !Hits.limited()) {
     return;
   }
 
   SearchHit hit;
 
   for (ThreadList::const_iterator t(Active.begin()); t != Active.end(); ++t) {
-    if (t->PC->OpCode == FINISH_OP) {
+    if ((*Prog)[t->PC].OpCode == FINISH_OP) {
       // has match
       if (t->Start >= MatchEnds[t->Label]) {
-        MatchEnds[t->Label] = t->End + 1;
+        _setMatchEnd(t->Label, t->End + 1);
 
-        hit.Start = t->Start;
-        hit.End = t->End + 1;
-        hit.KeywordIndex = t->Label;
-        (*CurHitFn)(UserData, &hit);
+        if (Hits.limited()) {
+          _reportLimitedHit(t->Start, t->End + 1, t->Label);
+        }
+        else {
+          hit.Start = t->Start;
+          hit.End = t->End + 1;
+          hit.KeywordIndex = t->Label;
+          (*CurHitFn)(UserData, &hit);
+        }
       }
     }
   }
@@ -16,20 +16,36 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <scope/test.h>
+
 #include "stest.h"
 
+#include "handles.h"
+#include "jitvm.h"
+
 namespace {
+  struct Collector {
+    ProgramHandle* Prog;
+    std::vector<SearchHit>& Hits;
+  };
+
   void collector(void* userData, const LG_SearchHit* const hit) {
-    STest* stest = static_cast<STest*>(userData);
+    Collector* c = static_cast<Collector*>(userData);
 
-    stest->Hits.push_back(*static_cast<const SearchHit* const>(hit));
+    c->Hits.push_back(*static_cast<const SearchHit* const>(hit));
 
     const LG_PatternInfo* info = lg_pattern_info(
-      stest->Prog.get(), hit->KeywordIndex
+      c->Prog, hit->KeywordIndex
     );
 
     // adjust the hit to reflect the user pattern index
-    stest->Hits.back().KeywordIndex = info->UserIndex;
+    c->Hits.back().KeywordIndex = info->UserIndex;
+  }
+
+  // checks that the interpreter found the same hits, from first on
+  void checkSame(const std::vector<SearchHit>& hits, const std::vector<SearchHit>& all, size_t first) {
+    SCOPE_ASSERT_EQUAL(all.size() - first, hits.size());
+    SCOPE_ASSERT(std::equal(hits.begin(), hits.end(), all.begin() + first));
   }
 }
 
@@ -75,12 +91,20 @@ void STest::init(const std::vector<Pattern>& pats) {
   LG_ProgramOptions progOpts{1};
 
   if (lg_compile_program(fsm.get(), Prog.get(), &progOpts)) {
-    LG_ContextOptions ctxOpts;
+    LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
 
     Ctx = std::unique_ptr<ContextHandle,void(*)(ContextHandle*)>(
       lg_create_context(Prog.get(), &ctxOpts),
       lg_destroy_context
     );
+
+    if (JitVm::supported()) {
+      ctxOpts.Engine = LG_ENGINE_JIT;
+      JitCtx = std::unique_ptr<ContextHandle,void(*)(ContextHandle*)>(
+        lg_create_context(Prog.get(), &ctxOpts),
+        lg_destroy_context
+      );
+    }
   }
   else {
     Prog.reset();
@@ -88,12 +112,29 @@ void STest::init(const std::vector<Pattern>& pats) {
 }
 
 void STest::search(const char* begin, const char* end, uint64_t offset) {
-  RetVal = lg_search(Ctx.get(), begin, end, offset, this, collector);
-  lg_closeout_search(Ctx.get(), this, collector);
+  const size_t first = Hits.size();
+
+  Collector c{Prog.get(), Hits};
+  RetVal = lg_search(Ctx.get(), begin, end, offset, &c, collector);
+  lg_closeout_search(Ctx.get(), &c, collector);
+
+  if (JitCtx) {
+    std::vector<SearchHit> jitHits;
+    Collector jc{Prog.get(), jitHits};
+    const uint64_t ret = lg_search(JitCtx.get(), begin, end, offset, &jc, collector);
+    lg_closeout_search(JitCtx.get(), &jc, collector);
+
+    // LiteralVm, used for plain strings, can give a different bound
+    if (dynamic_cast<Vm*>(Ctx->Impl.get())) {
+      SCOPE_ASSERT_EQUAL(RetVal, ret);
+    }
+    checkSame(jitHits, Hits, first);
+  }
 }
 
 void STest::startsWith(const char* begin, const char* end, uint64_t offset) {
-  lg_starts_with(Ctx.get(), begin, end, offset, this, collector);
+  Collector c{Prog.get(), Hits};
+  lg_starts_with(Ctx.get(), begin, end, offset, &c, collector);
 }
 
 bool STest::parsesButNotValid() const {
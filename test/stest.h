@@ -35,26 +35,26 @@ public:
   uint64_t RetVal;
 
   STest(const char* key):
-    Prog(nullptr, nullptr), Ctx(nullptr, nullptr)
+    Prog(nullptr, nullptr), Ctx(nullptr, nullptr), JitCtx(nullptr, nullptr)
   {
     init(make_patterns(std::initializer_list<const char*>{key}));
   }
 
   STest(std::initializer_list<const char*> keys):
-     Prog(nullptr, nullptr), Ctx(nullptr, nullptr)
+     Prog(nullptr, nullptr), Ctx(nullptr, nullptr), JitCtx(nullptr, nullptr)
   {
     init(make_patterns(keys));
   }
 
   template <typename T>
   STest(const T& keys):
-    Prog(nullptr, nullptr), Ctx(nullptr, nullptr)
+    Prog(nullptr, nullptr), Ctx(nullptr, nullptr), JitCtx(nullptr, nullptr)
   {
     init(make_patterns(keys));
   }
 
   STest(const std::vector<Pattern>& patterns):
-    Prog(nullptr, nullptr), Ctx(nullptr, nullptr)
+    Prog(nullptr, nullptr), Ctx(nullptr, nullptr), JitCtx(nullptr, nullptr)
   {
     init(patterns);
   }
@@ -82,4 +82,7 @@ private:
   void init(const std::vector<Pattern>& pats);
 
   std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> Ctx;
+
+  // the same program compiled to native code, checked against Ctx
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> JitCtx;
 };
@@ -21,12 +21,17 @@
 #include "lightgrep/api.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <iostream>
 
 #include "pattern_map.h"
+#include "searchhit.h"
 
 // #include "basic.h"
 
@@ -279,3 +284,683 @@ SCOPE_TEST(testLgWriteProgramLgReadProgram) {
     );
   }
 }
+
+namespace {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> compilePatternList(const char* pats) {
+    const char* defEncs[] = { "ASCII" };
+    const LG_KeyOptions defOpts{0, 0, 0};
+
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      lg_create_program(std::count(pats, pats + std::strlen(pats), '\n')),
+      lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0),
+      lg_destroy_fsm
+    );
+
+    LG_Error* err = nullptr;
+
+    lg_add_pattern_list(
+      fsm.get(), prog.get(), pats, "compilePatternList",
+      defEncs, 1, &defOpts, &err
+    );
+
+    std::unique_ptr<LG_Error,void(*)(LG_Error*)> e{err, lg_free_error};
+    SCOPE_ASSERT(!err);
+
+    LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collectHit(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  // checks lg_search_batch() against searching each buffer separately
+  void checkSearchBatch(const char* pats, uint32_t engine, const std::vector<std::string>& texts) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      compilePatternList(pats)
+    );
+
+    const LG_ContextOptions ctxOpts{0, 0, engine, 0, LG_HITS_ALL, 0};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog.get(), &ctxOpts),
+      lg_destroy_context
+    );
+
+    std::vector<LG_BatchBuffer> bufs;
+    std::vector<std::pair<uint64_t,SearchHit>> exp;
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+      const std::string& t = texts[i];
+      bufs.push_back(LG_BatchBuffer{t.data(), t.size(), 100 + i});
+
+      std::vector<SearchHit> hits;
+      lg_reset_context(ctx.get());
+      lg_search(ctx.get(), t.data(), t.data() + t.size(), 0, &hits, collectHit);
+      lg_closeout_search(ctx.get(), &hits, collectHit);
+
+      for (const SearchHit& h : hits) {
+        exp.emplace_back(100 + i, h);
+      }
+    }
+
+    SCOPE_ASSERT(!exp.empty());
+
+    // start with a tiny array, to make it grow
+    LG_BatchHits hits{
+      static_cast<LG_BatchHit*>(std::malloc(sizeof(LG_BatchHit))), 0, 1
+    };
+    std::unique_ptr<LG_BatchHits,void(*)(LG_BatchHits*)> h{&hits, lg_free_batch_hits};
+
+    for (int round = 1; round <= 2; ++round) {
+      SCOPE_ASSERT_EQUAL(
+        exp.size(),
+        lg_search_batch(ctx.get(), bufs.data(), bufs.size(), &hits)
+      );
+      SCOPE_ASSERT_EQUAL(round*exp.size(), hits.Size);
+      SCOPE_ASSERT(hits.Size <= hits.Capacity);
+
+      // hits from the second call are appended to those from the first
+      for (size_t i = 0; i < exp.size(); ++i) {
+        const LG_BatchHit& act = hits.Hits[(round-1)*exp.size() + i];
+        SCOPE_ASSERT_EQUAL(exp[i].first, act.Id);
+        SCOPE_ASSERT_EQUAL(exp[i].second, *static_cast<const SearchHit*>(&act.Hit));
+      }
+    }
+  }
+
+  // buffers where hits butt against the ends, and where matches would
+  // continue into the next buffer if they were searched as one stream
+  const std::vector<std::string> BATCH_TEXTS{
+    "aab", "", "aa", "bfoo", "b", "xxfooxx", "aaaaab", "bxc", "fo", "o"
+  };
+}
+
+SCOPE_TEST(testLgSearchBatch) {
+  checkSearchBatch("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_THREADS, BATCH_TEXTS);
+}
+
+SCOPE_TEST(testLgSearchBatchLazyDfa) {
+  checkSearchBatch("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_LAZY_DFA, BATCH_TEXTS);
+}
+
+SCOPE_TEST(testLgSearchBatchLiterals) {
+  checkSearchBatch("aa\tASCII\nfoo\tASCII\nab\tASCII\n", LG_ENGINE_THREADS, BATCH_TEXTS);
+}
+
+namespace {
+  std::vector<SearchHit> searchWithLimits(ProgramHandle* prog, uint32_t engine, uint32_t hitMode, uint64_t maxHits, const std::string& text, std::vector<uint64_t>& counts) {
+    const LG_ContextOptions ctxOpts{0, 0, engine, 0, hitMode, maxHits};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog, &ctxOpts),
+      lg_destroy_context
+    );
+
+    // search in two halves, to carry the limits across calls
+    const char* const beg = text.data();
+    const char* const mid = beg + text.size()/2;
+    const char* const end = beg + text.size();
+
+    std::vector<SearchHit> hits;
+    const uint64_t ret = lg_search(ctx.get(), beg, mid, 0, &hits, collectHit);
+    if (hitMode == LG_HITS_FIRST && !hits.empty()) {
+      SCOPE_ASSERT_EQUAL(static_cast<uint64_t>(mid - beg), ret);
+    }
+
+    lg_search(ctx.get(), mid, end, mid - beg, &hits, collectHit);
+    lg_closeout_search(ctx.get(), &hits, collectHit);
+
+    counts.clear();
+    for (uint64_t i = 0; i < 4; ++i) {
+      counts.push_back(lg_hit_count(ctx.get(), i));
+    }
+
+    // a reset clears the counts
+    lg_reset_context(ctx.get());
+    SCOPE_ASSERT_EQUAL(0u, lg_hit_count(ctx.get(), 0));
+    return hits;
+  }
+
+  void checkHitLimits(const char* pats, uint32_t engine) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      compilePatternList(pats)
+    );
+
+    const std::string text("aab foo aaab xx foofoo ab bxc foo aab bzc");
+
+    std::vector<uint64_t> counts, exp(4, 0);
+    const std::vector<SearchHit> all = searchWithLimits(
+      prog.get(), engine, LG_HITS_ALL, 0, text, counts
+    );
+
+    // nothing is counted without limits
+    SCOPE_ASSERT(exp == counts);
+
+    for (const SearchHit& h : all) {
+      ++exp[h.KeywordIndex];
+    }
+    SCOPE_ASSERT(exp[0] > 2 && exp[1] > 2);
+
+    // only the first hit is reported, and the search stops there
+    std::vector<SearchHit> act = searchWithLimits(
+      prog.get(), engine, LG_HITS_FIRST, 0, text, counts
+    );
+    SCOPE_ASSERT_EQUAL(1u, act.size());
+    SCOPE_ASSERT_EQUAL(all.front(), act.front());
+    SCOPE_ASSERT_EQUAL(1u, counts[all.front().KeywordIndex]);
+
+    // hits are counted, but not reported
+    act = searchWithLimits(prog.get(), engine, LG_HITS_COUNT, 0, text, counts);
+    SCOPE_ASSERT(act.empty());
+    SCOPE_ASSERT(exp == counts);
+
+    // each keyword reports only its first two hits
+    act = searchWithLimits(prog.get(), engine, LG_HITS_ALL, 2, text, counts);
+
+    std::vector<SearchHit> capped;
+    std::vector<uint64_t> seen(4, 0);
+    for (const SearchHit& h : all) {
+      if (++seen[h.KeywordIndex] <= 2) {
+        capped.push_back(h);
+      }
+      exp[h.KeywordIndex] = std::min(exp[h.KeywordIndex], uint64_t(2));
+    }
+
+    std::sort(capped.begin(), capped.end());
+    std::sort(act.begin(), act.end());
+    SCOPE_ASSERT(capped == act);
+    SCOPE_ASSERT(exp == counts);
+  }
+}
+
+SCOPE_TEST(testLgHitLimits) {
+  checkHitLimits("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(testLgHitLimitsLazyDfa) {
+  checkHitLimits("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_LAZY_DFA);
+}
+
+SCOPE_TEST(testLgHitLimitsLiterals) {
+  checkHitLimits("ab\tASCII\nfoo\tASCII\nbxc\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(testLgSearchBatchCountsHits) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\n")
+  );
+
+  const LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_COUNT, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &ctxOpts),
+    lg_destroy_context
+  );
+
+  std::vector<LG_BatchBuffer> bufs;
+  for (size_t i = 0; i < BATCH_TEXTS.size(); ++i) {
+    bufs.push_back(LG_BatchBuffer{BATCH_TEXTS[i].data(), BATCH_TEXTS[i].size(), i});
+  }
+
+  LG_BatchHits hits{nullptr, 0, 0};
+  SCOPE_ASSERT_EQUAL(0u, lg_search_batch(ctx.get(), bufs.data(), bufs.size(), &hits));
+  SCOPE_ASSERT_EQUAL(2u, lg_hit_count(ctx.get(), 0));
+  SCOPE_ASSERT_EQUAL(2u, lg_hit_count(ctx.get(), 1));
+  lg_free_batch_hits(&hits);
+}
+
+namespace {
+  std::vector<SearchHit> searchAll(ContextHandle* ctx, const std::string& text) {
+    std::vector<SearchHit> hits;
+    lg_search(ctx, text.data(), text.data() + text.size(), 0, &hits, collectHit);
+    lg_closeout_search(ctx, &hits, collectHit);
+    lg_reset_context(ctx);
+    return hits;
+  }
+
+  void checkCloneContext(const char* pats, uint32_t engine) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      compilePatternList(pats)
+    );
+
+    const std::string text("aab foo abbc ab foo bxc aaab");
+    const uint64_t off[] = {1};
+
+    const LG_ContextOptions ctxOpts{0, 0, engine, 0, LG_HITS_ALL, 2};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog.get(), &ctxOpts),
+      lg_destroy_context
+    );
+    SCOPE_ASSERT(lg_enable_keywords(ctx.get(), off, 1, 0));
+
+    const std::vector<SearchHit> exp = searchAll(ctx.get(), text);
+    SCOPE_ASSERT(!exp.empty());
+
+    // leave ctx mid-search; the clone must not pick up where it is
+    std::vector<SearchHit> hits;
+    lg_search(ctx.get(), text.data(), text.data() + 10, 0, &hits, collectHit);
+
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> clone(
+      lg_clone_context(ctx.get()),
+      lg_destroy_context
+    );
+    SCOPE_ASSERT(clone);
+
+    // the mask and hit limit carry over
+    SCOPE_ASSERT(exp == searchAll(clone.get(), text));
+    SCOPE_ASSERT(exp == searchAll(clone.get(), text));
+
+    // and the original is unaffected
+    lg_reset_context(ctx.get());
+    SCOPE_ASSERT(exp == searchAll(ctx.get(), text));
+  }
+}
+
+SCOPE_TEST(testLgCloneContext) {
+  checkCloneContext("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(testLgCloneContextLazyDfa) {
+  checkCloneContext("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_LAZY_DFA);
+}
+
+SCOPE_TEST(testLgCloneContextJit) {
+  checkCloneContext("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_JIT);
+}
+
+SCOPE_TEST(testLgCloneContextLiterals) {
+  checkCloneContext("ab\tASCII\nfoo\tASCII\nbxc\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(testLgContextPool) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n")
+  );
+
+  const std::string text("aab foo abbc ab foo bxc aaab");
+  const uint64_t off[] = {0};
+
+  const LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> proto(
+    lg_create_context(prog.get(), &ctxOpts),
+    lg_destroy_context
+  );
+  SCOPE_ASSERT(lg_enable_keywords(proto.get(), off, 1, 0));
+
+  const std::vector<SearchHit> exp = searchAll(proto.get(), text);
+
+  std::unique_ptr<ContextPoolHandle,void(*)(ContextPoolHandle*)> pool(
+    lg_create_context_pool(proto.get()),
+    lg_destroy_context_pool
+  );
+  SCOPE_ASSERT(pool);
+
+  // the pool has its own prototype
+  proto.reset();
+
+  LG_HCONTEXT a = lg_acquire_context(pool.get());
+  LG_HCONTEXT b = lg_acquire_context(pool.get());
+  SCOPE_ASSERT(a && b && a != b);
+  SCOPE_ASSERT(exp == searchAll(a, text));
+
+  // released contexts are reused, with their keywords restored
+  SCOPE_ASSERT(lg_enable_keywords(a, nullptr, 0, 1));
+  SCOPE_ASSERT(exp != searchAll(a, text));
+  lg_search(a, text.data(), text.data() + 10, 0, nullptr, nullptr);
+  lg_release_context(pool.get(), a);
+
+  LG_HCONTEXT c = lg_acquire_context(pool.get());
+  SCOPE_ASSERT_EQUAL(a, c);
+  SCOPE_ASSERT(exp == searchAll(c, text));
+
+  lg_release_context(pool.get(), b);
+  lg_release_context(pool.get(), c);
+}
+
+SCOPE_TEST(testLgContextPoolThreads) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n")
+  );
+
+  const std::string text("aab foo abbc ab foo bxc aaab");
+
+  const LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> proto(
+    lg_create_context(prog.get(), &ctxOpts),
+    lg_destroy_context
+  );
+
+  const std::vector<SearchHit> exp = searchAll(proto.get(), text);
+
+  std::unique_ptr<ContextPoolHandle,void(*)(ContextPoolHandle*)> pool(
+    lg_create_context_pool(proto.get()),
+    lg_destroy_context_pool
+  );
+
+  std::vector<int> ok(4, 1);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < ok.size(); ++i) {
+    workers.emplace_back([&, i](){
+      for (int j = 0; j < 100; ++j) {
+        LG_HCONTEXT ctx = lg_acquire_context(pool.get());
+        if (!ctx) {
+          ok[i] = 0;
+          break;
+        }
+
+        if (searchAll(ctx, text) != exp) {
+          ok[i] = 0;
+        }
+        lg_release_context(pool.get(), ctx);
+      }
+    });
+  }
+
+  for (std::thread& t : workers) {
+    t.join();
+  }
+
+  SCOPE_ASSERT(std::all_of(ok.begin(), ok.end(), [](int o){ return o; }));
+}
+
+namespace {
+  std::vector<char> saveContext(ContextHandle* ctx) {
+    std::vector<char> state(lg_save_context(ctx, nullptr, 0));
+    SCOPE_ASSERT(!state.empty());
+    SCOPE_ASSERT_EQUAL(state.size(), lg_save_context(ctx, state.data(), state.size()));
+    return state;
+  }
+
+  void checkSaveRestore(const char* pats, uint32_t engine, uint64_t maxHits) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      compilePatternList(pats)
+    );
+
+    const std::string text("aab foo abbc ab fofoo bxc aaab xaaaaaaab");
+
+    const LG_ContextOptions ctxOpts{0, 0, engine, 0, LG_HITS_ALL, maxHits};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog.get(), &ctxOpts),
+      lg_destroy_context
+    ),
+    other(
+      lg_create_context(prog.get(), &ctxOpts),
+      lg_destroy_context
+    );
+
+    const std::vector<SearchHit> exp = searchAll(ctx.get(), text);
+    SCOPE_ASSERT(!exp.empty());
+
+    for (size_t split = 0; split <= text.size(); ++split) {
+      std::vector<SearchHit> act;
+      lg_search(ctx.get(), text.data(), text.data() + split, 0, &act, collectHit);
+
+      // the search carries on in another context, as if in ctx
+      const std::vector<char> state(saveContext(ctx.get()));
+      lg_reset_context(ctx.get());
+      SCOPE_ASSERT(lg_restore_context(other.get(), state.data(), state.size()));
+
+      lg_search(other.get(), text.data() + split, text.data() + text.size(), split, &act, collectHit);
+      lg_closeout_search(other.get(), &act, collectHit);
+      lg_reset_context(other.get());
+
+      SCOPE_ASSERT(exp == act);
+    }
+  }
+}
+
+SCOPE_TEST(testLgSaveRestoreContext) {
+  checkSaveRestore("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_THREADS, 0);
+}
+
+SCOPE_TEST(testLgSaveRestoreContextLazyDfa) {
+  checkSaveRestore("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_LAZY_DFA, 0);
+}
+
+SCOPE_TEST(testLgSaveRestoreContextJit) {
+  checkSaveRestore("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_JIT, 0);
+}
+
+SCOPE_TEST(testLgSaveRestoreContextLiterals) {
+  checkSaveRestore("aab\tASCII\nfoo\tASCII\nbxc\tASCII\n", LG_ENGINE_THREADS, 0);
+}
+
+SCOPE_TEST(testLgSaveRestoreContextHitCounts) {
+  checkSaveRestore("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\n", LG_ENGINE_THREADS, 2);
+  checkSaveRestore("aab\tASCII\nfoo\tASCII\nbxc\tASCII\n", LG_ENGINE_THREADS, 1);
+}
+
+SCOPE_TEST(testLgSaveRestoreContextMultiplex) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\n")
+  );
+
+  const LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &ctxOpts),
+    lg_destroy_context
+  );
+
+  // two streams, taking turns on one context
+  const std::string s1[] = {"xaa", "aab f", "oo"}, s2[] = {"fo", "oa", "b"};
+  std::vector<char> state1(saveContext(ctx.get())), state2(state1);
+  std::vector<SearchHit> hits1, hits2;
+  uint64_t off1 = 0, off2 = 0;
+
+  for (size_t i = 0; i < 3; ++i) {
+    SCOPE_ASSERT(lg_restore_context(ctx.get(), state1.data(), state1.size()));
+    lg_search(ctx.get(), s1[i].data(), s1[i].data() + s1[i].size(), off1, &hits1, collectHit);
+    off1 += s1[i].size();
+    state1 = saveContext(ctx.get());
+
+    SCOPE_ASSERT(lg_restore_context(ctx.get(), state2.data(), state2.size()));
+    lg_search(ctx.get(), s2[i].data(), s2[i].data() + s2[i].size(), off2, &hits2, collectHit);
+    off2 += s2[i].size();
+    state2 = saveContext(ctx.get());
+  }
+
+  SCOPE_ASSERT(lg_restore_context(ctx.get(), state1.data(), state1.size()));
+  lg_closeout_search(ctx.get(), &hits1, collectHit);
+  SCOPE_ASSERT(lg_restore_context(ctx.get(), state2.data(), state2.size()));
+  lg_closeout_search(ctx.get(), &hits2, collectHit);
+
+  const std::vector<SearchHit> exp1{{1, 6, 0}, {7, 10, 1}}, exp2{{0, 3, 1}, {3, 5, 0}};
+  SCOPE_ASSERT(exp1 == hits1);
+  SCOPE_ASSERT(exp2 == hits2);
+}
+
+SCOPE_TEST(testLgRestoreContextBadState) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\n")
+  ),
+  otherProg(
+    compilePatternList("a+b\tASCII\nfoo\tASCII\nbar\tASCII\n")
+  );
+
+  const LG_ContextOptions threadOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0},
+                          dfaOpts{0, 0, LG_ENGINE_LAZY_DFA, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &threadOpts),
+    lg_destroy_context
+  ),
+  dfa(
+    lg_create_context(prog.get(), &dfaOpts),
+    lg_destroy_context
+  ),
+  other(
+    lg_create_context(otherProg.get(), &threadOpts),
+    lg_destroy_context
+  );
+
+  const std::string text("xaaa");
+  lg_search(ctx.get(), text.data(), text.data() + text.size(), 0, nullptr, nullptr);
+  std::vector<char> state(saveContext(ctx.get()));
+
+  // a buffer too small gets nothing, but the size
+  char small[4] = {0};
+  SCOPE_ASSERT_EQUAL(state.size(), lg_save_context(ctx.get(), small, sizeof(small)));
+  SCOPE_ASSERT_EQUAL(0, small[0]);
+
+  SCOPE_ASSERT(!lg_restore_context(dfa.get(), state.data(), state.size()));
+  SCOPE_ASSERT(!lg_restore_context(other.get(), state.data(), state.size()));
+
+  for (size_t len = 0; len < state.size(); ++len) {
+    SCOPE_ASSERT(!lg_restore_context(ctx.get(), state.data(), len));
+  }
+
+  // a thread off the end of the program
+  std::vector<char> bad(state);
+  const uint32_t pc = 0x7FFFFFFF;
+  std::memcpy(bad.data() + 32, &pc, sizeof(pc));
+  SCOPE_ASSERT(!lg_restore_context(ctx.get(), bad.data(), bad.size()));
+
+  // a failed restore leaves the context reset
+  std::vector<SearchHit> hits;
+  const std::string rest("b");
+  lg_search(ctx.get(), rest.data(), rest.data() + 1, 4, &hits, collectHit);
+  lg_closeout_search(ctx.get(), &hits, collectHit);
+  SCOPE_ASSERT(hits.empty());
+
+  SCOPE_ASSERT(lg_restore_context(ctx.get(), state.data(), state.size()));
+  lg_search(ctx.get(), rest.data(), rest.data() + 1, 4, &hits, collectHit);
+  lg_closeout_search(ctx.get(), &hits, collectHit);
+  SCOPE_ASSERT_EQUAL(1u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(1, 5, 0), hits[0]);
+}
+
+namespace {
+  // collects the hits from lg_search_hits() and lg_closeout_hits(),
+  // checking that a positive status always comes with a full buffer
+  void searchHitsBlocks(ContextHandle* ctx, const std::string& text, size_t block, uint64_t maxHits, std::vector<SearchHit>& act) {
+    std::vector<LG_SearchHit> buf(maxHits);
+    uint64_t n;
+    int status;
+
+    for (size_t off = 0; off < text.size(); off += block) {
+      const size_t len = std::min(block, text.size() - off);
+      do {
+        status = lg_search_hits(
+          ctx, text.data() + off, text.data() + off + len, off,
+          buf.data(), maxHits, &n
+        );
+        SCOPE_ASSERT(status >= 0);
+        SCOPE_ASSERT(!status || n == maxHits);
+        for (uint64_t i = 0; i < n; ++i) {
+          act.push_back(*static_cast<const SearchHit*>(&buf[i]));
+        }
+      } while (status);
+    }
+
+    do {
+      status = lg_closeout_hits(ctx, buf.data(), maxHits, &n);
+      SCOPE_ASSERT(status >= 0);
+      SCOPE_ASSERT(!status || n == maxHits);
+      for (uint64_t i = 0; i < n; ++i) {
+        act.push_back(*static_cast<const SearchHit*>(&buf[i]));
+      }
+    } while (status);
+
+    lg_reset_context(ctx);
+  }
+
+  void checkSearchHits(const char* pats, uint32_t engine, uint32_t mode, uint64_t maxPerLabel) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      compilePatternList(pats)
+    );
+
+    const std::string text("aab foo abbc ab fofoo bxc aaab xaaaaaaab foo xaaaa");
+
+    const LG_ContextOptions ctxOpts{0, 0, engine, 0, mode, maxPerLabel};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog.get(), &ctxOpts),
+      lg_destroy_context
+    );
+
+    const std::vector<SearchHit> whole = searchAll(ctx.get(), text);
+
+    for (const size_t block : {text.size(), size_t(7), size_t(1)}) {
+      std::vector<SearchHit> exp;
+      for (size_t off = 0; off < text.size(); off += block) {
+        const size_t len = std::min(block, text.size() - off);
+        lg_search(ctx.get(), text.data() + off, text.data() + off + len, off, &exp, collectHit);
+      }
+      lg_closeout_search(ctx.get(), &exp, collectHit);
+      lg_reset_context(ctx.get());
+      SCOPE_ASSERT(!exp.empty());
+
+      for (uint64_t maxHits = 1; maxHits <= exp.size() + 1; ++maxHits) {
+        std::vector<SearchHit> act;
+        searchHitsBlocks(ctx.get(), text, block, maxHits, act);
+        SCOPE_ASSERT(exp == act);
+
+        // callbacks work as before afterwards
+        SCOPE_ASSERT(whole == searchAll(ctx.get(), text));
+      }
+    }
+  }
+
+  const char* const SEARCH_HITS_PATS =
+    "a+b\tASCII\nfoo\tASCII\nb.c\tASCII\nxa+\tASCII\nxa+a\tASCII\n";
+}
+
+SCOPE_TEST(testLgSearchHits) {
+  checkSearchHits(SEARCH_HITS_PATS, LG_ENGINE_THREADS, LG_HITS_ALL, 0);
+}
+
+SCOPE_TEST(testLgSearchHitsLazyDfa) {
+  checkSearchHits(SEARCH_HITS_PATS, LG_ENGINE_LAZY_DFA, LG_HITS_ALL, 0);
+}
+
+SCOPE_TEST(testLgSearchHitsJit) {
+  checkSearchHits(SEARCH_HITS_PATS, LG_ENGINE_JIT, LG_HITS_ALL, 0);
+}
+
+SCOPE_TEST(testLgSearchHitsLiterals) {
+  checkSearchHits("aab\tASCII\nfoo\tASCII\nbxc\tASCII\nfo\tASCII\n", LG_ENGINE_THREADS, LG_HITS_ALL, 0);
+}
+
+SCOPE_TEST(testLgSearchHitsLimited) {
+  checkSearchHits(SEARCH_HITS_PATS, LG_ENGINE_THREADS, LG_HITS_ALL, 2);
+  checkSearchHits(SEARCH_HITS_PATS, LG_ENGINE_LAZY_DFA, LG_HITS_FIRST, 0);
+  checkSearchHits("aab\tASCII\nfoo\tASCII\nbxc\tASCII\nfo\tASCII\n", LG_ENGINE_THREADS, LG_HITS_ALL, 1);
+}
+
+SCOPE_TEST(testLgSearchHitsErrors) {
+  std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+    compilePatternList("a\tASCII\n")
+  );
+
+  const LG_ContextOptions ctxOpts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &ctxOpts),
+    lg_destroy_context
+  );
+
+  const std::string text("aaaa");
+  LG_SearchHit hits[2];
+  uint64_t n = 99;
+
+  SCOPE_ASSERT(lg_search_hits(ctx.get(), text.data(), text.data() + 4, 0, hits, 0, &n) < 0);
+  SCOPE_ASSERT_EQUAL(0u, n);
+
+  // paused after the second hit, so the rest of the buffer is to come
+  SCOPE_ASSERT(lg_search_hits(ctx.get(), text.data(), text.data() + 4, 0, hits, 2, &n) > 0);
+  SCOPE_ASSERT_EQUAL(2u, n);
+
+  // a state with hits to collect is not saved
+  SCOPE_ASSERT_EQUAL(0u, lg_save_context(ctx.get(), nullptr, 0));
+
+  // nor may the search carry on from another buffer
+  SCOPE_ASSERT(lg_search_hits(ctx.get(), text.data() + 4, text.data() + 4, 10, hits, 2, &n) < 0);
+
+  // but a reset drops what's left
+  lg_reset_context(ctx.get());
+  SCOPE_ASSERT_EQUAL(0, lg_search_hits(ctx.get(), text.data(), text.data() + 1, 0, hits, 2, &n));
+  SCOPE_ASSERT_EQUAL(1u, n);
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 1, 0), *static_cast<const SearchHit*>(&hits[0]));
+}
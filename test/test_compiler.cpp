@@ -183,14 +183,21 @@ SCOPE_TEST(testBitVectorGeneration) {
 
   ProgramPtr p = Compiler::createProgram(fsm);
   Program& prog(*p);
-  SCOPE_ASSERT_EQUAL(14u, prog.size());
-  SCOPE_ASSERT_EQUAL(Instruction::makeBitVector(), prog[0]);
-  SCOPE_ASSERT_EQUAL(bits, reinterpret_cast<ByteSet&>(prog[1]));
-  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[9]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[10]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[11]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[12]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[13]);
+
+  // the set's bytes are one class, and every other byte another
+  SCOPE_ASSERT_EQUAL(2u, prog.Classes.Num);
+  for (uint32_t i = 0; i < 256; ++i) {
+    SCOPE_ASSERT_EQUAL(bits[i] ? 1 : 0, prog.Classes[i]);
+  }
+
+  SCOPE_ASSERT_EQUAL(7u, prog.size());
+  SCOPE_ASSERT_EQUAL(Instruction::makeBitVector(1), prog[0]);
+  SCOPE_ASSERT_EQUAL(2u, *(uint32_t*) &prog[1]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[2]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[3]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[4]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[5]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[6]);
 }
 
 SCOPE_TEST(generateJumpTableRange) {
@@ -211,21 +218,24 @@ SCOPE_TEST(generateJumpTableRange) {
   ProgramPtr p = Compiler::createProgram(fsm);
   Program& prog(*p);
 
-  SCOPE_ASSERT_EQUAL(25u, prog.size());
+  // e is in the class of the bytes not used, so has no entry
+  SCOPE_ASSERT_EQUAL(7u, prog.Classes.Num);
+  SCOPE_ASSERT_EQUAL(0u, prog.Classes['e']);
+
+  SCOPE_ASSERT_EQUAL(24u, prog.size());
   SCOPE_ASSERT_EQUAL(Instruction::makeByte('a'), prog[0]);
   SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[1]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeJumpTableRange('b', 'g'), prog[2]);
-  SCOPE_ASSERT_EQUAL(10u, *(uint32_t*) &prog[3]); // b
-  SCOPE_ASSERT_EQUAL(10u, *(uint32_t*) &prog[4]); // c
-  SCOPE_ASSERT_EQUAL(10u, *(uint32_t*) &prog[5]); // d
-  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[6]); // e
-  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[7]); // f
-  SCOPE_ASSERT_EQUAL(10u, *(uint32_t*) &prog[8]); // g
-  SCOPE_ASSERT_EQUAL(Instruction::makeByte('b'), prog[9]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeByte('f'), prog[10]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeCheckHalt(1), prog[11]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[12]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[13]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeJumpTableRange(prog.Classes['b'], prog.Classes['g']), prog[2]);
+  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[3]); // b
+  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[4]); // c
+  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[5]); // d
+  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[6]); // f
+  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[7]); // g
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('b'), prog[8]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('f'), prog[9]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeCheckHalt(1), prog[10]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[11]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[12]);
 // From here on, this is garbage---maybe don't even test this?
 /*
   SCOPE_ASSERT_EQUAL(Instruction::makeByte('c'), prog[13]);
@@ -235,8 +245,8 @@ SCOPE_TEST(generateJumpTableRange) {
   SCOPE_ASSERT_EQUAL(Instruction::makeByte('g'), prog[17]);
   SCOPE_ASSERT_EQUAL(Instruction::makeJump(&prog[18], 9), prog[18]);
 */
-  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[23]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[24]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[22]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[23]);
 }
 
 SCOPE_TEST(generateJumpTableRangePreLabel) {
@@ -261,31 +271,78 @@ SCOPE_TEST(generateJumpTableRangePreLabel) {
   ProgramPtr p = Compiler::createProgram(fsm);
   Program& prog(*p);
 
-  SCOPE_ASSERT_EQUAL(34u, prog.size());
+  SCOPE_ASSERT_EQUAL(33u, prog.size());
   SCOPE_ASSERT_EQUAL(Instruction::makeByte('a'), prog[0]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeJumpTableRange('b', 'g'), prog[1]);
-  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[2]); // b
-  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[3]); // c
-  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[4]); // d
-  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[5]); // e
-  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[6]); // f
-  SCOPE_ASSERT_EQUAL(9u, *(uint32_t*) &prog[7]); // g
-//  SCOPE_ASSERT_EQUAL(Instruction::makeByte('b'), prog[8]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeByte('f'), prog[9]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeCheckHalt(1), prog[10]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFork(&prog[11], 28), prog[11]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeJump(&prog[13], 24), prog[13]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeJumpTableRange(prog.Classes['b'], prog.Classes['g']), prog[1]);
+  SCOPE_ASSERT_EQUAL(8u, *(uint32_t*) &prog[2]); // b
+  SCOPE_ASSERT_EQUAL(8u, *(uint32_t*) &prog[3]); // c
+  SCOPE_ASSERT_EQUAL(8u, *(uint32_t*) &prog[4]); // d
+  SCOPE_ASSERT_EQUAL(0u, *(uint32_t*) &prog[5]); // f
+  SCOPE_ASSERT_EQUAL(8u, *(uint32_t*) &prog[6]); // g
+//  SCOPE_ASSERT_EQUAL(Instruction::makeByte('b'), prog[7]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('f'), prog[8]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeCheckHalt(1), prog[9]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFork(&prog[10], 27), prog[10]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeJump(&prog[12], 23), prog[12]);
 // intervening crap
-  SCOPE_ASSERT_EQUAL(Instruction::makeByte('g'), prog[24]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[25]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[26]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[27]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeByte('h'), prog[28]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(1), prog[29]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[30]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[31]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[32]);
-  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[33]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('g'), prog[23]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[24]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[25]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[26]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('h'), prog[27]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(1), prog[28]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeMatch(), prog[29]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[30]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeHalt(), prog[31]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeFinish(), prog[32]);
+}
+
+SCOPE_TEST(generateJumpTableSparse) {
+  NFA fsm(12); // a(b|k|t|z) + cdefgh
+  edge(0, 1, fsm, fsm.TransFac->getByte('a'));
+  edge(1, 2, fsm, fsm.TransFac->getByte('b'));
+  edge(1, 3, fsm, fsm.TransFac->getByte('k'));
+  edge(1, 4, fsm, fsm.TransFac->getByte('t'));
+  edge(1, 5, fsm, fsm.TransFac->getByte('z'));
+  edge(0, 6, fsm, fsm.TransFac->getByte('c'));
+  edge(6, 7, fsm, fsm.TransFac->getByte('d'));
+  edge(7, 8, fsm, fsm.TransFac->getByte('e'));
+  edge(8, 9, fsm, fsm.TransFac->getByte('f'));
+  edge(9, 10, fsm, fsm.TransFac->getByte('g'));
+  edge(10, 11, fsm, fsm.TransFac->getByte('h'));
+
+  for (uint32_t i = 2; i <= 5; ++i) {
+    fsm[i].Label = 0;
+    fsm[i].IsMatch = true;
+  }
+  fsm[11].Label = 1;
+  fsm[11].IsMatch = true;
+
+  ProgramPtr p = Compiler::createProgram(fsm);
+  Program& prog(*p);
+
+  // b, k, t, and z are 4 of the 10 classes from b to z
+  SCOPE_ASSERT_EQUAL(12u, prog.Classes.Num);
+  SCOPE_ASSERT_EQUAL(36u, prog.size());
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('a'), prog[2]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeJumpTableSparse(prog.Classes['b'], prog.Classes['z'], 4), prog[3]);
+
+  const byte* keys = reinterpret_cast<const byte*>(&prog[4]);
+  SCOPE_ASSERT_EQUAL(prog.Classes['b'], keys[0]);
+  SCOPE_ASSERT_EQUAL(prog.Classes['k'], keys[1]);
+  SCOPE_ASSERT_EQUAL(prog.Classes['t'], keys[2]);
+  SCOPE_ASSERT_EQUAL(prog.Classes['z'], keys[3]);
+
+  SCOPE_ASSERT_EQUAL(19u, *(uint32_t*) &prog[5]); // b
+  SCOPE_ASSERT_EQUAL(23u, *(uint32_t*) &prog[6]); // k
+  SCOPE_ASSERT_EQUAL(27u, *(uint32_t*) &prog[7]); // t
+  SCOPE_ASSERT_EQUAL(31u, *(uint32_t*) &prog[8]); // z
+  SCOPE_ASSERT_EQUAL(Instruction::makeByte('c'), prog[9]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[19]);
+  SCOPE_ASSERT_EQUAL(Instruction::makeLabel(0), prog[31]);
+
+  SCOPE_ASSERT_EQUAL(0u, jumpTableTarget(prog[3], prog.Classes['c']));
+  SCOPE_ASSERT_EQUAL(27u, jumpTableTarget(prog[3], prog.Classes['t']));
 }
 
 SCOPE_TEST(testFirstChildNext) {
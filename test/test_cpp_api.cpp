@@ -0,0 +1,205 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include "lightgrep/cpp_api.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "searchhit.h"
+
+namespace {
+  lightgrep::Program compile(const std::string& pats) {
+    lightgrep::Program prog;
+    lightgrep::FSM fsm;
+    fsm.addPatternList(prog, pats, "test");
+    prog.compile(fsm);
+    return prog;
+  }
+
+  void collectHit(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  const std::string TEXT("aab foo abbc ab fofoo bxc aaab xaaaaaaab foo xaaaa");
+
+  void checkMatchesCApi(const char* pats, uint32_t engine) {
+    lightgrep::Program prog(compile(pats));
+
+    const LG_ContextOptions opts{0, 0, engine, 0, LG_HITS_ALL, 0};
+    lightgrep::Context ctx(prog, opts);
+
+    for (const size_t block : {TEXT.size(), size_t(5), size_t(1)}) {
+      std::vector<SearchHit> exp, act;
+      for (size_t off = 0; off < TEXT.size(); off += block) {
+        const size_t len = std::min(block, TEXT.size() - off);
+        lg_search(ctx.get(), TEXT.data() + off, TEXT.data() + off + len, off, &exp, collectHit);
+      }
+      lg_closeout_search(ctx.get(), &exp, collectHit);
+      ctx.reset();
+      SCOPE_ASSERT(!exp.empty());
+
+      const auto handler = [&act](const LG_SearchHit& hit) {
+        act.push_back(static_cast<const SearchHit&>(hit));
+      };
+
+      for (size_t off = 0; off < TEXT.size(); off += block) {
+        const size_t len = std::min(block, TEXT.size() - off);
+        ctx.search(TEXT.data() + off, TEXT.data() + off + len, off, handler);
+      }
+      ctx.closeOut(handler);
+      ctx.reset();
+
+      SCOPE_ASSERT(exp == act);
+    }
+  }
+}
+
+SCOPE_TEST(cppApiMatchesCApi) {
+  checkMatchesCApi("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\nxa+\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(cppApiMatchesCApiLazyDfa) {
+  checkMatchesCApi("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\nxa+\tASCII\n", LG_ENGINE_LAZY_DFA);
+}
+
+SCOPE_TEST(cppApiMatchesCApiJit) {
+  checkMatchesCApi("a+b\tASCII\nfoo\tASCII\nb.c\tASCII\nxa+\tASCII\n", LG_ENGINE_JIT);
+}
+
+SCOPE_TEST(cppApiMatchesCApiLiterals) {
+  checkMatchesCApi("aab\tASCII\nfoo\tASCII\nbxc\tASCII\n", LG_ENGINE_THREADS);
+}
+
+SCOPE_TEST(cppApiManyHits) {
+  // more hits than fit in one batch
+  lightgrep::Context ctx(compile("a\tASCII\n"));
+
+  const std::string text(10000, 'a');
+  uint64_t n = 0, next = 0;
+  bool inOrder = true;
+  ctx.searchBuffer(text, [&](const LG_SearchHit& hit) {
+    inOrder &= hit.Start == next++;
+    ++n;
+  });
+
+  SCOPE_ASSERT_EQUAL(10000u, n);
+  SCOPE_ASSERT(inOrder);
+}
+
+SCOPE_TEST(cppApiHandlerThrows) {
+  lightgrep::Context ctx(compile("a\tASCII\n"));
+
+  const std::string text(1000, 'a');
+  uint64_t n = 0;
+  SCOPE_EXPECT(
+    ctx.search(text, 0, [&n](const LG_SearchHit&) {
+      if (++n == 300) {
+        throw std::logic_error("enough");
+      }
+    }),
+    std::logic_error
+  );
+  SCOPE_ASSERT_EQUAL(300u, n);
+
+  // after a reset, the context searches from scratch
+  ctx.reset();
+  n = 0;
+  ctx.searchBuffer(text, [&n](const LG_SearchHit&) { ++n; });
+  SCOPE_ASSERT_EQUAL(1000u, n);
+}
+
+SCOPE_TEST(cppApiStartsWith) {
+  lightgrep::Context ctx(compile("ab\tASCII\nabcd\tASCII\nbc\tASCII\n"));
+
+  const std::string text("abcde");
+  std::vector<SearchHit> hits;
+  ctx.startsWith(text.data(), text.data() + text.size(), 7, [&hits](const LG_SearchHit& hit) {
+    hits.push_back(static_cast<const SearchHit&>(hit));
+  });
+
+  const std::vector<SearchHit> exp{{7, 9, 0}, {7, 11, 1}};
+  SCOPE_ASSERT(exp == hits);
+
+  // the library traps exceptions, but the handler's gets out anyway
+  SCOPE_EXPECT(
+    ctx.startsWith(text.data(), text.data() + text.size(), 0, [](const LG_SearchHit&) {
+      throw std::logic_error("no");
+    }),
+    std::logic_error
+  );
+}
+
+SCOPE_TEST(cppApiErrors) {
+  SCOPE_EXPECT(lightgrep::Pattern("a(b"), lightgrep::Error);
+
+  lightgrep::Program prog;
+  lightgrep::FSM fsm;
+  SCOPE_EXPECT(fsm.addPattern(prog, lightgrep::Pattern("a"), "NO-SUCH-ENCODING", 0), lightgrep::Error);
+  SCOPE_ASSERT_EQUAL(0, fsm.addPattern(prog, lightgrep::Pattern("a"), "ASCII", 0));
+  prog.compile(fsm);
+
+  lightgrep::Context ctx(prog);
+  SCOPE_EXPECT(ctx.enableKeywords({5}), lightgrep::Error);
+  SCOPE_EXPECT(ctx.restore(std::vector<char>(3)), lightgrep::Error);
+  SCOPE_EXPECT(prog.patternInfo(1), lightgrep::Error);
+}
+
+SCOPE_TEST(cppApiContextKeepsProgram) {
+  std::unique_ptr<lightgrep::Context> ctx;
+  {
+    lightgrep::Program prog(compile("foo\tASCII\n"));
+    ctx.reset(new lightgrep::Context(prog));
+  }
+
+  uint64_t n = 0;
+  ctx->searchBuffer("a foo foo", [&n](const LG_SearchHit&) { ++n; });
+  SCOPE_ASSERT_EQUAL(2u, n);
+}
+
+SCOPE_TEST(cppApiProgramReadWrite) {
+  const lightgrep::Program prog(compile("a+b\tASCII\nfoo\tASCII\n"));
+  const lightgrep::Program copy(lightgrep::Program::read(prog.write()));
+  SCOPE_ASSERT_EQUAL(2u, copy.patternCount());
+  SCOPE_ASSERT_EQUAL(std::string("foo"), copy.patternInfo(1).Pattern);
+
+  lightgrep::Context ctx(copy);
+  std::vector<SearchHit> hits;
+  const auto handler = [&hits](const LG_SearchHit& hit) {
+    hits.push_back(static_cast<const SearchHit&>(hit));
+  };
+
+  // a clone starts out reset
+  lightgrep::Context clone(ctx.clone());
+  clone.search("xaab fo", 0, handler);
+
+  // and its state carries over to another context
+  ctx.restore(clone.save());
+  ctx.search("o", 7, handler);
+  ctx.closeOut(handler);
+
+  const std::vector<SearchHit> exp{{1, 4, 0}, {5, 8, 1}};
+  SCOPE_ASSERT(exp == hits);
+}
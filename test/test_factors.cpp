@@ -0,0 +1,178 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compilePatterns(const std::vector<std::string>& pats) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(pats.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{0, 0, 0};
+
+    for (size_t i = 0; i < pats.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), pats[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  std::vector<SearchHit> searchBlocks(ProgramPtr prog, const std::string& text, size_t block) {
+    Vm vm(prog);
+    std::vector<SearchHit> hits;
+    const byte* const beg = reinterpret_cast<const byte*>(text.data());
+    for (size_t off = 0; off < text.size(); off += block) {
+      const size_t len = std::min(block, text.size() - off);
+      vm.search(beg + off, beg + off + len, off, collect, &hits);
+    }
+    vm.closeOut(collect, &hits);
+    return hits;
+  }
+
+  // a random pattern over a small alphabet, which never matches empty
+  std::string randomPattern(std::mt19937& rng, int depth = 0) {
+    std::uniform_int_distribution<int> pick(0, 9), ch('a', 'd');
+
+    std::string pat;
+    const int atoms = 1 + pick(rng) % 4;
+    for (int i = 0; i < atoms; ++i) {
+      const int k = pick(rng);
+      if (k < 5) {
+        pat += static_cast<char>(ch(rng));
+      }
+      else if (k < 7) {
+        pat += "[ab]";
+      }
+      else if (k < 8) {
+        pat += '.';
+      }
+      else if (depth < 2) {
+        pat += '(' + randomPattern(rng, depth + 1) + '|' +
+                     randomPattern(rng, depth + 1) + ')';
+      }
+      else {
+        pat += static_cast<char>(ch(rng));
+      }
+
+      switch (pick(rng)) {
+      case 0:
+        pat += '+';
+        break;
+      case 1:
+        pat += "{1,3}";
+        break;
+      default:
+        break;
+      }
+    }
+    return pat;
+  }
+}
+
+SCOPE_TEST(factorsSelected) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"[a-z]+@example\\.com"}));
+  SCOPE_ASSERT(prog->Prog->Factors);
+  SCOPE_ASSERT_EQUAL(12u, prog->Prog->FactorMaxLen);
+
+  // the prefilter already covers factors which start their patterns
+  prog = compilePatterns({"foo[0-9]+", "bar"});
+  SCOPE_ASSERT(!prog->Prog->Factors);
+
+  // every pattern needs a factor
+  prog = compilePatterns({"[a-z]+@example\\.com", "a+|b"});
+  SCOPE_ASSERT(!prog->Prog->Factors);
+}
+
+SCOPE_TEST(factorsSearch) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"[a-z]+@example\\.com", "x[0-9]{1,3}yz"}));
+  SCOPE_ASSERT(prog->Prog->Factors);
+
+  const std::string text("  bob@example.com x1yz x@example.com, 12@example.com x1234yz x99yz");
+  const std::vector<SearchHit> hits = searchBlocks(prog->Prog, text, text.size());
+  SCOPE_ASSERT_EQUAL(4u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(2, 17, 0), hits[0]);
+  SCOPE_ASSERT_EQUAL(SearchHit(18, 22, 1), hits[1]);
+  SCOPE_ASSERT_EQUAL(SearchHit(23, 36, 0), hits[2]);
+  SCOPE_ASSERT_EQUAL(SearchHit(61, 66, 1), hits[3]);
+}
+
+SCOPE_TEST(factorsMatchVm) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> ch('a', 'e'), npats(1, 4), block(1, 60);
+
+  uint32_t withFactors = 0;
+  for (int round = 0; round < 300; ++round) {
+    std::vector<std::string> pats(npats(rng));
+    for (std::string& p : pats) {
+      p = randomPattern(rng);
+    }
+
+    std::shared_ptr<ProgramHandle> prog(compilePatterns(pats));
+    if (!prog->Prog->Factors) {
+      continue;
+    }
+    ++withFactors;
+
+    // the same program, but without the factors
+    const std::vector<char> buf = prog->Prog->marshall();
+    ProgramPtr plain = Program::unmarshall(buf.data(), buf.size());
+    plain->Factors.reset();
+
+    std::string text;
+    for (int i = 0; i < 300; ++i) {
+      text.push_back(ch(rng));
+    }
+
+    const size_t b = block(rng);
+    SCOPE_ASSERT(searchBlocks(plain, text, b) == searchBlocks(prog->Prog, text, b));
+  }
+
+  SCOPE_ASSERT(withFactors > 50);
+}
@@ -21,7 +21,10 @@
 #include "instructions.h"
 #include "byteset.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 
 SCOPE_TEST(makeByte) {
   Instruction i = Instruction::makeByte('a');
@@ -115,6 +118,11 @@ SCOPE_TEST(makeBitVector) {
   SCOPE_ASSERT_EQUAL(9u, i.wordSize());
   SCOPE_ASSERT_EQUAL("BitVector", i.toString());
   SCOPE_ASSERT_EQUAL(32u, sizeof(ByteSet));
+
+  // a word for every 32 byte classes
+  SCOPE_ASSERT_EQUAL(3u, Instruction::makeBitVector(2).wordSize());
+  SCOPE_EXPECT(Instruction::makeBitVector(0), std::range_error);
+  SCOPE_EXPECT(Instruction::makeBitVector(9), std::range_error);
 }
 
 SCOPE_TEST(makeFork) {
@@ -145,6 +153,81 @@ SCOPE_TEST(makeJumpTableRange) {
   SCOPE_EXPECT(Instruction::makeJumpTableRange(1, 0), std::range_error);
 }
 
+SCOPE_TEST(makeJumpTableSparse) {
+  Instruction i = Instruction::makeJumpTableSparse(0x10, 0xF0, 3);
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_SPARSE_OP, i.OpCode);
+  SCOPE_ASSERT_EQUAL(1u, i.wordSize());
+  SCOPE_ASSERT_EQUAL(2u, i.Op.T3.Count);
+  SCOPE_ASSERT_EQUAL(0x10u, i.Op.T3.First);
+  SCOPE_ASSERT_EQUAL(0xF0u, i.Op.T3.Last);
+  SCOPE_ASSERT_EQUAL("JmpTblSparse 0x10-0xf0 3", i.toString());
+  SCOPE_EXPECT(Instruction::makeJumpTableSparse(1, 0, 1), std::range_error);
+  SCOPE_EXPECT(Instruction::makeJumpTableSparse(0, 1, 0), std::range_error);
+  SCOPE_EXPECT(Instruction::makeJumpTableSparse(0, 1, 3), std::range_error);
+}
+
+SCOPE_TEST(makeJumpTableBitmap) {
+  Instruction i = Instruction::makeJumpTableBitmap(0x10, 0xF0);
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_BITMAP_OP, i.OpCode);
+  SCOPE_ASSERT_EQUAL(1u, i.wordSize());
+  SCOPE_ASSERT_EQUAL(0x10u, i.Op.T2.First);
+  SCOPE_ASSERT_EQUAL(0xF0u, i.Op.T2.Last);
+  SCOPE_ASSERT_EQUAL("JmpTblBitmap 0x10-0xf0", i.toString());
+  SCOPE_EXPECT(Instruction::makeJumpTableBitmap(1, 0), std::range_error);
+}
+
+SCOPE_TEST(jumpTableLayouts) {
+  // half full or better is dense
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_RANGE_OP, jumpTableLayout(0, 9, 5));
+  SCOPE_ASSERT_EQUAL(10u, jumpTableWords(JUMP_TABLE_RANGE_OP, 0, 9, 5));
+  // a few entries far apart are sparse
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_SPARSE_OP, jumpTableLayout(0, 255, 4));
+  SCOPE_ASSERT_EQUAL(5u, jumpTableWords(JUMP_TABLE_SPARSE_OP, 0, 255, 4));
+  // more entries, less than half full, are bitmapped
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_BITMAP_OP, jumpTableLayout(0, 24, 9));
+  SCOPE_ASSERT_EQUAL(11u, jumpTableWords(JUMP_TABLE_BITMAP_OP, 0, 24, 9));
+  SCOPE_ASSERT_EQUAL(12u, jumpTableWords(JUMP_TABLE_SPARSE_OP, 0, 24, 9));
+}
+
+SCOPE_TEST(jumpTableTargetSparse) {
+  // 5 keys take two words, then five targets
+  Instruction tbl[8];
+  tbl[0] = Instruction::makeJumpTableSparse(3, 200, 5);
+  const byte keys[8] = {3, 7, 50, 51, 200, 0, 0, 0};
+  std::memcpy(tbl + 1, keys, sizeof(keys));
+  for (uint32_t i = 0; i < 5; ++i) {
+    *reinterpret_cast<uint32_t*>(tbl + 3 + i) = 100 + i;
+  }
+
+  for (uint32_t c = 0; c < 256; ++c) {
+    const byte* k = std::find(keys, keys + 5, c);
+    SCOPE_ASSERT_EQUAL(k == keys + 5 ? 0u : 100u + (k - keys), jumpTableTarget(tbl[0], c));
+  }
+}
+
+SCOPE_TEST(jumpTableTargetBitmap) {
+  // classes 10 to 80 take three words of bits and one of ranks
+  std::vector<byte> keys{10, 11, 41, 42, 43, 75, 80};
+  Instruction tbl[12];
+  tbl[0] = Instruction::makeJumpTableBitmap(10, 80);
+  uint32_t* const words = reinterpret_cast<uint32_t*>(tbl + 1);
+  std::fill(words, words + 4, 0);
+  for (const byte k : keys) {
+    words[(k - 10) >> 5] |= 1u << ((k - 10) & 31);
+  }
+  const byte ranks[4] = {0, 3, 5, 0};
+  std::memcpy(words + 3, ranks, sizeof(ranks));
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    words[4 + i] = 100 + i;
+  }
+
+  SCOPE_ASSERT_EQUAL(11u, jumpTableWords(JUMP_TABLE_BITMAP_OP, 10, 80, keys.size()));
+  for (uint32_t c = 0; c < 256; ++c) {
+    const auto k = std::find(keys.begin(), keys.end(), c);
+    SCOPE_ASSERT_EQUAL(k == keys.end() ? 0u : 100u + (k - keys.begin()), jumpTableTarget(tbl[0], c));
+  }
+}
+
 SCOPE_TEST(makeAny) {
   Instruction i = Instruction::makeAny();
   SCOPE_ASSERT_EQUAL(ANY_OP, i.OpCode);
@@ -0,0 +1,198 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <scope/test.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "jitvm.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compilePatterns(const std::vector<std::string>& pats, bool determinize = true) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(pats.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{0, 0, 0};
+
+    for (size_t i = 0; i < pats.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), pats[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{determinize};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  std::vector<SearchHit> searchBlocks(VmInterface& vm, const std::string& text, size_t block) {
+    std::vector<SearchHit> hits;
+    const byte* const beg = reinterpret_cast<const byte*>(text.data());
+    for (size_t off = 0; off < text.size(); off += block) {
+      const size_t len = std::min(block, text.size() - off);
+      vm.search(beg + off, beg + off + len, off, collect, &hits);
+    }
+    vm.closeOut(collect, &hits);
+    vm.reset();
+    return hits;
+  }
+
+  // a random pattern using every kind of consuming instruction
+  std::string randomPattern(std::mt19937& rng, int depth = 0) {
+    static const char* const classes[] = {
+      "[ab]", "[^a]", "[b-d]", "[^b-d]", "[acegi]", ".", "\\x00", "[\\x00-\\xFF]"
+    };
+
+    std::uniform_int_distribution<int> pick(0, 11), ch('a', 'e'), cls(0, 7);
+
+    std::string pat;
+    const int atoms = 1 + pick(rng) % 4;
+    for (int i = 0; i < atoms; ++i) {
+      const int k = pick(rng);
+      if (k < 5) {
+        pat += static_cast<char>(ch(rng));
+      }
+      else if (k < 9) {
+        pat += classes[cls(rng)];
+      }
+      else if (depth < 2) {
+        pat += '(' + randomPattern(rng, depth + 1) + '|' +
+                     randomPattern(rng, depth + 1) + ')';
+      }
+      else {
+        pat += static_cast<char>(ch(rng));
+      }
+
+      switch (pick(rng)) {
+      case 0:
+        pat += '+';
+        break;
+      case 1:
+        pat += "{1,3}";
+        break;
+      case 2:
+        if (i > 0) {
+          pat += '*';
+        }
+        break;
+      case 3:
+        pat += "+?";
+        break;
+      default:
+        break;
+      }
+    }
+    return pat;
+  }
+}
+
+SCOPE_TEST(jitSelected) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a+b", "cd"}));
+
+  LG_ContextOptions opts{0, 0, LG_ENGINE_JIT, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &opts), lg_destroy_context
+  );
+
+  if (JitVm::supported()) {
+    SCOPE_ASSERT(dynamic_cast<JitVm*>(ctx->Impl.get()));
+  }
+  else {
+    // elsewhere, the interpreter is used
+    SCOPE_ASSERT(dynamic_cast<Vm*>(ctx->Impl.get()));
+  }
+}
+
+SCOPE_TEST(jitSearch) {
+  if (!JitVm::supported()) {
+    return;
+  }
+
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a+b", "[a-z]+ing", "c[^x]d", "q[aeiou]{2}"}));
+  JitVm vm(prog->Prog);
+  SCOPE_ASSERT(vm.codeSize() > 0);
+
+  const std::string text("xx aaab  singing cyd going, aab quiet");
+  for (size_t block = 1; block <= text.size(); ++block) {
+    const std::vector<SearchHit> hits = searchBlocks(vm, text, block);
+    SCOPE_ASSERT_EQUAL(6u, hits.size());
+    SCOPE_ASSERT_EQUAL(SearchHit(3, 7, 0), hits[0]);
+    SCOPE_ASSERT_EQUAL(SearchHit(9, 16, 1), hits[1]);
+    SCOPE_ASSERT_EQUAL(SearchHit(17, 20, 2), hits[2]);
+    SCOPE_ASSERT_EQUAL(SearchHit(21, 26, 1), hits[3]);
+    SCOPE_ASSERT_EQUAL(SearchHit(28, 31, 0), hits[4]);
+    SCOPE_ASSERT_EQUAL(SearchHit(32, 35, 3), hits[5]);
+  }
+}
+
+SCOPE_TEST(jitMatchesVm) {
+  if (!JitVm::supported()) {
+    return;
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> ch(0, 7), npats(1, 5), block(1, 100), det(0, 1);
+
+  for (int round = 0; round < 300; ++round) {
+    std::vector<std::string> pats(npats(rng));
+    for (std::string& p : pats) {
+      p = randomPattern(rng);
+    }
+
+    std::shared_ptr<ProgramHandle> prog(compilePatterns(pats, det(rng)));
+
+    // mostly the pattern alphabet, with the odd NUL and x
+    std::string text;
+    for (int i = 0; i < 400; ++i) {
+      const int c = ch(rng);
+      text.push_back(c < 5 ? 'a' + c : c == 5 ? 'x' : c == 6 ? 'i' : '\0');
+    }
+
+    Vm vm(prog->Prog);
+    JitVm jit(prog->Prog);
+
+    const size_t b = block(rng);
+    SCOPE_ASSERT(searchBlocks(vm, text, b) == searchBlocks(jit, text, b));
+  }
+}
@@ -0,0 +1,152 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "labelmask.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compilePatterns(const std::vector<std::string>& pats, bool fixed = false, bool determinize = true) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(pats.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{fixed, 0, 0};
+
+    for (size_t i = 0; i < pats.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), pats[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{determinize};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  std::vector<SearchHit> search(ContextHandle* ctx, const std::string& text) {
+    std::vector<SearchHit> hits;
+    lg_search(ctx, text.data(), text.data() + text.size(), 0, &hits, collect);
+    lg_closeout_search(ctx, &hits, collect);
+    lg_reset_context(ctx);
+    return hits;
+  }
+
+  std::vector<SearchHit> without(const std::vector<SearchHit>& hits, uint32_t label) {
+    std::vector<SearchHit> ret;
+    for (const SearchHit& h : hits) {
+      if (h.KeywordIndex != label) {
+        ret.push_back(h);
+      }
+    }
+    return ret;
+  }
+
+  void checkMasking(const std::shared_ptr<ProgramHandle>& prog, uint32_t engine, const std::string& text) {
+
+    const LG_ContextOptions opts{0, 0, engine, 0, LG_HITS_ALL, 0};
+    std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+      lg_create_context(prog.get(), &opts), lg_destroy_context
+    );
+
+    const std::vector<SearchHit> all = search(ctx.get(), text);
+    const std::vector<SearchHit> exp = without(all, 1);
+    SCOPE_ASSERT(exp.size() < all.size());
+
+    const uint64_t one[] = {1}, others[] = {0, 2};
+
+    SCOPE_ASSERT(lg_enable_keywords(ctx.get(), one, 1, 0));
+    SCOPE_ASSERT(exp == search(ctx.get(), text));
+
+    // a bad index changes nothing
+    const uint64_t bad[] = {0, 99};
+    SCOPE_ASSERT(!lg_enable_keywords(ctx.get(), bad, 2, 0));
+    SCOPE_ASSERT(exp == search(ctx.get(), text));
+
+    SCOPE_ASSERT(lg_enable_keywords(ctx.get(), nullptr, 0, 1));
+    SCOPE_ASSERT(all == search(ctx.get(), text));
+
+    SCOPE_ASSERT(lg_enable_keywords(ctx.get(), nullptr, 0, 0));
+    SCOPE_ASSERT(search(ctx.get(), text).empty());
+
+    SCOPE_ASSERT(lg_enable_keywords(ctx.get(), others, 2, 1));
+    SCOPE_ASSERT(exp == search(ctx.get(), text));
+  }
+}
+
+SCOPE_TEST(labelMaskThreads) {
+  checkMasking(compilePatterns({"a+b", "b+c", "[a-c]d"}), LG_ENGINE_THREADS, "aabbcc abd bbbc xad aab");
+}
+
+SCOPE_TEST(labelMaskLazyDfa) {
+  checkMasking(compilePatterns({"a+b", "b+c", "[a-c]d"}), LG_ENGINE_LAZY_DFA, "aabbcc abd bbbc xad aab");
+}
+
+SCOPE_TEST(labelMaskLiterals) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"ab", "bc", "cd"}, true));
+  SCOPE_ASSERT(prog->Prog->Literals);
+  checkMasking(prog, LG_ENGINE_THREADS, "abcd bcd ab abc");
+}
+
+SCOPE_TEST(labelMaskPrunesStarts) {
+  // without determinization, each pattern has its own start thread
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"ab+c", "d[ef]", "x"}, false, false));
+  Vm vm(prog->Prog);
+  SCOPE_ASSERT_EQUAL(3u, vm.first().size());
+
+  std::vector<bool> disabled(3, false);
+  disabled[1] = true;
+  vm.setMask(std::make_shared<const LabelMask>(*prog->Prog, disabled));
+  SCOPE_ASSERT_EQUAL(2u, vm.first().size());
+
+  std::vector<SearchHit> hits;
+  const std::string text("abbc de x");
+  const byte* const beg = reinterpret_cast<const byte*>(text.data());
+  vm.search(beg, beg + text.size(), 0, collect, &hits);
+  vm.closeOut(collect, &hits);
+  SCOPE_ASSERT_EQUAL(2u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 4, 0), hits[0]);
+  SCOPE_ASSERT_EQUAL(SearchHit(8, 9, 2), hits[1]);
+
+  vm.setMask(nullptr);
+  SCOPE_ASSERT_EQUAL(3u, vm.first().size());
+}
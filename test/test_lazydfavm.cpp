@@ -0,0 +1,196 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "lazydfavm.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compilePatterns(const std::vector<std::string>& pats) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(pats.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{0, 0, 0};
+
+    for (size_t i = 0; i < pats.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), pats[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  std::vector<SearchHit> searchBlocks(VmInterface& vm, const std::string& text, size_t block) {
+    std::vector<SearchHit> hits;
+    const byte* const beg = reinterpret_cast<const byte*>(text.data());
+    for (size_t off = 0; off < text.size(); off += block) {
+      const size_t len = std::min(block, text.size() - off);
+      vm.search(beg + off, beg + off + len, off, collect, &hits);
+    }
+    vm.closeOut(collect, &hits);
+    vm.reset();
+    return hits;
+  }
+
+  // a random pattern over a small alphabet, which never matches empty
+  std::string randomPattern(std::mt19937& rng, int depth = 0) {
+    std::uniform_int_distribution<int> pick(0, 9), ch('a', 'd');
+
+    std::string pat;
+    const int atoms = 1 + pick(rng) % 4;
+    for (int i = 0; i < atoms; ++i) {
+      const int k = pick(rng);
+      if (k < 5) {
+        pat += static_cast<char>(ch(rng));
+      }
+      else if (k < 7) {
+        pat += "[ab]";
+      }
+      else if (k < 8) {
+        pat += '.';
+      }
+      else if (depth < 2) {
+        pat += '(' + randomPattern(rng, depth + 1) + '|' +
+                     randomPattern(rng, depth + 1) + ')';
+      }
+      else {
+        pat += static_cast<char>(ch(rng));
+      }
+
+      switch (pick(rng)) {
+      case 0:
+        pat += '+';
+        break;
+      case 1:
+        pat += "{1,3}";
+        break;
+      case 2:
+        if (i > 0) {
+          pat += '*';
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return pat;
+  }
+}
+
+SCOPE_TEST(lazyDfaSelected) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a+b", "cd"}));
+
+  LG_ContextOptions opts{0, 0, LG_ENGINE_LAZY_DFA, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &opts), lg_destroy_context
+  );
+  SCOPE_ASSERT(dynamic_cast<LazyDfaVm*>(ctx->Impl.get()));
+
+  opts.Engine = LG_ENGINE_THREADS;
+  ctx.reset(lg_create_context(prog.get(), &opts));
+  SCOPE_ASSERT(dynamic_cast<Vm*>(ctx->Impl.get()));
+}
+
+SCOPE_TEST(lazyDfaSearch) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a+b", "[a-z]+ing", "cd"}));
+  LazyDfaVm vm(prog->Prog);
+
+  const std::string text("xx aaab  singing cd going, aab");
+  for (size_t block = 1; block <= text.size(); ++block) {
+    const std::vector<SearchHit> hits = searchBlocks(vm, text, block);
+    SCOPE_ASSERT_EQUAL(5u, hits.size());
+    SCOPE_ASSERT_EQUAL(SearchHit(3, 7, 0), hits[0]);
+    SCOPE_ASSERT_EQUAL(SearchHit(9, 16, 1), hits[1]);
+    SCOPE_ASSERT_EQUAL(SearchHit(17, 19, 2), hits[2]);
+    SCOPE_ASSERT_EQUAL(SearchHit(20, 25, 1), hits[3]);
+    SCOPE_ASSERT_EQUAL(SearchHit(27, 30, 0), hits[4]);
+  }
+}
+
+SCOPE_TEST(lazyDfaMatchesVm) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> ch('a', 'e'), npats(1, 5), block(1, 100);
+
+  for (int round = 0; round < 300; ++round) {
+    std::vector<std::string> pats(npats(rng));
+    for (std::string& p : pats) {
+      p = randomPattern(rng);
+    }
+
+    std::shared_ptr<ProgramHandle> prog(compilePatterns(pats));
+
+    std::string text;
+    for (int i = 0; i < 400; ++i) {
+      text.push_back(ch(rng));
+    }
+
+    Vm vm(prog->Prog);
+    LazyDfaVm dfa(prog->Prog);
+
+    const size_t b = block(rng);
+    SCOPE_ASSERT(searchBlocks(vm, text, b) == searchBlocks(dfa, text, b));
+  }
+}
+
+SCOPE_TEST(lazyDfaThrashFallsBack) {
+  // (a|b)*a(a|b){8} needs a state for every suffix of nine bytes
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a[ab]{8}c"}));
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> ch('a', 'c');
+  std::string text;
+  for (int i = 0; i < 5000; ++i) {
+    text.push_back(ch(rng));
+  }
+
+  Vm vm(prog->Prog);
+  LazyDfaVm dfa(prog->Prog, 4096);
+
+  SCOPE_ASSERT(searchBlocks(vm, text, 1000) == searchBlocks(dfa, text, 1000));
+  SCOPE_ASSERT(dfa.fellBack());
+}
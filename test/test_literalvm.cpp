@@ -0,0 +1,208 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "literalvm.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compileKeys(const std::vector<std::string>& keys, bool fixed = true) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(keys.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{fixed, 0, 0};
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), keys[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  // searches text in blocks of the given size
+  std::vector<SearchHit> searchBlocks(VmInterface& vm, const std::string& text, size_t block) {
+    std::vector<SearchHit> hits;
+    const byte* const beg = reinterpret_cast<const byte*>(text.data());
+    for (size_t off = 0; off < text.size(); off += block) {
+      const size_t len = std::min(block, text.size() - off);
+      vm.search(beg + off, beg + off + len, off, collect, &hits);
+    }
+    vm.closeOut(collect, &hits);
+    vm.reset();
+    return hits;
+  }
+}
+
+SCOPE_TEST(literalVmSelected) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"foo", "bar"}));
+  SCOPE_ASSERT(prog->Prog->Literals);
+  SCOPE_ASSERT(dynamic_cast<LiteralVm*>(VmInterface::create(prog->Prog).get()));
+}
+
+SCOPE_TEST(literalVmNotSelectedForRegex) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"foo", "ba+r"}, false));
+  SCOPE_ASSERT(!prog->Prog->Literals);
+  SCOPE_ASSERT(dynamic_cast<Vm*>(VmInterface::create(prog->Prog).get()));
+}
+
+SCOPE_TEST(literalVmOverlappingKeys) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"aa", "abc", "bc", "c"}));
+  LiteralVm vm(prog->Prog);
+
+  const std::vector<SearchHit> hits = searchBlocks(vm, "aaaabcc", 100);
+  SCOPE_ASSERT_EQUAL(6u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 2, 0), hits[0]);
+  SCOPE_ASSERT_EQUAL(SearchHit(2, 4, 0), hits[1]);
+  SCOPE_ASSERT_EQUAL(SearchHit(3, 6, 1), hits[2]);
+  SCOPE_ASSERT_EQUAL(SearchHit(4, 6, 2), hits[3]);
+  SCOPE_ASSERT_EQUAL(SearchHit(5, 6, 3), hits[4]);
+  SCOPE_ASSERT_EQUAL(SearchHit(6, 7, 3), hits[5]);
+}
+
+SCOPE_TEST(literalVmAcrossBlocks) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"needle", "pin"}));
+  LiteralVm vm(prog->Prog);
+
+  const std::string text("xxneedlexxxpinxxxxneedle");
+  for (size_t block = 1; block <= text.size(); ++block) {
+    const std::vector<SearchHit> hits = searchBlocks(vm, text, block);
+    SCOPE_ASSERT_EQUAL(3u, hits.size());
+    SCOPE_ASSERT_EQUAL(SearchHit(2, 8, 0), hits[0]);
+    SCOPE_ASSERT_EQUAL(SearchHit(11, 14, 1), hits[1]);
+    SCOPE_ASSERT_EQUAL(SearchHit(18, 24, 0), hits[2]);
+  }
+}
+
+SCOPE_TEST(literalVmSearchResolve) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"abcd", "cdef"}));
+  LiteralVm vm(prog->Prog);
+
+  const byte text[] = "xxabcdef";
+  std::vector<SearchHit> hits;
+  SCOPE_ASSERT_EQUAL(2u, vm.search(text, text + 4, 0, collect, &hits));
+  SCOPE_ASSERT(hits.empty());
+
+  // only matches starting before offset 4 may be reported
+  vm.searchResolve(text + 4, text + 8, 4, collect, &hits);
+  SCOPE_ASSERT_EQUAL(1u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(2, 6, 0), hits[0]);
+}
+
+SCOPE_TEST(literalVmStartsWith) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"ab", "abcd", "bc"}));
+  LiteralVm vm(prog->Prog);
+
+  const byte text[] = "abcde";
+  std::vector<SearchHit> hits;
+  vm.startsWith(text, text + 5, 7, collect, &hits);
+  SCOPE_ASSERT_EQUAL(2u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(7, 9, 0), hits[0]);
+  SCOPE_ASSERT_EQUAL(SearchHit(7, 11, 1), hits[1]);
+}
+
+SCOPE_TEST(literalVmMarshall) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"one", "two", "three"}));
+  const std::vector<char> buf = prog->Prog->marshall();
+  SCOPE_ASSERT_EQUAL(prog->Prog->bufSize(), buf.size());
+
+  ProgramPtr p = Program::unmarshall(buf.data(), buf.size());
+  SCOPE_ASSERT(p->Literals);
+  SCOPE_ASSERT(*prog->Prog == *p);
+}
+
+SCOPE_TEST(literalVmMatchesVm) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> ch('a', 'c'), klen(1, 5), nkeys(1, 12), block(1, 40);
+
+  for (int round = 0; round < 200; ++round) {
+    std::vector<std::string> keys(nkeys(rng));
+    for (std::string& k : keys) {
+      for (int i = klen(rng); i > 0; --i) {
+        k.push_back(ch(rng));
+      }
+    }
+
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+      text.push_back(ch(rng));
+    }
+
+    std::shared_ptr<ProgramHandle> prog(compileKeys(keys));
+    SCOPE_ASSERT(prog->Prog->Literals);
+
+    Vm vm(prog->Prog);
+    LiteralVm lvm(prog->Prog);
+
+    std::vector<SearchHit> exp = searchBlocks(vm, text, text.size()),
+                           act = searchBlocks(lvm, text, block(rng));
+
+    // Vm may report a hit later than its end while a longer match with
+    // the same start is pending, so compare the hits but not their order
+    std::sort(exp.begin(), exp.end());
+    std::sort(act.begin(), act.end());
+    SCOPE_ASSERT(exp == act);
+  }
+}
+
+SCOPE_TEST(literalVmResetClearsMatchEnds) {
+  std::shared_ptr<ProgramHandle> prog(compileKeys({"ab", "b"}));
+  LiteralVm vm(prog->Prog);
+
+  // after a reset, hits at lower offsets than before must be found again
+  const byte text[] = "abab";
+  std::vector<SearchHit> hits;
+  vm.search(text, text + 4, 100, collect, &hits);
+  SCOPE_ASSERT_EQUAL(4u, hits.size());
+
+  vm.reset();
+  hits.clear();
+  vm.search(text, text + 4, 0, collect, &hits);
+  SCOPE_ASSERT_EQUAL(4u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 2, 0), hits[0]);
+}
@@ -656,3 +656,164 @@ SCOPE_TEST(testPruneBranches) {
   ASSERT_EQUAL_LABELS(exp, g);
   ASSERT_EQUAL_MATCHES(exp, g);
 }
+
+SCOPE_TEST(testMinimizeSharedSuffix) {
+  // ab|cb, with the b's distinct
+  NFA g(5);
+  edge(0, 1, g, g.TransFac->getByte('a'));
+  edge(0, 2, g, g.TransFac->getByte('c'));
+  edge(1, 3, g, g.TransFac->getByte('b'));
+  edge(2, 4, g, g.TransFac->getByte('b'));
+
+  g[3].IsMatch = g[4].IsMatch = true;
+  g[3].Label = g[4].Label = 0;
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, g);
+
+  NFA exp(4);
+  edge(0, 1, exp, exp.TransFac->getByte('a'));
+  edge(0, 2, exp, exp.TransFac->getByte('c'));
+  edge(1, 3, exp, exp.TransFac->getByte('b'));
+  edge(2, 3, exp, exp.TransFac->getByte('b'));
+
+  exp[3].IsMatch = true;
+  exp[3].Label = 0;
+
+  ASSERT_EQUAL_GRAPHS(exp, h);
+  ASSERT_EQUAL_LABELS(exp, h);
+  ASSERT_EQUAL_MATCHES(exp, h);
+}
+
+SCOPE_TEST(testMinimizeKeepsLabels) {
+  NFA g(5);
+  edge(0, 1, g, g.TransFac->getByte('a'));
+  edge(0, 2, g, g.TransFac->getByte('c'));
+  edge(1, 3, g, g.TransFac->getByte('b'));
+  edge(2, 4, g, g.TransFac->getByte('b'));
+
+  g[3].IsMatch = g[4].IsMatch = true;
+  g[3].Label = 0;
+  g[4].Label = 1;
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, g);
+
+  ASSERT_EQUAL_GRAPHS(g, h);
+  ASSERT_EQUAL_LABELS(g, h);
+  ASSERT_EQUAL_MATCHES(g, h);
+}
+
+SCOPE_TEST(testMinimizeLoops) {
+  // ax+y|bx+y
+  NFA g(7);
+  edge(0, 1, g, g.TransFac->getByte('a'));
+  edge(0, 2, g, g.TransFac->getByte('b'));
+  edge(1, 3, g, g.TransFac->getByte('x'));
+  edge(2, 4, g, g.TransFac->getByte('x'));
+  edge(3, 3, g, g.TransFac->getByte('x'));
+  edge(4, 4, g, g.TransFac->getByte('x'));
+  edge(3, 5, g, g.TransFac->getByte('y'));
+  edge(4, 6, g, g.TransFac->getByte('y'));
+
+  g[5].IsMatch = g[6].IsMatch = true;
+  g[5].Label = g[6].Label = 0;
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, g);
+
+  NFA exp(5);
+  edge(0, 1, exp, exp.TransFac->getByte('a'));
+  edge(0, 2, exp, exp.TransFac->getByte('b'));
+  edge(1, 3, exp, exp.TransFac->getByte('x'));
+  edge(2, 3, exp, exp.TransFac->getByte('x'));
+  edge(3, 3, exp, exp.TransFac->getByte('x'));
+  edge(3, 4, exp, exp.TransFac->getByte('y'));
+
+  exp[4].IsMatch = true;
+  exp[4].Label = 0;
+
+  ASSERT_EQUAL_GRAPHS(exp, h);
+  ASSERT_EQUAL_LABELS(exp, h);
+  ASSERT_EQUAL_MATCHES(exp, h);
+}
+
+SCOPE_TEST(testMinimizeKeepsEdgeOrder) {
+  // the same successors, but in another order, give other preferences
+  NFA g(7);
+  edge(0, 1, g, g.TransFac->getByte('a'));
+  edge(0, 2, g, g.TransFac->getByte('b'));
+  edge(1, 3, g, g.TransFac->getByte('x'));
+  edge(1, 4, g, g.TransFac->getByte('x'));
+  edge(2, 5, g, g.TransFac->getByte('x'));
+  edge(2, 6, g, g.TransFac->getByte('x'));
+  edge(3, 3, g, g.TransFac->getByte('x'));
+
+  g[4].IsMatch = g[5].IsMatch = true;
+  g[4].Label = g[5].Label = 0;
+  g[6].Trans = g[3].Trans;
+  g.addEdge(6, 6);
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, g);
+
+  // 3 and 6 merge, 4 and 5 merge, but 1 and 2 differ in order
+  SCOPE_ASSERT_EQUAL(5u, h.verticesSize());
+  SCOPE_ASSERT_EQUAL(h.outVertex(1, 0), h.outVertex(2, 1));
+  SCOPE_ASSERT_EQUAL(h.outVertex(1, 1), h.outVertex(2, 0));
+  SCOPE_ASSERT(h.outVertex(1, 0) != h.outVertex(1, 1));
+}
+
+SCOPE_TEST(testMinimizeIdempotent) {
+  // every vertex of a minimized graph is distinguishable, so minimizing
+  // again changes nothing
+  const std::vector<Pattern> pats{
+    {"(foo|bar)baz", false, false, false, "UTF-8"},
+    {"\\w+@\\w+", false, false, false, "UTF-8"},
+    {"a[bc]d|e[bc]d", false, false, false, "ASCII"}
+  };
+
+  NFAPtr g(createGraph(pats, true));
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, *g);
+  SCOPE_ASSERT(h.verticesSize() < g->verticesSize());
+
+  NFA k(1);
+  comp.minimizeDFA(k, h);
+  ASSERT_EQUAL_GRAPHS(h, k);
+}
+
+SCOPE_TEST(testMinimizeDropsDeadEdges) {
+  // ab(c|c), with both edges from b leading to equivalent vertices
+  NFA g(6);
+  edge(0, 1, g, g.TransFac->getByte('a'));
+  edge(1, 2, g, g.TransFac->getByte('b'));
+  edge(1, 3, g, g.TransFac->getByte('b'));
+  edge(2, 4, g, g.TransFac->getByte('c'));
+  edge(3, 5, g, g.TransFac->getByte('c'));
+
+  g[4].IsMatch = g[5].IsMatch = true;
+  g[4].Label = g[5].Label = 0;
+
+  NFA h(1);
+  NFAOptimizer comp;
+  comp.minimizeDFA(h, g);
+
+  NFA exp(4);
+  edge(0, 1, exp, exp.TransFac->getByte('a'));
+  edge(1, 2, exp, exp.TransFac->getByte('b'));
+  edge(2, 3, exp, exp.TransFac->getByte('c'));
+
+  exp[3].IsMatch = true;
+  exp[3].Label = 0;
+
+  ASSERT_EQUAL_GRAPHS(exp, h);
+  ASSERT_EQUAL_LABELS(exp, h);
+  ASSERT_EQUAL_MATCHES(exp, h);
+}
@@ -0,0 +1,150 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <scope/test.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lightgrep/api.h"
+
+namespace {
+  struct Compiled {
+    std::vector<char> Prog;
+    std::vector<std::string> Patterns;
+    std::vector<std::string> Errors;
+  };
+
+  std::string str(const char* s) {
+    return s ? s : "(null)";
+  }
+
+  Compiled compileList(const std::string& list, unsigned int numThreads) {
+    std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> prog(
+      lg_create_program(0), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    const char* defEncs[] = { "ASCII", "UTF-16LE" };
+    const LG_KeyOptions keyOpts{0, 0, 0};
+
+    LG_Error* err = nullptr;
+    lg_add_pattern_list_parallel(
+      fsm.get(), prog.get(), list.c_str(), "list", defEncs, 2, &keyOpts,
+      numThreads, &err
+    );
+
+    Compiled c;
+    for (const LG_Error* e = err; e; e = e->Next) {
+      c.Errors.push_back(
+        str(e->Message) + '|' + str(e->Pattern) + '|' +
+        str(e->EncodingChain) + '|' + str(e->Source) + '|' +
+        std::to_string(e->Index)
+      );
+    }
+    lg_free_error(err);
+
+    for (unsigned int i = 0; i < lg_pattern_count(prog.get()); ++i) {
+      const LG_PatternInfo* pi = lg_pattern_info(prog.get(), i);
+      c.Patterns.push_back(
+        str(pi->Pattern) + '|' + str(pi->EncodingChain) + '|' +
+        std::to_string(pi->UserIndex)
+      );
+    }
+
+    const LG_ProgramOptions progOpts{1};
+    if (lg_compile_program(fsm.get(), prog.get(), &progOpts)) {
+      c.Prog.resize(lg_program_size(prog.get()));
+      lg_write_program(prog.get(), c.Prog.data());
+    }
+    return c;
+  }
+
+  void checkParallel(const std::string& list) {
+    const Compiled exp = compileList(list, 1);
+    for (unsigned int threads = 2; threads <= 8; threads *= 2) {
+      const Compiled act = compileList(list, threads);
+      SCOPE_ASSERT(exp.Prog == act.Prog);
+      SCOPE_ASSERT(exp.Patterns == act.Patterns);
+      SCOPE_ASSERT(exp.Errors == act.Errors);
+    }
+  }
+
+  // a pattern list of the given length, with some bad lines among the
+  // good, and enough lines for several windows of jobs
+  std::string randomList(size_t len, bool literals) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> ch('a', 'f'), klen(2, 8), kind(0, 19);
+
+    std::string list;
+    for (size_t i = 0; i < len; ++i) {
+      std::string pat;
+      for (int j = klen(rng); j > 0; --j) {
+        pat.push_back(ch(rng));
+      }
+
+      if (!literals) {
+        switch (kind(rng)) {
+        case 0: pat += "(";                 break;  // parse error
+        case 1: pat = "a*";                 break;  // matches empty
+        case 2: pat += "\tASCII,NOPE";      break;  // unknown encoding
+        case 3: pat += "\t,";               break;  // no encoding list
+        case 4: pat += "\tUTF-8\t0\t1";     break;  // case-insensitive
+        case 5: pat.insert(1, "[0-9]+");    break;
+        case 6: pat.insert(2, "(x|yz)?");   break;
+        case 7: pat += "\\d{2,4}";          break;
+        case 8: pat.insert(1, ".*");        break;  // no required factor
+        }
+      }
+
+      list += pat;
+      list += '\n';
+    }
+    return list;
+  }
+}
+
+SCOPE_TEST(parallelCompileRegexes) {
+  checkParallel(randomList(3000, false));
+}
+
+SCOPE_TEST(parallelCompileLiterals) {
+  const Compiled c = compileList(randomList(2500, true), 4);
+  SCOPE_ASSERT(!c.Prog.empty());
+  SCOPE_ASSERT(c.Errors.empty());
+  checkParallel(randomList(2500, true));
+}
+
+SCOPE_TEST(parallelCompileFewPatterns) {
+  checkParallel("foo\nba+r\n(\n");
+}
+
+SCOPE_TEST(parallelCompileBadOptions) {
+  // reading stops at the bad line, after adding the lines before it
+  const std::string list = randomList(1500, false) + "foo\tASCII\tnope\nbar\n";
+  const Compiled c = compileList(list, 1);
+  SCOPE_ASSERT(!c.Errors.empty());
+  SCOPE_ASSERT_EQUAL(-1, std::stoi(c.Errors.back().substr(c.Errors.back().rfind('|') + 1)));
+  checkParallel(list);
+}
@@ -0,0 +1,190 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "handles.h"
+#include "lazydfavm.h"
+#include "literalvm.h"
+#include "parallelsearch.h"
+#include "program.h"
+#include "searchhit.h"
+#include "vm.h"
+
+namespace {
+  std::shared_ptr<ProgramHandle> compilePatterns(const std::vector<std::string>& pats, bool fixed = false) {
+    std::shared_ptr<ProgramHandle> prog(
+      lg_create_program(pats.size()), lg_destroy_program
+    );
+
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    std::unique_ptr<PatternHandle,void(*)(PatternHandle*)> pat(
+      lg_create_pattern(), lg_destroy_pattern
+    );
+
+    const LG_KeyOptions keyOpts{fixed, 0, 0};
+
+    for (size_t i = 0; i < pats.size(); ++i) {
+      LG_Error* err = nullptr;
+      lg_parse_pattern(pat.get(), pats[i].c_str(), &keyOpts, &err);
+      SCOPE_ASSERT(!err);
+      lg_add_pattern(fsm.get(), prog.get(), pat.get(), "ASCII", i, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    const LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  void collect(void* userData, const LG_SearchHit* const hit) {
+    static_cast<std::vector<SearchHit>*>(userData)->push_back(
+      *static_cast<const SearchHit*>(hit)
+    );
+  }
+
+  std::string randomText(size_t len, char lo, char hi) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> ch(lo, hi);
+    std::string text;
+    for (size_t i = 0; i < len; ++i) {
+      text.push_back(ch(rng));
+    }
+    return text;
+  }
+
+  // searches text in two blocks, first serially and then in parallel,
+  // and checks that the hits are identical, order included
+  void checkParallel(ProgramPtr prog, uint32_t engine, const std::string& text) {
+    const byte* const beg = reinterpret_cast<const byte*>(text.data());
+    const byte* const mid = beg + text.size()/2;
+    const byte* const end = beg + text.size();
+
+    std::shared_ptr<VmInterface> vm(VmInterface::create(prog, engine, 0));
+    std::vector<SearchHit> exp;
+    const uint64_t r1 = vm->search(beg, mid, 0, collect, &exp);
+    const uint64_t r2 = vm->search(mid, end, mid - beg, collect, &exp);
+    vm->closeOut(collect, &exp);
+
+    const auto create = [&](){ return VmInterface::create(prog, engine, 0); };
+
+    for (uint32_t threads = 1; threads <= 4; ++threads) {
+      std::shared_ptr<VmInterface> pvm(create());
+      std::vector<SearchHit> act;
+      SCOPE_ASSERT_EQUAL(r1, parallelSearch(pvm, create, beg, mid, 0, threads, collect, &act));
+      SCOPE_ASSERT_EQUAL(r2, parallelSearch(pvm, create, mid, end, mid - beg, threads, collect, &act));
+      pvm->closeOut(collect, &act);
+      SCOPE_ASSERT(exp == act);
+    }
+  }
+}
+
+SCOPE_TEST(parallelSearchMatchesSerial) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({
+    "ab+c", "d[a-f]{1,3}e", "(fo|ba)r", "q", "[a-c]+z"
+  }));
+
+  checkParallel(prog->Prog, LG_ENGINE_THREADS, randomText(9 << 20, 'a', 'z'));
+}
+
+SCOPE_TEST(parallelSearchLazyDfa) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"ab+c", "x[^y]*y", "zz"}));
+  checkParallel(prog->Prog, LG_ENGINE_LAZY_DFA, randomText(5 << 20, 'a', 'z'));
+}
+
+SCOPE_TEST(parallelSearchLiterals) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"aa", "aba", "ccc", "bcab"}, true));
+  SCOPE_ASSERT(prog->Prog->Literals);
+  checkParallel(prog->Prog, LG_ENGINE_THREADS, randomText(5 << 20, 'a', 'c'));
+}
+
+SCOPE_TEST(parallelSearchMatchAcrossParts) {
+  // the engines are never idle in the same place until the final 'z',
+  // so the first one has to run through all of the parts itself
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"a[^z]*z", "y+"}));
+
+  std::string text(7 << 20, 'y');
+  text[0] = 'a';
+  text.back() = 'z';
+  checkParallel(prog->Prog, LG_ENGINE_THREADS, text);
+}
+
+SCOPE_TEST(parallelSearchContext) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"ab+c", "q"}));
+
+  LG_ContextOptions opts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &opts), lg_destroy_context
+  );
+
+  const std::string text(randomText(4 << 20, 'a', 'z'));
+  const char* const beg = text.data();
+  const char* const end = beg + text.size();
+
+  std::vector<SearchHit> exp;
+  lg_search(ctx.get(), beg, end, 0, &exp, collect);
+  lg_closeout_search(ctx.get(), &exp, collect);
+  lg_reset_context(ctx.get());
+
+  std::vector<SearchHit> act;
+  lg_search_parallel(ctx.get(), beg, end, 0, 4, &act, collect);
+  lg_closeout_search(ctx.get(), &act, collect);
+
+  SCOPE_ASSERT(!exp.empty());
+  SCOPE_ASSERT(exp == act);
+}
+
+SCOPE_TEST(parallelSearchMasked) {
+  std::shared_ptr<ProgramHandle> prog(compilePatterns({"ab+c", "q", "x[yz]"}));
+
+  LG_ContextOptions opts{0, 0, LG_ENGINE_THREADS, 0, LG_HITS_ALL, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(prog.get(), &opts), lg_destroy_context
+  );
+
+  const uint64_t off[] = {1};
+  SCOPE_ASSERT(lg_enable_keywords(ctx.get(), off, 1, 0));
+
+  const std::string text(randomText(4 << 20, 'a', 'z'));
+  const char* const beg = text.data();
+  const char* const end = beg + text.size();
+
+  // the engines made for the other parts must have the mask, too
+  std::vector<SearchHit> act;
+  lg_search_parallel(ctx.get(), beg, end, 0, 4, &act, collect);
+  lg_closeout_search(ctx.get(), &act, collect);
+
+  SCOPE_ASSERT(!act.empty());
+  for (const SearchHit& h : act) {
+    SCOPE_ASSERT(h.KeywordIndex != 1);
+  }
+
+  std::vector<SearchHit> exp;
+  lg_reset_context(ctx.get());
+  lg_search(ctx.get(), beg, end, 0, &exp, collect);
+  lg_closeout_search(ctx.get(), &exp, collect);
+  SCOPE_ASSERT(exp == act);
+}
@@ -0,0 +1,155 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <scope/test.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lightgrep/api.h"
+
+#include "programcache.h"
+
+namespace {
+  typedef std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> ProgPtr;
+
+  const char* const DIR = ".";
+
+  const char* ENCS[] = { "ASCII", "UTF-16LE" };
+
+  const LG_KeyOptions KEY_OPTS{0, 0, 0};
+  const LG_ProgramOptions PROG_OPTS{1};
+
+  ProgPtr compile(const char** lists, unsigned int num) {
+    ProgPtr prog(lg_create_program(0), lg_destroy_program);
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    for (unsigned int i = 0; i < num; ++i) {
+      LG_Error* err = nullptr;
+      lg_add_pattern_list(fsm.get(), prog.get(), lists[i], "test", ENCS, 2, &KEY_OPTS, &err);
+      SCOPE_ASSERT(!err);
+    }
+
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &PROG_OPTS));
+    return prog;
+  }
+
+  std::vector<char> bytes(ProgramHandle* prog) {
+    std::vector<char> buf(lg_program_size(prog));
+    lg_write_program(prog, buf.data());
+    return buf;
+  }
+
+  ProgPtr readCached(const char** lists, unsigned int num, const LG_KeyOptions& keyOpts = KEY_OPTS, const LG_ProgramOptions& progOpts = PROG_OPTS) {
+    return ProgPtr(
+      lg_read_cached_program(DIR, lists, num, ENCS, 2, &keyOpts, &progOpts),
+      lg_destroy_program
+    );
+  }
+
+  std::string cachePath(const char** lists, unsigned int num) {
+    return ProgramCache(DIR).path(
+      programCacheInputs(lists, num, ENCS, 2, &KEY_OPTS, &PROG_OPTS)
+    );
+  }
+}
+
+SCOPE_TEST(programCacheRoundTrip) {
+  const char* lists[] = { "foo\nba+r\n", "baz\tUTF-8\n" };
+  ProgPtr prog(compile(lists, 2));
+
+  std::remove(cachePath(lists, 2).c_str());
+  SCOPE_ASSERT(!readCached(lists, 2));
+
+  SCOPE_ASSERT(lg_write_cached_program(prog.get(), DIR, lists, 2, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+
+  ProgPtr cached(readCached(lists, 2));
+  SCOPE_ASSERT(cached);
+  SCOPE_ASSERT(bytes(prog.get()) == bytes(cached.get()));
+
+  // the pattern map refers to the buffer the program was read from
+  SCOPE_ASSERT_EQUAL(lg_pattern_count(prog.get()), lg_pattern_count(cached.get()));
+  SCOPE_ASSERT_EQUAL(std::string("baz"), lg_pattern_info(cached.get(), 4)->Pattern);
+  SCOPE_ASSERT_EQUAL(std::string("UTF-8"), lg_pattern_info(cached.get(), 4)->EncodingChain);
+
+  std::remove(cachePath(lists, 2).c_str());
+}
+
+SCOPE_TEST(programCacheMisses) {
+  const char* lists[] = { "foo\nba+r\n", "baz\tUTF-8\n" };
+  ProgPtr prog(compile(lists, 2));
+  SCOPE_ASSERT(lg_write_cached_program(prog.get(), DIR, lists, 2, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+
+  // any change to the inputs misses
+  const char* otherText[] = { "foo\nba+r\n", "bat\tUTF-8\n" };
+  SCOPE_ASSERT(!readCached(otherText, 2));
+
+  // the line numbers differ if the lists are split differently
+  const char* joined[] = { "foo\nba+r\nbaz\tUTF-8\n" };
+  SCOPE_ASSERT(!readCached(joined, 1));
+
+  SCOPE_ASSERT(!readCached(lists, 1));
+  SCOPE_ASSERT(!readCached(lists, 2, LG_KeyOptions{0, 1, 0}));
+  SCOPE_ASSERT(!readCached(lists, 2, KEY_OPTS, LG_ProgramOptions{0}));
+  SCOPE_ASSERT(!ProgPtr(lg_read_cached_program(DIR, lists, 2, ENCS, 1, &KEY_OPTS, &PROG_OPTS), lg_destroy_program));
+
+  SCOPE_ASSERT(readCached(lists, 2));
+  std::remove(cachePath(lists, 2).c_str());
+}
+
+SCOPE_TEST(programCacheRejectsBadFiles) {
+  const char* lists[] = { "foo\nbar\n" };
+  const char* others[] = { "baz\n" };
+  ProgPtr prog(compile(lists, 1));
+  const std::string path = cachePath(lists, 1);
+
+  // a truncated file
+  SCOPE_ASSERT(lg_write_cached_program(prog.get(), DIR, lists, 1, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+  {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    SCOPE_ASSERT(f);
+    std::vector<char> buf(1 << 20);
+    buf.resize(std::fread(buf.data(), 1, buf.size(), f));
+    std::fclose(f);
+
+    f = std::fopen(path.c_str(), "wb");
+    std::fwrite(buf.data(), 1, buf.size() - 1, f);
+    std::fclose(f);
+  }
+  SCOPE_ASSERT(!readCached(lists, 1));
+
+  // a file for other inputs, as if their hashes collided
+  SCOPE_ASSERT(lg_write_cached_program(prog.get(), DIR, others, 1, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+  std::remove(path.c_str());
+  SCOPE_ASSERT(!std::rename(cachePath(others, 1).c_str(), path.c_str()));
+  SCOPE_ASSERT(!readCached(lists, 1));
+
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(programCacheUncompiled) {
+  const char* lists[] = { "foo\n" };
+  ProgPtr prog(lg_create_program(0), lg_destroy_program);
+  SCOPE_ASSERT(!lg_write_cached_program(prog.get(), DIR, lists, 1, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+  SCOPE_ASSERT(!lg_write_cached_program(prog.get(), "no/such/dir", lists, 1, ENCS, 2, &KEY_OPTS, &PROG_OPTS));
+}
@@ -0,0 +1,161 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <scope/test.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "lightgrep/api.h"
+
+#include "handles.h"
+#include "program.h"
+#include "programfile.h"
+
+namespace {
+  typedef std::unique_ptr<ProgramHandle,void(*)(ProgramHandle*)> ProgPtr;
+
+  ProgPtr compile(const char* patterns) {
+    ProgPtr prog(lg_create_program(0), lg_destroy_program);
+    std::unique_ptr<FSMHandle,void(*)(FSMHandle*)> fsm(
+      lg_create_fsm(0), lg_destroy_fsm
+    );
+
+    const char* encs[] = { "ASCII", "UTF-16LE" };
+    const LG_KeyOptions keyOpts{0, 0, 0};
+
+    LG_Error* err = nullptr;
+    lg_add_pattern_list(fsm.get(), prog.get(), patterns, "test", encs, 2, &keyOpts, &err);
+    SCOPE_ASSERT(!err);
+
+    const LG_ProgramOptions progOpts{1};
+    SCOPE_ASSERT(lg_compile_program(fsm.get(), prog.get(), &progOpts));
+    return prog;
+  }
+
+  std::vector<char> bytes(ProgramHandle* prog) {
+    std::vector<char> buf(lg_program_size(prog));
+    lg_write_program(prog, buf.data());
+    return buf;
+  }
+
+  ProgPtr read(const std::vector<char>& buf) {
+    return ProgPtr(lg_read_program(buf.data(), buf.size()), lg_destroy_program);
+  }
+
+  void assertSame(ProgramHandle* exp, ProgramHandle* act) {
+    SCOPE_ASSERT(act);
+    SCOPE_ASSERT(*exp->PMap == *act->PMap);
+    SCOPE_ASSERT(*exp->Prog == *act->Prog);
+  }
+
+  void countHit(void* userData, const LG_SearchHit* const) {
+    ++*static_cast<unsigned int*>(userData);
+  }
+
+  void writeFile(const char* path, const std::vector<char>& buf) {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    out.write(buf.data(), buf.size());
+  }
+}
+
+SCOPE_TEST(programFileRoundTrip) {
+  // literals, factors, and neither
+  for (const char* pats : { "foo\nbar\n", "ab+c\nxyz\\d\n", "[a-c]+\n" }) {
+    ProgPtr prog(compile(pats));
+    const std::vector<char> buf(bytes(prog.get()));
+    SCOPE_ASSERT_EQUAL(0u, buf.size() % 8);
+
+    ProgPtr copy(read(buf));
+    assertSame(prog.get(), copy.get());
+    SCOPE_ASSERT(buf == bytes(copy.get()));
+  }
+}
+
+SCOPE_TEST(programFileMisalignedBuffer) {
+  ProgPtr prog(compile("foo\nbar\n"));
+  const std::vector<char> buf(bytes(prog.get()));
+
+  std::vector<char> shifted(buf.size() + 1);
+  std::memcpy(shifted.data() + 1, buf.data(), buf.size());
+
+  ProgPtr copy(lg_read_program(shifted.data() + 1, buf.size()), lg_destroy_program);
+  assertSame(prog.get(), copy.get());
+}
+
+SCOPE_TEST(programFileRejectsDamage) {
+  ProgPtr prog(compile("foo\nba+r\n"));
+  const std::vector<char> buf(bytes(prog.get()));
+
+  std::vector<char> bad(buf);
+  bad[0] ^= 1;
+  SCOPE_ASSERT(!read(bad)); // magic
+
+  bad = buf;
+  bad[4] ^= 1;
+  SCOPE_ASSERT(!read(bad)); // format
+
+  bad.assign(buf.begin(), buf.end() - 8);
+  SCOPE_ASSERT(!read(bad));
+
+  for (size_t i : { size_t(56), buf.size() / 2, buf.size() - 1 }) {
+    bad = buf;
+    bad[i] ^= 0x10;
+    SCOPE_ASSERT(!read(bad));
+  }
+
+  SCOPE_ASSERT(read(buf));
+}
+
+SCOPE_TEST(programFileMapped) {
+  const char* const path = "programfile_test.lgprog";
+
+  ProgPtr prog(compile("foo\nbar\n"));
+  std::vector<char> buf(bytes(prog.get()));
+  writeFile(path, buf);
+
+  ProgPtr mapped(lg_map_program(path, 1), lg_destroy_program);
+  assertSame(prog.get(), mapped.get());
+
+  const LG_ContextOptions ctxOpts{0, 0, 0, 0, 0, 0};
+  std::unique_ptr<ContextHandle,void(*)(ContextHandle*)> ctx(
+    lg_create_context(mapped.get(), &ctxOpts), lg_destroy_context
+  );
+
+  // the program outlives its handle for as long as a context uses it
+  mapped.reset();
+
+  const char text[] = "xfooxbarx";
+  unsigned int hits = 0;
+  lg_search(ctx.get(), text, text + 9, 0, &hits, countHit);
+  lg_closeout_search(ctx.get(), &hits, countHit);
+  SCOPE_ASSERT_EQUAL(2u, hits);
+
+  // a bad checksum is caught only when verifying
+  buf[8+8] ^= 1;
+  writeFile(path, buf);
+  SCOPE_ASSERT(!ProgPtr(lg_map_program(path, 1), lg_destroy_program));
+  SCOPE_ASSERT(ProgPtr(lg_map_program(path, 0), lg_destroy_program));
+
+  std::remove(path);
+  SCOPE_ASSERT(!ProgPtr(lg_map_program(path, 0), lg_destroy_program));
+}
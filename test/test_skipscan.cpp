@@ -0,0 +1,121 @@
+/*
+  liblightgrep: not the worst forensics regexp engine
+  Copyright (C) 2013, Lightbox Technologies, Inc
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <scope/test.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "skipscan.h"
+#include "stest.h"
+
+namespace {
+  void checkAllImpls(const std::bitset<256*256>& filter, const std::vector<byte>& buf) {
+    // the last byte is only ever read as the second byte of a pair
+    const byte* const beg = buf.data();
+    const byte* const end = buf.data() + buf.size() - 1;
+
+    const SkipScanner scalar(filter, SkipScanner::SCALAR),
+                      sse(filter, SkipScanner::SSE42),
+                      avx(filter, SkipScanner::AVX2);
+
+    for (const byte* p = beg; p < end; ++p) {
+      const byte* const exp = scalar.next(p, end);
+      SCOPE_ASSERT(exp == end || filter[exp[0] | (exp[1] << 8)]);
+      SCOPE_ASSERT(exp == sse.next(p, end));
+      SCOPE_ASSERT(exp == avx.next(p, end));
+    }
+  }
+}
+
+SCOPE_TEST(skipScanEmptyFilter) {
+  std::bitset<256*256> filter;
+  const std::vector<byte> buf(100, 'a');
+  const SkipScanner skip(filter);
+  SCOPE_ASSERT(buf.data() + 99 == skip.next(buf.data(), buf.data() + 99));
+}
+
+SCOPE_TEST(skipScanFullFilter) {
+  std::bitset<256*256> filter;
+  filter.set();
+  const SkipScanner skip(filter);
+  SCOPE_ASSERT_EQUAL(SkipScanner::SCALAR, skip.impl());
+
+  const std::vector<byte> buf(100, 'a');
+  SCOPE_ASSERT(buf.data() + 7 == skip.next(buf.data() + 7, buf.data() + 99));
+}
+
+SCOPE_TEST(skipScanImplsAgree) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<uint32_t> b(0, 255);
+
+  std::vector<byte> buf(1000);
+  for (byte& c : buf) {
+    c = b(rng);
+  }
+
+  // a handful of pairs, including high-bit bytes and a pair whose
+  // bytes pass the projected sets separately but not together
+  std::bitset<256*256> filter;
+  filter.set('a' | ('b' << 8));
+  filter.set('c' | ('d' << 8));
+  filter.set(0xFF | (0x80 << 8));
+  filter.set(0x00 | (0x7F << 8));
+
+  buf[500] = 'a';
+  buf[501] = 'd';
+  buf[700] = 'c';
+  buf[701] = 'd';
+  buf[998] = 0xFF;
+  buf[999] = 0x80;
+
+  checkAllImpls(filter, buf);
+}
+
+SCOPE_TEST(skipScanImplsAgreeDense) {
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<uint32_t> b(0, 255);
+
+  std::vector<byte> buf(300);
+  for (byte& c : buf) {
+    c = b(rng);
+  }
+
+  std::bitset<256*256> filter;
+  for (uint32_t i = 0; i < 256*256; i += 97) {
+    filter.set(i);
+  }
+
+  checkAllImpls(filter, buf);
+}
+
+SCOPE_FIXTURE_CTOR(skipScanSearchFarHits, STest, STest({"needle", "x[0-9]y"})) {
+  std::string text(4096, ' ');
+  text.replace(0, 6, "needle");
+  text.replace(1000, 3, "x5y");
+  text.replace(2047, 6, "needle");
+  text.replace(4090, 6, "needle");
+
+  fixture.search(text.data(), text.data() + text.size(), 0);
+  SCOPE_ASSERT_EQUAL(4u, fixture.Hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 6, 0), fixture.Hits[0]);
+  SCOPE_ASSERT_EQUAL(SearchHit(1000, 1003, 1), fixture.Hits[1]);
+  SCOPE_ASSERT_EQUAL(SearchHit(2047, 2053, 0), fixture.Hits[2]);
+  SCOPE_ASSERT_EQUAL(SearchHit(4090, 4096, 0), fixture.Hits[3]);
+}
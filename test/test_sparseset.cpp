@@ -47,3 +47,17 @@ SCOPE_TEST(sparseClear) {
     SCOPE_ASSERT(!s.find(i));
   }
 }
+
+SCOPE_TEST(sparseIterate) {
+  SparseSet s(5);
+  SCOPE_ASSERT(s.begin() == s.end());
+  s.insert(4);
+  s.insert(0);
+  s.insert(2);
+  SCOPE_ASSERT_EQUAL(3, s.end() - s.begin());
+  SCOPE_ASSERT_EQUAL(4u, s.begin()[0]);
+  SCOPE_ASSERT_EQUAL(0u, s.begin()[1]);
+  SCOPE_ASSERT_EQUAL(2u, s.begin()[2]);
+  s.clear();
+  SCOPE_ASSERT(s.begin() == s.end());
+}
@@ -22,15 +22,18 @@
 
 SCOPE_TEST(defaultThreadConstructor) {
   Thread t;
-  Instruction *nullPtr = 0;
-  SCOPE_ASSERT_EQUAL(nullPtr, t.PC);
+  SCOPE_ASSERT_EQUAL(Thread::DEAD, t.PC);
   SCOPE_ASSERT_EQUAL(Thread::NOLABEL, t.Label);
   SCOPE_ASSERT_EQUAL(0u, t.Start);
   SCOPE_ASSERT_EQUAL(Thread::NONE, t.End);
 }
 
 SCOPE_TEST(threadSize) {
+  #ifdef LBT_TRACE_ENABLED
   SCOPE_ASSERT(sizeof(Thread) <= 32);
+  #else
+  SCOPE_ASSERT(sizeof(Thread) <= 24);
+  #endif
 }
 
 /*
@@ -48,19 +51,18 @@ SCOPE_TEST(threadInit) {
 
 SCOPE_TEST(threadJump) {
   Thread t;
-  Instruction* basePtr = reinterpret_cast<Instruction*>(8);
-  t.jump(basePtr, 5);
-  SCOPE_ASSERT_EQUAL(reinterpret_cast<Instruction*>(28), t.PC);
+  t.jump(5);
+  SCOPE_ASSERT_EQUAL(5u, t.PC);
   SCOPE_ASSERT_EQUAL(Thread::NOLABEL, t.Label);
   SCOPE_ASSERT_EQUAL(0u, t.Start);
   SCOPE_ASSERT_EQUAL(Thread::NONE, t.End);
 }
 
 SCOPE_TEST(threadFork) {
-  Thread parent(0, 5, 123, std::numeric_limits<uint64_t>::max()),
+  Thread parent(0, 5, 123, Thread::NONE),
          child;
-  child.fork(parent, 0, 4);
-  SCOPE_ASSERT_EQUAL(reinterpret_cast<Instruction*>(16), child.PC);
+  child.fork(parent, 4);
+  SCOPE_ASSERT_EQUAL(4u, child.PC);
   SCOPE_ASSERT_EQUAL(5u, child.Label);
   SCOPE_ASSERT_EQUAL(123u, child.Start);
   SCOPE_ASSERT_EQUAL(Thread::NONE, child.End);
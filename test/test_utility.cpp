@@ -193,6 +193,62 @@ SCOPE_TEST(dotaa2ByteSet) {
   SCOPE_ASSERT_EQUAL(exp, act);
 }
 
+SCOPE_TEST(requiredFactorTrailingLiteral) {
+  NFAPtr fsm = createGraph({"[a-z0-9._%+-]+@example\\.com"}, true);
+
+  ByteSet lead;
+  lead.set('a', 'z' + 1, true);
+  lead.set('0', '9' + 1, true);
+  lead.set('.');
+  lead.set('_');
+  lead.set('%');
+  lead.set('+');
+  lead.set('-');
+
+  RequiredFactor f;
+  SCOPE_ASSERT(requiredFactor(*fsm, f));
+  SCOPE_ASSERT_EQUAL("@example.com", f.Bytes);
+  SCOPE_ASSERT_EQUAL(RequiredFactor::UNBOUNDED, f.MaxLead);
+  SCOPE_ASSERT_EQUAL(lead, f.Lead);
+}
+
+SCOPE_TEST(requiredFactorAfterAlternation) {
+  NFAPtr fsm = createGraph({"(abc|xy)def"}, true);
+
+  ByteSet lead;
+  lead.set('a');
+  lead.set('b');
+  lead.set('c');
+  lead.set('x');
+  lead.set('y');
+
+  RequiredFactor f;
+  SCOPE_ASSERT(requiredFactor(*fsm, f));
+  SCOPE_ASSERT_EQUAL("def", f.Bytes);
+  SCOPE_ASSERT_EQUAL(3u, f.MaxLead);
+  SCOPE_ASSERT_EQUAL(lead, f.Lead);
+}
+
+SCOPE_TEST(requiredFactorLongest) {
+  NFAPtr fsm = createGraph({"x[0-9]{1,3}yz"}, true);
+
+  ByteSet lead;
+  lead.set('x');
+  lead.set('0', '9' + 1, true);
+
+  RequiredFactor f;
+  SCOPE_ASSERT(requiredFactor(*fsm, f));
+  SCOPE_ASSERT_EQUAL("yz", f.Bytes);
+  SCOPE_ASSERT_EQUAL(4u, f.MaxLead);
+  SCOPE_ASSERT_EQUAL(lead, f.Lead);
+}
+
+SCOPE_TEST(requiredFactorNone) {
+  NFAPtr fsm = createGraph({"a+|b"}, true);
+  RequiredFactor f;
+  SCOPE_ASSERT(!requiredFactor(*fsm, f));
+}
+
 SCOPE_TEST(simpleCollapse) {
   NFAPtr fsm = createGraph({"ab", "ac"}, true);
   SCOPE_ASSERT_EQUAL(4u, fsm->verticesSize());
@@ -317,6 +373,36 @@ SCOPE_TEST(testCodeGenVisitorShouldBeJumpTableRange) {
   SCOPE_ASSERT_EQUAL(0u, vis.calcJumpTableSize(3, g, g.outDegree(3)));
 }
 
+SCOPE_TEST(testCodeGenVisitorShouldBeJumpTableSparse) {
+  NFA g(4);
+  edge(0, 1, g, g.TransFac->getByte(0x00));
+  edge(0, 2, g, g.TransFac->getByte(0x40));
+  edge(0, 3, g, g.TransFac->getByte(0x80));
+  edge(0, 4, g, g.TransFac->getByte(0xFF));
+
+  CodeGenHelper cg(g.verticesSize());
+  CodeGenVisitor vis(cg);
+
+  // one word of keys, four targets
+  SCOPE_ASSERT_EQUAL(6u, vis.calcJumpTableSize(0, g, g.outDegree(0)));
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_SPARSE_OP, cg.Snippets[0].Op);
+}
+
+SCOPE_TEST(testCodeGenVisitorShouldBeJumpTableBitmap) {
+  NFA g(9);
+  const std::string keys("adgjmpsvy");
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    edge(0, i + 1, g, g.TransFac->getByte(keys[i]));
+  }
+
+  CodeGenHelper cg(g.verticesSize());
+  CodeGenVisitor vis(cg);
+
+  // one word of bits, one of ranks, nine targets
+  SCOPE_ASSERT_EQUAL(12u, vis.calcJumpTableSize(0, g, g.outDegree(0)));
+  SCOPE_ASSERT_EQUAL(JUMP_TABLE_BITMAP_OP, cg.Snippets[0].Op);
+}
+
 SCOPE_TEST(testInitVM) {
   NFAPtr fsm = createGraph({"one", "two"}, true);
   ProgramPtr prog = Compiler::createProgram(*fsm);
@@ -365,6 +451,36 @@ SCOPE_TEST(testPivotTransitions) {
   }
 }
 
+SCOPE_TEST(testByteClasses) {
+  NFA fsm(3);
+  edge(0, 1, fsm, fsm.TransFac->getRange('a', 'c'));
+  edge(1, 2, fsm, fsm.TransFac->getByte('b'));
+
+  // a and c are never told apart, nor are the bytes not used
+  const ByteClasses classes(byteClasses(fsm));
+  SCOPE_ASSERT_EQUAL(3u, classes.Num);
+  for (uint32_t i = 0; i < 256; ++i) {
+    SCOPE_ASSERT_EQUAL(i == 'b' ? 2 : i == 'a' || i == 'c' ? 1 : 0, classes[i]);
+  }
+}
+
+SCOPE_TEST(testPivotClasses) {
+  NFA fsm(4);
+  edge(0, 1, fsm, fsm.TransFac->getRange('a', 'c'));
+  edge(0, 2, fsm, fsm.TransFac->getByte('b'));
+  edge(0, 3, fsm, fsm.TransFac->getByte('z'));
+
+  const ByteClasses classes(byteClasses(fsm));
+  SCOPE_ASSERT_EQUAL(4u, classes.Num);
+
+  std::vector<std::vector<NFA::VertexDescriptor>> tbl = pivotClasses(0, fsm, classes);
+  SCOPE_ASSERT_EQUAL(4u, tbl.size());
+  SCOPE_ASSERT(tbl[classes[0]].empty());
+  SCOPE_ASSERT(std::vector<NFA::VertexDescriptor>({1}) == tbl[classes['a']]);
+  SCOPE_ASSERT(std::vector<NFA::VertexDescriptor>({1, 2}) == tbl[classes['b']]);
+  SCOPE_ASSERT(std::vector<NFA::VertexDescriptor>({3}) == tbl[classes['z']]);
+}
+
 SCOPE_TEST(testMaxOutbound) {
   NFA fsm(5);
   edge(0, 1, fsm, fsm.TransFac->getByte('a'));
@@ -23,31 +23,32 @@
 #include "mockcallback.h"
 #include "program.h"
 
+#include <cstring>
 #include <iostream>
 
 SCOPE_TEST(executeByte) {
   byte b = 'a';
   ProgramPtr p(new Program(1, Instruction::makeByte('a')));
   Vm         s(p);
-  Thread cur(&(*p)[0]);
+  Thread cur(0);
   SCOPE_ASSERT(s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
 
   s.reset();
   b = 'c';
   SCOPE_ASSERT(!s.execute(&cur, &b));
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front());
+  SCOPE_ASSERT_EQUAL(Thread(0), s.active().front());
 }
 
 SCOPE_TEST(executeNotByte) {
   byte b = 'a';
   ProgramPtr p(new Program(1, Instruction::makeByte('a', true)));
   Vm         s(p);
-  Thread cur(&(*p)[0]);
+  Thread cur(0);
   SCOPE_ASSERT(!s.execute(&cur, &b));
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front());
+  SCOPE_ASSERT_EQUAL(Thread(0), s.active().front());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
 
   s.reset();
@@ -55,63 +56,63 @@ SCOPE_TEST(executeNotByte) {
   SCOPE_ASSERT(s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
 }
 
 SCOPE_TEST(executeEither) {
   byte b = 'z';
   ProgramPtr p(new Program(1, Instruction::makeEither('z', '3')));
   Vm         s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   SCOPE_ASSERT(s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
 
   s.reset();
   b = '3';
   SCOPE_ASSERT(s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
 
   s.reset();
   b = '4';
   SCOPE_ASSERT(!s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(Thread(0), s.active().front().PC);
 }
 
 SCOPE_TEST(executeNeither) {
   byte b = 'z';
   ProgramPtr p(new Program(1, Instruction::makeEither('z', '3', true)));
   Vm         s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   SCOPE_ASSERT(!s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(Thread(0), s.active().front().PC);
 
   s.reset();
   b = '3';
   SCOPE_ASSERT(!s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(Thread(0), s.active().front().PC);
 
   s.reset();
   b = '4';
   SCOPE_ASSERT(s.execute(&cur, &b));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
 }
 
 SCOPE_TEST(executeRange) {
   ProgramPtr p(new Program(1, Instruction::makeRange('c', 't')));
   Vm         s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   for (uint32_t j = 0; j < 256; ++j) {
     s.reset();
     byte b = j;
@@ -120,13 +121,13 @@ SCOPE_TEST(executeRange) {
       SCOPE_ASSERT(s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+      SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
     }
     else {
       SCOPE_ASSERT(!s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front().PC);
+      SCOPE_ASSERT_EQUAL(Thread(0), s.active().front().PC);
     }
   }
 }
@@ -134,7 +135,7 @@ SCOPE_TEST(executeRange) {
 SCOPE_TEST(executeNotInRange) {
   ProgramPtr p(new Program(1, Instruction::makeRange('c', 't', true)));
   Vm         s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   for (uint32_t j = 0; j < 256; ++j) {
     s.reset();
     byte b = j;
@@ -143,13 +144,13 @@ SCOPE_TEST(executeNotInRange) {
       SCOPE_ASSERT(!s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0]), s.active().front().PC);
+      SCOPE_ASSERT_EQUAL(Thread(0), s.active().front().PC);
     }
     else {
       SCOPE_ASSERT(s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+      SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
     }
   }
 }
@@ -157,14 +158,14 @@ SCOPE_TEST(executeNotInRange) {
 SCOPE_TEST(executeAny) {
   ProgramPtr p(new Program(1, Instruction::makeAny()));
   Vm         s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   for (uint32_t i = 0; i < 256; ++i) {
     s.reset();
     byte b = i;
     SCOPE_ASSERT(s.execute(&cur, &b));
     SCOPE_ASSERT_EQUAL(1u, s.numActive());
     SCOPE_ASSERT_EQUAL(0u, s.numNext());
-    SCOPE_ASSERT_EQUAL(&(*p)[1], s.active().front().PC);
+    SCOPE_ASSERT_EQUAL(1u, s.active().front().PC);
   }
 }
 
@@ -183,11 +184,11 @@ SCOPE_TEST(executeJump) {
   prog[9] = Instruction::makeFinish();
 
   Vm s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   SCOPE_ASSERT(s.executeEpsilon(&cur, 0));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[7], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(7u, s.active().front().PC);
 }
 
 SCOPE_TEST(executeJumpTableRange) {
@@ -199,7 +200,7 @@ SCOPE_TEST(executeJumpTableRange) {
   *(uint32_t*)&((*p)[2]) = 3;
 
   Vm s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
 
   for (uint32_t i = 0; i < 256; ++i) {
     b = i;
@@ -207,25 +208,71 @@ SCOPE_TEST(executeJumpTableRange) {
       SCOPE_ASSERT(s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0] + 3, 0, 0, 0), s.active().front());
+      SCOPE_ASSERT_EQUAL(Thread(3, 0, 0, 0), s.active().front());
     }
     else if ('b' == i) {
       SCOPE_ASSERT(s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0] + 3, 0, 0, 0), s.active().front());
+      SCOPE_ASSERT_EQUAL(Thread(3, 0, 0, 0), s.active().front());
     }
     else {
       SCOPE_ASSERT(!s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0], 0, 0, 0), s.active().front());
+      SCOPE_ASSERT_EQUAL(Thread(0, 0, 0, 0), s.active().front());
     }
 
     s.reset();
   }
 }
 
+SCOPE_TEST(executeJumpTableSparse) {
+  byte b;
+  ProgramPtr p(new Program(5, Instruction::makeHalt()));
+  (*p)[0] = Instruction::makeJumpTableSparse('a', 'z', 3);
+  const byte keys[4] = {'a', 'm', 'z', 0};
+  std::memcpy(&(*p)[1], keys, sizeof(keys));
+  *(uint32_t*)&((*p)[2]) = 5;
+  *(uint32_t*)&((*p)[3]) = 6;
+  *(uint32_t*)&((*p)[4]) = 7;
+
+  Vm s(p);
+  Thread cur(0, 0, 0, 0);
+
+  for (uint32_t i = 0; i < 256; ++i) {
+    b = i;
+    const uint32_t pc = 'a' == i ? 5 : 'm' == i ? 6 : 'z' == i ? 7 : 0;
+    SCOPE_ASSERT_EQUAL(pc != 0, s.execute(&cur, &b));
+    SCOPE_ASSERT_EQUAL(1u, s.numActive());
+    SCOPE_ASSERT_EQUAL(Thread(pc, 0, 0, 0), s.active().front());
+    s.reset();
+  }
+}
+
+SCOPE_TEST(executeJumpTableBitmap) {
+  byte b;
+  ProgramPtr p(new Program(6, Instruction::makeHalt()));
+  (*p)[0] = Instruction::makeJumpTableBitmap('a', 'z');
+  *(uint32_t*)&((*p)[1]) = (1u << 1) | (1u << 12) | (1u << 25); // b, m, z
+  *(uint32_t*)&((*p)[2]) = 0;
+  *(uint32_t*)&((*p)[3]) = 6;
+  *(uint32_t*)&((*p)[4]) = 7;
+  *(uint32_t*)&((*p)[5]) = 8;
+
+  Vm s(p);
+  Thread cur(0, 0, 0, 0);
+
+  for (uint32_t i = 0; i < 256; ++i) {
+    b = i;
+    const uint32_t pc = 'b' == i ? 6 : 'm' == i ? 7 : 'z' == i ? 8 : 0;
+    SCOPE_ASSERT_EQUAL(pc != 0, s.execute(&cur, &b));
+    SCOPE_ASSERT_EQUAL(1u, s.numActive());
+    SCOPE_ASSERT_EQUAL(Thread(pc, 0, 0, 0), s.active().front());
+    s.reset();
+  }
+}
+
 SCOPE_TEST(executeBitVector) {
   SCOPE_ASSERT_EQUAL(32u, sizeof(ByteSet));
 
@@ -239,7 +286,7 @@ SCOPE_TEST(executeBitVector) {
   setPtr->set('b');
 
   Vm s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   byte b;
   for (uint32_t i = 0; i < 256; ++i) {
     b = i;
@@ -247,13 +294,13 @@ SCOPE_TEST(executeBitVector) {
       SCOPE_ASSERT(s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[9], 0, 0, 0), s.active().front());
+      SCOPE_ASSERT_EQUAL(Thread(9, 0, 0, 0), s.active().front());
     }
     else {
       SCOPE_ASSERT(!s.execute(&cur, &b));
       SCOPE_ASSERT_EQUAL(1u, s.numActive());
       SCOPE_ASSERT_EQUAL(0u, s.numNext());
-      SCOPE_ASSERT_EQUAL(Thread(&(*p)[0], 0, 0, 0), s.active().front());
+      SCOPE_ASSERT_EQUAL(Thread(0, 0, 0, 0), s.active().front());
     }
 
     s.reset();
@@ -271,11 +318,11 @@ SCOPE_TEST(executeLabel) {
   prog.MaxCheck = 0;
 
   Vm s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   SCOPE_ASSERT(s.executeEpsilon(&cur, 57));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[1], 34, 0, 0), s.active().front());
+  SCOPE_ASSERT_EQUAL(Thread(1, 34, 0, 0), s.active().front());
 }
 
 SCOPE_TEST(executeMatch) {
@@ -285,11 +332,11 @@ SCOPE_TEST(executeMatch) {
   p->MaxCheck = 0;
 
   Vm s(p);
-  Thread cur(&(*p)[1], 0, 0, Thread::NONE);
+  Thread cur(1, 0, 0, Thread::NONE);
   SCOPE_ASSERT(s.executeEpsilon(&cur, 57));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[2], 0, 0, 57), s.active().front());
+  SCOPE_ASSERT_EQUAL(Thread(2, 0, 0, 57), s.active().front());
 }
 
 SCOPE_TEST(executeFork) {
@@ -299,12 +346,12 @@ SCOPE_TEST(executeFork) {
   (*p)[3] = Instruction::makeByte('a');
 
   Vm s(p);
-  Thread cur(&(*p)[0], 0, 0, 0);
+  Thread cur(0, 0, 0, 0);
   SCOPE_ASSERT(s.executeEpsilon(&cur, 47));
   SCOPE_ASSERT_EQUAL(1u, s.numActive()); // cha-ching!
   SCOPE_ASSERT_EQUAL(1u, s.numNext());
-  SCOPE_ASSERT_EQUAL(&(*p)[2], s.next()[0].PC);
-  SCOPE_ASSERT_EQUAL(&(*p)[3], s.active().front().PC);
+  SCOPE_ASSERT_EQUAL(2u, s.next()[0].PC);
+  SCOPE_ASSERT_EQUAL(3u, s.active().front().PC);
 }
 
 // re-enable this once check halt is restored to former glory
@@ -333,11 +380,11 @@ SCOPE_TEST(executeHalt) {
   ProgramPtr p(new Program(1, Instruction::makeHalt()));
   Vm s(p);
 
-  Thread cur(&(*p)[0], 0, 0, Thread::NONE);
+  Thread cur(0, 0, 0, Thread::NONE);
   SCOPE_ASSERT(!s.executeEpsilon(&cur, 317));
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(0u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(0, 0, 0, Thread::NONE), s.active().front());
+  SCOPE_ASSERT_EQUAL(Thread(Thread::DEAD, 0, 0, Thread::NONE), s.active().front());
 }
 
 SCOPE_TEST(runFrame) {
@@ -366,8 +413,8 @@ SCOPE_TEST(runFrame) {
   s.executeFrame(&b, 0, 0, 0);
   SCOPE_ASSERT_EQUAL(1u, s.numActive());
   SCOPE_ASSERT_EQUAL(2u, s.numNext());
-  SCOPE_ASSERT_EQUAL(Thread(&prog[7], 1, 0, 0), s.next()[0]);
-  SCOPE_ASSERT_EQUAL(Thread(&prog[8], Thread::NOLABEL, 0, Thread::NONE), s.next()[1]);
+  SCOPE_ASSERT_EQUAL(Thread(7, 1, 0, 0), s.next()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(8, Thread::NOLABEL, 0, Thread::NONE), s.next()[1]);
 }
 
 SCOPE_TEST(testInit) {
@@ -394,10 +441,10 @@ SCOPE_TEST(testInit) {
 
   Vm s(p);
   SCOPE_ASSERT_EQUAL(4u, s.first().size());
-  SCOPE_ASSERT_EQUAL(&prog[11], s.first()[0].PC);
-  SCOPE_ASSERT_EQUAL(&prog[6], s.first()[1].PC);
-  SCOPE_ASSERT_EQUAL(&prog[13], s.first()[2].PC);
-  SCOPE_ASSERT_EQUAL(&prog[12], s.first()[3].PC);
+  SCOPE_ASSERT_EQUAL(11u, s.first()[0].PC);
+  SCOPE_ASSERT_EQUAL(6u, s.first()[1].PC);
+  SCOPE_ASSERT_EQUAL(13u, s.first()[2].PC);
+  SCOPE_ASSERT_EQUAL(12u, s.first()[3].PC);
 }
 
 SCOPE_TEST(simpleLitMatch) {
@@ -469,7 +516,7 @@ SCOPE_TEST(newThreadInit) {
 
   v.executeFrame(&text[0], 13, 0, 0);
   SCOPE_ASSERT_EQUAL(1u, v.active().size());
-  SCOPE_ASSERT_EQUAL(Thread(0, 1, 13, 13), v.active()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(Thread::DEAD, 1, 13, 13), v.active()[0]);
   SCOPE_ASSERT_EQUAL(0u, v.next().size());
 
   v.cleanup();
@@ -478,7 +525,7 @@ SCOPE_TEST(newThreadInit) {
 
   v.executeFrame(&text[1], 14, 0, 0);
   SCOPE_ASSERT_EQUAL(1u, v.active().size());
-  SCOPE_ASSERT_EQUAL(Thread(0, 1, 14, 14), v.active()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(Thread::DEAD, 1, 14, 14), v.active()[0]);
   SCOPE_ASSERT_EQUAL(0u, v.next().size());
 
   v.cleanup();
@@ -487,13 +534,13 @@ SCOPE_TEST(newThreadInit) {
 
   v.executeFrame(&text[2], 15, 0, 0);
   SCOPE_ASSERT_EQUAL(1u, v.active().size());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[9], Thread::NOLABEL, 15, Thread::NONE), v.active()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(9, Thread::NOLABEL, 15, Thread::NONE), v.active()[0]);
   SCOPE_ASSERT_EQUAL(1u, v.next().size());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[9], Thread::NOLABEL, 15, Thread::NONE), v.next()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(9, Thread::NOLABEL, 15, Thread::NONE), v.next()[0]);
 
   v.cleanup();
   SCOPE_ASSERT_EQUAL(1u, v.active().size());
-  SCOPE_ASSERT_EQUAL(Thread(&(*p)[9], Thread::NOLABEL, 15, Thread::NONE), v.active()[0]);
+  SCOPE_ASSERT_EQUAL(Thread(9, Thread::NOLABEL, 15, Thread::NONE), v.active()[0]);
   SCOPE_ASSERT_EQUAL(0u, v.next().size());
 }
 
@@ -574,3 +621,38 @@ SCOPE_TEST(stitchedText) {
   SCOPE_ASSERT_EQUAL(1u, hits.size());
   SCOPE_ASSERT_EQUAL(SearchHit(2, 4, 0), hits[0]);
 }
+
+SCOPE_TEST(resetClearsMatchEnds) {
+  ProgramPtr p(new Program(8, Instruction::makeRaw32(0)));
+  Program& prog(*p);
+  prog[0] = Instruction::makeByte('a');
+  prog[1] = Instruction::makeByte('b');
+  prog[2] = Instruction::makeLabel(0);
+  prog[3] = Instruction::makeMatch();
+  prog[4] = Instruction::makeFork(&prog[4], 7);
+  prog[6] = Instruction::makeHalt();
+  prog[7] = Instruction::makeFinish();
+
+  prog.MaxLabel = 0;
+  prog.MaxCheck = 0;
+
+  const byte text[] = {'a', 'b'};
+
+  p->FilterOff = 0;
+  for (uint32_t i = 0; i < 256; ++i) {
+    p->Filter.set((i << 8) | 'a');
+  }
+
+  Vm v(p);
+  std::vector<SearchHit> hits;
+  v.search(text, &text[2], 100, &mockCallback, &hits);
+  v.closeOut(&mockCallback, &hits);
+  SCOPE_ASSERT_EQUAL(1u, hits.size());
+
+  // the hit ending at 102 must not block one starting at 0 after a reset
+  v.reset();
+  v.search(text, &text[2], 0, &mockCallback, &hits);
+  v.closeOut(&mockCallback, &hits);
+  SCOPE_ASSERT_EQUAL(2u, hits.size());
+  SCOPE_ASSERT_EQUAL(SearchHit(0, 2, 0), hits[1]);
+}